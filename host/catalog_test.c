@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "catalog.h"
+#include "sim.h"
+
+// The image catalogue at card scale: COUNT files added one by one, looked up
+// by index and by name, saved as an index and loaded back as the previous
+// catalogue, and the index rejected once any byte of its entries or names is
+// changed, it is cut short or it was saved with other settings.
+
+#define COUNT  12000
+#define CONFIG 0x1234
+
+static int failures = 0;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+// Names of varying length, up to a long one now and then
+static void name_for(int i, char* out, size_t size) {
+    if (i % 1000 == 999) {
+        snprintf(out, size, "%05d a long file name from a camera that keeps going and going.png", i);
+    } else {
+        snprintf(out, size, "IMG_%0*d.%s", 1 + i % 7, i, i % 3 == 0 ? "jpeg" : "png");
+    }
+}
+
+static void fill_entry(catalog_entry_t* entry, int i) {
+    entry->size        = 1000u * i + 17;
+    entry->width       = 100 + i % 2000;
+    entry->height      = 50 + i % 1000;
+    entry->color_type  = i % 7;
+    entry->bit_depth   = 1 << (i % 5);
+    entry->interlaced  = i % 11 == 0;
+    entry->bad         = i % 13 == 0;
+    entry->cache_stale = i % 17 == 0;
+    entry->codec       = i % 4;
+    entry->animated    = i % 19 == 0;
+}
+
+static bool write_file(const char* path, const void* data, size_t size) {
+    FILE* fd = fopen(path, "wb");
+    if (fd == NULL) return false;
+    bool ok = fwrite(data, 1, size, fd) == size;
+    return fclose(fd) == 0 && ok;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s DIR\nThe index is written to DIR.\n", argv[0]);
+        return 1;
+    }
+    sim_set_log_level(ESP_LOG_ERROR);
+    mkdir(argv[1], 0755);
+    char index_path[512];
+    snprintf(index_path, sizeof(index_path), "%s/imagewag.idx", argv[1]);
+
+    catalog_t catalog = {0};
+    CHECK(catalog_reset(&catalog, "./images"));
+    char name[128];
+    for (int i = 0; i < COUNT; i++) {
+        name_for(i, name, sizeof(name));
+        catalog_entry_t* entry = catalog_add(&catalog, name);
+        CHECK(entry != NULL);
+        if (entry == NULL) return 1;
+        CHECK(entry->size == 0 && !entry->bad);
+        fill_entry(entry, i);
+    }
+    CHECK(catalog_count(&catalog) == COUNT);
+    printf("%d entries in %zu bytes\n", COUNT, catalog_memory(&catalog));
+
+    // Every name by index, and by name for a spread of them
+    for (int i = 0; i < COUNT; i++) {
+        name_for(i, name, sizeof(name));
+        CHECK(strcmp(catalog_name(&catalog, i), name) == 0);
+        catalog_entry_t expected = {.name = catalog_entry(&catalog, i)->name};
+        fill_entry(&expected, i);
+        CHECK(memcmp(catalog_entry(&catalog, i), &expected, sizeof(expected)) == 0);
+        if (i % 97 == 0 || i == COUNT - 1) CHECK(catalog_find(&catalog, name) == i);
+    }
+    CHECK(catalog_find(&catalog, "IMG_missing.png") == -1);
+    char path[256];
+    name_for(COUNT - 1, name, sizeof(name));
+    CHECK(catalog_path(&catalog, COUNT - 1, path, sizeof(path)));
+    CHECK(strncmp(path, "./images/", 9) == 0 && strcmp(path + 9, name) == 0);
+    CHECK(!catalog_path(&catalog, COUNT - 1, path, 10));
+
+    // Saved and loaded back, looked up in order and out of it
+    CHECK(catalog_save(&catalog, index_path, CONFIG));
+    CHECK(catalog_load_previous(index_path, CONFIG));
+    CHECK(catalog_matches_previous(&catalog));
+    for (int i = 0; i < COUNT; i++) {
+        int j = i % 2 == 0 ? i : COUNT - i;
+        name_for(j, name, sizeof(name));
+        const catalog_entry_t* previous = catalog_find_previous(name);
+        CHECK(previous != NULL && memcmp(previous, catalog_entry(&catalog, j), sizeof(*previous)) == 0);
+    }
+    CHECK(catalog_find_previous("IMG_missing.png") == NULL);
+
+    // One file renamed: still usable for lookups, but no longer the same list
+    catalog_t renamed = {0};
+    CHECK(catalog_reset(&renamed, "./images"));
+    for (int i = 0; i < COUNT; i++) {
+        name_for(i, name, sizeof(name));
+        if (i == COUNT / 2) name[0] = 'X';
+        CHECK(catalog_add(&renamed, name) != NULL);
+    }
+    CHECK(!catalog_matches_previous(&renamed));
+    catalog_free(&renamed);
+    CHECK(renamed.entries == NULL && renamed.count == 0);
+
+    CHECK(!catalog_load_previous(index_path, CONFIG + 1));
+    CHECK(catalog_find_previous(name) == NULL);
+
+    // Any damage to the entries or the names fails the checksum
+    struct stat info;
+    CHECK(stat(index_path, &info) == 0);
+    size_t   size  = info.st_size;
+    uint8_t* saved = malloc(size);
+    FILE*    fd    = fopen(index_path, "rb");
+    CHECK(fd != NULL && fread(saved, 1, size, fd) == size);
+    if (fd != NULL) fclose(fd);
+    size_t names_start = sizeof(catalog_index_header_t) + (size_t)COUNT * sizeof(catalog_entry_t);
+    size_t damaged[]   = {sizeof(catalog_index_header_t), names_start - 3, names_start + 5, size - 2};
+    for (size_t i = 0; i < sizeof(damaged) / sizeof(damaged[0]); i++) {
+        saved[damaged[i]] ^= 0x20;
+        CHECK(write_file(index_path, saved, size));
+        if (catalog_load_previous(index_path, CONFIG)) {
+            printf("index with byte %zu changed was accepted\n", damaged[i]);
+            failures++;
+        }
+        saved[damaged[i]] ^= 0x20;
+    }
+    CHECK(write_file(index_path, saved, size - 1));
+    CHECK(!catalog_load_previous(index_path, CONFIG));
+    CHECK(write_file(index_path, saved, size));
+    CHECK(catalog_load_previous(index_path, CONFIG));
+    free(saved);
+
+    // Reset keeps the allocations for the next directory
+    size_t memory = catalog_memory(&catalog);
+    CHECK(catalog_reset(&catalog, "./images/album"));
+    CHECK(catalog_count(&catalog) == 0 && catalog_memory(&catalog) == memory);
+    CHECK(catalog_add(&catalog, "one.png") != NULL && catalog_find(&catalog, "one.png") == 0);
+    CHECK(catalog_path(&catalog, 0, path, sizeof(path)) && strcmp(path, "./images/album/one.png") == 0);
+
+    catalog_free(&catalog);
+    catalog_free_previous();
+    unlink(index_path);
+    printf("%d failures\n", failures);
+    return failures > 0 ? 1 : 0;
+}
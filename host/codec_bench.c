@@ -0,0 +1,322 @@
+#include <dirent.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "codec.h"
+#include "esp_timer.h"
+#include "pax_gfx.h"
+#include "pixel_format.h"
+#include "png_stream.h"
+#include "sim.h"
+
+// Decode benchmark for the image codecs: decodes each file into a frame the
+// way the app does and reports size and decode time per file, per codec, and
+// for images stored in several formats under the same name, side by side.
+// PNGs are also decoded on one thread, to show what the second core gains.
+
+#define MAX_FILES 1024
+
+typedef struct {
+    char     path[512];
+    int      codec;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes;
+    double   best_ms;
+    double   average_ms;
+    double   serial_ms;  // best time decoding a PNG on one thread, 0 for other codecs
+    double   inflate_ms;  // CPU time of the best pipelined decode on the decoding thread
+    double   rows_ms;     // and on the row worker
+    bool     ok;
+} result_t;
+
+static result_t results[MAX_FILES];
+static int      result_count = 0;
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [options] FILE|DIR...\n"
+            "  --frame WxH   frame to decode into (default 800x480)\n"
+            "  --repeat N    decode every file N times (default 5)\n"
+            "  --verbose     show the decoders' log output\n",
+            argv0);
+}
+
+static void add_file(const char* path) {
+    const char* name  = strrchr(path, '/');
+    int         codec = codec_for_name(name != NULL ? name + 1 : path);
+    if (codec < 0) return;
+    if (result_count == MAX_FILES) {
+        fprintf(stderr, "More than %d files, ignoring %s\n", MAX_FILES, path);
+        return;
+    }
+    result_t* result = &results[result_count++];
+    snprintf(result->path, sizeof(result->path), "%s", path);
+    result->codec = codec;
+}
+
+static void add_path(const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        add_file(path);
+        return;
+    }
+    DIR* dir = opendir(path);
+    if (dir == NULL) return;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        char child[512];
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (stat(child, &st) == 0 && S_ISREG(st.st_mode)) add_file(child);
+    }
+    closedir(dir);
+}
+
+static int compare_paths(const void* a, const void* b) {
+    return strcmp(((const result_t*)a)->path, ((const result_t*)b)->path);
+}
+
+static double cpu_ms(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Decode the file, whose header read as info, into frame repeat times as the
+// app does after scanning. Returns false if a decode fails.
+// The CPU time of the fastest decode is split into this thread's and the
+// other threads', which is what the PNG row worker did.
+static bool time_decodes(result_t* result, const codec_info_t* info, pax_buf_t* frame, int repeat, double* best_ms,
+                         double* average_ms) {
+    double total_ms = 0;
+    for (int i = 0; i < repeat; i++) {
+        double  thread_start  = cpu_ms(CLOCK_THREAD_CPUTIME_ID);
+        double  process_start = cpu_ms(CLOCK_PROCESS_CPUTIME_ID);
+        int64_t start         = esp_timer_get_time();
+        FILE*   fd            = fopen(result->path, "rb");
+        bool    ok            = fd != NULL && codec_decode_into(fd, result->codec, info, frame);
+        if (fd != NULL) fclose(fd);
+        if (!ok) return false;
+        double ms     = (esp_timer_get_time() - start) / 1000.0;
+        double thread = cpu_ms(CLOCK_THREAD_CPUTIME_ID) - thread_start;
+        double all    = cpu_ms(CLOCK_PROCESS_CPUTIME_ID) - process_start;
+        total_ms += ms;
+        if (i == 0 || ms < *best_ms) {
+            *best_ms           = ms;
+            result->inflate_ms = thread;
+            result->rows_ms    = all - thread;
+        }
+    }
+    *average_ms = total_ms / repeat;
+    return true;
+}
+
+static void run(result_t* result, pax_buf_t* frame, int repeat) {
+    struct stat  st;
+    codec_info_t info;
+    FILE*        fd = stat(result->path, &st) == 0 ? fopen(result->path, "rb") : NULL;
+    if (fd == NULL || !codec_read_info(fd, &result->codec, &info) || !info.supported) {
+        if (fd != NULL) fclose(fd);
+        return;
+    }
+    fclose(fd);
+    result->bytes   = (uint32_t)st.st_size;
+    result->width   = info.width;
+    result->height  = info.height;
+    result->ok      = time_decodes(result, &info, frame, repeat, &result->best_ms, &result->average_ms);
+    if (result->ok && result->codec == CODEC_PNG) {
+        // The pipelined split is kept, the serial one overwrites it otherwise
+        double average_ms, inflate_ms = result->inflate_ms, rows_ms = result->rows_ms;
+        png_stream_set_pipelined(false);
+        if (!time_decodes(result, &info, frame, repeat, &result->serial_ms, &average_ms)) result->serial_ms = 0;
+        png_stream_set_pipelined(true);
+        result->inflate_ms = inflate_ms;
+        result->rows_ms    = rows_ms;
+    }
+}
+
+static double bits_per_pixel(const result_t* result) {
+    return result->bytes * 8.0 / ((double)result->width * result->height);
+}
+
+// Filename without directory and extension
+static void stem_of(const result_t* result, char* out, size_t out_size) {
+    const char* name = strrchr(result->path, '/');
+    name             = name != NULL ? name + 1 : result->path;
+    const char* dot  = strrchr(name, '.');
+    size_t      len  = dot != NULL ? (size_t)(dot - name) : strlen(name);
+    snprintf(out, out_size, "%.*s", (int)len, name);
+}
+
+static void print_files(void) {
+    printf("%-40s %-5s %11s %9s %7s %9s %9s %7s\n", "file", "codec", "size", "KB", "bits/px", "best ms", "avg ms",
+           "MP/s");
+    for (int i = 0; i < result_count; i++) {
+        const result_t* r    = &results[i];
+        const char*     name = strrchr(r->path, '/');
+        name                 = name != NULL ? name + 1 : r->path;
+        if (!r->ok) {
+            printf("%-40s %-5s failed or unsupported\n", name, codec_name(r->codec));
+            continue;
+        }
+        char size[24];
+        snprintf(size, sizeof(size), "%" PRIu32 "x%" PRIu32, r->width, r->height);
+        printf("%-40s %-5s %11s %9.1f %7.2f %9.2f %9.2f %7.1f\n", name, codec_name(r->codec), size, r->bytes / 1024.0,
+               bits_per_pixel(r), r->best_ms, r->average_ms, (double)r->width * r->height / (r->best_ms * 1000.0));
+    }
+}
+
+static void print_codecs(void) {
+    printf("\n%-5s %6s %11s %7s %11s %7s\n", "codec", "files", "KB", "bits/px", "best ms", "MP/s");
+    for (int codec = 0; codec < CODEC_COUNT; codec++) {
+        int    files  = 0;
+        double bytes  = 0;
+        double pixels = 0;
+        double ms     = 0;
+        for (int i = 0; i < result_count; i++) {
+            if (results[i].codec != codec || !results[i].ok) continue;
+            files++;
+            bytes += results[i].bytes;
+            pixels += (double)results[i].width * results[i].height;
+            ms += results[i].best_ms;
+        }
+        if (files == 0) continue;
+        printf("%-5s %6d %11.1f %7.2f %11.2f %7.1f\n", codec_name(codec), files, bytes / 1024.0, bytes * 8 / pixels,
+               ms, pixels / (ms * 1000.0));
+    }
+}
+
+// Best PNG decode times on one thread and pipelined over two. On a single
+// CPU the threads take turns, so the bound the split of the work sets, with
+// each thread on a core of its own, is shown too: the pipelined time scaled
+// to the busier thread's share of the CPU time.
+static void print_pipeline(void) {
+    int    files      = 0;
+    double serial_ms  = 0;
+    double ms         = 0;
+    double inflate_ms = 0;
+    double rows_ms    = 0;
+    double bound_ms   = 0;
+    for (int i = 0; i < result_count; i++) {
+        const result_t* r = &results[i];
+        if (r->codec != CODEC_PNG || !r->ok || r->serial_ms == 0) continue;
+        files++;
+        serial_ms += r->serial_ms;
+        ms += r->best_ms;
+        inflate_ms += r->inflate_ms;
+        rows_ms += r->rows_ms;
+        // The busier thread's share of the time both took
+        double busiest = r->inflate_ms > r->rows_ms ? r->inflate_ms : r->rows_ms;
+        if (busiest > 0) bound_ms += r->best_ms * busiest / (r->inflate_ms + r->rows_ms);
+    }
+    if (files == 0) return;
+    printf("\nPNG pipeline (%d files, %ld CPUs)\n", files, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("  one thread      %9.2f ms\n", serial_ms);
+    printf("  pipelined       %9.2f ms  %5.2fx\n", ms, serial_ms / ms);
+    printf("  inflate thread  %9.2f ms CPU\n", inflate_ms);
+    printf("  row worker      %9.2f ms CPU\n", rows_ms);
+    printf("  two-core bound  %9.2f ms  %5.2fx\n", bound_ms, serial_ms / bound_ms);
+}
+
+// Images present in more than one format, each format's size and decode
+// time relative to the first one listed
+static void print_comparison(void) {
+    bool header = false;
+    for (int i = 0; i < result_count; i++) {
+        char stem[256], other[256];
+        stem_of(&results[i], stem, sizeof(stem));
+        // Only from the first file of each stem
+        bool first = true;
+        int  count = 0;
+        for (int j = 0; j < result_count; j++) {
+            stem_of(&results[j], other, sizeof(other));
+            if (strcmp(stem, other) != 0) continue;
+            if (j < i) first = false;
+            count++;
+        }
+        if (!first || count < 2 || !results[i].ok) continue;
+
+        if (!header) {
+            printf("\n%-32s %-5s %9s %7s %9s %7s\n", "image", "codec", "KB", "size", "best ms", "time");
+            header = true;
+        }
+        for (int j = i; j < result_count; j++) {
+            stem_of(&results[j], other, sizeof(other));
+            if (strcmp(stem, other) != 0 || !results[j].ok) continue;
+            printf("%-32s %-5s %9.1f %6.0f%% %9.2f %6.0f%%\n", j == i ? stem : "", codec_name(results[j].codec),
+                   results[j].bytes / 1024.0, 100.0 * results[j].bytes / results[i].bytes, results[j].best_ms,
+                   100.0 * results[j].best_ms / results[i].best_ms);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    static const struct option options[] = {
+        {"frame", required_argument, NULL, 'f'},
+        {"repeat", required_argument, NULL, 'n'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    uint32_t frame_width  = 800;
+    uint32_t frame_height = 480;
+    int      repeat       = 5;
+    bool     verbose      = false;
+    int      option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'f':
+                if (sscanf(optarg, "%" SCNu32 "x%" SCNu32, &frame_width, &frame_height) != 2 || frame_width == 0 ||
+                    frame_height == 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'n':
+                repeat = atoi(optarg);
+                if (repeat < 1) repeat = 1;
+                break;
+            case 'v': verbose = true; break;
+            default: usage(argv[0]); return option == 'h' ? 0 : 1;
+        }
+    }
+    if (optind == argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    sim_set_log_level(verbose ? ESP_LOG_DEBUG : ESP_LOG_NONE);
+
+    for (int i = optind; i < argc; i++) add_path(argv[i]);
+    if (result_count == 0) {
+        fprintf(stderr, "No images found\n");
+        return 1;
+    }
+    qsort(results, result_count, sizeof(results[0]), compare_paths);
+
+    pax_buf_t frame;
+    if (!pax_buf_init(&frame, NULL, frame_width, frame_height, IMAGE_BUF_TYPE)) {
+        fprintf(stderr, "Failed to allocate a %" PRIu32 "x%" PRIu32 " frame\n", frame_width, frame_height);
+        return 1;
+    }
+    codec_init();
+    for (int i = 0; i < result_count; i++) run(&results[i], &frame, repeat);
+    pax_buf_destroy(&frame);
+
+    printf("%d files into a %" PRIu32 "x%" PRIu32 " frame, best of %d\n\n", result_count, frame_width, frame_height,
+           repeat);
+    print_files();
+    print_codecs();
+    print_pipeline();
+    print_comparison();
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "image_ops.h"
+
+// The 180 degree flip kernels against the two-pass flip they replaced (swap
+// rows top to bottom, then reverse every row) for every size up to
+// MAX_SIDE x MAX_SIDE, odd and even, and a few panel sized frames, at every
+// alignment of the buffer its pixel format allows. The reverse copies are
+// checked the same way.
+
+#define MAX_SIDE 40
+
+typedef void (*flip_fn)(uint8_t* pixels, size_t count);
+typedef void (*reverse_copy_fn)(uint8_t* dst, const uint8_t* src, size_t count);
+
+typedef struct {
+    const char*     name;
+    size_t          bytes_per_pixel;
+    size_t          alignment;  // of the pixels, RGB565 ones are uint16_t
+    flip_fn         flip;
+    reverse_copy_fn reverse_copy;
+} kernel_t;
+
+static const kernel_t kernels[] = {
+    {"rgb888", 3, 1, image_flip_rgb888_180, image_reverse_copy_rgb888},
+    {"rgb565", 2, 2, image_flip_rgb565_180, image_reverse_copy_rgb565},
+};
+
+static const int large_sizes[][2] = {{800, 480}, {799, 479}, {480, 800}, {320, 240}, {321, 241}};
+
+static void two_pass_flip(uint8_t* pixels, int w, int h, size_t bpp) {
+    size_t   row_bytes = w * bpp;
+    uint8_t* tmp_row   = malloc(row_bytes);
+    for (int y = 0; y < h / 2; y++) {
+        uint8_t* top_row    = pixels + (size_t)y * row_bytes;
+        uint8_t* bottom_row = pixels + (size_t)(h - 1 - y) * row_bytes;
+        memcpy(tmp_row, top_row, row_bytes);
+        memcpy(top_row, bottom_row, row_bytes);
+        memcpy(bottom_row, tmp_row, row_bytes);
+    }
+    free(tmp_row);
+    for (int y = 0; y < h; y++) {
+        uint8_t* row = pixels + (size_t)y * row_bytes;
+        for (int x = 0; x < w / 2; x++) {
+            uint8_t* left  = row + (size_t)x * bpp;
+            uint8_t* right = row + (size_t)(w - 1 - x) * bpp;
+            uint8_t  tmp[4];
+            memcpy(tmp, left, bpp);
+            memcpy(left, right, bpp);
+            memcpy(right, tmp, bpp);
+        }
+    }
+}
+
+// Compare the kernels with the reference for one size. The buffers have a
+// guard byte on both sides that must stay untouched.
+static int check(const kernel_t* kernel, int w, int h, size_t offset) {
+    size_t   size      = (size_t)w * h * kernel->bytes_per_pixel;
+    uint8_t* source    = malloc(size + offset + 2);
+    uint8_t* flipped   = malloc(size + offset + 2);
+    uint8_t* reference = malloc(size);
+    for (size_t i = 0; i < size + offset + 2; i++) source[i] = rand();
+    uint8_t* src = source + offset + 1;
+    memcpy(reference, src, size);
+    two_pass_flip(reference, w, h, kernel->bytes_per_pixel);
+
+    int failures = 0;
+    memcpy(flipped, source, size + offset + 2);
+    kernel->flip(flipped + offset + 1, (size_t)w * h);
+    if (memcmp(flipped + offset + 1, reference, size) != 0 || flipped[offset] != source[offset] ||
+        flipped[offset + 1 + size] != source[offset + 1 + size]) {
+        printf("%s flip %dx%d at offset %zu differs\n", kernel->name, w, h, offset);
+        failures++;
+    }
+
+    memset(flipped, 0xA5, size + offset + 2);
+    kernel->reverse_copy(flipped + offset + 1, src, (size_t)w * h);
+    if (memcmp(flipped + offset + 1, reference, size) != 0 || flipped[offset] != 0xA5 ||
+        flipped[offset + 1 + size] != 0xA5) {
+        printf("%s reverse copy %dx%d at offset %zu differs\n", kernel->name, w, h, offset);
+        failures++;
+    }
+    free(source);
+    free(flipped);
+    free(reference);
+    return failures;
+}
+
+int main(void) {
+    int failures = 0;
+    int checks   = 0;
+    srand(1);
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        // The pixels start at offset + 1
+        for (size_t offset = kernels[k].alignment - 1; offset < 4; offset += kernels[k].alignment) {
+            for (int h = 1; h <= MAX_SIDE; h++) {
+                for (int w = 1; w <= MAX_SIDE; w++, checks++) failures += check(&kernels[k], w, h, offset);
+            }
+            for (size_t i = 0; i < sizeof(large_sizes) / sizeof(large_sizes[0]); i++, checks++) {
+                failures += check(&kernels[k], large_sizes[i][0], large_sizes[i][1], offset);
+            }
+        }
+    }
+    printf("%d sizes checked, %d failures\n", checks, failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,205 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "image_cache.h"
+#include "pixel_format.h"
+#include "sim.h"
+
+// The decode cache driven directly, with a fake decode function that marks
+// each frame with its index and can be held mid-decode: taking and
+// prefetching, dropping queued work when the wanted list changes, dropping
+// the result of a decode that invalidate waited for, keeping a held frame
+// while the decoder is short of slots, not retrying a bad file, and retrying
+// an image whose frame could not be allocated once memory is back. Frame
+// allocations fail on request through the wrappers below (linked with --wrap).
+
+#define FRAME_WIDTH  64
+#define FRAME_HEIGHT 64
+#define FRAME_BYTES  (FRAME_WIDTH * FRAME_HEIGHT * IMAGE_BYTES_PER_PIXEL)
+#define BAD_INDEX    99
+#define MAX_CALLS    64
+
+static int failures = 0;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+
+static atomic_bool fail_frames = false;
+
+void* __wrap_malloc(size_t size) {
+    if (atomic_load(&fail_frames) && size >= FRAME_BYTES) return NULL;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    if (atomic_load(&fail_frames) && count * size >= FRAME_BYTES) return NULL;
+    return __real_calloc(count, size);
+}
+
+static pthread_mutex_t decode_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  decode_cond = PTHREAD_COND_INITIALIZER;
+static bool            gate_closed = false;  // decodes wait in the fake decoder until it opens
+static int             calls[MAX_CALLS];     // indices decoded, in order
+static int             call_count  = 0;
+
+static bool fake_decode(int index, pax_buf_t* dst, void* ctx) {
+    (void)ctx;
+    pthread_mutex_lock(&decode_lock);
+    if (call_count < MAX_CALLS) calls[call_count] = index;
+    call_count++;
+    pthread_cond_broadcast(&decode_cond);
+    while (gate_closed) pthread_cond_wait(&decode_cond, &decode_lock);
+    pthread_mutex_unlock(&decode_lock);
+
+    memset(pax_buf_get_pixels_rw(dst), index, FRAME_BYTES);
+    return index != BAD_INDEX;
+}
+
+static void set_gate(bool closed) {
+    pthread_mutex_lock(&decode_lock);
+    gate_closed = closed;
+    pthread_cond_broadcast(&decode_cond);
+    pthread_mutex_unlock(&decode_lock);
+}
+
+// Wait up to 10 s for the decode function to have been called count times
+static bool wait_calls(int count) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 10;
+    pthread_mutex_lock(&decode_lock);
+    int result = 0;
+    while (call_count < count && result == 0) {
+        result = pthread_cond_timedwait(&decode_cond, &decode_lock, &deadline);
+    }
+    bool called = call_count >= count;
+    pthread_mutex_unlock(&decode_lock);
+    return called;
+}
+
+static int decodes(void) {
+    pthread_mutex_lock(&decode_lock);
+    int count = call_count;
+    pthread_mutex_unlock(&decode_lock);
+    return count;
+}
+
+// Times the decode function was called for index
+static int decodes_of(int index) {
+    int count = 0;
+    pthread_mutex_lock(&decode_lock);
+    for (int i = 0; i < call_count && i < MAX_CALLS; i++) {
+        if (calls[i] == index) count++;
+    }
+    pthread_mutex_unlock(&decode_lock);
+    return count;
+}
+
+// The index the fake decoder marked frame with
+static int marker(const pax_buf_t* frame) {
+    return ((const uint8_t*)pax_buf_get_pixels(frame))[FRAME_BYTES - 1];
+}
+
+static void prefetch(const int* indices, size_t count) {
+    image_cache_prefetch(indices, count, -1);
+    sim_task_wait_idle("decoder");
+}
+
+static atomic_bool invalidated = false;
+
+static void* invalidate_thread(void* arg) {
+    (void)arg;
+    image_cache_invalidate();
+    atomic_store(&invalidated, true);
+    return NULL;
+}
+
+int main(void) {
+    sim_set_log_level(ESP_LOG_NONE);
+    CHECK(image_cache_init(fake_decode, NULL, NULL, FRAME_WIDTH, FRAME_HEIGHT));
+
+    // Out of memory: no frame and no decode, and the previous frame (none)
+    // unchanged. Unlike a bad file the image is tried again.
+    atomic_store(&fail_frames, true);
+    CHECK(image_cache_take(0) == NULL);
+    CHECK(decodes() == 0);
+    CHECK(image_cache_modify_shown() == NULL);
+    atomic_store(&fail_frames, false);
+    const pax_buf_t* zero = image_cache_take(0);
+    CHECK(zero != NULL && marker(zero) == 0);
+    CHECK(decodes_of(0) == 1);
+
+    // Taking the shown image again is free
+    CHECK(image_cache_take(0) == zero);
+    CHECK(decodes_of(0) == 1);
+
+    // A new wanted list drops the queued 2 and 3; 1, already being decoded,
+    // is kept as a spare
+    set_gate(true);
+    image_cache_prefetch((const int[]){1, 2, 3}, 3, -1);
+    CHECK(wait_calls(2));
+    image_cache_prefetch((const int[]){4, 5}, 2, -1);
+    set_gate(false);
+    sim_task_wait_idle("decoder");
+    CHECK(decodes_of(2) == 0 && decodes_of(3) == 0);
+    CHECK(decodes_of(4) == 1 && decodes_of(5) == 1);
+    int              before = decodes();
+    const pax_buf_t* one    = image_cache_take(1);
+    CHECK(one != NULL && marker(one) == 1);
+    CHECK(decodes() == before);
+    // The frame it replaced is still cached
+    CHECK(image_cache_take(0) == zero && decodes() == before);
+
+    // Invalidate waits for the decode of the old list, and drops its result
+    set_gate(true);
+    before = decodes();
+    image_cache_prefetch((const int[]){7}, 1, -1);
+    CHECK(wait_calls(before + 1));
+    pthread_t thread;
+    pthread_create(&thread, NULL, invalidate_thread, NULL);
+    usleep(50 * 1000);
+    CHECK(!atomic_load(&invalidated));
+    set_gate(false);
+    pthread_join(thread, NULL);
+    CHECK(atomic_load(&invalidated));
+    CHECK(decodes() == before + 1);
+    const pax_buf_t* seven = image_cache_take(7);
+    CHECK(seven != NULL && marker(seven) == 7);
+    CHECK(decodes_of(7) == 2);
+
+    // A held frame is not reused, even when the decoder runs out of slots for
+    // the wanted list; once released, the decoder takes it for the rest
+    image_cache_hold_shown();
+    const pax_buf_t* ten = image_cache_take(10);
+    CHECK(ten != NULL && ten != seven && marker(ten) == 10);
+    prefetch((const int[]){12, 13, 14}, 3);
+    CHECK(decodes_of(12) == 1 && decodes_of(13) == 1 && decodes_of(14) == 0);
+    CHECK(marker(seven) == 7);
+    image_cache_release_held();
+    sim_task_wait_idle("decoder");
+    CHECK(decodes_of(14) == 1);
+    CHECK(marker(ten) == 10);
+
+    // A bad file fails without replacing the shown frame, and is remembered
+    CHECK(image_cache_take(BAD_INDEX) == NULL);
+    CHECK(decodes_of(BAD_INDEX) == 1);
+    CHECK(marker(ten) == 10);
+    CHECK(image_cache_take(BAD_INDEX) == NULL);
+    CHECK(decodes_of(BAD_INDEX) == 1);
+    CHECK(image_cache_modify_shown() == ten);
+
+    printf("%d failures\n", failures);
+    return failures > 0 ? 1 : 0;
+}
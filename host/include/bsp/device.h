@@ -0,0 +1,16 @@
+#pragma once
+
+#include "bsp/display.h"
+#include "esp_err.h"
+
+typedef struct {
+    struct {
+        bsp_display_color_format_t requested_color_format;
+        int                        num_fbs;
+    } display;
+} bsp_configuration_t;
+
+esp_err_t bsp_device_initialize(const bsp_configuration_t* configuration);
+
+// Ends the simulation
+void bsp_device_restart_to_launcher(void);
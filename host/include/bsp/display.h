@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include "esp_err.h"
+
+typedef enum {
+    BSP_DISPLAY_COLOR_FORMAT_1_PAL,
+    BSP_DISPLAY_COLOR_FORMAT_2_PAL,
+    BSP_DISPLAY_COLOR_FORMAT_4_PAL,
+    BSP_DISPLAY_COLOR_FORMAT_8_PAL,
+    BSP_DISPLAY_COLOR_FORMAT_16_PAL,
+    BSP_DISPLAY_COLOR_FORMAT_1_GREY,
+    BSP_DISPLAY_COLOR_FORMAT_2_GREY,
+    BSP_DISPLAY_COLOR_FORMAT_4_GREY,
+    BSP_DISPLAY_COLOR_FORMAT_8_GREY,
+    BSP_DISPLAY_COLOR_FORMAT_8_332RGB,
+    BSP_DISPLAY_COLOR_FORMAT_16_565RGB,
+    BSP_DISPLAY_COLOR_FORMAT_4_1111ARGB,
+    BSP_DISPLAY_COLOR_FORMAT_8_2222ARGB,
+    BSP_DISPLAY_COLOR_FORMAT_16_4444ARGB,
+    BSP_DISPLAY_COLOR_FORMAT_24_888RGB,
+    BSP_DISPLAY_COLOR_FORMAT_32_8888ARGB,
+} bsp_display_color_format_t;
+
+typedef enum {
+    BSP_DISPLAY_ENDIAN_LITTLE,
+    BSP_DISPLAY_ENDIAN_BIG,
+} bsp_display_endianness_t;
+
+typedef enum {
+    BSP_DISPLAY_ROTATION_0,
+    BSP_DISPLAY_ROTATION_90,
+    BSP_DISPLAY_ROTATION_180,
+    BSP_DISPLAY_ROTATION_270,
+} bsp_display_rotation_t;
+
+// The simulated panel is an 800x480 24-bit buffer in memory; blitted rows
+// are copied into it
+esp_err_t              bsp_display_get_parameters(size_t* h_res, size_t* v_res, bsp_display_color_format_t* color_format,
+                                                  bsp_display_endianness_t* data_endian);
+bsp_display_rotation_t bsp_display_get_default_rotation(void);
+esp_err_t              bsp_display_blit(size_t x_start, size_t y_start, size_t x_end, size_t y_end, const void* buffer);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+typedef enum {
+    INPUT_EVENT_TYPE_NONE,
+    INPUT_EVENT_TYPE_NAVIGATION,
+    INPUT_EVENT_TYPE_KEYBOARD,
+    INPUT_EVENT_TYPE_SCANCODE,
+    INPUT_EVENT_TYPE_ACTION,
+} bsp_input_event_type_t;
+
+typedef enum {
+    BSP_INPUT_NAVIGATION_KEY_NONE,
+    BSP_INPUT_NAVIGATION_KEY_ESC,
+    BSP_INPUT_NAVIGATION_KEY_LEFT,
+    BSP_INPUT_NAVIGATION_KEY_RIGHT,
+    BSP_INPUT_NAVIGATION_KEY_UP,
+    BSP_INPUT_NAVIGATION_KEY_DOWN,
+    BSP_INPUT_NAVIGATION_KEY_F1,
+} bsp_input_navigation_key_t;
+
+typedef struct {
+    bsp_input_event_type_t type;
+    union {
+        struct {
+            bsp_input_navigation_key_t key;
+            uint32_t                   modifiers;
+            bool                       state;
+        } args_navigation;
+        struct {
+            char        ascii;
+            const char* utf8;
+            uint32_t    modifiers;
+        } args_keyboard;
+        struct {
+            int scancode;
+        } args_scancode;
+    };
+} bsp_input_event_t;
+
+// Events are injected by the simulator's input script
+esp_err_t bsp_input_get_queue(QueueHandle_t* queue);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include "driver/gpio.h"
+
+typedef struct {
+    int slot;
+    int max_freq_khz;
+} sdmmc_host_t;
+
+#define SDMMC_HOST_DEFAULT() {.slot = 0, .max_freq_khz = 20000}
+#define SDSPI_HOST_DEFAULT() {.slot = 1, .max_freq_khz = 20000}
+#define SDMMC_FREQ_HIGHSPEED 40000
+#define SDMMC_SLOT_NO_CD     GPIO_NUM_NC
+#define SDMMC_SLOT_NO_WP     GPIO_NUM_NC
+#define SDSPI_DEFAULT_DMA    3
+
+typedef struct {
+    gpio_num_t clk, cmd, d0, d1, d2, d3, d4, d5, d6, d7, cd, wp;
+    int        width;
+    uint32_t   flags;
+} sdmmc_slot_config_t;
+
+typedef struct {
+    int mosi_io_num;
+    int miso_io_num;
+    int sclk_io_num;
+    int quadwp_io_num;
+    int quadhd_io_num;
+    int max_transfer_sz;
+} spi_bus_config_t;
+
+typedef struct {
+    int gpio_cs;
+    int host_id;
+} sdspi_device_config_t;
+
+#define SDSPI_DEVICE_CONFIG_DEFAULT() {.gpio_cs = GPIO_NUM_NC, .host_id = 1}
+
+esp_err_t spi_bus_initialize(int host, const spi_bus_config_t* config, int dma);
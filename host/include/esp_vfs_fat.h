@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "driver/sdmmc_host.h"
+
+typedef struct sdmmc_card sdmmc_card_t;
+
+typedef struct {
+    bool   format_if_mount_failed;
+    int    max_files;
+    size_t allocation_unit_size;
+} esp_vfs_fat_sdmmc_mount_config_t;
+
+// The simulated card is a host directory: mounting succeeds if mount_point
+// exists relative to the directory given with --sd
+esp_err_t esp_vfs_fat_sdmmc_mount(const char* mount_point, const sdmmc_host_t* host, const void* slot_config,
+                                  const esp_vfs_fat_sdmmc_mount_config_t* config, sdmmc_card_t** card);
+esp_err_t esp_vfs_fat_sdspi_mount(const char* mount_point, const sdmmc_host_t* host,
+                                  const sdspi_device_config_t* slot_config,
+                                  const esp_vfs_fat_sdmmc_mount_config_t* config, sdmmc_card_t** card);
@@ -0,0 +1,29 @@
+#pragma once
+
+// Host shim: the subset of the FreeRTOS API the app uses, implemented on
+// POSIX threads in sim_freertos.c. One tick is one millisecond.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int      BaseType_t;
+typedef unsigned UBaseType_t;
+
+typedef struct sim_queue* QueueHandle_t;
+typedef struct sim_queue* SemaphoreHandle_t;
+typedef struct sim_task*  TaskHandle_t;
+
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  1
+#define pdFAIL  0
+
+#define configTICK_RATE_HZ 1000
+#define portMAX_DELAY      0xFFFFFFFFu
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms)  ((TickType_t)(ms))
+#define tskIDLE_PRIORITY   0
+#define tskNO_AFFINITY     0x7FFFFFFF
+#define portNUM_PROCESSORS 2
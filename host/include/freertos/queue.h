@@ -0,0 +1,21 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+void          vQueueDelete(QueueHandle_t queue);
+BaseType_t    xQueueSend(QueueHandle_t queue, const void* item, TickType_t timeout);
+BaseType_t    xQueueReceive(QueueHandle_t queue, void* item, TickType_t timeout);
+UBaseType_t   uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t   uxQueueSpacesAvailable(QueueHandle_t queue);
+
+// Queue sets: a set is a queue of the handles of its members, one per item
+// sent to them
+typedef struct sim_queue* QueueSetHandle_t;
+typedef struct sim_queue* QueueSetMemberHandle_t;
+
+QueueSetHandle_t       xQueueCreateSet(UBaseType_t length);
+BaseType_t             xQueueAddToSet(QueueSetMemberHandle_t member, QueueSetHandle_t set);
+QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t set, TickType_t timeout);
+
+#define xQueueSendToBack(queue, item, timeout) xQueueSend(queue, item, timeout)
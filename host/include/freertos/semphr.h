@@ -0,0 +1,12 @@
+#pragma once
+
+#include "queue.h"
+
+// Semaphores are queues of empty items, as in FreeRTOS itself. The mutex is
+// not recursive and has no priority inheritance.
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+BaseType_t        xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout);
+BaseType_t        xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+#define vSemaphoreDelete(semaphore) vQueueDelete(semaphore)
@@ -0,0 +1,18 @@
+#pragma once
+
+// Host simulator build: no CONFIG_IDF_TARGET_* is set, the app uses the
+// settings of a large-memory target
+#define CONFIG_IMAGEWAG_SIMULATOR 1
+
+// Pixel format: RGB888 unless the build is configured with -DIMAGEWAG_RGB565=ON
+#ifndef CONFIG_IMAGEWAG_PIXEL_FORMAT_RGB565
+#define CONFIG_IMAGEWAG_PIXEL_FORMAT_RGB888 1
+#endif
+
+// PNG rows are unfiltered on a second thread, as on the dual-core targets
+#define CONFIG_IMAGEWAG_PNG_PIPELINE 1
+
+// SD reads go through the same buffers as on the large-memory targets
+#define CONFIG_IMAGEWAG_SD_HIGH_SPEED     0
+#define CONFIG_IMAGEWAG_SD_READ_BUFFER_KB 32
+#define CONFIG_IMAGEWAG_SD_READ_AHEAD_KB  1152
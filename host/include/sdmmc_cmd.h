@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdio.h>
+#include "esp_vfs_fat.h"
+
+void sdmmc_card_print_info(FILE* stream, const sdmmc_card_t* card);
@@ -0,0 +1,87 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "catalog.h"
+#include "sim.h"
+
+// Checks a card the app has finished with: every directory below DIR must
+// hold an index that loads, listing each of its PNGs as having a fresh .wag
+// sidecar next to it, and no temporary file of an interrupted or overlapping
+// write may be left. Run after the sim has visited every album and the
+// sidecar builder has caught up.
+
+#define INDEX_NAME "imagewag.idx"  // in main.c
+#define WAG_SUFFIX ".wag"          // in wag.h
+
+static int failures    = 0;
+static int directories = 0;
+
+static bool has_suffix(const char* name, const char* suffix) {
+    size_t length = strlen(name);
+    return length >= strlen(suffix) && strcmp(name + length - strlen(suffix), suffix) == 0;
+}
+
+static void check_dir(const char* dir) {
+    directories++;
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, INDEX_NAME);
+    catalog_index_header_t header;
+    FILE*                  fd = fopen(path, "rb");
+    bool ok = fd != NULL && fread(&header, sizeof(header), 1, fd) == 1 && catalog_load_previous(path, header.config);
+    if (fd != NULL) fclose(fd);
+    if (!ok) {
+        printf("%s: missing or invalid\n", path);
+        failures++;
+    }
+
+    DIR* listing = opendir(dir);
+    if (listing == NULL) return;
+    struct dirent* entry;
+    uint32_t       images = 0;
+    while ((entry = readdir(listing)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        struct stat source;
+        if (stat(path, &source) != 0) continue;
+        if (S_ISDIR(source.st_mode)) {
+            check_dir(path);
+            // The subdirectory's index replaced ours as the previous one
+            char index_path[1024];
+            snprintf(index_path, sizeof(index_path), "%s/%s", dir, INDEX_NAME);
+            ok = ok && catalog_load_previous(index_path, header.config);
+        } else if (has_suffix(entry->d_name, "~")) {
+            printf("%s: left over from writing\n", path);
+            failures++;
+        } else if (has_suffix(entry->d_name, ".png")) {
+            images++;
+            const catalog_entry_t* known = ok ? catalog_find_previous(entry->d_name) : NULL;
+            char                   wag_path[1100];
+            if (known == NULL || known->cache_stale || known->bad) {
+                printf("%s: %s in the index\n", path, known == NULL ? "missing" : "not fresh");
+                failures++;
+            } else if (snprintf(wag_path, sizeof(wag_path), "%s%s", path, WAG_SUFFIX) >= (int)sizeof(wag_path) ||
+                       stat(wag_path, &source) != 0) {
+                printf("%s: no sidecar\n", path);
+                failures++;
+            }
+        }
+    }
+    closedir(listing);
+    if (ok && header.count != images) {
+        printf("%s: %u images in the index, %u in the directory\n", dir, (unsigned)header.count, (unsigned)images);
+        failures++;
+    }
+    catalog_free_previous();
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s DIR\n", argv[0]);
+        return 1;
+    }
+    sim_set_log_level(ESP_LOG_ERROR);
+    check_dir(argv[1]);
+    printf("%d directories checked, %d failures\n", directories, failures);
+    return failures > 0 || directories == 0 ? 1 : 0;
+}
@@ -0,0 +1,189 @@
+#include <dirent.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "esp_timer.h"
+#include "image_file.h"
+#include "sdkconfig.h"
+#include "sim.h"
+
+// SD read benchmark: reads every file the way the decoders do, in requests of
+// a few KB, with stdio's 128 byte buffer as on ESP-IDF, with the buffers of
+// image_file_open, and with each file read ahead while the one before it is
+// worked on, and reports the throughput of each. The directories stand in
+// for the card: on Linux the files come from the page cache, so the numbers
+// show what each mode costs per byte rather than what a card delivers.
+
+#define MAX_FILES 4096
+
+typedef enum {
+    MODE_STDIO,
+    MODE_BUFFERED,
+    MODE_AHEAD,
+    MODE_COUNT,
+} read_mode_t;
+
+static const char* const mode_names[MODE_COUNT] = {"stdio", "buffered", "ahead"};
+
+static char* paths[MAX_FILES];
+static int   path_count = 0;
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [options] FILE|DIR...\n"
+            "  --request N   bytes per fread (default 4096)\n"
+            "  --buffer KB   buffer of files opened from the card (default %d)\n"
+            "  --work-ms N   time each file is worked on after reading it, which reading ahead\n"
+            "                overlaps (default 20)\n"
+            "  --repeat N    read every file N times per mode (default 3)\n"
+            "  --verbose     show the log output\n",
+            argv0, CONFIG_IMAGEWAG_SD_READ_BUFFER_KB);
+}
+
+static void add_file(const char* path) {
+    if (path_count == MAX_FILES) {
+        fprintf(stderr, "More than %d files, ignoring %s\n", MAX_FILES, path);
+        return;
+    }
+    paths[path_count++] = strdup(path);
+}
+
+static void add_path(const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        add_file(path);
+        return;
+    }
+    DIR* dir = opendir(path);
+    if (dir == NULL) return;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        char child[512];
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (stat(child, &st) == 0 && S_ISREG(st.st_mode)) add_file(child);
+    }
+    closedir(dir);
+}
+
+static int compare_paths(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static FILE* open_file(read_mode_t mode, const char* path) {
+    if (mode != MODE_STDIO) return image_file_open(path);
+    FILE* fd = fopen(path, "rb");
+    if (fd != NULL) setvbuf(fd, NULL, _IOFBF, 128);
+    return fd;
+}
+
+static void close_file(read_mode_t mode, FILE* fd) {
+    if (mode == MODE_STDIO) {
+        fclose(fd);
+    } else {
+        image_file_close(fd);
+    }
+}
+
+// Read every file front to back in request sized freads. Returns the bytes
+// read; *read_us is the time spent opening, reading and closing, without the
+// work done on each file.
+static uint64_t run(read_mode_t mode, uint8_t* scratch, size_t request, int work_ms, int64_t* read_us) {
+    uint64_t bytes = 0;
+    *read_us       = 0;
+    for (int i = 0; i < path_count; i++) {
+        int64_t start = esp_timer_get_time();
+        FILE*   fd    = open_file(mode, paths[i]);
+        if (fd == NULL) continue;
+        if (mode == MODE_AHEAD && i + 1 < path_count) image_file_read_ahead(paths[i + 1]);
+        size_t n;
+        while ((n = fread(scratch, 1, request, fd)) > 0) bytes += n;
+        close_file(mode, fd);
+        *read_us += esp_timer_get_time() - start;
+        if (work_ms > 0) usleep(work_ms * 1000);
+    }
+    return bytes;
+}
+
+int main(int argc, char** argv) {
+    static const struct option options[] = {
+        {"request", required_argument, NULL, 'q'}, {"buffer", required_argument, NULL, 'b'},
+        {"work-ms", required_argument, NULL, 'w'}, {"repeat", required_argument, NULL, 'n'},
+        {"verbose", no_argument, NULL, 'v'},       {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int  request   = 4096;
+    int  buffer_kb = CONFIG_IMAGEWAG_SD_READ_BUFFER_KB;
+    int  work_ms   = 20;
+    int  repeat    = 3;
+    bool verbose   = false;
+    int  option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'q': request = atoi(optarg); break;
+            case 'b': buffer_kb = atoi(optarg); break;
+            case 'w': work_ms = atoi(optarg); break;
+            case 'n': repeat = atoi(optarg); break;
+            case 'v': verbose = true; break;
+            default:  usage(argv[0]); return option == 'h' ? 0 : 1;
+        }
+    }
+    if (optind == argc || request < 1 || buffer_kb < 0 || work_ms < 0 || repeat < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    sim_set_log_level(verbose ? ESP_LOG_DEBUG : ESP_LOG_NONE);
+
+    for (int i = optind; i < argc; i++) add_path(argv[i]);
+    if (path_count == 0) {
+        fprintf(stderr, "No files found\n");
+        return 1;
+    }
+    qsort(paths, path_count, sizeof(paths[0]), compare_paths);
+
+    uint8_t* scratch = malloc(request);
+    if (scratch == NULL) {
+        fprintf(stderr, "Failed to allocate %d bytes\n", request);
+        return 1;
+    }
+    image_file_init();
+    image_file_set_buffer_size((size_t)buffer_kb * 1024);
+
+    // Once untimed, so every mode finds the files in the page cache
+    int64_t  read_us;
+    uint64_t total = run(MODE_STDIO, scratch, request, 0, &read_us);
+    printf("%d files, %.1f MB, %d byte reads, %d KB buffers, %d ms of work per file\n\n", path_count, total / 1e6,
+           request, buffer_kb, work_ms);
+    printf("%-10s %9s %9s %9s %7s\n", "mode", "MB", "read_s", "MB/s", "hits");
+    for (read_mode_t mode = 0; mode < MODE_COUNT; mode++) {
+        image_file_stats_t before, after;
+        image_file_get_stats(&before);
+        uint64_t bytes = 0;
+        int64_t  us    = 0;
+        for (int i = 0; i < repeat; i++) {
+            bytes += run(mode, scratch, request, work_ms, &read_us);
+            us    += read_us;
+        }
+        image_file_get_stats(&after);
+        printf("%-10s %9.1f %9.3f %9.1f %7" PRIu32 "\n", mode_names[mode], bytes / 1e6, us / 1e6,
+               us > 0 ? bytes / (double)us : 0.0, after.hits - before.hits);
+    }
+
+    image_file_stats_t stats;
+    image_file_get_stats(&stats);
+    if (stats.files > 0) {
+        printf("\nread-ahead task: %" PRIu32 " files, %.1f MB at %.1f MB/s\n", stats.files, stats.bytes / 1e6,
+               stats.read_us > 0 ? stats.bytes / (double)stats.read_us : 0.0);
+    }
+    free(scratch);
+    for (int i = 0; i < path_count; i++) free(paths[i]);
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <string.h>
+#include "jpeg.h"
+#include "sim.h"
+
+// The JPEG decoder against hand-built files: an 8x8 grey baseline image that
+// must decode, and the same file with Huffman tables that are complete,
+// over-subscribed within the fast lookup table or beyond it. Over-subscribed
+// tables must be rejected before any of their codes are stored; run under
+// ASan to see a table written out of bounds.
+
+static int failures = 0;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+typedef struct {
+    uint8_t data[1024];
+    size_t  size;
+} file_t;
+
+static void put(file_t* f, const uint8_t* data, size_t size) {
+    memcpy(f->data + f->size, data, size);
+    f->size += size;
+}
+
+static void put_segment(file_t* f, uint8_t marker, const uint8_t* data, size_t size) {
+    uint8_t header[4] = {0xFF, marker, (uint8_t)((size + 2) >> 8), (uint8_t)(size + 2)};
+    put(f, header, sizeof(header));
+    put(f, data, size);
+}
+
+// A Huffman table of class 0 (DC) or 1 (AC), with symbols 0, 1, 2...
+static void put_table(file_t* f, int class, const uint8_t counts[16]) {
+    uint8_t data[1 + 16 + 256] = {class << 4};
+    int     total              = 0;
+    memcpy(data + 1, counts, 16);
+    for (int i = 0; i < 16; i++) total += counts[i];
+    for (int i = 0; i < total; i++) data[17 + i] = (uint8_t)i;
+    put_segment(f, 0xC4, data, 17 + total);
+}
+
+// One block whose coefficients are all zero: a mid grey 8x8 image. The DC
+// table gives category 0 the two-bit code 00, and the AC table end of block
+// (symbol 0) the one-bit code 0.
+static void make_file(file_t* f, const uint8_t dc_counts[16]) {
+    static const uint8_t soi[]      = {0xFF, 0xD8};
+    static const uint8_t frame[]    = {8, 0, 8, 0, 8, 1, 1, 0x11, 0};
+    static const uint8_t ac[16]     = {2};
+    static const uint8_t scan[]     = {1, 1, 0x00, 0, 63, 0};
+    static const uint8_t entropy[]  = {0x1F};  // 00 0 and 1s to pad
+    static const uint8_t eoi[]      = {0xFF, 0xD9};
+    uint8_t              quant[65]  = {0};
+    memset(quant + 1, 1, 64);
+
+    f->size = 0;
+    put(f, soi, sizeof(soi));
+    put_segment(f, 0xDB, quant, sizeof(quant));
+    put_segment(f, 0xC0, frame, sizeof(frame));
+    put_table(f, 0, dc_counts);
+    put_table(f, 1, ac);
+    put_segment(f, 0xDA, scan, sizeof(scan));
+    put(f, entropy, sizeof(entropy));
+    put(f, eoi, sizeof(eoi));
+}
+
+typedef struct {
+    uint32_t rows;
+    bool     grey;
+} result_t;
+
+static bool check_row(void* ctx, uint32_t y, const uint8_t* row) {
+    result_t* result = ctx;
+    if (y != result->rows++) result->grey = false;
+    for (int i = 0; i < 8 * 3; i++) {
+        if (row[i] != 128) result->grey = false;
+    }
+    return true;
+}
+
+static bool decode(const char* name, const uint8_t dc_counts[16], result_t* result) {
+    file_t file;
+    make_file(&file, dc_counts);
+    FILE* fd = fmemopen(file.data, file.size, "rb");
+    if (fd == NULL) return false;
+    *result = (result_t){.grey = true};
+    bool ok = jpeg_decode(fd, check_row, result);
+    fclose(fd);
+    printf("%s: %s\n", name, ok ? "decoded" : "rejected");
+    return ok;
+}
+
+int main(void) {
+    sim_set_log_level(ESP_LOG_NONE);
+    result_t result;
+
+    // The luminance DC table of the JPEG standard, which 00 is in
+    static const uint8_t standard[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1};
+    CHECK(decode("standard table", standard, &result));
+    CHECK(result.rows == 8 && result.grey);
+
+    // Exactly full at two bits, and at the sixteenth
+    static const uint8_t full[16] = {0, 4};
+    CHECK(decode("full at two bits", full, &result));
+    static const uint8_t full_long[16] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2};
+    CHECK(decode("full at sixteen bits", full_long, &result));
+
+    // 255 codes of one bit
+    static const uint8_t one_bit[16] = {255};
+    CHECK(!decode("255 one-bit codes", one_bit, &result));
+    // One code too many at two bits, and at nine, the longest in the fast table
+    static const uint8_t two_bits[16] = {0, 5};
+    CHECK(!decode("5 two-bit codes", two_bits, &result));
+    static const uint8_t nine_bits[16] = {0, 3, 0, 0, 0, 0, 0, 0, 129};
+    CHECK(!decode("129 nine-bit codes after 3 two-bit ones", nine_bits, &result));
+    // Beyond the fast table
+    static const uint8_t long_codes[16] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3};
+    CHECK(!decode("one sixteen-bit code too many", long_codes, &result));
+
+    printf("%d failures\n", failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include "test_png.h"
+
+// Writes a synthetic SD card for the host tests: DIR/images holds PNGs in
+// every colour type the decoders take, and with --frames the first of them
+// is an APNG. With --albums every directory gets that many subdirectories
+// with images of their own, --depth levels deep. Start from an empty DIR;
+// files from an earlier run are overwritten but nothing is removed.
+
+typedef struct {
+    uint8_t color_type;
+    uint8_t bit_depth;
+} format_t;
+
+static const format_t formats[] = {
+    {2, 8}, {6, 8}, {0, 8}, {3, 8}, {4, 8}, {2, 16}, {0, 1}, {3, 4}, {6, 16}, {0, 16}, {4, 16}, {3, 2},
+};
+#define FORMAT_COUNT (sizeof(formats) / sizeof(formats[0]))
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [options] DIR\n"
+            "  --count N     images to write (default 6)\n"
+            "  --size WxH    image size (default 800x480)\n"
+            "  --frames N    make the first image an APNG of N frames (default 1, a still)\n"
+            "  --delay MS    frame delay of the APNG (default 50)\n"
+            "  --albums N    subdirectories of every directory (default 0)\n"
+            "  --depth N     levels of subdirectories below images/ (default 1)\n",
+            argv0);
+}
+
+static bool make_dir(const char* path) {
+    if (mkdir(path, 0755) == 0 || errno == EEXIST) return true;
+    perror(path);
+    return false;
+}
+
+typedef struct {
+    int count;
+    int width;
+    int height;
+    int frames;
+    int delay;
+    int albums;
+    int depth;
+    int written;  // images so far, numbering them across the whole card
+} card_t;
+
+// Fill dir with images and, above the deepest level, with albums of their own
+static bool write_album(card_t* card, const char* dir, int level) {
+    if (!make_dir(dir)) return false;
+    char path[512];
+    for (int i = 0; i < card->count; i++, card->written++) {
+        const format_t* format = &formats[card->written % FORMAT_COUNT];
+        test_png_t      png    = {
+            .width      = card->width,
+            .height     = card->height,
+            .color_type = format->color_type,
+            .bit_depth  = format->bit_depth,
+            .filter     = -1,
+            .frames     = card->written == 0 ? card->frames : 1,
+            .delay_ms   = card->delay,
+            .seed       = card->written,
+        };
+        snprintf(path, sizeof(path), "%s/img%02d.png", dir, card->written);
+        if (!test_png_write(path, &png)) {
+            fprintf(stderr, "Failed to write %s\n", path);
+            return false;
+        }
+    }
+    for (int i = 0; level < card->depth && i < card->albums; i++) {
+        snprintf(path, sizeof(path), "%s/album%d", dir, i);
+        if (!write_album(card, path, level + 1)) return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    static const struct option options[] = {
+        {"count", required_argument, NULL, 'n'}, {"size", required_argument, NULL, 's'},
+        {"frames", required_argument, NULL, 'f'}, {"delay", required_argument, NULL, 'd'},
+        {"albums", required_argument, NULL, 'a'}, {"depth", required_argument, NULL, 'l'},
+        {"help", no_argument, NULL, 'h'},        {NULL, 0, NULL, 0},
+    };
+    card_t card = {.count = 6, .width = 800, .height = 480, .frames = 1, .delay = 50, .depth = 1};
+    int    option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'n': card.count = atoi(optarg); break;
+            case 's':
+                if (sscanf(optarg, "%dx%d", &card.width, &card.height) != 2) card.width = 0;
+                break;
+            case 'f': card.frames = atoi(optarg); break;
+            case 'd': card.delay = atoi(optarg); break;
+            case 'a': card.albums = atoi(optarg); break;
+            case 'l': card.depth = atoi(optarg); break;
+            default:  usage(argv[0]); return option == 'h' ? 0 : 1;
+        }
+    }
+    if (optind + 1 != argc || card.count < 1 || card.width < 1 || card.height < 1 || card.frames < 1 ||
+        card.delay < 0 || card.delay > 65535 || card.albums < 0 || card.depth < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/images", argv[optind]);
+    return make_dir(argv[optind]) && write_album(&card, path, 0) ? 0 : 1;
+}
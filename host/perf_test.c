@@ -0,0 +1,132 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "perf.h"
+#include "sim.h"
+
+// The timing probes against a stopped clock: known durations are recorded by
+// advancing the clock between perf_begin and perf_end, then the statistics,
+// the ring's wrap-around and every line of the CSV dump are checked.
+
+#define RING_SIZE 256  // PERF_RING_SIZE in perf.c
+#define CLOCK_US  1000000
+
+static int failures = 0;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+static void record(perf_probe_t probe, uint32_t duration_us) {
+    int64_t start = perf_begin();
+    sim_clock_advance(duration_us);
+    perf_end(probe, start);
+}
+
+static void check_stats(perf_probe_t probe, uint32_t count, uint32_t min_us, uint32_t avg_us, uint32_t p99_us,
+                        uint32_t max_us) {
+    perf_stats_t stats;
+    perf_get_stats(probe, &stats);
+    printf("%s: count %" PRIu32 " min %" PRIu32 " avg %" PRIu32 " p99 %" PRIu32 " max %" PRIu32 "\n",
+           perf_probe_name(probe), stats.count, stats.min_us, stats.avg_us, stats.p99_us, stats.max_us);
+    CHECK(stats.count == count);
+    CHECK(stats.min_us == min_us);
+    CHECK(stats.avg_us == avg_us);
+    CHECK(stats.p99_us == p99_us);
+    CHECK(stats.max_us == max_us);
+}
+
+// Run perf_dump_csv with the log, which goes to stderr, captured in a
+// buffer holding just the messages, one line each
+static char* dump_csv(void) {
+    FILE* capture = tmpfile();
+    int   saved   = dup(STDERR_FILENO);
+    fflush(stderr);
+    dup2(fileno(capture), STDERR_FILENO);
+    perf_dump_csv();
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+
+    long size = ftell(capture);
+    rewind(capture);
+    char* text = calloc(size + 1, 1);
+    char* out  = text;
+    char  line[256];
+    while (fgets(line, sizeof(line), capture) != NULL) {
+        const char* message = strstr(line, "perf: ");
+        if (message == NULL) continue;
+        out += sprintf(out, "%s", message + strlen("perf: "));
+    }
+    fclose(capture);
+    return text;
+}
+
+int main(void) {
+    sim_set_log_level(ESP_LOG_INFO);
+    sim_clock_set(CLOCK_US);
+
+    // 1 to 100 ms, shuffled so nothing relies on the order they came in
+    for (uint32_t i = 0; i < 100; i++) record(PERF_DECODE, ((i * 37) % 100 + 1) * 1000);
+    for (int i = 0; i < 3; i++) record(PERF_BLIT, 7);
+    check_stats(PERF_DECODE, 100, 1000, 50500, 99000, 100000);
+    check_stats(PERF_BLIT, 3, 7, 7, 7, 7);
+    check_stats(PERF_FLIP, 0, 0, 0, 0, 0);
+
+    for (int i = 0; i < 5; i++) perf_count(PERF_FRAMES_DROPPED);
+    CHECK(perf_counter(PERF_FRAMES_DROPPED) == 5);
+    CHECK(perf_milestone_us(PERF_FIRST_IMAGE) == -1);
+    int64_t first_image = CLOCK_US + 5050000 + 21;
+    perf_milestone(PERF_FIRST_IMAGE);
+    sim_clock_advance(1000);
+    perf_milestone(PERF_FIRST_IMAGE);
+    CHECK(perf_milestone_us(PERF_FIRST_IMAGE) == first_image);
+
+    char* csv = dump_csv();
+    CHECK(strstr(csv, "probe,count,min_us,avg_us,p99_us,max_us\n") != NULL);
+    CHECK(strstr(csv, "\ndecode,100,1000,50500,99000,100000\n") != NULL);
+    CHECK(strstr(csv, "\nblit,3,7,7,7,7\n") != NULL);
+    CHECK(strstr(csv, "\nflip,") == NULL);
+    CHECK(strstr(csv, "\nframes_dropped,5\n") != NULL);
+    CHECK(strstr(csv, "\nframes_shown,0\n") != NULL);
+    char expected[128];
+    snprintf(expected, sizeof(expected), "\nfirst_image,%" PRId64 "\n", first_image);
+    CHECK(strstr(csv, expected) != NULL);
+    CHECK(strstr(csv, "\nfirst_pixel,-1\n") != NULL);
+    // The samples, oldest first, each starting where the one before ended
+    const char* samples = strstr(csv, "probe,start_us,duration_us\n");
+    CHECK(samples != NULL);
+    if (samples != NULL) {
+        samples += strlen("probe,start_us,duration_us\n");
+        int64_t start = CLOCK_US;
+        for (uint32_t i = 0; i < 103; i++) {
+            uint32_t duration = i < 100 ? ((i * 37) % 100 + 1) * 1000 : 7;
+            int      length   = snprintf(expected, sizeof(expected), "%s,%" PRId64 ",%" PRIu32 "\n",
+                                         i < 100 ? "decode" : "blit", start, duration);
+            if (strncmp(samples, expected, length) != 0) {
+                printf("sample %" PRIu32 ": expected %s", i, expected);
+                failures++;
+                break;
+            }
+            samples += length;
+            start   += duration;
+        }
+        CHECK(*samples == '\0');
+    }
+    free(csv);
+
+    // The ring keeps the last RING_SIZE samples of all probes together
+    for (uint32_t i = 1; i <= 300; i++) record(PERF_FLIP, i);
+    check_stats(PERF_DECODE, 0, 0, 0, 0, 0);
+    check_stats(PERF_BLIT, 0, 0, 0, 0, 0);
+    check_stats(PERF_FLIP, RING_SIZE, 300 - RING_SIZE + 1, (300 - RING_SIZE + 1 + 300) / 2, 298, 300);
+
+    printf("%d failures\n", failures);
+    return failures > 0 ? 1 : 0;
+}
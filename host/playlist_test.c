@@ -0,0 +1,167 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "playlist.h"
+
+// The shuffled playlist over many rounds, for album sizes from one image to
+// more than 16-bit indices hold: stepped forward, every round shows each
+// image once and never starts with the image the round before ended on, and
+// playlist_at predicts every step, across round boundaries too. Stepped back,
+// it retraces the same images into earlier rounds, down to the start. A
+// playlist created at a later round plays that round the same way. With
+// three images a third of the rounds would start with the image before, so
+// the swap in load_round is taken many times. Over many consecutive seeds,
+// every image must be as likely at every position of a round as any other,
+// in the first round and in one that went through that swap.
+
+#define ROUNDS       8    // for larger albums
+#define SMALL_ROUNDS 200  // for albums of up to 16 images
+
+#define UNIFORM_SEEDS 20000
+#define CHI2_Z        3.09  // standard normal quantile of the critical value, p = 0.001
+
+static int failures = 0;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+// Stop after the first few failures of a size, there would be thousands
+#define CHECK_STEP(condition, count, seed, step)                                                          \
+    do {                                                                                                  \
+        if (!(condition)) {                                                                               \
+            if (failures < 20) {                                                                          \
+                printf("%s:%d: %u images, seed %u, step %u: check failed: %s\n", __FILE__, __LINE__, count, \
+                       seed, step, #condition);                                                           \
+            }                                                                                             \
+            failures++;                                                                                   \
+        }                                                                                                 \
+    } while (0)
+
+static void check_playlist(uint32_t count, uint32_t seed, uint32_t rounds) {
+    uint32_t  steps = count * rounds;
+    int*      shown = malloc(steps * sizeof(int));
+    uint32_t* seen  = calloc(count, sizeof(uint32_t));
+
+    playlist_t* playlist = playlist_create(count, seed, 0);
+    CHECK(playlist != NULL);
+    if (playlist == NULL || shown == NULL || seen == NULL) return;
+    CHECK(playlist_seed(playlist) == seed);
+    CHECK(playlist_at(playlist, -1) == -1);
+
+    // Forward, each step as playlist_at predicted it
+    int predicted  = playlist_at(playlist, 0);
+    int next_first = -1;  // first image of the next round, as predicted at the start of this one
+    for (uint32_t i = 0; i < steps; i++) {
+        uint32_t position = i % count;
+        int      image    = i == 0 ? playlist_at(playlist, 0) : playlist_step(playlist, 1);
+        CHECK_STEP(image == predicted, count, seed, i);
+        if (image < 0 || (uint32_t)image >= count) {
+            failures++;
+            break;
+        }
+        shown[i] = image;
+        CHECK_STEP(playlist_round(playlist) == i / count, count, seed, i);
+        CHECK_STEP(playlist_at(playlist, 0) == image, count, seed, i);
+        CHECK_STEP(playlist_at(playlist, -1) == (position > 0 ? shown[i - 1] : -1), count, seed, i);
+
+        // Once per round, and not twice in a row where a round begins
+        CHECK_STEP(seen[image] == i / count, count, seed, i);
+        seen[image]++;
+        if (position == 0 && i > 0) {
+            CHECK_STEP(image == next_first, count, seed, i);
+            if (count >= 3) CHECK_STEP(image != shown[i - 1], count, seed, i);
+        }
+
+        // The rest of the round and the first image of the next, no further
+        uint32_t rest = count - position;
+        if (position == 0) next_first = playlist_at(playlist, rest);
+        CHECK_STEP(playlist_at(playlist, rest) >= 0, count, seed, i);
+        CHECK_STEP(playlist_at(playlist, rest + 1) == -1, count, seed, i);
+        predicted = playlist_at(playlist, 1);
+    }
+
+    // A playlist started at a later round plays it the same way
+    for (uint32_t round = 1; round < rounds; round += 3) {
+        playlist_t* later = playlist_create(count, seed, round);
+        CHECK(later != NULL && playlist_round(later) == round);
+        for (uint32_t i = 0; later != NULL && i < count; i++) {
+            int image = i == 0 ? playlist_at(later, 0) : playlist_step(later, 1);
+            CHECK_STEP(image == shown[round * count + i], count, seed, round * count + i);
+        }
+        playlist_destroy(later);
+    }
+
+    // Back through every round to the start, and no further
+    for (uint32_t i = steps - 1; i > 0; i--) {
+        int image = playlist_step(playlist, -1);
+        CHECK_STEP(image == shown[i - 1], count, seed, i - 1);
+        CHECK_STEP(playlist_round(playlist) == (i - 1) / count, count, seed, i - 1);
+        // Backwards, playlist_at still only looks ahead into the next round
+        if ((i - 1) % count == count - 1) CHECK_STEP(playlist_at(playlist, 1) == shown[i], count, seed, i - 1);
+    }
+    CHECK(playlist_step(playlist, -1) == -1);
+    CHECK(playlist_round(playlist) == 0 && playlist_at(playlist, 0) == shown[0]);
+
+    // Seeking stays in the round, where the next step goes on from
+    uint32_t middle = count / 2;
+    playlist_seek(playlist, (uint32_t)shown[middle]);
+    CHECK(playlist_at(playlist, 0) == shown[middle]);
+    if (middle + 1 < steps) CHECK(playlist_step(playlist, 1) == shown[middle + 1]);
+
+    playlist_destroy(playlist);
+    free(shown);
+    free(seen);
+}
+
+// Pearson's chi-square of how often each image came at each position over
+// UNIFORM_SEEDS playlists. Every playlist puts each image at one position and
+// one image at each position, so the statistic times (count - 1) / count is
+// chi-square distributed with (count - 1)^2 degrees of freedom.
+static void check_uniform(uint32_t count, uint32_t round) {
+    uint32_t* seen = calloc((size_t)count * count, sizeof(uint32_t));
+    if (seen == NULL) return;
+    for (uint32_t seed = 1; seed <= UNIFORM_SEEDS; seed++) {
+        playlist_t* playlist = playlist_create(count, seed, round);
+        for (uint32_t i = 0; playlist != NULL && i < count; i++) {
+            int image = i == 0 ? playlist_at(playlist, 0) : playlist_step(playlist, 1);
+            if (image >= 0 && (uint32_t)image < count) seen[(size_t)image * count + i]++;
+        }
+        playlist_destroy(playlist);
+    }
+    double expected = (double)UNIFORM_SEEDS / count;
+    double chi2     = 0;
+    for (size_t i = 0; i < (size_t)count * count; i++) chi2 += (seen[i] - expected) * (seen[i] - expected) / expected;
+    chi2 *= (count - 1.0) / count;
+    // Wilson-Hilferty approximation of the critical value
+    double freedom  = (double)(count - 1) * (count - 1);
+    double term     = 2 / (9 * freedom);
+    double critical = freedom * pow(1 - term + CHI2_Z * sqrt(term), 3);
+    printf("%6u images, round %u: chi-square %.1f, critical %.1f\n", count, round, chi2, critical);
+    CHECK(chi2 < critical);
+    free(seen);
+}
+
+int main(void) {
+    static const uint32_t counts[] = {1, 2, 3, 4, 5, 7, 16, 255, 1000, 65536, 65537, 70000};
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        uint32_t count = counts[c];
+        // Small albums cross many more round boundaries
+        uint32_t rounds = count <= 16 ? SMALL_ROUNDS : ROUNDS;
+        uint32_t seeds  = count <= 1000 ? 20 : 2;
+        for (uint32_t seed = 0; seed < seeds; seed++) check_playlist(count, seed * 0x9E3779B9u + 1, rounds);
+        printf("%6u images: %u seeds, %u rounds\n", count, seeds, rounds);
+    }
+    static const uint32_t uniform_counts[] = {3, 4, 5, 7, 16};
+    for (size_t c = 0; c < sizeof(uniform_counts) / sizeof(uniform_counts[0]); c++) {
+        check_uniform(uniform_counts[c], 0);
+        check_uniform(uniform_counts[c], 1);
+    }
+    CHECK(playlist_create(0, 1, 0) == NULL);
+    printf("%d failures\n", failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,227 @@
+#include <malloc.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "png_stream.h"
+#include "sdkconfig.h"
+#include "sim.h"
+#include "test_png.h"
+
+// Peak heap of the streaming PNG decoder. The app's allocations go through
+// the wrappers below (linked with --wrap), which keep the bytes in use and
+// their high-water mark; each PNG is decoded with its rows discarded, and the
+// peak over the decode must stay within the fixed working set (inflater
+// state and window) plus a few rows, and on two cores the pipeline's slots.
+// Images of the same width but different heights must peak at exactly the
+// same number of bytes. PNGs whose deflate streams declare too many codes
+// must fail to decode, and free what they allocated.
+
+// Decoder state including the 32 KB window, Huffman tables and input buffer
+#define FIXED_BYTES (48 * 1024)
+// Pipeline slots, each rounded down to whole rows but at least one
+#define PIPELINE_BYTES(row_bytes) (4 * ((row_bytes) > 16384 ? (row_bytes) : 16384))
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void  __real_free(void* ptr);
+
+static atomic_llong in_use = 0;
+static atomic_llong peak   = 0;
+
+static void account(long long delta) {
+    long long now  = atomic_fetch_add(&in_use, delta) + delta;
+    long long high = atomic_load(&peak);
+    while (now > high && !atomic_compare_exchange_weak(&peak, &high, now)) {
+    }
+}
+
+void* __wrap_malloc(size_t size) {
+    void* ptr = __real_malloc(size);
+    if (ptr != NULL) account(malloc_usable_size(ptr));
+    return ptr;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    void* ptr = __real_calloc(count, size);
+    if (ptr != NULL) account(malloc_usable_size(ptr));
+    return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    size_t before = ptr != NULL ? malloc_usable_size(ptr) : 0;
+    void*  out    = __real_realloc(ptr, size);
+    if (out != NULL) account((long long)malloc_usable_size(out) - before);
+    return out;
+}
+
+void __wrap_free(void* ptr) {
+    if (ptr != NULL) account(-(long long)malloc_usable_size(ptr));
+    __real_free(ptr);
+}
+
+typedef struct {
+    int     width;
+    int     height;
+    uint8_t color_type;
+    uint8_t bit_depth;
+} image_t;
+
+// Pairs of the same width and format with different heights
+static const image_t images[] = {
+    {64, 64, 2, 8},    {64, 2048, 2, 8},  {800, 480, 2, 8},  {800, 2400, 2, 8},
+    {800, 480, 6, 16}, {800, 1440, 6, 16}, {1920, 240, 6, 8}, {1920, 1080, 6, 8},
+    {333, 97, 3, 4},   {333, 1001, 3, 4}, {4000, 16, 0, 1},  {4000, 640, 0, 1},
+};
+#define IMAGE_COUNT (sizeof(images) / sizeof(images[0]))
+
+static bool discard_row(void* ctx, uint32_t y, const uint8_t* row) {
+    (void)y;
+    (void)row;
+    (*(uint32_t*)ctx)++;
+    return true;
+}
+
+static int channels(uint8_t color_type) {
+    return color_type == 2 ? 3 : color_type == 4 ? 2 : color_type == 6 ? 4 : 1;
+}
+
+// Peak bytes allocated while decoding path, or -1 if decoding failed
+static long long decode_peak(const char* path, int height) {
+    FILE* fd = fopen(path, "rb");
+    if (fd == NULL) return -1;
+    uint32_t  rows = 0;
+    long long base = atomic_load(&in_use);
+    atomic_store(&peak, base);
+    bool ok = png_stream_decode(fd, NULL, discard_row, &rows) && rows == (uint32_t)height;
+    fclose(fd);
+    if (atomic_load(&in_use) != base) {
+        printf("%s: %lld bytes still allocated after decoding\n", path, atomic_load(&in_use) - base);
+        ok = false;
+    }
+    return ok ? atomic_load(&peak) - base : -1;
+}
+
+// Deflate streams with more literal/length or distance codes than deflate
+// has, declared in a dynamic block header and all given lengths with code 18
+// runs. Decoders must reject them before storing the lengths.
+typedef struct {
+    const char* name;
+    int         literals;   // HLIT + 257
+    int         distances;  // HDIST + 1
+} bad_stream_t;
+
+static const bad_stream_t bad_streams[] = {
+    {"288 literal, 32 distance codes", 288, 32},
+    {"286 literal, 32 distance codes", 286, 32},
+    {"288 literal, 30 distance codes", 288, 30},
+};
+#define BAD_STREAM_COUNT (sizeof(bad_streams) / sizeof(bad_streams[0]))
+
+typedef struct {
+    uint8_t data[64];
+    size_t  bytes;
+    int     bits;
+} bit_writer_t;
+
+static void put_bits(bit_writer_t* w, uint32_t value, int count) {
+    for (int i = 0; i < count; i++, w->bits++) {
+        if (w->bits == 8) {
+            w->bytes++;
+            w->bits = 0;
+        }
+        w->data[w->bytes] |= ((value >> i) & 1) << w->bits;
+    }
+}
+
+static size_t bad_stream(const bad_stream_t* bad, uint8_t* out) {
+    bit_writer_t w = {.data = {0x78, 0x01}, .bytes = 2};
+    put_bits(&w, 1, 1);  // final block
+    put_bits(&w, 2, 2);  // dynamic Huffman codes
+    put_bits(&w, bad->literals - 257, 5);
+    put_bits(&w, bad->distances - 1, 5);
+    // Code length codes 16, 17, 18 and 0: one bit each for 0 and 18, which
+    // get the codes 0 and 1
+    put_bits(&w, 0, 4);
+    put_bits(&w, 0, 3);
+    put_bits(&w, 0, 3);
+    put_bits(&w, 1, 3);
+    put_bits(&w, 1, 3);
+    for (int left = bad->literals + bad->distances; left > 0;) {
+        int run = left > 138 ? 138 : left;
+        if (left - run < 11 && left - run > 0) run = left - 11;
+        put_bits(&w, 1, 1);  // 18: 11 to 138 zeros
+        put_bits(&w, run - 11, 7);
+        left -= run;
+    }
+    memcpy(out, w.data, w.bytes + 1);
+    return w.bytes + 1;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s DIR\nTest images are written to DIR.\n", argv[0]);
+        return 1;
+    }
+    sim_set_log_level(ESP_LOG_WARN);
+    png_stream_init();
+    mkdir(argv[1], 0755);
+
+    int failures = 0;
+    for (int pipelined = 0; pipelined <= CONFIG_IMAGEWAG_PNG_PIPELINE; pipelined++) {
+        png_stream_set_pipelined(pipelined);
+        long long previous       = -1;
+        bool      previous_slots = false;
+        for (size_t i = 0; i < IMAGE_COUNT; i++) {
+            const image_t* image = &images[i];
+            test_png_t     png   = {
+                .width      = image->width,
+                .height     = image->height,
+                .color_type = image->color_type,
+                .bit_depth  = image->bit_depth,
+                .filter     = -1,
+                .seed       = i,
+            };
+            char path[512];
+            snprintf(path, sizeof(path), "%s/%dx%d_%u_%u.png", argv[1], image->width, image->height,
+                     image->color_type, image->bit_depth);
+            if (!pipelined && !test_png_write(path, &png)) {
+                fprintf(stderr, "Failed to write %s\n", path);
+                return 1;
+            }
+
+            size_t    stride = ((size_t)image->width * channels(image->color_type) * image->bit_depth + 7) / 8;
+            long long bound  = FIXED_BYTES + 3 * (stride + 1) + (size_t)image->width * 4;
+            // Small images are decoded on one core either way
+            bool      slots  = pipelined && (stride + 1) * image->height >= 64 * 1024;
+            if (slots) bound += PIPELINE_BYTES(stride + 1);
+            long long used = decode_peak(path, image->height);
+            bool      ok   = used >= 0 && used <= bound;
+            // Every second image is the same as the one before but taller
+            if (i % 2 == 1 && slots == previous_slots && used != previous) ok = false;
+            printf("%-28s %s: peak %7lld bytes, bound %7lld%s\n", path + strlen(argv[1]) + 1,
+                   pipelined ? "pipelined" : "serial   ", used, bound, ok ? "" : "  FAILED");
+            failures += !ok;
+            previous       = used;
+            previous_slots = slots;
+        }
+    }
+
+    for (size_t i = 0; i < BAD_STREAM_COUNT; i++) {
+        test_png_t png = {.width = 4, .height = 4, .color_type = 2, .bit_depth = 8};
+        uint8_t    stream[64];
+        char       path[512];
+        snprintf(path, sizeof(path), "%s/bad_%zu.png", argv[1], i);
+        if (!test_png_write_stream(path, &png, stream, bad_stream(&bad_streams[i], stream))) {
+            fprintf(stderr, "Failed to write %s\n", path);
+            return 1;
+        }
+        long long used = decode_peak(path, png.height);
+        printf("%-32s rejected: %s\n", bad_streams[i].name, used < 0 ? "yes" : "no  FAILED");
+        failures += used >= 0;
+    }
+    printf("%d failures\n", failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "png_stream.h"
+#include "sdkconfig.h"
+#include "sim.h"
+#include "test_png.h"
+
+// The pipelined PNG decoder against the serial one: every colour type and
+// bit depth, every filter, widths from one pixel to rows longer than a
+// pipeline slot and heights that leave a short last slot, each decoded both
+// ways into a frame that must come out the same byte for byte, with every
+// row delivered once and in order. Images large enough for the pipeline must
+// have their rows handed out by its worker, so the two runs really took
+// different paths.
+
+#define PIPELINE_MIN_BYTES (64 * 1024)  // in png_stream.c
+
+typedef struct {
+    uint8_t color_type;
+    uint8_t bit_depth;
+} format_t;
+
+static const format_t formats[] = {
+    {0, 1}, {0, 2}, {0, 4}, {0, 8}, {0, 16}, {2, 8}, {2, 16}, {3, 1},
+    {3, 2}, {3, 4}, {3, 8}, {4, 8}, {4, 16}, {6, 8}, {6, 16},
+};
+#define FORMAT_COUNT (sizeof(formats) / sizeof(formats[0]))
+
+// From a single column to rows longer than a 16 KB slot in every format
+static const int widths[] = {1, 13, 333, 1920, 8209};
+#define WIDTH_COUNT (sizeof(widths) / sizeof(widths[0]))
+
+typedef struct {
+    uint8_t*  pixels;
+    int       width;
+    uint32_t  next_row;  // rows must arrive in order
+    bool      in_order;
+    pthread_t decoder;
+    bool      other_thread;  // some row came from another thread than the decoder's
+} frame_t;
+
+static bool store_row(void* ctx, uint32_t y, const uint8_t* row) {
+    frame_t* frame = ctx;
+    if (y != frame->next_row) frame->in_order = false;
+    frame->next_row = y + 1;
+    if (!pthread_equal(pthread_self(), frame->decoder)) frame->other_thread = true;
+    memcpy(frame->pixels + (size_t)y * frame->width * 3, row, (size_t)frame->width * 3);  // PAX_BUF_24_888RGB
+    return true;
+}
+
+static bool decode(const char* path, bool pipelined, frame_t* frame, int height) {
+    FILE* fd = fopen(path, "rb");
+    if (fd == NULL) return false;
+    png_stream_set_pipelined(pipelined);
+    frame->next_row     = 0;
+    frame->in_order     = true;
+    frame->decoder      = pthread_self();
+    frame->other_thread = false;
+    memset(frame->pixels, pipelined ? 0x5A : 0xA5, (size_t)frame->width * 3 * height);
+    bool ok = png_stream_decode(fd, NULL, store_row, frame);
+    fclose(fd);
+    return ok && frame->in_order && frame->next_row == (uint32_t)height;
+}
+
+static int channels(uint8_t color_type) {
+    return color_type == 2 ? 3 : color_type == 4 ? 2 : color_type == 6 ? 4 : 1;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s DIR\nTest images are written to DIR.\n", argv[0]);
+        return 1;
+    }
+    if (!CONFIG_IMAGEWAG_PNG_PIPELINE) {
+        printf("Built without the PNG pipeline\n");
+        return 77;
+    }
+    sim_set_log_level(ESP_LOG_WARN);
+    png_stream_init();
+    mkdir(argv[1], 0755);
+
+    int failures = 0;
+    int images   = 0;
+    for (size_t f = 0; f < FORMAT_COUNT; f++) {
+        for (size_t w = 0; w < WIDTH_COUNT; w++, images++) {
+            const format_t* format    = &formats[f];
+            int             width     = widths[w];
+            size_t          row_bytes = ((size_t)width * channels(format->color_type) * format->bit_depth + 7) / 8;
+            row_bytes++;  // the filter type
+            // Twice what the pipeline takes, plus an odd few rows for a short last slot
+            int        height = (int)((2 * PIPELINE_MIN_BYTES + row_bytes - 1) / row_bytes) + 3;
+            test_png_t png    = {
+                .width      = width,
+                .height     = height,
+                .color_type = format->color_type,
+                .bit_depth  = format->bit_depth,
+                .filter     = images % 6 - 1,  // all five in turn, then each alone
+                .seed       = images,
+            };
+            char path[512];
+            snprintf(path, sizeof(path), "%s/%dx%d_%u_%u.png", argv[1], width, height, format->color_type,
+                     format->bit_depth);
+            if (!test_png_write(path, &png)) {
+                fprintf(stderr, "Failed to write %s\n", path);
+                return 1;
+            }
+
+            size_t      size     = (size_t)width * 3 * height;
+            frame_t     serial   = {.pixels = malloc(size), .width = width};
+            frame_t     pipeline = {.pixels = malloc(size), .width = width};
+            const char* problem  = NULL;
+            if (!decode(path, false, &serial, height)) {
+                problem = "serial decode failed";
+            } else if (!decode(path, true, &pipeline, height)) {
+                problem = "pipelined decode failed";
+            } else if (serial.other_thread || !pipeline.other_thread) {
+                problem = "pipeline not used as expected";
+            } else if (memcmp(serial.pixels, pipeline.pixels, size) != 0) {
+                problem = "frames differ";
+            }
+            if (problem != NULL) {
+                printf("%s: %s\n", path + strlen(argv[1]) + 1, problem);
+                failures++;
+            }
+            free(serial.pixels);
+            free(pipeline.pixels);
+        }
+    }
+    png_stream_set_pipelined(true);
+    printf("%d images decoded both ways, %d failures\n", images, failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include "power.h"
+#include "sim.h"
+
+// Busy and idle time of the power module against a stopped clock: holds and
+// releases, nested and not, with the clock advanced by known amounts in
+// between, must add up to exactly that much busy and idle time, the stretch
+// still running included.
+
+#define CLOCK_US 5000000
+
+static int failures = 0;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+static void check_times(int64_t busy_us, int64_t idle_us) {
+    int64_t busy, idle;
+    power_get_times(&busy, &idle);
+    printf("busy %" PRId64 " us, idle %" PRId64 " us\n", busy, idle);
+    CHECK(busy == busy_us);
+    CHECK(idle == idle_us);
+}
+
+int main(void) {
+    sim_set_log_level(ESP_LOG_WARN);
+    sim_clock_set(CLOCK_US);
+    check_times(0, 0);
+
+    // power_init leaves the calling task holding the power
+    power_init();
+    check_times(0, 0);
+    sim_clock_advance(1000);
+    check_times(1000, 0);
+    power_release();
+    sim_clock_advance(20000);
+    check_times(1000, 20000);
+
+    // Nested holds count once, until the last one is released
+    power_hold();
+    sim_clock_advance(300);
+    power_hold();
+    sim_clock_advance(400);
+    power_release();
+    sim_clock_advance(500);
+    check_times(2200, 20000);
+    power_release();
+    check_times(2200, 20000);
+
+    // A long idle stretch, then a short busy one, as in a slideshow
+    sim_clock_advance(15000000);
+    check_times(2200, 15020000);
+    power_hold();
+    sim_clock_advance(7);
+    power_release();
+    check_times(2207, 15020000);
+
+    // Nothing passes while the clock stands still
+    power_hold();
+    power_release();
+    check_times(2207, 15020000);
+
+    printf("%d failures\n", failures);
+    return failures > 0 ? 1 : 0;
+}
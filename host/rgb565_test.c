@@ -0,0 +1,132 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "image_scale.h"
+#include "pixel_format.h"
+#include "sim.h"
+
+// RGB888 rows scaled at their own size into an RGB565 frame, built with and
+// without CONFIG_IMAGEWAG_RGB565_DITHER: known pixels must come out as known
+// 16-bit values, and converting every level back to 8 bits must give the
+// source colour, to within one 565 step for each pixel without dithering and
+// to within one 8-bit level for the average of each 4x4 block with it.
+
+#if !CONFIG_IMAGEWAG_PIXEL_FORMAT_RGB565
+#error "Build with CONFIG_IMAGEWAG_PIXEL_FORMAT_RGB565"
+#endif
+
+// One 4x4 block per level, the width of the dither pattern
+#define BLOCK  4
+#define LEVELS 256
+#define WIDTH  (LEVELS * BLOCK)
+#define HEIGHT BLOCK
+
+static int failures = 0;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+// The source colour of block v, every channel a different level
+static void source_colour(int v, uint8_t rgb[3]) {
+    rgb[0] = (uint8_t)v;
+    rgb[1] = (uint8_t)(255 - v);
+    rgb[2] = (uint8_t)(v * 7);
+}
+
+// Colours in PAX_BUF_24_888RGB order
+static void fill_row(uint8_t* row) {
+    for (int x = 0; x < WIDTH; x++) {
+        uint8_t rgb[3];
+        source_colour(x / BLOCK, rgb);
+        row[x * 3 + 0] = rgb[2];
+        row[x * 3 + 1] = rgb[1];
+        row[x * 3 + 2] = rgb[0];
+    }
+}
+
+static uint16_t pixel_at(const pax_buf_t* frame, int x, int y) {
+    const uint16_t* pixels = pax_buf_get_pixels(frame);
+    return pixels[y * WIDTH + x];
+}
+
+// 8-bit levels of a 565 pixel, the nearest to each 5- or 6-bit level
+static void unpack(uint16_t pixel, double rgb[3]) {
+    rgb[0] = (pixel >> 11) * 255.0 / 31;
+    rgb[1] = ((pixel >> 5) & 63) * 255.0 / 63;
+    rgb[2] = (pixel & 31) * 255.0 / 31;
+}
+
+int main(void) {
+    sim_set_log_level(ESP_LOG_NONE);
+
+    pax_buf_t frame;
+    CHECK(pax_buf_init(&frame, NULL, WIDTH, HEIGHT, IMAGE_BUF_TYPE));
+    image_scaler_t* scaler = image_scaler_create(WIDTH, HEIGHT, &frame);
+    CHECK(scaler != NULL);
+    if (scaler == NULL) return 1;
+    uint8_t row[WIDTH * 3];
+    fill_row(row);
+    for (uint32_t y = 0; y < HEIGHT; y++) CHECK(image_scaler_row(scaler, y, row));
+    image_scaler_destroy(scaler);
+
+    // Full and empty channels are exact at every dither threshold
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < BLOCK; x++) {
+            CHECK(pixel_at(&frame, 0 * BLOCK + x, y) == 0x07E0);                // 0, 255, 0
+            CHECK((pixel_at(&frame, 255 * BLOCK + x, y) & 0xFFE0) == 0xF800);  // 255, 0, 249
+        }
+    }
+    // 200, 55, 120
+#if CONFIG_IMAGEWAG_RGB565_DITHER
+    // Rounded down at the first threshold, and up at the last
+    CHECK(pixel_at(&frame, 200 * BLOCK + 0, 0) == ((24 << 11) | (13 << 5) | 14));
+    CHECK(pixel_at(&frame, 200 * BLOCK + 0, 3) == ((25 << 11) | (14 << 5) | 15));
+#else
+    CHECK(pixel_at(&frame, 200 * BLOCK + 0, 0) == ((25 << 11) | (13 << 5) | 15));
+    CHECK(pixel_at(&frame, 200 * BLOCK + 0, 3) == ((25 << 11) | (13 << 5) | 15));
+#endif
+
+    double worst = 0;
+    for (int v = 0; v < LEVELS; v++) {
+        uint8_t source[3];
+        double  sum[3] = {0};
+        source_colour(v, source);
+        for (int y = 0; y < HEIGHT; y++) {
+            for (int x = 0; x < BLOCK; x++) {
+                double rgb[3];
+                unpack(pixel_at(&frame, v * BLOCK + x, y), rgb);
+                for (int c = 0; c < 3; c++) {
+                    sum[c] += rgb[c];
+#if !CONFIG_IMAGEWAG_RGB565_DITHER
+                    // Truncated, so less than one step away
+                    double step = c == 1 ? 255.0 / 63 : 255.0 / 31;
+                    CHECK(fabs(rgb[c] - source[c]) < step);
+#endif
+                }
+            }
+        }
+#if CONFIG_IMAGEWAG_RGB565_DITHER
+        for (int c = 0; c < 3; c++) {
+            double error = fabs(sum[c] / (BLOCK * BLOCK) - source[c]);
+            if (error > worst) worst = error;
+            // 16 thresholds round to a 16th of a step
+            CHECK(error <= 1.0);
+        }
+#endif
+    }
+#if CONFIG_IMAGEWAG_RGB565_DITHER
+    printf("largest error of a 4x4 average: %.2f levels\n", worst);
+#else
+    (void)worst;
+#endif
+    pax_buf_destroy(&frame);
+
+    printf("%d failures\n", failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "bsp/display.h"
+#include "bsp/input.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+// Hooks between the simulated platform and the benchmark driver
+
+// Highest log level printed, whatever the app asks for
+void sim_set_log_level(esp_log_level_t level);
+
+// Stop esp_timer_get_time at us, from then on it only moves with
+// sim_clock_advance. esp_timers fire when the clock reaches their time, and
+// both calls return once the callbacks of those that came due have run.
+// FreeRTOS delays and ticks keep running in real time.
+void sim_clock_set(int64_t us);
+void sim_clock_advance(int64_t us);
+
+// Block until a task is waiting on queue and the queue is empty, as is the
+// queue set it is in, i.e. the consumer has handled everything sent to it
+void sim_queue_wait_idle(QueueHandle_t queue);
+
+// Block until the task created with name is waiting for a notification and
+// has none pending, e.g. the image decoder once it has run out of work.
+// Returns at once if there is no such task.
+void sim_task_wait_idle(const char* name);
+
+// Send count items to queue at once, so its consumer finds them all waiting.
+// count must not exceed the queue's length.
+void sim_queue_send_all(QueueHandle_t queue, const void* items, size_t count);
+
+void sim_display_set_rotation(bsp_display_rotation_t rotation);
+
+// Make every blit take as long as pushing its bytes at this rate would, like
+// a slow panel link. 0, the default, blits instantly.
+void sim_display_set_rate(double megabytes_per_second);
+
+// Blits and bytes pushed to the panel since the last reset
+void sim_display_get_stats(size_t* blits, size_t* bytes);
+void sim_display_reset_stats(void);
+
+// Write the panel contents as a binary PPM
+bool sim_display_write_ppm(const char* path);
+
+// Keep NVS in path across runs. Without this, every run starts with empty NVS.
+void sim_nvs_set_path(const char* path);
+
+// Queue an input event as if a key had been pressed
+void sim_input_send(const bsp_input_event_t* event);
+
+#define SIM_INPUT_QUEUE_LENGTH 64
+
+// Queue count input events at once, like keys pressed while the app was
+// busy. Up to SIM_INPUT_QUEUE_LENGTH arrive together, more in groups of that.
+void sim_input_send_burst(const bsp_input_event_t* events, size_t count);
+
+// Wait until the app has started and created its input queue
+void sim_input_wait_ready(void);
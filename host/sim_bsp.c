@@ -0,0 +1,149 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bsp/device.h"
+#include "bsp/display.h"
+#include "bsp/input.h"
+#include "sim.h"
+
+// Badge hardware: an in-memory panel and an input queue fed by the script
+
+#define PANEL_WIDTH  800
+#define PANEL_HEIGHT 480
+
+// The panel takes the format the app requests: 24_888RGB, bytes B, G, R, or
+// 16_565RGB, native uint16_t
+static uint8_t                    panel[PANEL_WIDTH * PANEL_HEIGHT * 3];
+static bsp_display_color_format_t panel_format   = BSP_DISPLAY_COLOR_FORMAT_24_888RGB;
+static size_t                     panel_bpp      = 3;
+static bsp_display_rotation_t     panel_rotation = BSP_DISPLAY_ROTATION_0;
+static atomic_size_t              blit_count     = 0;  // read by the benchmark driver while the app blits
+static atomic_size_t              blit_bytes     = 0;
+static double                     panel_rate     = 0;  // MB/s a blit is limited to, 0 for instant
+
+static QueueHandle_t   input_queue = NULL;
+static pthread_mutex_t input_lock  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  input_ready = PTHREAD_COND_INITIALIZER;
+
+esp_err_t bsp_device_initialize(const bsp_configuration_t* configuration) {
+    if (configuration->display.requested_color_format == BSP_DISPLAY_COLOR_FORMAT_16_565RGB) {
+        panel_format = BSP_DISPLAY_COLOR_FORMAT_16_565RGB;
+        panel_bpp    = 2;
+    }
+    pthread_mutex_lock(&input_lock);
+    input_queue = xQueueCreate(SIM_INPUT_QUEUE_LENGTH, sizeof(bsp_input_event_t));
+    pthread_cond_broadcast(&input_ready);
+    pthread_mutex_unlock(&input_lock);
+    return input_queue != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void bsp_device_restart_to_launcher(void) {
+    fprintf(stderr, "App returned to the launcher\n");
+    exit(0);
+}
+
+esp_err_t bsp_display_get_parameters(size_t* h_res, size_t* v_res, bsp_display_color_format_t* color_format,
+                                     bsp_display_endianness_t* data_endian) {
+    *h_res        = PANEL_WIDTH;
+    *v_res        = PANEL_HEIGHT;
+    *color_format = panel_format;
+    *data_endian  = BSP_DISPLAY_ENDIAN_LITTLE;
+    return ESP_OK;
+}
+
+bsp_display_rotation_t bsp_display_get_default_rotation(void) {
+    return panel_rotation;
+}
+
+void sim_display_set_rotation(bsp_display_rotation_t rotation) {
+    panel_rotation = rotation;
+}
+
+esp_err_t bsp_display_blit(size_t x_start, size_t y_start, size_t x_end, size_t y_end, const void* buffer) {
+    if (x_start >= x_end || y_start >= y_end || x_end > PANEL_WIDTH || y_end > PANEL_HEIGHT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const uint8_t* src       = buffer;
+    size_t         row_bytes = (x_end - x_start) * panel_bpp;
+    for (size_t y = y_start; y < y_end; y++, src += row_bytes) {
+        memcpy(panel + (y * PANEL_WIDTH + x_start) * panel_bpp, src, row_bytes);
+    }
+    blit_count++;
+    blit_bytes += row_bytes * (y_end - y_start);
+    if (panel_rate > 0) {
+        // Take as long as a panel link of that speed would
+        double          seconds = row_bytes * (y_end - y_start) / (panel_rate * 1e6);
+        struct timespec ts      = {.tv_sec = (time_t)seconds, .tv_nsec = (long)((seconds - (time_t)seconds) * 1e9)};
+        nanosleep(&ts, NULL);
+    }
+    return ESP_OK;
+}
+
+void sim_display_set_rate(double megabytes_per_second) {
+    panel_rate = megabytes_per_second;
+}
+
+void sim_display_get_stats(size_t* blits, size_t* bytes) {
+    *blits = blit_count;
+    *bytes = blit_bytes;
+}
+
+void sim_display_reset_stats(void) {
+    blit_count = 0;
+    blit_bytes = 0;
+}
+
+bool sim_display_write_ppm(const char* path) {
+    FILE* fd = fopen(path, "wb");
+    if (fd == NULL) return false;
+    fprintf(fd, "P6\n%d %d\n255\n", PANEL_WIDTH, PANEL_HEIGHT);
+    uint8_t row[PANEL_WIDTH * 3];
+    bool    ok = true;
+    for (int y = 0; y < PANEL_HEIGHT && ok; y++) {
+        const uint8_t* src = panel + (size_t)y * PANEL_WIDTH * panel_bpp;
+        for (int x = 0; x < PANEL_WIDTH; x++) {
+            if (panel_bpp == 2) {
+                uint16_t pixel;
+                memcpy(&pixel, src + 2 * x, sizeof(pixel));
+                uint32_t r = pixel >> 11, g = (pixel >> 5) & 0x3F, b = pixel & 0x1F;
+                row[3 * x + 0] = (uint8_t)((r << 3) | (r >> 2));
+                row[3 * x + 1] = (uint8_t)((g << 2) | (g >> 4));
+                row[3 * x + 2] = (uint8_t)((b << 3) | (b >> 2));
+            } else {
+                row[3 * x + 0] = src[3 * x + 2];
+                row[3 * x + 1] = src[3 * x + 1];
+                row[3 * x + 2] = src[3 * x + 0];
+            }
+        }
+        ok = fwrite(row, 1, sizeof(row), fd) == sizeof(row);
+    }
+    return fclose(fd) == 0 && ok;
+}
+
+esp_err_t bsp_input_get_queue(QueueHandle_t* queue) {
+    *queue = input_queue;
+    return input_queue != NULL ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+void sim_input_wait_ready(void) {
+    pthread_mutex_lock(&input_lock);
+    while (input_queue == NULL) {
+        pthread_cond_wait(&input_ready, &input_lock);
+    }
+    pthread_mutex_unlock(&input_lock);
+    sim_queue_wait_idle(input_queue);
+}
+
+void sim_input_send(const bsp_input_event_t* event) {
+    xQueueSend(input_queue, event, portMAX_DELAY);
+}
+
+void sim_input_send_burst(const bsp_input_event_t* events, size_t count) {
+    for (size_t sent = 0; sent < count; sent += SIM_INPUT_QUEUE_LENGTH) {
+        size_t group = count - sent < SIM_INPUT_QUEUE_LENGTH ? count - sent : SIM_INPUT_QUEUE_LENGTH;
+        sim_queue_send_all(input_queue, events + sent, group);
+    }
+}
@@ -0,0 +1,457 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "driver/gpio.h"
+#include "driver/sdmmc_host.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_vfs_fat.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "sdmmc_cmd.h"
+#include "sim.h"
+
+// ESP-IDF services used by the app, mapped onto the host
+
+static esp_log_level_t max_log_level = ESP_LOG_INFO;
+static esp_log_level_t app_log_level = ESP_LOG_INFO;
+
+const char* esp_err_to_name(esp_err_t err) {
+    switch (err) {
+        case ESP_OK:                        return "ESP_OK";
+        case ESP_FAIL:                      return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:                return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:           return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:         return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_NOT_FOUND:             return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:         return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_NVS_NO_FREE_PAGES:     return "ESP_ERR_NVS_NO_FREE_PAGES";
+        case ESP_ERR_NVS_NOT_FOUND:         return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_TYPE_MISMATCH:     return "ESP_ERR_NVS_TYPE_MISMATCH";
+        case ESP_ERR_NVS_INVALID_LENGTH:    return "ESP_ERR_NVS_INVALID_LENGTH";
+        case ESP_ERR_NVS_NEW_VERSION_FOUND: return "ESP_ERR_NVS_NEW_VERSION_FOUND";
+        default:                            return "UNKNOWN_ERROR";
+    }
+}
+
+void sim_set_log_level(esp_log_level_t level) {
+    max_log_level = level;
+}
+
+void esp_log_level_set(const char* tag, esp_log_level_t level) {
+    (void)tag;
+    app_log_level = level;
+}
+
+void sim_log(esp_log_level_t level, const char* tag, const char* format, ...) {
+    if (level > max_log_level || level > app_log_level) return;
+
+    static const char letters[] = "?EWIDV";
+    va_list           args;
+    va_start(args, format);
+    flockfile(stderr);
+    fprintf(stderr, "%c (%" PRIu32 ") %s: ", letters[level], (uint32_t)xTaskGetTickCount(), tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    funlockfile(stderr);
+    va_end(args);
+}
+
+// Set by sim_clock_set, after which the clock only moves when told to
+static atomic_int_least64_t manual_clock_us = -1;
+
+struct esp_timer {
+    esp_timer_cb_t    callback;
+    void*             arg;
+    pthread_mutex_t   lock;
+    pthread_cond_t    changed;
+    int64_t           due_us;  // esp_timer_get_time when it fires, 0 if not started
+    bool              firing;  // in the callback
+    bool              deleted;
+    struct esp_timer* next;
+};
+
+// Every timer, so moving the stopped clock can fire the ones that came due
+static pthread_mutex_t   timers_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct esp_timer* timers      = NULL;
+
+// Wake every timer to look at the clock again, and wait for those that are
+// due to have run their callbacks. Callbacks must not create timers.
+static void fire_due_timers(void) {
+    int64_t now = manual_clock_us;
+    pthread_mutex_lock(&timers_lock);
+    for (struct esp_timer* timer = timers; timer != NULL; timer = timer->next) {
+        pthread_mutex_lock(&timer->lock);
+        pthread_cond_broadcast(&timer->changed);
+        while ((timer->due_us != 0 && timer->due_us <= now) || timer->firing) {
+            pthread_cond_wait(&timer->changed, &timer->lock);
+        }
+        pthread_mutex_unlock(&timer->lock);
+    }
+    pthread_mutex_unlock(&timers_lock);
+}
+
+void sim_clock_set(int64_t us) {
+    manual_clock_us = us;
+    fire_due_timers();
+}
+
+void sim_clock_advance(int64_t us) {
+    manual_clock_us += us;
+    fire_due_timers();
+}
+
+int64_t esp_timer_get_time(void) {
+    int64_t manual = manual_clock_us;
+    if (manual >= 0) return manual;
+    static struct timespec start;
+    struct timespec        now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (start.tv_sec == 0 && start.tv_nsec == 0) start = now;
+    return (int64_t)(now.tv_sec - start.tv_sec) * 1000000 + (now.tv_nsec - start.tv_nsec) / 1000;
+}
+
+static void* timer_thread(void* arg) {
+    struct esp_timer* timer = arg;
+    pthread_mutex_lock(&timer->lock);
+    while (!timer->deleted) {
+        int64_t wait_us = timer->due_us - esp_timer_get_time();
+        if (timer->due_us == 0) {
+            pthread_cond_wait(&timer->changed, &timer->lock);
+        } else if (wait_us > 0) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += wait_us / 1000000;
+            deadline.tv_nsec += (long)(wait_us % 1000000) * 1000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&timer->changed, &timer->lock, &deadline);
+        } else {
+            timer->due_us = 0;
+            timer->firing = true;
+            pthread_mutex_unlock(&timer->lock);
+            timer->callback(timer->arg);
+            pthread_mutex_lock(&timer->lock);
+            timer->firing = false;
+            pthread_cond_broadcast(&timer->changed);
+        }
+    }
+    pthread_mutex_unlock(&timer->lock);
+
+    pthread_mutex_lock(&timers_lock);
+    struct esp_timer** link = &timers;
+    while (*link != timer) link = &(*link)->next;
+    *link = timer->next;
+    pthread_mutex_unlock(&timers_lock);
+    pthread_mutex_destroy(&timer->lock);
+    pthread_cond_destroy(&timer->changed);
+    free(timer);
+    return NULL;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+    struct esp_timer* timer = calloc(1, sizeof(*timer));
+    if (timer == NULL) return ESP_ERR_NO_MEM;
+    timer->callback = args->callback;
+    timer->arg      = args->arg;
+    pthread_mutex_init(&timer->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timer->changed, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_mutex_lock(&timers_lock);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, timer_thread, timer) != 0) {
+        pthread_mutex_unlock(&timers_lock);
+        free(timer);
+        return ESP_ERR_NO_MEM;
+    }
+    timer->next = timers;
+    timers      = timer;
+    pthread_mutex_unlock(&timers_lock);
+    pthread_detach(thread);
+    *handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    pthread_mutex_lock(&timer->lock);
+    bool running = timer->due_us != 0;
+    if (!running) {
+        // Never 0, which means stopped
+        int64_t due   = esp_timer_get_time() + (int64_t)timeout_us;
+        timer->due_us = due != 0 ? due : 1;
+        pthread_cond_broadcast(&timer->changed);
+    }
+    pthread_mutex_unlock(&timer->lock);
+    return running ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    pthread_mutex_lock(&timer->lock);
+    bool running  = timer->due_us != 0;
+    timer->due_us = 0;
+    pthread_cond_broadcast(&timer->changed);
+    pthread_mutex_unlock(&timer->lock);
+    return running ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    pthread_mutex_lock(&timer->lock);
+    if (timer->due_us != 0) {
+        pthread_mutex_unlock(&timer->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->deleted = true;
+    pthread_cond_broadcast(&timer->changed);
+    pthread_mutex_unlock(&timer->lock);
+    return ESP_OK;
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+    (void)caps;
+    return malloc(size);
+}
+
+void* heap_caps_calloc(size_t count, size_t size, uint32_t caps) {
+    (void)caps;
+    return calloc(count, size);
+}
+
+void* heap_caps_realloc(void* ptr, size_t size, uint32_t caps) {
+    (void)caps;
+    return realloc(ptr, size);
+}
+
+void* heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps) {
+    (void)caps;
+    // aligned_alloc wants a multiple of the alignment
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+void heap_caps_free(void* ptr) {
+    free(ptr);
+}
+
+size_t heap_caps_get_total_size(uint32_t caps) {
+    (void)caps;
+    return 0;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    (void)caps;
+    return 0;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    (void)caps;
+    return 0;
+}
+
+// NVS: values kept as strings, integers in decimal, in memory and, with sim_nvs_set_path, loaded
+// from a text file at nvs_flash_init and written back on every commit. Each
+// line is namespace, key and value, separated by tabs.
+#define NVS_MAX_ENTRIES    32
+#define NVS_MAX_NAMESPACES 8
+#define NVS_KEY_LENGTH     16  // including the terminator, as on the device
+
+typedef struct {
+    char  space[NVS_KEY_LENGTH];
+    char  key[NVS_KEY_LENGTH];
+    char* value;
+} nvs_entry_t;
+
+static nvs_entry_t nvs_entries[NVS_MAX_ENTRIES];
+static size_t      nvs_count = 0;
+static char        nvs_spaces[NVS_MAX_NAMESPACES][NVS_KEY_LENGTH];
+static size_t      nvs_space_count = 0;
+static const char* nvs_path        = NULL;
+
+void sim_nvs_set_path(const char* path) {
+    nvs_path = path;
+}
+
+static nvs_entry_t* nvs_find(const char* space, const char* key) {
+    for (size_t i = 0; i < nvs_count; i++) {
+        if (strcmp(nvs_entries[i].space, space) == 0 && strcmp(nvs_entries[i].key, key) == 0) return &nvs_entries[i];
+    }
+    return NULL;
+}
+
+static esp_err_t nvs_store(const char* space, const char* key, const char* value) {
+    if (strlen(space) >= NVS_KEY_LENGTH || strlen(key) >= NVS_KEY_LENGTH) return ESP_ERR_INVALID_ARG;
+    nvs_entry_t* entry = nvs_find(space, key);
+    if (entry == NULL) {
+        if (nvs_count == NVS_MAX_ENTRIES) return ESP_ERR_NVS_NO_FREE_PAGES;
+        entry = &nvs_entries[nvs_count++];
+        strcpy(entry->space, space);
+        strcpy(entry->key, key);
+        entry->value = NULL;
+    }
+    char* copy = strdup(value);
+    if (copy == NULL) return ESP_ERR_NO_MEM;
+    free(entry->value);
+    entry->value = copy;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void) {
+    if (nvs_path == NULL) return ESP_OK;
+    FILE* fd = fopen(nvs_path, "r");
+    if (fd == NULL) return ESP_OK;
+    char line[1024];
+    while (fgets(line, sizeof(line), fd) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        char* key   = strchr(line, '\t');
+        char* value = key ? strchr(key + 1, '\t') : NULL;
+        if (value == NULL) continue;
+        *key++   = '\0';
+        *value++ = '\0';
+        nvs_store(line, key, value);
+    }
+    fclose(fd);
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    for (size_t i = 0; i < nvs_count; i++) free(nvs_entries[i].value);
+    nvs_count = 0;
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle) {
+    (void)open_mode;
+    if (strlen(name) >= NVS_KEY_LENGTH) return ESP_ERR_INVALID_ARG;
+    size_t i = 0;
+    while (i < nvs_space_count && strcmp(nvs_spaces[i], name) != 0) i++;
+    if (i == nvs_space_count) {
+        if (nvs_space_count == NVS_MAX_NAMESPACES) return ESP_ERR_NVS_NO_FREE_PAGES;
+        strcpy(nvs_spaces[nvs_space_count++], name);
+    }
+    *out_handle = (nvs_handle_t)(i + 1);
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    (void)handle;
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* out_value, size_t* length) {
+    if (handle == 0 || handle > nvs_space_count) return ESP_ERR_INVALID_ARG;
+    nvs_entry_t* entry = nvs_find(nvs_spaces[handle - 1], key);
+    if (entry == NULL) return ESP_ERR_NVS_NOT_FOUND;
+    size_t needed = strlen(entry->value) + 1;
+    if (out_value != NULL) {
+        if (*length < needed) return ESP_ERR_NVS_INVALID_LENGTH;
+        memcpy(out_value, entry->value, needed);
+    }
+    *length = needed;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value) {
+    if (handle == 0 || handle > nvs_space_count) return ESP_ERR_INVALID_ARG;
+    if (strchr(value, '\n') != NULL || strchr(value, '\t') != NULL) return ESP_ERR_INVALID_ARG;
+    return nvs_store(nvs_spaces[handle - 1], key, value);
+}
+
+static esp_err_t nvs_get_number(nvs_handle_t handle, const char* key, uint32_t max, uint32_t* out_value) {
+    char      text[16];
+    size_t    length = sizeof(text);
+    esp_err_t res    = nvs_get_str(handle, key, text, &length);
+    if (res != ESP_OK) return res;
+    char*              end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (*end != '\0' || value > max) return ESP_ERR_NVS_TYPE_MISMATCH;
+    *out_value = (uint32_t)value;
+    return ESP_OK;
+}
+
+static esp_err_t nvs_set_number(nvs_handle_t handle, const char* key, uint32_t value) {
+    char text[16];
+    snprintf(text, sizeof(text), "%" PRIu32, value);
+    return nvs_set_str(handle, key, text);
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char* key, uint8_t* out_value) {
+    uint32_t  value;
+    esp_err_t res = nvs_get_number(handle, key, UINT8_MAX, &value);
+    if (res == ESP_OK) *out_value = (uint8_t)value;
+    return res;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char* key, uint8_t value) {
+    return nvs_set_number(handle, key, value);
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char* key, uint32_t* out_value) {
+    return nvs_get_number(handle, key, UINT32_MAX, out_value);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char* key, uint32_t value) {
+    return nvs_set_number(handle, key, value);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    (void)handle;
+    if (nvs_path == NULL) return ESP_OK;
+    FILE* fd = fopen(nvs_path, "w");
+    if (fd == NULL) return ESP_FAIL;
+    for (size_t i = 0; i < nvs_count; i++) {
+        fprintf(fd, "%s\t%s\t%s\n", nvs_entries[i].space, nvs_entries[i].key, nvs_entries[i].value);
+    }
+    return fclose(fd) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t gpio_install_isr_service(int flags) {
+    (void)flags;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_initialize(int host, const spi_bus_config_t* config, int dma) {
+    (void)host;
+    (void)config;
+    (void)dma;
+    return ESP_OK;
+}
+
+static esp_err_t mount_directory(const char* mount_point, sdmmc_card_t** card) {
+    struct stat st;
+    *card = NULL;
+    return stat(mount_point, &st) == 0 && S_ISDIR(st.st_mode) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_vfs_fat_sdmmc_mount(const char* mount_point, const sdmmc_host_t* host, const void* slot_config,
+                                  const esp_vfs_fat_sdmmc_mount_config_t* config, sdmmc_card_t** card) {
+    (void)host;
+    (void)slot_config;
+    (void)config;
+    return mount_directory(mount_point, card);
+}
+
+esp_err_t esp_vfs_fat_sdspi_mount(const char* mount_point, const sdmmc_host_t* host,
+                                  const sdspi_device_config_t* slot_config,
+                                  const esp_vfs_fat_sdmmc_mount_config_t* config, sdmmc_card_t** card) {
+    (void)host;
+    (void)slot_config;
+    (void)config;
+    return mount_directory(mount_point, card);
+}
+
+void sdmmc_card_print_info(FILE* stream, const sdmmc_card_t* card) {
+    (void)card;
+    fprintf(stream, "Name: simulated card (host directory)\n");
+}
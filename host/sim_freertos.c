@@ -0,0 +1,348 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sim.h"
+
+// FreeRTOS on POSIX threads. Priorities and core affinity are ignored; the
+// host scheduler runs every task in parallel.
+
+struct sim_task {
+    TaskFunction_t   fn;
+    void*            arg;
+    char             name[16];
+    pthread_mutex_t  lock;
+    pthread_cond_t   notified;
+    uint32_t         notify_value;
+    bool             waiting;  // blocked in ulTaskNotifyTake
+    struct sim_task* next;     // in the list of named tasks
+    struct sim_task* next_deleted;
+};
+
+struct sim_queue {
+    pthread_mutex_t   lock;
+    pthread_cond_t    changed;
+    size_t            length;
+    size_t            item_size;
+    size_t            count;
+    size_t            head;
+    size_t            receivers;  // tasks blocked in xQueueReceive
+    uint8_t*          items;
+    struct sim_queue* set;  // queue set this queue is a member of
+};
+
+static __thread struct sim_task* current_task = NULL;
+
+static void init_cond(pthread_cond_t* cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static struct timespec now_monotonic(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts;
+}
+
+static struct timespec deadline_after(TickType_t ticks) {
+    struct timespec ts = now_monotonic();
+    ts.tv_sec += ticks / 1000;
+    ts.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+// Wait on cond until woken or the deadline passes. Returns false on timeout.
+static bool wait_until(pthread_cond_t* cond, pthread_mutex_t* lock, TickType_t timeout, const struct timespec* deadline) {
+    if (timeout == portMAX_DELAY) {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+static struct timespec start_time;
+static pthread_once_t  start_once = PTHREAD_ONCE_INIT;
+
+static void record_start_time(void) {
+    start_time = now_monotonic();
+}
+
+TickType_t xTaskGetTickCount(void) {
+    pthread_once(&start_once, record_start_time);
+    struct timespec now = now_monotonic();
+    return (TickType_t)((now.tv_sec - start_time.tv_sec) * 1000 + (now.tv_nsec - start_time.tv_nsec) / 1000000);
+}
+
+// Every task created through xTaskCreate, for sim_task_wait_idle
+static struct sim_task* tasks      = NULL;
+static pthread_mutex_t  tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct sim_task* new_task(TaskFunction_t fn, void* arg) {
+    struct sim_task* task = calloc(1, sizeof(*task));
+    if (task == NULL) return NULL;
+    task->fn  = fn;
+    task->arg = arg;
+    pthread_mutex_init(&task->lock, NULL);
+    init_cond(&task->notified);
+    return task;
+}
+
+static void* task_entry(void* arg) {
+    current_task = arg;
+    current_task->fn(current_task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack_depth, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    (void)stack_depth;
+    (void)priority;
+    (void)core;
+    struct sim_task* task = new_task(fn, arg);
+    pthread_t        thread;
+    if (task == NULL || pthread_create(&thread, NULL, task_entry, task) != 0) {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    snprintf(task->name, sizeof(task->name), "%s", name != NULL ? name : "");
+    pthread_mutex_lock(&tasks_lock);
+    task->next = tasks;
+    tasks      = task;
+    pthread_mutex_unlock(&tasks_lock);
+    if (handle != NULL) *handle = task;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stack_depth, void* arg, UBaseType_t priority,
+                       TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(fn, name, stack_depth, arg, priority, handle, tskNO_AFFINITY);
+}
+
+// Deleted tasks are kept rather than freed, since other tasks may still hold
+// their handles
+static struct sim_task* deleted_tasks = NULL;
+static pthread_mutex_t  deleted_lock  = PTHREAD_MUTEX_INITIALIZER;
+
+void vTaskDelete(TaskHandle_t task) {
+    // Only self-deletion is used
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    if (task != NULL && task != self) return;
+    pthread_mutex_lock(&deleted_lock);
+    self->next_deleted = deleted_tasks;
+    deleted_tasks      = self;
+    pthread_mutex_unlock(&deleted_lock);
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct timespec ts = {.tv_sec = ticks / 1000, .tv_nsec = (long)(ticks % 1000) * 1000000};
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    // Threads not created through xTaskCreate get a handle on first use
+    if (current_task == NULL) current_task = new_task(NULL, NULL);
+    return current_task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&task->lock);
+    task->notify_value++;
+    pthread_cond_broadcast(&task->notified);  // sim_task_wait_idle may be waiting too
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t timeout) {
+    struct sim_task* task     = xTaskGetCurrentTaskHandle();
+    struct timespec  deadline = deadline_after(timeout);
+    pthread_mutex_lock(&task->lock);
+    task->waiting = true;
+    pthread_cond_broadcast(&task->notified);
+    while (task->notify_value == 0 && wait_until(&task->notified, &task->lock, timeout, &deadline)) {
+    }
+    task->waiting = false;
+    uint32_t value = task->notify_value;
+    if (value > 0) task->notify_value = clear_on_exit ? 0 : value - 1;
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    struct sim_queue* queue = calloc(1, sizeof(*queue));
+    if (queue == NULL) return NULL;
+    queue->items = calloc(length, item_size > 0 ? item_size : 1);
+    if (queue->items == NULL) {
+        free(queue);
+        return NULL;
+    }
+    queue->length    = length;
+    queue->item_size = item_size;
+    pthread_mutex_init(&queue->lock, NULL);
+    init_cond(&queue->changed);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->changed);
+    free(queue->items);
+    free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t timeout) {
+    struct timespec deadline = deadline_after(timeout);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length) {
+        if (timeout == 0 || !wait_until(&queue->changed, &queue->lock, timeout, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+    }
+    size_t tail = (queue->head + queue->count) % queue->length;
+    if (item != NULL) memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+    queue->count++;
+    pthread_cond_broadcast(&queue->changed);
+    struct sim_queue* set = queue->set;
+    pthread_mutex_unlock(&queue->lock);
+    // The set is sized for every item its members can hold
+    if (set != NULL) xQueueSend(set, &queue, 0);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t timeout) {
+    struct timespec deadline = deadline_after(timeout);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        queue->receivers++;
+        pthread_cond_broadcast(&queue->changed);
+        bool woken = timeout != 0 && wait_until(&queue->changed, &queue->lock, timeout, &deadline);
+        queue->receivers--;
+        if (!woken && queue->count == 0) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+    }
+    if (item != NULL) memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t spaces = queue->length - queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return spaces;
+}
+
+QueueSetHandle_t xQueueCreateSet(UBaseType_t length) {
+    return xQueueCreate(length, sizeof(QueueSetMemberHandle_t));
+}
+
+BaseType_t xQueueAddToSet(QueueSetMemberHandle_t member, QueueSetHandle_t set) {
+    pthread_mutex_lock(&member->lock);
+    bool added = member->set == NULL && member->count == 0;
+    if (added) member->set = set;
+    pthread_cond_broadcast(&member->changed);
+    pthread_mutex_unlock(&member->lock);
+    return added ? pdPASS : pdFAIL;
+}
+
+QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t set, TickType_t timeout) {
+    QueueSetMemberHandle_t member;
+    return xQueueReceive(set, &member, timeout) == pdTRUE ? member : NULL;
+}
+
+void sim_queue_send_all(QueueHandle_t queue, const void* items, size_t count) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->length - queue->count < count) {
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+    for (size_t i = 0; i < count; i++) {
+        size_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->items + tail * queue->item_size, (const uint8_t*)items + i * queue->item_size,
+               queue->item_size);
+        queue->count++;
+    }
+    pthread_cond_broadcast(&queue->changed);
+    struct sim_queue* set = queue->set;
+    pthread_mutex_unlock(&queue->lock);
+    for (size_t i = 0; set != NULL && i < count; i++) xQueueSend(set, &queue, 0);
+}
+
+void sim_task_wait_idle(const char* name) {
+    struct sim_task* task = NULL;
+    pthread_mutex_lock(&tasks_lock);
+    for (task = tasks; task != NULL; task = task->next) {
+        if (strcmp(task->name, name) == 0) break;
+    }
+    pthread_mutex_unlock(&tasks_lock);
+    if (task == NULL) return;
+
+    pthread_mutex_lock(&task->lock);
+    while (!task->waiting || task->notify_value > 0) {
+        pthread_cond_wait(&task->notified, &task->lock);
+    }
+    pthread_mutex_unlock(&task->lock);
+}
+
+void sim_queue_wait_idle(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->set == NULL && (queue->count > 0 || queue->receivers == 0)) {
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+    struct sim_queue* set = queue->set;
+    pthread_mutex_unlock(&queue->lock);
+    if (set == NULL) return;
+
+    // The consumer of a set member blocks on the set instead, once it has
+    // handled whatever other member woke it too
+    pthread_mutex_lock(&set->lock);
+    while (uxQueueMessagesWaiting(queue) > 0 || set->count > 0 || set->receivers == 0) {
+        pthread_cond_wait(&set->changed, &set->lock);
+    }
+    pthread_mutex_unlock(&set->lock);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    SemaphoreHandle_t mutex = xQueueCreate(1, 0);
+    if (mutex != NULL) xSemaphoreGive(mutex);
+    return mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout) {
+    return xQueueReceive(semaphore, NULL, timeout);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    return xQueueSend(semaphore, NULL, 0);
+}
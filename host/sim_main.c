@@ -0,0 +1,397 @@
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bsp/input.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "image_file.h"
+#include "perf.h"
+#include "power.h"
+#include "sim.h"
+
+// Headless benchmark driver: runs the app against the simulated platform,
+// replays a key script and reports how long each key took to handle, from
+// the event being queued until the main loop is waiting for input again.
+// With --hold it keeps running afterwards, so an animated image left on
+// screen plays, and reports the frames shown and dropped and how late they
+// were; --panel-rate adds the load of a slow panel. With --burst the keys of
+// each replay are queued all at once, like keys pressed while the app is
+// busy, and --expect-images checks how many images that put on the panel.
+// --expect-decodes fails the run if the keys, and --hold, had more images
+// loaded into the image cache's frames than given, counted once the decoder
+// has finished the work they gave it: a burst loads the image it ends on and
+// the neighbours prefetched around it, not the images it passed.
+// --expect-bytes fails the run if any key pushed more bytes to the panel than
+// given, and --expect-hold-bytes if the time after the script did, e.g. the
+// menu bar hiding itself. --expect-frames, --expect-dropped and
+// --expect-late do the same for the animation played during --hold. With
+// --virtual-clock the hold runs on a stopped clock moved on 1 ms at a time,
+// each step once the app has handled the timers that came due, so what an
+// animation shows does not depend on how busy the host is.
+// Main loop wakeups and the time the app was busy, holding the power, are
+// counted throughout; an idle run, or a slideshow left to itself with --hold,
+// shows what the app costs when nobody uses it.
+
+void app_main(void);
+
+#define DEFAULT_SCRIPT ">>>>>>>><<<<rrrrff"
+
+typedef struct {
+    char        key;
+    const char* name;
+    uint32_t    count;
+    uint32_t*   latencies_us;
+    size_t      max_bytes;  // most bytes pushed to the panel by one press
+} op_stats_t;
+
+static op_stats_t ops[] = {
+    {.key = '>', .name = "next"},   {.key = '<', .name = "previous"}, {.key = 'r', .name = "random"},
+    {.key = 's', .name = "shuffle"}, {.key = 'f', .name = "flip"},     {.key = 't', .name = "timer"},
+    {.key = 'p', .name = "hud"},     {.key = 'v', .name = "album+"},   {.key = '^', .name = "album-"},
+    {.key = 'e', .name = "transition"},
+};
+#define OP_COUNT (sizeof(ops) / sizeof(ops[0]))
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --sd DIR        directory standing in for the SD card, images are read from DIR/images (default .)\n"
+            "  --script KEYS   keys to replay: > next, < previous, v next album, ^ previous album,\n"
+            "                  r random, s shuffle, f flip, t timer, e transition, p HUD\n"
+            "                  (default \"" DEFAULT_SCRIPT "\")\n"
+            "  --repeat N      replay the script N times (default 1)\n"
+            "  --settle MS     pause between keys so the decoder can prefetch (default 0)\n"
+            "  --rotation DEG  panel rotation: 0, 90, 180 or 270 (default 0)\n"
+            "  --frames DIR    write the panel to DIR/frame_NNNN.ppm after every key, and after --hold\n"
+            "  --hold MS       keep running MS after the script, e.g. to let an animation play (default 0)\n"
+            "  --virtual-clock  stop the clock after the script and step it through --hold, counting only\n"
+            "                  the frames played meanwhile: the same on any host, but never late\n"
+            "  --panel-rate R  limit blits to R MB/s like a slow panel link (default unlimited)\n"
+            "  --burst         queue the keys of each replay at once, up to 64 together, and time them as one\n"
+            "  --expect-images N  fail unless the keys put exactly N images on the panel\n"
+            "  --expect-decodes N  fail if the keys and --hold loaded more than N images into frames\n"
+            "  --expect-bytes N   fail if any key, or burst, pushed more than N bytes to the panel\n"
+            "  --expect-hold-bytes N  fail if more than N bytes were pushed during --hold\n"
+            "  --expect-frames N  fail unless at least N animation frames reached the panel\n"
+            "  --expect-dropped PCT  fail if more than PCT percent of the animation frames were dropped\n"
+            "  --expect-late MS   fail if the 99th percentile of how late animation frames were exceeds MS\n"
+            "  --nvs FILE      keep NVS, e.g. the last image viewed, in FILE between runs\n"
+            "  --verbose       show the app's log output\n",
+            argv0);
+}
+
+static op_stats_t* find_op(char key) {
+    for (size_t i = 0; i < OP_COUNT; i++) {
+        if (ops[i].key == key) return &ops[i];
+    }
+    return NULL;
+}
+
+static bsp_input_event_t event_for_key(char key) {
+    bsp_input_event_t event = {0};
+    if (key == '>' || key == '<' || key == 'v' || key == '^') {
+        event.type                  = INPUT_EVENT_TYPE_NAVIGATION;
+        event.args_navigation.key   = key == '>'   ? BSP_INPUT_NAVIGATION_KEY_RIGHT
+                                      : key == '<' ? BSP_INPUT_NAVIGATION_KEY_LEFT
+                                      : key == 'v' ? BSP_INPUT_NAVIGATION_KEY_DOWN
+                                                   : BSP_INPUT_NAVIGATION_KEY_UP;
+        event.args_navigation.state = true;
+    } else {
+        event.type                = INPUT_EVENT_TYPE_KEYBOARD;
+        event.args_keyboard.ascii = key;
+    }
+    return event;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void print_row(const char* name, uint32_t* values, uint32_t count, size_t max_bytes) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < count; i++) total += values[i];
+    qsort(values, count, sizeof(values[0]), compare_u32);
+    printf("%-10s %6" PRIu32 " %9.2f %9.2f %9.2f %9.2f %9.1f\n", name, count, values[0] / 1000.0,
+           total / 1000.0 / count, values[(count * 99 + 99) / 100 - 1] / 1000.0, values[count - 1] / 1000.0,
+           max_bytes / 1000.0);
+}
+
+static void app_task(void* arg) {
+    (void)arg;
+    app_main();
+    vTaskDelete(NULL);
+}
+
+int main(int argc, char** argv) {
+    const char* sd_dir     = ".";
+    const char* script     = DEFAULT_SCRIPT;
+    const char* frames_dir = NULL;
+    int         repeat     = 1;
+    int         settle_ms  = 0;
+    int         hold_ms    = 0;
+    bool        stepped    = false;
+    int         rotation   = 0;
+    bool        burst      = false;
+    int         expected   = -1;
+    long        max_loads  = -1;
+    long        max_bytes  = -1;
+    long        max_hold   = -1;
+    long        min_frames = -1;
+    double      max_drop   = -1;
+    double      max_late   = -1;
+
+    static const struct option options[] = {
+        {"sd", required_argument, NULL, 's'},       {"script", required_argument, NULL, 'k'},
+        {"repeat", required_argument, NULL, 'n'},   {"settle", required_argument, NULL, 'w'},
+        {"rotation", required_argument, NULL, 'r'}, {"frames", required_argument, NULL, 'f'},
+        {"nvs", required_argument, NULL, 'm'},      {"hold", required_argument, NULL, 'd'},
+        {"panel-rate", required_argument, NULL, 'p'}, {"verbose", no_argument, NULL, 'v'},
+        {"burst", no_argument, NULL, 'b'},          {"expect-images", required_argument, NULL, 'e'},
+        {"expect-decodes", required_argument, NULL, 'g'},
+        {"expect-bytes", required_argument, NULL, 'x'}, {"expect-hold-bytes", required_argument, NULL, 'y'},
+        {"expect-frames", required_argument, NULL, 'a'}, {"expect-dropped", required_argument, NULL, 'o'},
+        {"expect-late", required_argument, NULL, 'l'}, {"virtual-clock", no_argument, NULL, 'c'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    sim_set_log_level(ESP_LOG_WARN);
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+            case 's': sd_dir = optarg; break;
+            case 'k': script = optarg; break;
+            case 'n': repeat = atoi(optarg); break;
+            case 'w': settle_ms = atoi(optarg); break;
+            case 'r': rotation = atoi(optarg); break;
+            case 'f': frames_dir = optarg; break;
+            case 'm': sim_nvs_set_path(optarg); break;
+            case 'd': hold_ms = atoi(optarg); break;
+            case 'c': stepped = true; break;
+            case 'p': sim_display_set_rate(atof(optarg)); break;
+            case 'v': sim_set_log_level(ESP_LOG_VERBOSE); break;
+            case 'b': burst = true; break;
+            case 'e': expected = atoi(optarg); break;
+            case 'g': max_loads = atol(optarg); break;
+            case 'x': max_bytes = atol(optarg); break;
+            case 'y': max_hold = atol(optarg); break;
+            case 'a': min_frames = atol(optarg); break;
+            case 'o': max_drop = atof(optarg); break;
+            case 'l': max_late = atof(optarg); break;
+            default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (rotation % 90 != 0 || rotation < 0 || rotation > 270 || repeat < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    for (const char* k = script; *k; k++) {
+        if (find_op(*k) == NULL) {
+            fprintf(stderr, "Unknown key '%c' in script\n", *k);
+            return 1;
+        }
+    }
+    // The app's SD mount point is "." in this build
+    if (chdir(sd_dir) != 0) {
+        perror(sd_dir);
+        return 1;
+    }
+
+    size_t steps = strlen(script) * repeat;
+    for (size_t i = 0; i < OP_COUNT; i++) {
+        ops[i].latencies_us = calloc(steps, sizeof(uint32_t));
+    }
+    uint32_t*          all_us = calloc(steps, sizeof(uint32_t));
+    bsp_input_event_t* events = calloc(strlen(script) + 1, sizeof(bsp_input_event_t));
+
+    sim_display_set_rotation((bsp_display_rotation_t)(rotation / 90));
+    int64_t start = esp_timer_get_time();
+    xTaskCreate(app_task, "main", 8192, NULL, 1, NULL);
+    // The input queue exists before the images are listed, keys only work after that
+    while (perf_milestone_us(PERF_LISTING_READY) < 0) vTaskDelay(1);
+    sim_input_wait_ready();
+    int64_t startup_us = esp_timer_get_time() - start;
+    sim_display_reset_stats();
+
+    QueueHandle_t queue;
+    bsp_input_get_queue(&queue);
+    if (max_loads >= 0) {
+        // Prefetching around the startup image is not the keys' doing
+        sim_queue_wait_idle(queue);
+        sim_task_wait_idle("decoder");
+    }
+    int64_t busy_before, idle_before;
+    power_get_times(&busy_before, &idle_before);
+    image_file_stats_t sd_before;
+    image_file_get_stats(&sd_before);
+    uint32_t shown_before      = perf_counter(PERF_FRAMES_SHOWN);
+    uint32_t dropped_before    = perf_counter(PERF_FRAMES_DROPPED);
+    uint32_t transition_before = perf_counter(PERF_TRANSITION_FRAMES);
+    uint32_t images_before     = perf_counter(PERF_IMAGES_SHOWN);
+    uint32_t loaded_before     = perf_counter(PERF_IMAGES_LOADED);
+    uint32_t wakeups_before    = perf_counter(PERF_WAKEUPS);
+    int64_t  run_start         = esp_timer_get_time();
+    size_t   step_bytes_max    = 0;
+    // A burst is one step of strlen(script) keys
+    size_t   keys_per_step     = burst ? strlen(script) : 1;
+    size_t   timed             = burst ? (size_t)repeat : steps;
+    for (size_t step = 0; step < timed; step++) {
+        for (size_t k = 0; k < keys_per_step; k++) {
+            events[k] = event_for_key(script[(step * keys_per_step + k) % strlen(script)]);
+        }
+        size_t blits_before, bytes_before;
+        sim_display_get_stats(&blits_before, &bytes_before);
+        int64_t t0 = esp_timer_get_time();
+        sim_input_send_burst(events, keys_per_step);
+        sim_queue_wait_idle(queue);
+        uint32_t elapsed = (uint32_t)(esp_timer_get_time() - t0);
+        size_t   step_bytes, blits_after;
+        sim_display_get_stats(&blits_after, &step_bytes);
+        step_bytes -= bytes_before;
+        if (step_bytes > step_bytes_max) step_bytes_max = step_bytes;
+        if (!burst) {
+            op_stats_t* op                = find_op(script[step % strlen(script)]);
+            op->latencies_us[op->count++] = elapsed;
+            if (step_bytes > op->max_bytes) op->max_bytes = step_bytes;
+        }
+        all_us[step] = elapsed;
+
+        if (frames_dir != NULL) {
+            char path[512];
+            snprintf(path, sizeof(path), "%s/frame_%04zu.ppm", frames_dir, step + 1);
+            if (!sim_display_write_ppm(path)) fprintf(stderr, "Failed to write %s\n", path);
+        }
+        if (settle_ms > 0) vTaskDelay(pdMS_TO_TICKS(settle_ms));
+    }
+    double run_s = (esp_timer_get_time() - run_start) / 1e6;
+    size_t blits, bytes;
+    sim_display_get_stats(&blits, &bytes);
+    size_t hold_bytes = bytes;
+    if (hold_ms > 0 && stepped) {
+        // Frames that came due before the clock stopped are played first and not counted
+        sim_clock_set(esp_timer_get_time());
+        sim_queue_wait_idle(queue);
+        shown_before   = perf_counter(PERF_FRAMES_SHOWN);
+        dropped_before = perf_counter(PERF_FRAMES_DROPPED);
+        for (int ms = 0; ms < hold_ms; ms++) {
+            sim_clock_advance(1000);
+            sim_queue_wait_idle(queue);
+        }
+    } else if (hold_ms > 0) {
+        vTaskDelay(pdMS_TO_TICKS(hold_ms));
+    }
+    if (hold_ms > 0) {
+        if (frames_dir != NULL) {
+            char path[512];
+            snprintf(path, sizeof(path), "%s/frame_%04zu.ppm", frames_dir, timed + 1);
+            if (!sim_display_write_ppm(path)) fprintf(stderr, "Failed to write %s\n", path);
+        }
+    }
+    if (max_loads >= 0) {
+        sim_queue_wait_idle(queue);
+        sim_task_wait_idle("decoder");
+    }
+    double   total_s           = (esp_timer_get_time() - run_start) / 1e6;
+    uint32_t shown             = perf_counter(PERF_FRAMES_SHOWN) - shown_before;
+    uint32_t dropped           = perf_counter(PERF_FRAMES_DROPPED) - dropped_before;
+    uint32_t transition_frames = perf_counter(PERF_TRANSITION_FRAMES) - transition_before;
+    uint32_t images            = perf_counter(PERF_IMAGES_SHOWN) - images_before;
+    uint32_t loaded            = perf_counter(PERF_IMAGES_LOADED) - loaded_before;
+    uint32_t wakeups           = perf_counter(PERF_WAKEUPS) - wakeups_before;
+    int64_t  busy_us, idle_us;
+    power_get_times(&busy_us, &idle_us);
+    busy_us -= busy_before;
+    idle_us -= idle_before;
+    image_file_stats_t sd;
+    image_file_get_stats(&sd);
+    sd.opened  -= sd_before.opened;
+    sd.hits    -= sd_before.hits;
+    sd.bytes   -= sd_before.bytes;
+    sd.read_us -= sd_before.read_us;
+
+    sim_display_get_stats(&blits, &bytes);
+    hold_bytes = bytes - hold_bytes;
+    printf("startup        %9.2f ms\n", startup_us / 1000.0);
+    for (int m = 0; m < PERF_MILESTONE_COUNT; m++) {
+        printf("%-14s %9.2f ms\n", perf_milestone_name(m), perf_milestone_us(m) / 1000.0);
+    }
+    printf("\n");
+    printf("%-10s %6s %9s %9s %9s %9s %9s\n", "key", "count", "min_ms", "avg_ms", "p99_ms", "max_ms", "max_kB");
+    for (size_t i = 0; i < OP_COUNT; i++) {
+        if (ops[i].count > 0) print_row(ops[i].name, ops[i].latencies_us, ops[i].count, ops[i].max_bytes);
+    }
+    if (timed > 0) print_row(burst ? "burst" : "all", all_us, timed, step_bytes_max);
+    printf("\n%zu keys in %.2f s: %.1f keys/s, %" PRIu32 " images shown, %zu blits, %.1f MB pushed to the panel\n",
+           steps, run_s, steps / run_s, images, blits, bytes / 1e6);
+    printf("decoder: %" PRIu32 " images loaded into frames\n", loaded);
+    printf("main loop: %" PRIu32 " wakeups in %.2f s, %.1f per minute\n", wakeups, total_s, wakeups * 60 / total_s);
+    printf("power: busy %.3f s, idle %.3f s (%.1f%% idle)\n", busy_us / 1e6, idle_us / 1e6,
+           100.0 * idle_us / (busy_us + idle_us));
+    if (sd.opened > 0) {
+        printf("sd: %" PRIu32 " of %" PRIu32 " files opened from read-ahead, read ahead at %.1f MB/s\n", sd.hits,
+               sd.opened, sd.read_us > 0 ? sd.bytes / (double)sd.read_us : 0.0);
+    }
+    if (hold_ms > 0) printf("hold: %zu bytes pushed to the panel\n", hold_bytes);
+    if (shown + dropped > 0) {
+        printf("animation: %" PRIu32 " frames shown, %" PRIu32 " dropped (%.1f%%) in %.2f s: %.1f frames/s\n", shown,
+               dropped, 100.0 * dropped / (shown + dropped), total_s, shown / total_s);
+    }
+    perf_stats_t late;
+    perf_get_stats(PERF_FRAME_LATE, &late);
+    if (transition_frames > 0) {
+        perf_stats_t stats;
+        perf_get_stats(PERF_TRANSITION, &stats);
+        printf("transitions: %" PRIu32 " frames, %.2f ms to render and push each: up to %.1f frames/s\n",
+               transition_frames, stats.avg_us / 1000.0, 1e6 / stats.avg_us);
+    }
+    printf("\n");
+
+    printf("%-10s %6s %9s %9s %9s %9s\n", "probe", "count", "min_ms", "avg_ms", "p99_ms", "max_ms");
+    for (int p = 0; p < PERF_PROBE_COUNT; p++) {
+        perf_stats_t stats;
+        perf_get_stats(p, &stats);
+        if (stats.count == 0) continue;
+        printf("%-10s %6" PRIu32 " %9.2f %9.2f %9.2f %9.2f\n", perf_probe_name(p), stats.count, stats.min_us / 1000.0,
+               stats.avg_us / 1000.0, stats.p99_us / 1000.0, stats.max_us / 1000.0);
+    }
+    free(all_us);
+    free(events);
+    if (expected >= 0 && images != (uint32_t)expected) {
+        fprintf(stderr, "Expected %d images shown, got %" PRIu32 "\n", expected, images);
+        exit(1);
+    }
+    if (max_loads >= 0 && loaded > (uint32_t)max_loads) {
+        fprintf(stderr, "Expected at most %ld images loaded into frames, got %" PRIu32 "\n", max_loads, loaded);
+        exit(1);
+    }
+    if (max_bytes >= 0 && step_bytes_max > (size_t)max_bytes) {
+        fprintf(stderr, "Expected at most %ld bytes pushed per key, got %zu\n", max_bytes, step_bytes_max);
+        exit(1);
+    }
+    if (max_hold >= 0 && hold_bytes > (size_t)max_hold) {
+        fprintf(stderr, "Expected at most %ld bytes pushed during --hold, got %zu\n", max_hold, hold_bytes);
+        exit(1);
+    }
+    if (min_frames >= 0 && shown < (uint32_t)min_frames) {
+        fprintf(stderr, "Expected at least %ld animation frames shown, got %" PRIu32 "\n", min_frames, shown);
+        exit(1);
+    }
+    double dropped_pct = shown + dropped > 0 ? 100.0 * dropped / (shown + dropped) : 0;
+    if (max_drop >= 0 && dropped_pct > max_drop) {
+        fprintf(stderr, "Expected at most %.1f%% of animation frames dropped, got %.1f%%\n", max_drop, dropped_pct);
+        exit(1);
+    }
+    if (max_late >= 0 && late.p99_us > max_late * 1000) {
+        fprintf(stderr, "Expected animation frames at most %.1f ms late (p99), got %.2f ms\n", max_late,
+                late.p99_us / 1000.0);
+        exit(1);
+    }
+    // The app task never returns
+    exit(0);
+}
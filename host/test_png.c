@@ -0,0 +1,223 @@
+#include "test_png.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Image data is split over chunks of this size, so decoders cross chunk
+// boundaries in the middle of rows and of stored blocks
+#define CHUNK_DATA 8192
+#define STORED_MAX 65535
+
+static uint32_t crc_table[256];
+
+static void init_crc_table(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+}
+
+static uint32_t crc_update(uint32_t crc, const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+static void put_u32(uint8_t* out, uint32_t value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static bool write_chunk(FILE* fd, const char* type, const uint8_t* data, size_t length) {
+    uint8_t header[8];
+    put_u32(header, length);
+    memcpy(header + 4, type, 4);
+    uint32_t crc = crc_update(0xffffffffu, header + 4, 4);
+    crc          = crc_update(crc, data, length) ^ 0xffffffffu;
+    uint8_t trailer[4];
+    put_u32(trailer, crc);
+    return fwrite(header, 1, 8, fd) == 8 && (length == 0 || fwrite(data, 1, length, fd) == length) &&
+           fwrite(trailer, 1, 4, fd) == 4;
+}
+
+static int channels(uint8_t color_type) {
+    switch (color_type) {
+        case 2:  return 3;
+        case 4:  return 2;
+        case 6:  return 4;
+        default: return 1;
+    }
+}
+
+static uint32_t hash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Smooth gradients with noise in 8x8 blocks, so the filters have something to
+// predict and the frames of an animation differ
+static uint8_t sample(const test_png_t* png, int frame, int y, size_t i) {
+    uint32_t noise = hash(png->seed ^ hash((uint32_t)frame << 24 ^ (uint32_t)(y >> 3) << 12 ^ (uint32_t)(i >> 3)));
+    return (uint8_t)(i * 3 + y * 5 + frame * 40) ^ (noise & 0x1f);
+}
+
+static uint8_t paeth(int a, int b, int c) {
+    int p  = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+static void filter_row(uint8_t* out, const uint8_t* row, const uint8_t* prior, size_t length, size_t bpp, int type) {
+    out[0] = type;
+    for (size_t i = 0; i < length; i++) {
+        int a = i >= bpp ? row[i - bpp] : 0;
+        int b = prior[i];
+        int c = i >= bpp ? prior[i - bpp] : 0;
+        int p = 0;
+        switch (type) {
+            case 1: p = a; break;
+            case 2: p = b; break;
+            case 3: p = (a + b) / 2; break;
+            case 4: p = paeth(a, b, c); break;
+        }
+        out[1 + i] = row[i] - p;
+    }
+}
+
+// One frame as a zlib stream of stored blocks
+static uint8_t* frame_stream(const test_png_t* png, int frame, size_t* stream_length) {
+    size_t   row_bytes = ((size_t)png->width * channels(png->color_type) * png->bit_depth + 7) / 8;
+    size_t   bpp       = (channels(png->color_type) * png->bit_depth + 7) / 8;
+    size_t   raw_size  = (row_bytes + 1) * png->height;
+    size_t   blocks    = raw_size / STORED_MAX + 1;
+    uint8_t* raw       = malloc(raw_size);
+    uint8_t* rows      = calloc(2, row_bytes);
+    uint8_t* stream    = malloc(2 + raw_size + blocks * 5 + 4);
+    if (raw == NULL || rows == NULL || stream == NULL) {
+        free(raw);
+        free(rows);
+        free(stream);
+        return NULL;
+    }
+    for (int y = 0; y < png->height; y++) {
+        uint8_t* row   = rows + (y & 1) * row_bytes;
+        uint8_t* prior = rows + (~y & 1) * row_bytes;
+        if (y == 0) memset(prior, 0, row_bytes);
+        for (size_t i = 0; i < row_bytes; i++) row[i] = sample(png, frame, y, i);
+        int type = png->filter >= 0 ? png->filter : y % 5;
+        filter_row(raw + y * (row_bytes + 1), row, prior, row_bytes, bpp, type);
+    }
+    free(rows);
+
+    size_t length    = 0;
+    stream[length++] = 0x78;
+    stream[length++] = 0x01;
+    uint32_t s1 = 1, s2 = 0;
+    for (size_t offset = 0; offset < raw_size;) {
+        size_t block     = raw_size - offset < STORED_MAX ? raw_size - offset : STORED_MAX;
+        stream[length++] = offset + block == raw_size;
+        stream[length++] = block;
+        stream[length++] = block >> 8;
+        stream[length++] = ~block;
+        stream[length++] = ~block >> 8;
+        memcpy(stream + length, raw + offset, block);
+        length += block;
+        for (size_t i = 0; i < block; i++) {
+            s1 = (s1 + raw[offset + i]) % 65521;
+            s2 = (s2 + s1) % 65521;
+        }
+        offset += block;
+    }
+    put_u32(stream + length, s2 << 16 | s1);
+    length += 4;
+    free(raw);
+    *stream_length = length;
+    return stream;
+}
+
+// The signature, IHDR and PLTE chunks
+static bool write_start(FILE* fd, const test_png_t* png) {
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    bool                 ok           = fwrite(signature, 1, 8, fd) == 8;
+
+    uint8_t ihdr[13] = {0};
+    put_u32(ihdr, png->width);
+    put_u32(ihdr + 4, png->height);
+    ihdr[8] = png->bit_depth;
+    ihdr[9] = png->color_type;
+    ok      = ok && write_chunk(fd, "IHDR", ihdr, sizeof(ihdr));
+
+    if (png->color_type == 3) {
+        int     entries = 1 << png->bit_depth;
+        uint8_t palette[256 * 3];
+        for (int i = 0; i < entries * 3; i++) palette[i] = hash(png->seed + i);
+        ok = ok && write_chunk(fd, "PLTE", palette, entries * 3);
+    }
+    return ok;
+}
+
+bool test_png_write(const char* path, const test_png_t* png) {
+    if (crc_table[1] == 0) init_crc_table();
+    FILE* fd = fopen(path, "wb");
+    if (fd == NULL) return false;
+    bool ok = write_start(fd, png);
+
+    int      frames   = png->frames > 1 ? png->frames : 1;
+    uint32_t sequence = 0;
+    if (frames > 1) {
+        uint8_t actl[8];
+        put_u32(actl, frames);
+        put_u32(actl + 4, 0);
+        ok = ok && write_chunk(fd, "acTL", actl, sizeof(actl));
+    }
+    for (int frame = 0; ok && frame < frames; frame++) {
+        if (frames > 1) {
+            uint8_t fctl[26] = {0};
+            put_u32(fctl, sequence++);
+            put_u32(fctl + 4, png->width);
+            put_u32(fctl + 8, png->height);
+            fctl[20] = png->delay_ms >> 8;
+            fctl[21] = png->delay_ms;
+            fctl[22] = 1000 >> 8;
+            fctl[23] = 1000 & 0xff;
+            ok       = write_chunk(fd, "fcTL", fctl, sizeof(fctl));
+        }
+        size_t   length;
+        uint8_t* stream = frame_stream(png, frame, &length);
+        if (stream == NULL) {
+            ok = false;
+            break;
+        }
+        uint8_t chunk[4 + CHUNK_DATA];
+        for (size_t offset = 0; ok && offset < length; offset += CHUNK_DATA) {
+            size_t part = length - offset < CHUNK_DATA ? length - offset : CHUNK_DATA;
+            if (frame == 0) {
+                ok = write_chunk(fd, "IDAT", stream + offset, part);
+            } else {
+                put_u32(chunk, sequence++);
+                memcpy(chunk + 4, stream + offset, part);
+                ok = write_chunk(fd, "fdAT", chunk, 4 + part);
+            }
+        }
+        free(stream);
+    }
+    ok = ok && write_chunk(fd, "IEND", NULL, 0);
+    return fclose(fd) == 0 && ok;
+}
+
+bool test_png_write_stream(const char* path, const test_png_t* png, const uint8_t* stream, size_t length) {
+    if (crc_table[1] == 0) init_crc_table();
+    FILE* fd = fopen(path, "wb");
+    if (fd == NULL) return false;
+    bool ok = write_start(fd, png) && write_chunk(fd, "IDAT", stream, length) && write_chunk(fd, "IEND", NULL, 0);
+    return fclose(fd) == 0 && ok;
+}
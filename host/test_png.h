@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Synthetic PNGs for the host tests, written without any library: the image
+// data is deflated into stored blocks, so every file is as large as its raw
+// scanlines but exercises the decoders' chunk, filter and pixel format paths
+// like any other PNG. The pixels are a deterministic function of the seed.
+
+typedef struct {
+    int      width;
+    int      height;
+    uint8_t  color_type;  // 0 grey, 2 RGB, 3 palette, 4 grey and alpha, 6 RGBA
+    uint8_t  bit_depth;   // any depth the colour type allows
+    int      filter;      // filter type for every row, or -1 to use all five in turn
+    int      frames;      // more than one writes an APNG
+    uint16_t delay_ms;    // per frame of an APNG
+    uint32_t seed;
+} test_png_t;
+
+// Write png to path. Returns false on failure.
+bool test_png_write(const char* path, const test_png_t* png);
+
+// Write png to path with stream, a zlib stream of any content, as its image
+// data, for files the decoders must reject. Only the header fields are used.
+bool test_png_write_stream(const char* path, const test_png_t* png, const uint8_t* stream, size_t length);
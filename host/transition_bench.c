@@ -0,0 +1,112 @@
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_timer.h"
+#include "pixel_format.h"
+#include "transition.h"
+
+// Frame rate benchmark for the image transitions: renders each one between
+// two frames step by step, the way the app does, and reports how many frames
+// per second the rendering alone allows. With --panel-rate the time to push
+// the changed rows over a panel link of that speed is added, which is what
+// decides the rate on a device.
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --frame WxH     frame size (default 800x480)\n"
+            "  --steps N       frames per transition (default 30)\n"
+            "  --repeat N      transitions of each kind (default 10)\n"
+            "  --panel-rate R  add the time to push changed rows at R MB/s (default 0, rendering only)\n",
+            argv0);
+}
+
+// Two different, busy images, so nothing the kernels do is free
+static void fill_frames(uint8_t* a, uint8_t* b, size_t bytes) {
+    uint32_t state = 12345;
+    for (size_t i = 0; i < bytes; i++) {
+        state = state * 1103515245 + 12345;
+        a[i]  = (uint8_t)(state >> 16);
+        b[i]  = (uint8_t)(i * 7);
+    }
+}
+
+int main(int argc, char** argv) {
+    static const struct option options[] = {
+        {"frame", required_argument, NULL, 'f'},      {"steps", required_argument, NULL, 's'},
+        {"repeat", required_argument, NULL, 'n'},     {"panel-rate", required_argument, NULL, 'p'},
+        {"help", no_argument, NULL, 'h'},             {NULL, 0, NULL, 0},
+    };
+    uint32_t width      = 800;
+    uint32_t height     = 480;
+    int      steps      = 30;
+    int      repeat     = 10;
+    double   panel_rate = 0;
+    int      option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'f':
+                if (sscanf(optarg, "%" SCNu32 "x%" SCNu32, &width, &height) != 2 || width == 0 || height == 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 's': steps = atoi(optarg); break;
+            case 'n': repeat = atoi(optarg); break;
+            case 'p': panel_rate = atof(optarg); break;
+            default:  usage(argv[0]); return option == 'h' ? 0 : 1;
+        }
+    }
+    if (steps < 1 || repeat < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    size_t   row_bytes = (size_t)width * IMAGE_BYTES_PER_PIXEL;
+    size_t   bytes     = row_bytes * height;
+    uint8_t* from      = malloc(bytes);
+    uint8_t* to        = malloc(bytes);
+    uint8_t* dst       = malloc(bytes);
+    if (from == NULL || to == NULL || dst == NULL) {
+        fprintf(stderr, "Failed to allocate %" PRIu32 "x%" PRIu32 " frames\n", width, height);
+        return 1;
+    }
+    fill_frames(from, to, bytes);
+
+    printf("%" PRIu32 "x%" PRIu32 " %s frames, %d steps per transition, %d of each\n\n", width, height,
+           IMAGE_BYTES_PER_PIXEL == 2 ? "RGB565" : "RGB888", steps, repeat);
+    printf("%-10s %7s %9s %9s %9s %9s\n", "transition", "frames", "avg_ms", "rows", "MB/s", "fps");
+    for (int type = TRANSITION_CUT + 1; type < TRANSITION_COUNT; type++) {
+        uint32_t frames = 0;
+        uint64_t rows   = 0;
+        int64_t  total  = 0;
+        for (int run = 0; run < repeat; run++) {
+            // Alternate directions like paging back and forth
+            int      direction = run % 2 == 0 ? 1 : -1;
+            uint32_t previous  = 0;
+            for (int step = 1; step <= steps; step++) {
+                uint32_t progress = (uint32_t)((uint64_t)step * TRANSITION_END / steps);
+                uint32_t top, bottom;
+                int64_t  start   = esp_timer_get_time();
+                bool     changed = transition_render(type, direction, dst, from, to, width, height, previous,
+                                                     progress, &top, &bottom);
+                total += esp_timer_get_time() - start;
+                if (!changed) continue;
+                previous = progress;
+                frames++;
+                rows += bottom - top;
+            }
+        }
+        double avg_us     = frames > 0 ? (double)total / frames : 0;
+        double avg_rows   = frames > 0 ? (double)rows / frames : 0;
+        double push_us    = panel_rate > 0 ? avg_rows * row_bytes / panel_rate : 0;
+        double throughput = total > 0 ? rows * row_bytes / (double)total : 0;
+        printf("%-10s %7" PRIu32 " %9.3f %9.1f %9.1f %9.1f\n", transition_name(type), frames, avg_us / 1000, avg_rows,
+               throughput, 1e6 / (avg_us + push_us));
+    }
+    free(from);
+    free(to);
+    free(dst);
+    return 0;
+}
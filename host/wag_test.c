@@ -0,0 +1,174 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "codec.h"
+#include "pax_codecs.h"
+#include "sim.h"
+#include "test_png.h"
+#include "wag.h"
+
+// Round trip of the .wag sidecars: PNGs of the panel's size in the opaque
+// colour types are turned into sidecars by the app (decode, wag_write) and by
+// tools/png2wag.py, and both are read back with wag_read and compared pixel
+// for pixel with the PNG decoded by pax-codecs. --reference stream compares
+// with the app's own decoder instead, for pax-codecs builds that cannot
+// decode. Exits 77, which ctest reports as skipped, if the reference decoder
+// fails on every image.
+
+#define WIDTH  800
+#define HEIGHT 480
+
+#define SKIPPED 77
+
+typedef struct {
+    uint8_t color_type;
+    uint8_t bit_depth;
+} format_t;
+
+static const format_t formats[] = {
+    {2, 8}, {2, 16}, {0, 1}, {0, 2}, {0, 4}, {0, 8}, {0, 16}, {3, 1}, {3, 2}, {3, 4}, {3, 8},
+};
+#define FORMAT_COUNT (sizeof(formats) / sizeof(formats[0]))
+
+static bool use_pax = true;
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [options] DIR\n"
+            "  --reference pax|stream  decoder the sidecars are compared with (default pax)\n"
+            "  --png2wag SCRIPT        also check the sidecars tools/png2wag.py writes\n"
+            "  --python PATH           interpreter for SCRIPT (default python3)\n"
+            "Test images are written to DIR.\n",
+            argv0);
+}
+
+static bool decode_reference(const char* path, pax_buf_t* image) {
+    FILE* fd = fopen(path, "rb");
+    if (fd == NULL) return false;
+    bool ok;
+    if (use_pax) {
+        ok = pax_decode_png_fd(image, fd, PAX_BUF_24_888RGB, CODEC_FLAG_STRICT) &&
+             pax_buf_get_type(image) == PAX_BUF_24_888RGB && pax_buf_get_width(image) == WIDTH &&
+             pax_buf_get_height(image) == HEIGHT;
+    } else {
+        ok = pax_buf_init(image, NULL, WIDTH, HEIGHT, PAX_BUF_24_888RGB);
+        if (ok && !codec_decode_into(fd, CODEC_PNG, NULL, image)) {
+            pax_buf_destroy(image);
+            ok = false;
+        }
+    }
+    fclose(fd);
+    return ok;
+}
+
+// The sidecar the app writes for path: decoded into a frame and stored
+static bool app_sidecar(const char* path, const struct stat* source, const char* wag_path) {
+    pax_buf_t frame;
+    if (!pax_buf_init(&frame, NULL, WIDTH, HEIGHT, PAX_BUF_24_888RGB)) return false;
+    FILE* fd = fopen(path, "rb");
+    bool  ok = fd != NULL && codec_decode_into(fd, CODEC_PNG, NULL, &frame) &&
+              wag_write(wag_path, source, &frame, false);
+    if (fd != NULL) fclose(fd);
+    pax_buf_destroy(&frame);
+    return ok;
+}
+
+static bool script_sidecar(const char* python, const char* script, const char* path) {
+    char command[1024];
+    snprintf(command, sizeof(command), "'%s' '%s' '%s' >/dev/null", python, script, path);
+    return system(command) == 0;
+}
+
+// Number of pixels of the sidecar at wag_path that differ from reference, or
+// -1 if it cannot be read
+static long compare_sidecar(const char* wag_path, const struct stat* source, const pax_buf_t* reference) {
+    pax_buf_t stored;
+    if (!pax_buf_init(&stored, NULL, WIDTH, HEIGHT, PAX_BUF_24_888RGB)) return -1;
+    bool flipped = true;
+    long diff    = -1;
+    if (wag_read(wag_path, source, &stored, &flipped) && !flipped) {
+        const uint8_t* a = pax_buf_get_pixels(&stored);
+        const uint8_t* b = pax_buf_get_pixels(reference);
+        diff             = 0;
+        for (size_t i = 0; i < (size_t)WIDTH * HEIGHT; i++) diff += memcmp(a + i * 3, b + i * 3, 3) != 0;
+    }
+    pax_buf_destroy(&stored);
+    return diff;
+}
+
+int main(int argc, char** argv) {
+    static const struct option options[] = {
+        {"reference", required_argument, NULL, 'r'}, {"png2wag", required_argument, NULL, 's'},
+        {"python", required_argument, NULL, 'p'},    {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    const char* script = NULL;
+    const char* python = "python3";
+    int         option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'r': use_pax = strcmp(optarg, "stream") != 0; break;
+            case 's': script = optarg; break;
+            case 'p': python = optarg; break;
+            default:  usage(argv[0]); return option == 'h' ? 0 : 1;
+        }
+    }
+    if (optind + 1 != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    sim_set_log_level(ESP_LOG_WARN);
+    codec_init();
+    mkdir(argv[optind], 0755);
+
+    int failures = 0;
+    int compared = 0;
+    for (size_t i = 0; i < FORMAT_COUNT; i++) {
+        test_png_t png = {
+            .width      = WIDTH,
+            .height     = HEIGHT,
+            .color_type = formats[i].color_type,
+            .bit_depth  = formats[i].bit_depth,
+            .filter     = -1,
+            .seed       = i,
+        };
+        char path[512], wag_path[520];
+        snprintf(path, sizeof(path), "%s/type%u_%u.png", argv[optind], png.color_type, png.bit_depth);
+        wag_path_for(path, wag_path, sizeof(wag_path));
+        struct stat source;
+        if (!test_png_write(path, &png) || stat(path, &source) != 0) {
+            fprintf(stderr, "Failed to write %s\n", path);
+            return 1;
+        }
+
+        pax_buf_t reference;
+        if (!decode_reference(path, &reference)) {
+            printf("%s: the reference decoder failed\n", path);
+            continue;
+        }
+        compared++;
+
+        long diff = app_sidecar(path, &source, wag_path) ? compare_sidecar(wag_path, &source, &reference) : -1;
+        printf("%s: wag_write %s", path, diff == 0 ? "matches" : "DIFFERS");
+        failures += diff != 0;
+        if (diff > 0) printf(" (%ld pixels)", diff);
+        if (script != NULL) {
+            unlink(wag_path);
+            diff = script_sidecar(python, script, path) ? compare_sidecar(wag_path, &source, &reference) : -1;
+            printf(", png2wag.py %s", diff == 0 ? "matches" : "DIFFERS");
+            failures += diff != 0;
+            if (diff > 0) printf(" (%ld pixels)", diff);
+        }
+        printf("\n");
+        pax_buf_destroy(&reference);
+    }
+    if (compared == 0) {
+        printf("No image decoded by the reference, skipped\n");
+        return SKIPPED;
+    }
+    printf("%d of %d comparisons failed\n", failures, compared * (script != NULL ? 2 : 1));
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,203 @@
+#include "album.h"
+#include <stdatomic.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static char const TAG[] = "album";
+
+#define INITIAL_ALBUMS     16
+#define INITIAL_PATH_BYTES 1024
+
+typedef struct {
+    uint32_t path;    // offset of the full directory path in the path arena
+    bool     listed;  // its subdirectories are in the album list
+} album_t;
+
+typedef struct {
+    int        album;      // -1 if unused
+    uint32_t   last_used;  // use_clock when last entered
+    atomic_int pins;
+    catalog_t  listing;
+} cached_listing_t;
+
+static album_t*         albums         = NULL;
+static int              count          = 0;
+static int              capacity       = 0;
+static char*            paths          = NULL;
+static size_t           paths_used     = 0;
+static size_t           paths_capacity = 0;
+static cached_listing_t cache[ALBUM_CACHE_SIZE];
+static uint32_t         use_clock      = 0;
+static int              current        = -1;
+static album_scan_fn    scan_fn        = NULL;
+static void*            scan_ctx       = NULL;
+static int              scanning       = -1;  // album being listed for the first time, -1 if none
+static int              insert_at      = 0;   // where its next subdirectory goes
+
+// Grow an allocation to new_size, preferring PSRAM and falling back to
+// internal RAM. The old block is kept on failure.
+static void* grow(void* ptr, size_t new_size) {
+    void* grown = heap_caps_realloc(ptr, new_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (grown == NULL) grown = heap_caps_realloc(ptr, new_size, MALLOC_CAP_8BIT);
+    return grown;
+}
+
+// Insert an album for parent/name at position, or for name alone if parent
+// is negative. Later albums move up by one.
+static bool insert_album(int position, int parent, const char* name) {
+    size_t name_length   = strlen(name) + 1;
+    size_t parent_length = parent >= 0 ? strlen(&paths[albums[parent].path]) + 1 : 0;  // with the '/'
+    size_t length        = parent_length + name_length;
+
+    if (count == capacity) {
+        int      new_capacity = capacity ? capacity * 2 : INITIAL_ALBUMS;
+        album_t* grown        = grow(albums, (size_t)new_capacity * sizeof(*grown));
+        if (grown == NULL) return false;
+        albums   = grown;
+        capacity = new_capacity;
+    }
+    if (paths_capacity - paths_used < length) {
+        size_t new_capacity = paths_capacity ? paths_capacity : INITIAL_PATH_BYTES;
+        while (new_capacity - paths_used < length) new_capacity *= 2;
+        char* grown = grow(paths, new_capacity);
+        if (grown == NULL) return false;
+        paths          = grown;
+        paths_capacity = new_capacity;
+    }
+
+    char* path = &paths[paths_used];
+    if (parent >= 0) {
+        memcpy(path, &paths[albums[parent].path], parent_length - 1);
+        path[parent_length - 1] = '/';
+    }
+    memcpy(path + parent_length, name, name_length);
+    memmove(&albums[position + 1], &albums[position], (count - position) * sizeof(*albums));
+    albums[position] = (album_t){.path = (uint32_t)paths_used};
+    paths_used += length;
+    count++;
+
+    for (int i = 0; i < ALBUM_CACHE_SIZE; i++) {
+        if (cache[i].album >= position) cache[i].album++;
+    }
+    if (current >= position) current++;
+    return true;
+}
+
+bool album_init(const char* root, album_scan_fn scan, void* ctx) {
+    scan_fn  = scan;
+    scan_ctx = ctx;
+    for (int i = 0; i < ALBUM_CACHE_SIZE; i++) {
+        cache[i].album = -1;
+    }
+    return insert_album(0, -1, root);
+}
+
+void album_found_subdir(const char* name) {
+    if (scanning < 0) return;
+    if (!insert_album(insert_at, scanning, name)) {
+        ESP_LOGW(TAG, "Out of memory, skipping album %s", name);
+        return;
+    }
+    insert_at++;
+}
+
+int album_count(void) {
+    return count;
+}
+
+int album_current(void) {
+    return current;
+}
+
+const char* album_dir(int album) {
+    return &paths[albums[album].path];
+}
+
+// An unused slot, or else the least recently used listing nobody is using
+static cached_listing_t* claim_listing(void) {
+    cached_listing_t* victim = NULL;
+    for (int i = 0; i < ALBUM_CACHE_SIZE; i++) {
+        cached_listing_t* slot = &cache[i];
+        if (slot->album == current && slot->album >= 0) continue;
+        if (atomic_load(&slot->pins) > 0) continue;
+        if (slot->album < 0) return slot;
+        if (victim == NULL || slot->last_used < victim->last_used) victim = slot;
+    }
+    return victim;
+}
+
+catalog_t* album_list(int album) {
+    if (album < 0 || album >= count) return NULL;
+
+    cached_listing_t* slot = NULL;
+    for (int i = 0; i < ALBUM_CACHE_SIZE && slot == NULL; i++) {
+        if (cache[i].album == album) slot = &cache[i];
+    }
+    if (slot == NULL) {
+        slot = claim_listing();
+        if (slot == NULL) {
+            ESP_LOGW(TAG, "Every album listing is in use, cannot enter %s", album_dir(album));
+            return NULL;
+        }
+        slot->album = -1;
+        if (!catalog_reset(&slot->listing, album_dir(album))) {
+            ESP_LOGE(TAG, "Out of memory listing %s", album_dir(album));
+            return NULL;
+        }
+
+        // Subdirectories are inserted after the album, so its index does not change
+        slot->album = album;
+        scanning    = albums[album].listed ? -1 : album;
+        insert_at   = album + 1;
+        scan_fn(&slot->listing, scan_ctx);
+        albums[album].listed = true;
+        scanning             = -1;
+        ESP_LOGD(TAG, "Listed %s: %d images, %d albums known", album_dir(album), catalog_count(&slot->listing),
+                 count);
+    }
+    slot->last_used = ++use_clock;
+    return &slot->listing;
+}
+
+catalog_t* album_enter(int album) {
+    catalog_t* listing = album_list(album);
+    if (listing != NULL) current = album;
+    return listing;
+}
+
+int album_discover(const char* dir) {
+    while (true) {
+        // The album itself, or else its deepest known ancestor
+        int    ancestor        = -1;
+        size_t ancestor_length = 0;
+        for (int i = 0; i < count; i++) {
+            const char* path   = album_dir(i);
+            size_t      length = strlen(path);
+            if (strcmp(path, dir) == 0) return i;
+            if (length > ancestor_length && strncmp(path, dir, length) == 0 && dir[length] == '/') {
+                ancestor        = i;
+                ancestor_length = length;
+            }
+        }
+        // Listing the ancestor adds its subdirectories, unless that already happened
+        if (ancestor < 0 || albums[ancestor].listed || album_list(ancestor) == NULL) return -1;
+    }
+}
+
+static cached_listing_t* find_listing(catalog_t* listing) {
+    for (int i = 0; i < ALBUM_CACHE_SIZE; i++) {
+        if (&cache[i].listing == listing) return &cache[i];
+    }
+    return NULL;
+}
+
+void album_pin(catalog_t* listing) {
+    cached_listing_t* slot = find_listing(listing);
+    if (slot != NULL) atomic_fetch_add(&slot->pins, 1);
+}
+
+void album_unpin(catalog_t* listing) {
+    cached_listing_t* slot = find_listing(listing);
+    if (slot != NULL) atomic_fetch_sub(&slot->pins, 1);
+}
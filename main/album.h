@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdbool.h>
+#include "catalog.h"
+
+// Albums: the images directory and every directory below it, in depth-first
+// order. Only the directories that have been entered are listed: when an
+// album is entered for the first time, its subdirectories are inserted right
+// after it, so the album list grows as the tree is explored. The listings of
+// the most recently used albums are kept, so switching back and forth does
+// not walk the directories again, and memory does not grow with the number of
+// albums visited.
+#define ALBUM_CACHE_SIZE 4
+
+// Fill listing with the images in listing->dir, calling album_found_subdir for
+// each subdirectory. Called from album_enter on the calling task.
+typedef void (*album_scan_fn)(catalog_t* listing, void* ctx);
+
+// Start with root as the only album. Returns false if out of memory.
+bool album_init(const char* root, album_scan_fn scan, void* ctx);
+
+// Report a subdirectory of the directory being scanned. Only has an effect
+// the first time an album is listed.
+void album_found_subdir(const char* name);
+
+int album_count(void);
+
+// The album last entered, or -1 before the first album_enter.
+int album_current(void);
+
+const char* album_dir(int album);
+
+// The album for directory dir, listing the albums above it as far as needed
+// to discover it. Returns -1 if there is no such album.
+int album_discover(const char* dir);
+
+// The listing of album, scanning the directory unless it is cached. The
+// listing stays valid until the next album_list or album_enter, or for as
+// long as the album is current or the listing is pinned. Returns NULL if
+// every cached listing is in use or out of memory.
+catalog_t* album_list(int album);
+
+// Make album the current one and return its listing, as album_list. The
+// current album is unchanged if this returns NULL.
+catalog_t* album_enter(int album);
+
+// Keep a listing cached while another task uses it, e.g. after switching
+// albums. May be called from any task.
+void album_pin(catalog_t* listing);
+void album_unpin(catalog_t* listing);
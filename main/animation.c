@@ -0,0 +1,209 @@
+#include "animation.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "codec.h"
+#include "esp_log.h"
+#include "gif.h"
+#include "png_stream.h"
+
+static char const TAG[] = "animation";
+
+// Like browsers, show frames asking for less than this for the default
+// instead: such short delays are nearly always meant as unspecified
+#define MIN_DELAY_MS     20
+#define DEFAULT_DELAY_MS 100
+
+struct animation {
+    png_animation_t* png;
+    gif_t*           gif;
+    uint32_t         width;
+    uint32_t         height;
+    uint32_t         plays;        // 0 for forever
+    uint32_t         played;       // complete plays so far
+    uint32_t         frame_index;  // frames composed in the current play
+    uint8_t*         canvas;
+    uint8_t*         saved;  // the canvas under the current frame, for PNG_DISPOSE_PREVIOUS
+    size_t           saved_size;
+    png_frame_t      frame;  // the frame on the canvas, disposed of before the next
+    bool             shown;
+    uint32_t         damage_top;
+    uint32_t         damage_bottom;  // 0 if no damage
+};
+
+animation_t* animation_open(FILE* fd, int codec) {
+    animation_t* a = calloc(1, sizeof(*a));
+    if (a == NULL) return NULL;
+    rewind(fd);
+
+    bool ok = false;
+    if (codec == CODEC_PNG) {
+        png_ihdr_t ihdr;
+        uint32_t   frames;
+        a->png = png_animation_open(fd, &ihdr, &frames, &a->plays);
+        if (a->png != NULL) {
+            a->width  = ihdr.width;
+            a->height = ihdr.height;
+            ok        = true;
+        }
+    } else if (codec == CODEC_GIF) {
+        a->gif = gif_open(fd, &a->width, &a->height);
+        ok     = a->gif != NULL;
+    }
+    if (ok) {
+        a->canvas = calloc((size_t)a->width * a->height, 3);
+        if (a->canvas == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate a %" PRIu32 "x%" PRIu32 " canvas", a->width, a->height);
+            ok = false;
+        }
+    }
+    if (!ok) {
+        animation_close(a);
+        return NULL;
+    }
+    return a;
+}
+
+void animation_size(const animation_t* a, uint32_t* width, uint32_t* height) {
+    *width  = a->width;
+    *height = a->height;
+}
+
+static void add_damage(animation_t* a, uint32_t top, uint32_t bottom) {
+    if (top >= bottom) return;
+    if (a->damage_bottom == 0 || top < a->damage_top) a->damage_top = top;
+    if (bottom > a->damage_bottom) a->damage_bottom = bottom;
+}
+
+static uint8_t* canvas_at(const animation_t* a, uint32_t x, uint32_t y) {
+    return a->canvas + ((size_t)y * a->width + x) * 3;
+}
+
+// Copy the area of frame between the canvas and the saved area
+static void copy_area(animation_t* a, const png_frame_t* frame, bool save) {
+    size_t row_bytes = (size_t)frame->width * 3;
+    for (uint32_t y = 0; y < frame->height; y++) {
+        uint8_t* canvas = canvas_at(a, frame->x, frame->y + y);
+        uint8_t* saved  = a->saved + y * row_bytes;
+        if (save) {
+            memcpy(saved, canvas, row_bytes);
+        } else {
+            memcpy(canvas, saved, row_bytes);
+        }
+    }
+}
+
+static bool save_area(animation_t* a, const png_frame_t* frame) {
+    size_t size = (size_t)frame->width * frame->height * 3;
+    if (size > a->saved_size) {
+        free(a->saved);
+        a->saved_size = 0;
+        a->saved      = malloc(size);
+        if (a->saved == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate %zu bytes for a frame", size);
+            return false;
+        }
+        a->saved_size = size;
+    }
+    copy_area(a, frame, true);
+    return true;
+}
+
+static void dispose(animation_t* a) {
+    const png_frame_t* frame = &a->frame;
+    if (frame->dispose == PNG_DISPOSE_NONE) return;
+    if (frame->dispose == PNG_DISPOSE_PREVIOUS) {
+        copy_area(a, frame, false);
+    } else {
+        for (uint32_t y = 0; y < frame->height; y++) {
+            memset(canvas_at(a, frame->x, frame->y + y), 0, (size_t)frame->width * 3);
+        }
+    }
+    add_damage(a, frame->y, frame->y + frame->height);
+}
+
+// Blend frame row y, B, G, R, A bytes, onto the canvas
+static bool compose_row(void* ctx, uint32_t y, const uint8_t* row) {
+    animation_t*       a     = ctx;
+    const png_frame_t* frame = &a->frame;
+    if (y >= frame->height) return true;
+
+    uint8_t* out = canvas_at(a, frame->x, frame->y + y);
+    for (uint32_t x = 0; x < frame->width; x++, row += 4, out += 3) {
+        uint32_t alpha = row[3];
+        if (alpha == 255) {
+            out[0] = row[0];
+            out[1] = row[1];
+            out[2] = row[2];
+        } else if (frame->blend == PNG_BLEND_SOURCE) {
+            for (int ch = 0; ch < 3; ch++) out[ch] = (row[ch] * alpha + 127) / 255;
+        } else if (alpha > 0) {
+            for (int ch = 0; ch < 3; ch++) out[ch] = (row[ch] * alpha + out[ch] * (255 - alpha) + 127) / 255;
+        }
+    }
+    return true;
+}
+
+static bool next_frame(animation_t* a, png_frame_t* frame) {
+    if (a->png != NULL) return png_animation_next(a->png, frame);
+    if (!gif_next(a->gif, frame)) return false;
+    // The loop extension comes before the first frame
+    a->plays = gif_plays(a->gif);
+    return true;
+}
+
+bool animation_step(animation_t* a, uint32_t* delay_ms) {
+    png_frame_t frame;
+    if (!next_frame(a, &frame)) {
+        // Past the last frame: start over unless the loop count is used up. A
+        // single frame is not animated, however many times it is meant to play.
+        a->played++;
+        if (a->frame_index <= 1 || (a->plays != 0 && a->played >= a->plays)) return false;
+        if (a->png != NULL) {
+            png_animation_rewind(a->png);
+        } else {
+            gif_rewind(a->gif);
+        }
+        if (!next_frame(a, &frame)) return false;
+        memset(a->canvas, 0, (size_t)a->width * a->height * 3);
+        add_damage(a, 0, a->height);
+        a->frame_index = 0;
+        a->shown       = false;
+    }
+    if (a->shown) dispose(a);
+    if (frame.dispose == PNG_DISPOSE_PREVIOUS && !save_area(a, &frame)) return false;
+    a->frame = frame;
+    a->shown = true;
+    a->frame_index++;
+
+    bool ok = a->png != NULL ? png_animation_decode(a->png, compose_row, a) : gif_decode(a->gif, compose_row, a);
+    add_damage(a, frame.y, frame.y + frame.height);
+    if (!ok) {
+        ESP_LOGW(TAG, "Failed to decode frame %" PRIu32, a->frame_index);
+        return false;
+    }
+    *delay_ms = frame.delay_ms >= MIN_DELAY_MS ? frame.delay_ms : DEFAULT_DELAY_MS;
+    return true;
+}
+
+bool animation_take_damage(animation_t* a, uint32_t* top, uint32_t* bottom) {
+    if (a->damage_bottom == 0) return false;
+    *top             = a->damage_top;
+    *bottom          = a->damage_bottom;
+    a->damage_top    = 0;
+    a->damage_bottom = 0;
+    return true;
+}
+
+const uint8_t* animation_canvas(const animation_t* a) {
+    return a->canvas;
+}
+
+void animation_close(animation_t* a) {
+    if (a == NULL) return;
+    png_animation_close(a->png);
+    gif_close(a->gif);
+    free(a->canvas);
+    free(a->saved);
+    free(a);
+}
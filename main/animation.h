@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Player for animated PNGs and GIFs. Frames are decoded one at a time onto a
+// canvas of the image's size, held as B, G, R rows premultiplied over black,
+// which is what surrounds an image on the panel anyway. Besides the canvas
+// only the area of one frame is kept, for frames disposed of by restoring
+// what was under them, however long the animation is. The canvas rows each
+// step changes are tracked so the caller rescales and redraws only those.
+
+typedef struct animation animation_t;
+
+// Start playing the image fd from its start with codec (CODEC_PNG or
+// CODEC_GIF). The file is read as frames are needed, so it must stay open
+// until animation_close. Returns NULL if it cannot be played.
+animation_t* animation_open(FILE* fd, int codec);
+
+void animation_size(const animation_t* animation, uint32_t* width, uint32_t* height);
+
+// Compose the next frame onto the canvas, starting over after the last one as
+// long as the file's loop count allows. *delay_ms receives how long to show
+// it. Returns false when the animation has ended or the frame cannot be read.
+bool animation_step(animation_t* animation, uint32_t* delay_ms);
+
+// The canvas rows changed since the last call, [*top, *bottom). Returns false
+// if there are none.
+bool animation_take_damage(animation_t* animation, uint32_t* top, uint32_t* bottom);
+
+// Rows of width pixels in PAX_BUF_24_888RGB layout, width * 3 bytes apart.
+const uint8_t* animation_canvas(const animation_t* animation);
+
+void animation_close(animation_t* animation);
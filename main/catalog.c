@@ -0,0 +1,240 @@
+#include "catalog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static char const TAG[] = "catalog";
+
+#define INITIAL_ENTRIES    64
+#define INITIAL_NAME_BYTES 2048
+
+_Static_assert(sizeof(catalog_entry_t) == 20, "catalog_entry_t is stored in the index and must stay 20 bytes");
+_Static_assert(sizeof(catalog_index_header_t) == 28, "catalog_index_header_t must stay 28 bytes");
+
+// Previous catalogue loaded from an index: header, entries and names in one block
+static uint8_t*                      previous         = NULL;
+static const catalog_index_header_t* previous_header  = NULL;
+static const catalog_entry_t*        previous_entries = NULL;
+static const char*                   previous_names   = NULL;
+static uint32_t                      previous_cursor  = 0;  // where the next lookup starts
+
+// Grow an allocation to new_size, preferring PSRAM and falling back to
+// internal RAM. The old block is kept on failure.
+static void* grow(void* ptr, size_t new_size) {
+    void* grown = heap_caps_realloc(ptr, new_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (grown == NULL) grown = heap_caps_realloc(ptr, new_size, MALLOC_CAP_8BIT);
+    return grown;
+}
+
+bool catalog_reset(catalog_t* catalog, const char* dir) {
+    catalog->count      = 0;
+    catalog->names_used = 0;
+
+    char* copy = grow(catalog->dir, strlen(dir) + 1);
+    if (copy == NULL) return false;
+    strcpy(copy, dir);
+    catalog->dir = copy;
+    return true;
+}
+
+void catalog_free(catalog_t* catalog) {
+    heap_caps_free(catalog->dir);
+    heap_caps_free(catalog->entries);
+    heap_caps_free(catalog->names);
+    memset(catalog, 0, sizeof(*catalog));
+}
+
+catalog_entry_t* catalog_add(catalog_t* catalog, const char* name) {
+    size_t length = strlen(name) + 1;
+
+    if (catalog->count == catalog->capacity) {
+        int              new_capacity = catalog->capacity ? catalog->capacity * 2 : INITIAL_ENTRIES;
+        catalog_entry_t* grown        = grow(catalog->entries, (size_t)new_capacity * sizeof(*grown));
+        if (grown == NULL) {
+            ESP_LOGE(TAG, "Failed to grow the catalogue to %d entries", new_capacity);
+            return NULL;
+        }
+        catalog->entries  = grown;
+        catalog->capacity = new_capacity;
+    }
+    if (catalog->names_capacity - catalog->names_used < length) {
+        size_t new_capacity = catalog->names_capacity ? catalog->names_capacity : INITIAL_NAME_BYTES;
+        while (new_capacity - catalog->names_used < length) new_capacity *= 2;
+        if (new_capacity > UINT32_MAX) return NULL;
+        char* grown = grow(catalog->names, new_capacity);
+        if (grown == NULL) {
+            ESP_LOGE(TAG, "Failed to grow the name arena to %zu bytes", new_capacity);
+            return NULL;
+        }
+        catalog->names          = grown;
+        catalog->names_capacity = new_capacity;
+    }
+
+    catalog_entry_t* entry = &catalog->entries[catalog->count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->name = (uint32_t)catalog->names_used;
+    memcpy(&catalog->names[catalog->names_used], name, length);
+    catalog->names_used += length;
+    return entry;
+}
+
+int catalog_count(const catalog_t* catalog) {
+    return catalog->count;
+}
+
+catalog_entry_t* catalog_entry(const catalog_t* catalog, int index) {
+    return &catalog->entries[index];
+}
+
+const char* catalog_name(const catalog_t* catalog, int index) {
+    return &catalog->names[catalog->entries[index].name];
+}
+
+int catalog_find(const catalog_t* catalog, const char* name) {
+    for (int i = 0; i < catalog->count; i++) {
+        if (strcmp(catalog_name(catalog, i), name) == 0) return i;
+    }
+    return -1;
+}
+
+bool catalog_path(const catalog_t* catalog, int index, char* out, size_t out_size) {
+    int len = snprintf(out, out_size, "%s/%s", catalog->dir, catalog_name(catalog, index));
+    return len > 0 && (size_t)len < out_size;
+}
+
+size_t catalog_memory(const catalog_t* catalog) {
+    return (size_t)catalog->capacity * sizeof(*catalog->entries) + catalog->names_capacity;
+}
+
+#define FNV_OFFSET_BASIS 2166136261u
+
+static uint32_t fnv1a(uint32_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t fingerprint(const char* data, size_t size) {
+    return fnv1a(FNV_OFFSET_BASIS, data, size);
+}
+
+bool catalog_save(const catalog_t* catalog, const char* path, uint32_t config) {
+    char tmp_path[strlen(path) + 2];
+    snprintf(tmp_path, sizeof(tmp_path), "%s~", path);
+
+    catalog_index_header_t header = {
+        .version     = CATALOG_INDEX_VERSION,
+        .entry_size  = sizeof(catalog_entry_t),
+        .count       = (uint32_t)catalog->count,
+        .names_size  = (uint32_t)catalog->names_used,
+        .fingerprint = fingerprint(catalog->names, catalog->names_used),
+        .checksum    = fnv1a(fnv1a(FNV_OFFSET_BASIS, catalog->entries, (size_t)catalog->count * sizeof(catalog_entry_t)),
+                             catalog->names, catalog->names_used),
+        .config      = config,
+    };
+    memcpy(header.magic, CATALOG_INDEX_MAGIC, sizeof(header.magic));
+
+    FILE* fd = fopen(tmp_path, "wb");
+    if (fd == NULL) {
+        ESP_LOGW(TAG, "Failed to create %s", tmp_path);
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fd) == 1 &&
+              fwrite(catalog->entries, sizeof(catalog_entry_t), catalog->count, fd) == (size_t)catalog->count &&
+              fwrite(catalog->names, 1, catalog->names_used, fd) == catalog->names_used;
+    ok      = (fclose(fd) == 0) && ok;
+
+    // FAT cannot rename over an existing file
+    if (ok) {
+        unlink(path);
+        ok = rename(tmp_path, path) == 0;
+    }
+    if (!ok) {
+        ESP_LOGW(TAG, "Failed to write %s", path);
+        unlink(tmp_path);
+    }
+    return ok;
+}
+
+bool catalog_load_previous(const char* path, uint32_t config) {
+    catalog_free_previous();
+
+    struct stat info;
+    if (stat(path, &info) != 0) return false;
+    size_t size = (size_t)info.st_size;
+    if (size < sizeof(catalog_index_header_t)) {
+        ESP_LOGW(TAG, "Ignoring %s: truncated", path);
+        return false;
+    }
+
+    FILE* fd = fopen(path, "rb");
+    if (fd == NULL) return false;
+    previous = grow(NULL, size);
+    bool ok  = previous != NULL && fread(previous, 1, size, fd) == size;
+    fclose(fd);
+    if (!ok) {
+        ESP_LOGW(TAG, "Failed to read %s", path);
+        catalog_free_previous();
+        return false;
+    }
+
+    const catalog_index_header_t* header       = (const catalog_index_header_t*)previous;
+    size_t                        entries_size = (size_t)header->count * sizeof(catalog_entry_t);
+    previous_entries = (const catalog_entry_t*)(previous + sizeof(*header));
+    previous_names   = (const char*)previous + sizeof(*header) + entries_size;
+
+    ok = memcmp(header->magic, CATALOG_INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+         header->version == CATALOG_INDEX_VERSION && header->entry_size == sizeof(catalog_entry_t) &&
+         header->config == config && header->count <= size / sizeof(catalog_entry_t) &&
+         size == sizeof(*header) + entries_size + header->names_size &&
+         (header->count == 0 || (header->names_size > 0 && previous_names[header->names_size - 1] == '\0')) &&
+         fnv1a(FNV_OFFSET_BASIS, previous_entries, entries_size + header->names_size) == header->checksum;
+    // Every name must start inside the arena, which ends with a terminator
+    for (uint32_t i = 0; ok && i < header->count; i++) {
+        ok = previous_entries[i].name < header->names_size;
+    }
+    if (!ok) {
+        ESP_LOGW(TAG, "Ignoring %s: invalid or written with other settings", path);
+        catalog_free_previous();
+        return false;
+    }
+    previous_header = header;
+    previous_cursor = 0;
+    return true;
+}
+
+const catalog_entry_t* catalog_find_previous(const char* name) {
+    if (previous_header == NULL) return NULL;
+
+    // Start at the entry after the last match, so an unchanged directory read
+    // in the same order costs one comparison per file
+    uint32_t total = previous_header->count;
+    for (uint32_t n = 0; n < total; n++) {
+        uint32_t i = (previous_cursor + n) % total;
+        if (strcmp(&previous_names[previous_entries[i].name], name) == 0) {
+            previous_cursor = i + 1;
+            return &previous_entries[i];
+        }
+    }
+    return NULL;
+}
+
+bool catalog_matches_previous(const catalog_t* catalog) {
+    return previous_header != NULL && previous_header->count == (uint32_t)catalog->count &&
+           previous_header->names_size == catalog->names_used &&
+           fingerprint(catalog->names, catalog->names_used) == previous_header->fingerprint;
+}
+
+void catalog_free_previous(void) {
+    heap_caps_free(previous);
+    previous         = NULL;
+    previous_header  = NULL;
+    previous_entries = NULL;
+    previous_names   = NULL;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Catalogue of the images in one directory. Filenames are stored once, without
+// the directory, in a growing name arena, and each file has a small fixed-size
+// entry. Both grow by doubling and live in PSRAM when there is any, so the
+// number of files is only limited by memory.
+
+// Per-file metadata, read once while scanning so files that cannot be shown
+// are skipped during navigation without touching the SD card again. bad and
+// cache_stale are separate bytes because different tasks update them.
+typedef struct {
+    uint32_t name;   // offset of the filename in the name arena
+    uint32_t size;   // file size in bytes
+    uint16_t width;  // clamped to UINT16_MAX
+    uint16_t height;
+    uint8_t  color_type;
+    uint8_t  bit_depth;
+    bool     interlaced;   // PNG decoded with pax-codecs instead of png_stream, or progressive JPEG
+    bool     bad;          // unreadable, corrupt or not the expected size
+    bool     cache_stale;  // .wag sidecar missing or out of date
+    uint8_t  codec;        // codec_id_t by magic bytes; padding, so 0 (PNG), in older indexes
+    bool     animated;     // more than one frame
+} catalog_entry_t;
+
+typedef struct {
+    char*            dir;
+    catalog_entry_t* entries;
+    int              count;
+    int              capacity;
+    char*            names;
+    size_t           names_used;
+    size_t           names_capacity;
+} catalog_t;
+
+// Drop every entry and start over for dir. The allocations are kept for reuse.
+// A zero-initialised catalog_t is empty and ready for this. Returns false if
+// out of memory.
+bool catalog_reset(catalog_t* catalog, const char* dir);
+
+// Release everything the catalogue allocated, leaving it zeroed.
+void catalog_free(catalog_t* catalog);
+
+// Append a file by name. Returns its zeroed entry, or NULL if out of memory.
+// Entry pointers are invalidated by the next catalog_add or catalog_reset.
+catalog_entry_t* catalog_add(catalog_t* catalog, const char* name);
+
+int catalog_count(const catalog_t* catalog);
+
+catalog_entry_t* catalog_entry(const catalog_t* catalog, int index);
+
+const char* catalog_name(const catalog_t* catalog, int index);
+
+// Index of the file called name, or -1.
+int catalog_find(const catalog_t* catalog, const char* name);
+
+// Build the full path of a file. Returns false if it does not fit.
+bool catalog_path(const catalog_t* catalog, int index, char* out, size_t out_size);
+
+// Bytes allocated for entries and names.
+size_t catalog_memory(const catalog_t* catalog);
+
+// On-card index: the catalogue saved as a header, the entries and the name
+// arena, so a later scan can reuse the metadata without opening every file.
+// The fingerprint is a hash of the arena, i.e. of every filename in order.
+#define CATALOG_INDEX_MAGIC   "IWIX"
+#define CATALOG_INDEX_VERSION 1
+
+typedef struct __attribute__((packed)) {
+    char     magic[4];
+    uint16_t version;
+    uint16_t entry_size;
+    uint32_t count;
+    uint32_t names_size;
+    uint32_t fingerprint;
+    uint32_t checksum;  // FNV-1a of the entries and names
+    uint32_t config;    // chosen by the caller, an index saved with another config is ignored
+} catalog_index_header_t;
+
+// Save the catalogue to path. Written under a temporary name first.
+bool catalog_save(const catalog_t* catalog, const char* path, uint32_t config);
+
+// Load a saved catalogue with one read, as the reference for the next scan.
+// There is one previous catalogue at a time. Returns false if there is none
+// or it is unusable.
+bool catalog_load_previous(const char* path, uint32_t config);
+
+// The entry for name in the previous catalogue, or NULL. Fast when names are
+// looked up in the order they were saved in.
+const catalog_entry_t* catalog_find_previous(const char* name);
+
+// Whether the catalogue lists the same files in the same order as the
+// previous one.
+bool catalog_matches_previous(const catalog_t* catalog);
+
+void catalog_free_previous(void);
@@ -0,0 +1,234 @@
+#include "codec.h"
+#include <string.h>
+#include <strings.h>
+#include "animation.h"
+#include "esp_log.h"
+#include "gif.h"
+#include "image_scale.h"
+#include "jpeg.h"
+#include "pax_codecs.h"
+#include "png_stream.h"
+#include "qoi.h"
+
+static char const TAG[] = "codec";
+
+#define MAX_MAGIC_LENGTH 8
+
+typedef struct {
+    const char* name;
+    const char* extensions[3];  // with the dot, NULL-terminated
+    uint8_t     magic[MAX_MAGIC_LENGTH];
+    size_t      magic_length;
+    // Read the header at the start of fd
+    bool (*read_info)(FILE* fd, codec_info_t* info);
+    // After read_info, whether there is more than one frame, for formats whose
+    // header does not say and that need to read on to tell. Only while scanning.
+    bool (*read_animated)(FILE* fd);
+    // Decode from the start of fd an image whose header read as info
+    bool (*decode)(FILE* fd, const codec_info_t* info, png_row_fn row, void* ctx);
+} codec_t;
+
+static bool png_read_info(FILE* fd, codec_info_t* info) {
+    png_ihdr_t ihdr;
+    if (!png_read_ihdr(fd, &ihdr)) return false;
+    info->width      = ihdr.width;
+    info->height     = ihdr.height;
+    info->color_type = ihdr.color_type;
+    info->bit_depth  = ihdr.bit_depth;
+    info->interlaced = ihdr.interlace != 0;
+    info->supported  = info->interlaced || png_stream_supported(&ihdr);
+    info->animated   = false;
+    return true;
+}
+
+static bool png_read_animated(FILE* fd) {
+    return png_frame_count(fd) > 1;
+}
+
+// Decode with pax-codecs into a temporary buffer and hand out its rows. Only
+// used for PNGs the streaming decoder does not handle (interlaced ones).
+static bool png_decode_with_pax(FILE* fd, png_row_fn row, void* ctx) {
+    pax_buf_t image;
+    if (!pax_decode_png_fd(&image, fd, PAX_BUF_24_888RGB, CODEC_FLAG_STRICT)) return false;
+
+    int            width  = pax_buf_get_width(&image);
+    int            height = pax_buf_get_height(&image);
+    const uint8_t* pixels = pax_buf_get_pixels(&image);
+    bool           ok     = pax_buf_get_type(&image) == PAX_BUF_24_888RGB;
+    for (int y = 0; y < height && ok; y++) {
+        ok = row(ctx, y, pixels + (size_t)y * width * 3);  // PAX_BUF_24_888RGB
+    }
+    pax_buf_destroy(&image);
+    return ok;
+}
+
+static bool png_decode(FILE* fd, const codec_info_t* info, png_row_fn row, void* ctx) {
+    return info->interlaced ? png_decode_with_pax(fd, row, ctx) : png_stream_decode(fd, NULL, row, ctx);
+}
+
+static bool qoi_read_info(FILE* fd, codec_info_t* info) {
+    qoi_header_t header;
+    if (!qoi_read_header(fd, &header)) return false;
+    info->width      = header.width;
+    info->height     = header.height;
+    info->color_type = header.channels == 4 ? PNG_COLOR_RGBA : PNG_COLOR_RGB;
+    info->bit_depth  = 8;
+    info->interlaced = false;
+    info->supported  = true;
+    info->animated   = false;
+    return true;
+}
+
+static bool qoi_decode_rows(FILE* fd, const codec_info_t* info, png_row_fn row, void* ctx) {
+    (void)info;
+    return qoi_decode(fd, row, ctx);
+}
+
+static bool jpeg_read_info_for_codec(FILE* fd, codec_info_t* info) {
+    jpeg_info_t header;
+    if (!jpeg_read_info(fd, &header)) return false;
+    info->width      = header.width;
+    info->height     = header.height;
+    info->color_type = header.components == 1 ? PNG_COLOR_GREY : PNG_COLOR_RGB;
+    info->bit_depth  = header.precision;
+    info->interlaced = !header.sequential;
+    info->supported  = jpeg_supported(&header);
+    info->animated   = false;
+    return true;
+}
+
+static bool jpeg_decode_rows(FILE* fd, const codec_info_t* info, png_row_fn row, void* ctx) {
+    (void)info;
+    return jpeg_decode(fd, row, ctx);
+}
+
+static bool gif_read_info_for_codec(FILE* fd, codec_info_t* info) {
+    gif_info_t header;
+    if (!gif_read_info(fd, &header)) return false;
+    info->width      = header.width;
+    info->height     = header.height;
+    info->color_type = PNG_COLOR_PALETTE;
+    info->bit_depth  = 8;
+    info->interlaced = false;  // interlaced frames are no different to decode
+    info->supported  = true;
+    info->animated   = header.animated;
+    return true;
+}
+
+// A frame may cover only part of the image, so the first one is composed on
+// a canvas and its rows handed out from there
+static bool gif_decode_rows(FILE* fd, const codec_info_t* info, png_row_fn row, void* ctx) {
+    animation_t* animation = animation_open(fd, CODEC_GIF);
+    uint32_t     delay_ms;
+    bool         ok = animation != NULL && animation_step(animation, &delay_ms);
+    for (uint32_t y = 0; y < info->height && ok; y++) {
+        ok = row(ctx, y, animation_canvas(animation) + (size_t)y * info->width * 3);  // PAX_BUF_24_888RGB
+    }
+    animation_close(animation);
+    return ok;
+}
+
+static const codec_t codecs[CODEC_COUNT] = {
+    [CODEC_PNG] =
+        {
+            .name          = "PNG",
+            .extensions    = {".png"},
+            .magic         = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'},
+            .magic_length  = 8,
+            .read_info     = png_read_info,
+            .read_animated = png_read_animated,
+            .decode        = png_decode,
+        },
+    [CODEC_QOI] =
+        {
+            .name         = "QOI",
+            .extensions   = {".qoi"},
+            .magic        = {'q', 'o', 'i', 'f'},
+            .magic_length = 4,
+            .read_info    = qoi_read_info,
+            .decode       = qoi_decode_rows,
+        },
+    [CODEC_JPEG] =
+        {
+            .name         = "JPEG",
+            .extensions   = {".jpg", ".jpeg"},
+            .magic        = {0xFF, 0xD8, 0xFF},
+            .magic_length = 3,
+            .read_info    = jpeg_read_info_for_codec,
+            .decode       = jpeg_decode_rows,
+        },
+    [CODEC_GIF] =
+        {
+            .name         = "GIF",
+            .extensions   = {".gif"},
+            .magic        = {'G', 'I', 'F', '8'},
+            .magic_length = 4,
+            .read_info    = gif_read_info_for_codec,
+            .decode       = gif_decode_rows,
+        },
+};
+
+void codec_init(void) {
+    png_stream_init();
+    jpeg_init();
+}
+
+int codec_for_name(const char* filename) {
+    const char* extension = strrchr(filename, '.');
+    if (extension == NULL) return -1;
+    for (int codec = 0; codec < CODEC_COUNT; codec++) {
+        for (int i = 0; codecs[codec].extensions[i] != NULL; i++) {
+            if (strcasecmp(extension, codecs[codec].extensions[i]) == 0) return codec;
+        }
+    }
+    return -1;
+}
+
+const char* codec_name(int codec) {
+    return codec >= 0 && codec < CODEC_COUNT ? codecs[codec].name : "?";
+}
+
+// The codec the magic bytes at the start of fd belong to, or -1. Leaves fd
+// at its start.
+static int identify(FILE* fd) {
+    uint8_t magic[MAX_MAGIC_LENGTH];
+    rewind(fd);
+    size_t length = fread(magic, 1, sizeof(magic), fd);
+    rewind(fd);
+
+    for (int i = 0; i < CODEC_COUNT; i++) {
+        if (length >= codecs[i].magic_length && memcmp(magic, codecs[i].magic, codecs[i].magic_length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool codec_read_info(FILE* fd, int* codec, codec_info_t* info) {
+    int found = identify(fd);
+    if (found < 0) return false;
+    if (found != *codec) ESP_LOGD(TAG, "Named as %s but is %s", codec_name(*codec), codecs[found].name);
+    *codec = found;
+    if (!codecs[found].read_info(fd, info)) return false;
+    if (codecs[found].read_animated != NULL) info->animated = codecs[found].read_animated(fd);
+    return true;
+}
+
+bool codec_decode_into(FILE* fd, int codec, const codec_info_t* info, pax_buf_t* dst) {
+    int found = identify(fd);
+    if (found < 0) return false;
+    codec_info_t header;
+    if (info == NULL || found != codec) {
+        // Still images decode the first frame either way, so no need to look for more
+        if (!codecs[found].read_info(fd, &header)) return false;
+        rewind(fd);
+        info = &header;
+    }
+    if (!info->supported) return false;
+
+    image_scaler_t* scaler = image_scaler_create(info->width, info->height, dst);
+    if (scaler == NULL) return false;
+    bool ok = codecs[found].decode(fd, info, image_scaler_row, scaler);
+    image_scaler_destroy(scaler);
+    return ok;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "pax_gfx.h"
+
+// Registry of the image decoders. Every codec reads a header and streams
+// PAX_BUF_24_888RGB rows through a png_row_fn, so decoded images reach frames
+// through the same scaler whatever their format. Files are picked up by
+// extension while scanning and identified by their magic bytes when opened,
+// so a misnamed file is still decoded by the right codec.
+//
+// A new codec is one entry in the table in codec.c and a value here.
+
+// Stored in the catalogue index: append only
+typedef enum {
+    CODEC_PNG,  // 0, the only format of indexes written before there were others
+    CODEC_QOI,
+    CODEC_JPEG,
+    CODEC_GIF,
+    CODEC_COUNT,
+} codec_id_t;
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint8_t  color_type;  // PNG_COLOR_*, the nearest for other formats
+    uint8_t  bit_depth;   // bits per sample
+    bool     interlaced;  // interlaced PNG or progressive JPEG
+    bool     supported;   // the codec can decode this variant of its format
+    bool     animated;    // more than one frame, see animation.h; decoding gives the first
+} codec_info_t;
+
+// Set up the decoders, including any hardware ones. Call once at startup.
+void codec_init(void);
+
+// The codec for a filename by its extension, or -1 if it is not an image.
+int codec_for_name(const char* filename);
+
+const char* codec_name(int codec);
+
+// Read the header of the image file fd from its start. codec is the codec
+// expected from the name; it is replaced by the one the magic bytes identify.
+// Returns false if fd is not an image any codec knows.
+bool codec_read_info(FILE* fd, int* codec, codec_info_t* info);
+
+// Decode the image file fd with codec into an existing IMAGE_BUF_TYPE buffer
+// (pixel_format.h), scaled to fit and letterboxed as image_scale.h describes.
+// info is the header codec_read_info gave while scanning, so only the magic
+// bytes are read before decoding; if it is NULL, or the magic bytes are of
+// another codec, the header is read again. dst may be partly written when
+// decoding fails.
+bool codec_decode_into(FILE* fd, int codec, const codec_info_t* info, pax_buf_t* dst);
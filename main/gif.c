@@ -0,0 +1,393 @@
+#include "gif.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+
+static char const TAG[] = "gif";
+
+#define LZW_MAX_BITS  12
+#define LZW_MAX_CODES (1 << LZW_MAX_BITS)
+
+#define BLOCK_EXTENSION 0x21
+#define BLOCK_IMAGE     0x2C
+
+#define EXTENSION_GRAPHIC_CONTROL 0xF9
+#define EXTENSION_APPLICATION     0xFF
+
+struct gif {
+    FILE*    fd;
+    uint32_t width;  // logical screen
+    uint32_t height;
+    uint32_t plays;
+    long     first_block;   // offset of the first block after the global colour table
+    bool     data_pending;  // the image data of the frame gif_next read is still ahead
+
+    uint8_t        global_palette[256 * 3];
+    int            global_colors;
+    uint8_t        local_palette[256 * 3];
+    const uint8_t* palette;
+    int            colors;
+
+    // Graphic control extension, applying to the next frame only
+    uint32_t delay_ms;
+    uint8_t  dispose;
+    int      transparent;  // colour index, or -1
+
+    // The frame gif_next read
+    png_frame_t frame;  // clipped to the logical screen
+    uint32_t    data_width;
+    uint32_t    data_height;
+    bool        interlaced;
+    int         frame_transparent;
+
+    // Image data sub-blocks
+    uint8_t block[255];
+    int     block_size;
+    int     block_pos;
+    bool    blocks_done;
+
+    // Rows being decoded
+    uint8_t* indices;  // data_width colour indices
+    size_t   indices_size;
+    uint8_t* out;      // converted row, 4 bytes per pixel, logical screen width
+    uint32_t x;
+    uint32_t y;
+    int      pass;  // of an interlaced frame
+    uint32_t rows_left;
+
+    // Code table: each code is its prefix code followed by its suffix byte
+    uint16_t prefix[LZW_MAX_CODES];
+    uint8_t  suffix[LZW_MAX_CODES];
+    uint8_t  stack[LZW_MAX_CODES];
+};
+
+// Interlaced frames store every 8th row from 0, every 8th from 4, every 4th
+// from 2 and every other one from 1
+static const uint8_t pass_start[4] = {0, 4, 2, 1};
+static const uint8_t pass_step[4]  = {8, 8, 4, 2};
+
+static inline uint16_t read_le16(const uint8_t* p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+// Skip a sequence of data sub-blocks up to its terminator
+static bool skip_sub_blocks(FILE* fd) {
+    while (true) {
+        int size = fgetc(fd);
+        if (size == EOF) return false;
+        if (size == 0) return true;
+        if (fseek(fd, size, SEEK_CUR) != 0) return false;
+    }
+}
+
+// Read the header and logical screen descriptor, and the global colour table
+// into palette, or skip it if palette is NULL
+static bool read_header(FILE* fd, uint32_t* width, uint32_t* height, uint8_t* palette, int* colors) {
+    uint8_t data[13];
+    if (fread(data, 1, sizeof(data), fd) != sizeof(data) ||
+        (memcmp(data, "GIF87a", 6) != 0 && memcmp(data, "GIF89a", 6) != 0)) {
+        return false;
+    }
+    *width  = read_le16(data + 6);
+    *height = read_le16(data + 8);
+    *colors = data[10] & 0x80 ? 2 << (data[10] & 7) : 0;
+    if (*colors > 0) {
+        size_t size = (size_t)*colors * 3;
+        if (palette != NULL ? fread(palette, 1, size, fd) != size : fseek(fd, (long)size, SEEK_CUR) != 0) {
+            return false;
+        }
+    }
+    return *width > 0 && *height > 0;
+}
+
+bool gif_read_info(FILE* fd, gif_info_t* info) {
+    int colors;
+    if (!read_header(fd, &info->width, &info->height, NULL, &colors)) return false;
+
+    // Count frames up to two, skipping extensions and image data
+    info->animated = false;
+    int frames     = 0;
+    while (frames < 2) {
+        int     block = fgetc(fd);
+        uint8_t descriptor[9];
+        if (block == BLOCK_EXTENSION) {
+            if (fgetc(fd) == EOF || !skip_sub_blocks(fd)) break;
+        } else if (block == BLOCK_IMAGE) {
+            if (fread(descriptor, 1, sizeof(descriptor), fd) != sizeof(descriptor)) break;
+            frames++;
+            long table = descriptor[8] & 0x80 ? 3L * (2 << (descriptor[8] & 7)) : 0;
+            if (frames < 2 && (fseek(fd, table + 1, SEEK_CUR) != 0 || !skip_sub_blocks(fd))) break;
+        } else {
+            break;
+        }
+    }
+    info->animated = frames == 2;
+    return true;
+}
+
+gif_t* gif_open(FILE* fd, uint32_t* width, uint32_t* height) {
+    gif_t* g = calloc(1, sizeof(*g));
+    if (g == NULL) return NULL;
+    g->fd    = fd;
+    g->plays = 1;
+    if (!read_header(fd, &g->width, &g->height, g->global_palette, &g->global_colors) ||
+        (g->out = malloc((size_t)g->width * 4)) == NULL) {
+        gif_close(g);
+        return NULL;
+    }
+    g->first_block = ftell(fd);
+    g->transparent = -1;
+    *width         = g->width;
+    *height        = g->height;
+    return g;
+}
+
+static bool read_extension(gif_t* g) {
+    int     label = fgetc(g->fd);
+    uint8_t data[255];
+    if (label == EXTENSION_GRAPHIC_CONTROL) {
+        int size = fgetc(g->fd);
+        if (size != 4 || fread(data, 1, 4, g->fd) != 4) return false;
+        g->delay_ms    = read_le16(data + 1) * 10;
+        g->dispose     = (data[0] >> 2) & 7;
+        g->transparent = data[0] & 1 ? data[3] : -1;
+        return skip_sub_blocks(g->fd);
+    }
+    if (label != EXTENSION_APPLICATION) return label != EOF && skip_sub_blocks(g->fd);
+
+    // The loop count is the first sub-block of the NETSCAPE2.0 extension
+    bool looping = false;
+    bool first   = true;
+    while (true) {
+        int size = fgetc(g->fd);
+        if (size == EOF) return false;
+        if (size == 0) return true;
+        if (fread(data, 1, size, g->fd) != (size_t)size) return false;
+        if (first) {
+            looping = size == 11 && (memcmp(data, "NETSCAPE2.0", 11) == 0 || memcmp(data, "ANIMEXTS1.0", 11) == 0);
+        } else if (looping && size >= 3 && data[0] == 1) {
+            // The number of repeats after the first play
+            uint16_t loops = read_le16(data + 1);
+            g->plays       = loops == 0 ? 0 : loops + 1u;
+        }
+        first = false;
+    }
+}
+
+static bool read_image_descriptor(gif_t* g, png_frame_t* frame) {
+    uint8_t data[9];
+    if (fread(data, 1, sizeof(data), g->fd) != sizeof(data)) return false;
+    uint32_t x     = read_le16(data);
+    uint32_t y     = read_le16(data + 2);
+    g->data_width  = read_le16(data + 4);
+    g->data_height = read_le16(data + 6);
+    g->interlaced  = data[8] & 0x40;
+    if (data[8] & 0x80) {
+        g->colors  = 2 << (data[8] & 7);
+        g->palette = g->local_palette;
+        if (fread(g->local_palette, 1, (size_t)g->colors * 3, g->fd) != (size_t)g->colors * 3) return false;
+    } else {
+        g->colors  = g->global_colors;
+        g->palette = g->global_palette;
+    }
+    if (g->data_width > g->indices_size) {
+        free(g->indices);
+        g->indices_size = 0;
+        g->indices      = malloc(g->data_width);
+        if (g->indices == NULL) return false;
+        g->indices_size = g->data_width;
+    }
+
+    // Frames reaching outside the logical screen are clipped to it
+    frame->x        = x < g->width ? x : g->width;
+    frame->y        = y < g->height ? y : g->height;
+    frame->width    = g->data_width < g->width - frame->x ? g->data_width : g->width - frame->x;
+    frame->height   = g->data_height < g->height - frame->y ? g->data_height : g->height - frame->y;
+    frame->delay_ms = g->delay_ms;
+    // 0 is unspecified and 1 leave the frame in place, 2 restores the
+    // background, 3 the previous canvas
+    frame->dispose = g->dispose == 2   ? PNG_DISPOSE_BACKGROUND
+                     : g->dispose == 3 ? PNG_DISPOSE_PREVIOUS
+                                       : PNG_DISPOSE_NONE;
+    frame->blend         = PNG_BLEND_OVER;
+    g->frame             = *frame;
+    g->frame_transparent = g->transparent;
+
+    g->delay_ms     = 0;
+    g->dispose      = 0;
+    g->transparent  = -1;
+    g->data_pending = true;
+    return true;
+}
+
+bool gif_next(gif_t* g, png_frame_t* frame) {
+    if (g->data_pending) {
+        g->data_pending = false;
+        if (fgetc(g->fd) == EOF || !skip_sub_blocks(g->fd)) return false;
+    }
+    while (true) {
+        int block = fgetc(g->fd);
+        if (block == BLOCK_IMAGE) return read_image_descriptor(g, frame);
+        // Anything else is the trailer, the end of the file or garbage
+        if (block != BLOCK_EXTENSION || !read_extension(g)) return false;
+    }
+}
+
+uint32_t gif_plays(const gif_t* g) {
+    return g->plays;
+}
+
+static bool next_byte(gif_t* g, uint8_t* byte) {
+    if (g->block_pos == g->block_size) {
+        if (g->blocks_done) return false;
+        int size = fgetc(g->fd);
+        if (size <= 0 || fread(g->block, 1, size, g->fd) != (size_t)size) {
+            g->blocks_done = true;
+            return false;
+        }
+        g->block_size = size;
+        g->block_pos  = 0;
+    }
+    *byte = g->block[g->block_pos++];
+    return true;
+}
+
+// Convert and emit the completed row of indices, then move to the next row
+static bool emit_row(gif_t* g, png_row_fn row, void* ctx) {
+    if (g->y < g->frame.height) {
+        uint8_t* out = g->out;
+        for (uint32_t x = 0; x < g->frame.width; x++, out += 4) {
+            uint8_t index = g->indices[x];
+            if (index < g->colors) {
+                const uint8_t* entry = g->palette + 3 * index;
+                out[0]               = entry[2];
+                out[1]               = entry[1];
+                out[2]               = entry[0];
+            } else {
+                out[0] = out[1] = out[2] = 0;
+            }
+            out[3] = index == g->frame_transparent ? 0 : 255;
+        }
+        if (!row(ctx, g->y, g->out)) return false;
+    }
+
+    g->x = 0;
+    g->rows_left--;
+    if (!g->interlaced) {
+        g->y++;
+        return true;
+    }
+    g->y += pass_step[g->pass];
+    while (g->y >= g->data_height && g->pass < 3) {
+        g->pass++;
+        g->y = pass_start[g->pass];
+    }
+    return true;
+}
+
+bool gif_decode(gif_t* g, png_row_fn row, void* ctx) {
+    if (!g->data_pending) return false;
+    g->data_pending = false;
+
+    int min_bits = fgetc(g->fd);
+    if (min_bits < 2 || min_bits > 8) return false;
+    g->block_size  = 0;
+    g->block_pos   = 0;
+    g->blocks_done = false;
+    g->x           = 0;
+    g->y           = 0;
+    g->pass        = 0;
+    g->rows_left   = g->data_width > 0 ? g->data_height : 0;
+
+    uint32_t clear     = 1u << min_bits;
+    uint32_t end       = clear + 1;
+    uint32_t next      = clear + 2;
+    int      code_bits = min_bits + 1;
+    uint32_t bits      = 0;
+    int      bit_count = 0;
+    int      previous  = -1;
+    uint8_t  first     = 0;
+    bool     ok        = true;
+    for (uint32_t code = 0; code < clear; code++) {
+        g->prefix[code] = 0;
+        g->suffix[code] = (uint8_t)code;
+    }
+
+    while (ok && g->rows_left > 0) {
+        while (bit_count < code_bits) {
+            uint8_t byte;
+            if (!next_byte(g, &byte)) break;
+            bits |= (uint32_t)byte << bit_count;
+            bit_count += 8;
+        }
+        if (bit_count < code_bits) {
+            ESP_LOGD(TAG, "Image data ends %" PRIu32 " rows early", g->rows_left);
+            break;
+        }
+        uint32_t code = bits & ((1u << code_bits) - 1);
+        bits >>= code_bits;
+        bit_count -= code_bits;
+
+        if (code == clear) {
+            next      = clear + 2;
+            code_bits = min_bits + 1;
+            previous  = -1;
+            continue;
+        }
+        if (code == end) break;
+        if (code > next || (previous < 0 && code >= clear)) {
+            ESP_LOGW(TAG, "Invalid code %" PRIu32, code);
+            ok = false;
+            break;
+        }
+
+        // Unwind the code's string onto the stack, last byte first. A code not
+        // in the table yet is the previous string plus its own first byte.
+        size_t   depth = 0;
+        uint32_t walk  = code;
+        if (code == next) {
+            g->stack[depth++] = first;
+            walk              = previous;
+        }
+        while (walk >= clear) {
+            g->stack[depth++] = g->suffix[walk];
+            walk              = g->prefix[walk];
+        }
+        g->stack[depth++] = (uint8_t)walk;
+        first             = (uint8_t)walk;
+
+        while (depth > 0 && g->rows_left > 0) {
+            g->indices[g->x++] = g->stack[--depth];
+            if (g->x == g->data_width && !emit_row(g, row, ctx)) ok = false;
+            if (!ok) break;
+        }
+
+        if (previous >= 0 && next < LZW_MAX_CODES) {
+            g->prefix[next] = (uint16_t)previous;
+            g->suffix[next] = first;
+            next++;
+            if (next == (1u << code_bits) && code_bits < LZW_MAX_BITS) code_bits++;
+        }
+        previous = (int)code;
+    }
+
+    // Skip what is left of the data, up to its terminator
+    if (!g->blocks_done && !skip_sub_blocks(g->fd)) ok = false;
+    return ok;
+}
+
+void gif_rewind(gif_t* g) {
+    fseek(g->fd, g->first_block, SEEK_SET);
+    g->data_pending = false;
+    g->delay_ms     = 0;
+    g->dispose      = 0;
+    g->transparent  = -1;
+}
+
+void gif_close(gif_t* g) {
+    if (g == NULL) return;
+    free(g->indices);
+    free(g->out);
+    free(g);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "png_stream.h"
+
+// GIF decoder. Frames are read one at a time and their LZW data decoded
+// straight into rows, so the working set is the 4096-entry code table and one
+// row whatever the image size. Each frame is described with a png_frame_t;
+// GIF's disposal methods map onto APNG's and every frame blends over the
+// canvas, its transparent colour being the only transparency there is.
+
+typedef struct gif gif_t;
+
+typedef struct {
+    uint32_t width;  // logical screen, the canvas the frames go on
+    uint32_t height;
+    bool     animated;  // more than one frame
+} gif_info_t;
+
+// Read the header at the current position, and whether there is a second
+// frame, which means skipping over the first one's data.
+bool gif_read_info(FILE* fd, gif_info_t* info);
+
+// Start reading the frames of the GIF at the current position of fd. Returns
+// NULL if it is not a GIF or out of memory.
+gif_t* gif_open(FILE* fd, uint32_t* width, uint32_t* height);
+
+// Read up to the next frame. Returns false after the last one. The loop
+// count, if the file has one, has been seen by the time this returns true.
+bool gif_next(gif_t* gif, png_frame_t* frame);
+
+// How many times to play the animation, 0 for forever. Without a loop
+// extension a GIF plays once.
+uint32_t gif_plays(const gif_t* gif);
+
+// Decode the frame gif_next read, calling row for every row of it as frame
+// width pixels of B, G, R, A bytes. Interlaced frames deliver their rows out
+// of order. A frame whose data ends early keeps the rows decoded by then, as
+// browsers show it.
+bool gif_decode(gif_t* gif, png_row_fn row, void* ctx);
+
+// Go back to before the first frame.
+void gif_rewind(gif_t* gif);
+
+void gif_close(gif_t* gif);
@@ -0,0 +1,308 @@
+#include "image_cache.h"
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "pixel_format.h"
+
+static char const TAG[] = "image_cache";
+
+#define DECODER_TASK_STACK    8192
+#define DECODER_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+
+// One slot always holds the frame being shown
+#define MAX_WANTED (IMAGE_CACHE_SLOTS - 1)
+
+typedef enum {
+    SLOT_EMPTY,
+    SLOT_DECODING,  // owned by whoever claimed it until the decode finishes
+    SLOT_READY,
+    SLOT_FAILED,  // remembered so a broken file is not retried in a loop
+    SLOT_SHOWN,   // returned by the last image_cache_take, never reused
+    SLOT_HELD,    // shown before it, kept until image_cache_release_held
+} slot_state_t;
+
+typedef struct {
+    slot_state_t state;
+    int          index;
+    bool         allocated;  // image holds a frame, kept across reuse
+    pax_buf_t    image;
+} cache_slot_t;
+
+static cache_slot_t          slots[IMAGE_CACHE_SLOTS];
+static int                   wanted[MAX_WANTED];
+static size_t                wanted_count = 0;
+static int                   ahead_index  = -1;  // told to next_fn once nothing else is wanted
+static uint32_t              generation   = 0;   // bumped by invalidate, decodes started before are dropped
+static SemaphoreHandle_t     lock         = NULL;
+static SemaphoreHandle_t     decode_done  = NULL;
+static TaskHandle_t          decoder_task = NULL;
+static image_cache_decode_fn decode_fn    = NULL;
+static image_cache_next_fn   next_fn      = NULL;
+static void*                 decode_ctx   = NULL;
+static int                   frame_width  = 0;
+static int                   frame_height = 0;
+static bool                  hold_shown   = false;  // the next take holds the frame it replaces
+
+static bool is_wanted(int index) {
+    for (size_t i = 0; i < wanted_count; i++) {
+        if (wanted[i] == index) return true;
+    }
+    return false;
+}
+
+// Put index at the front of the wanted list, dropping the least important
+// entry if the list is full
+static void want_first(int index) {
+    if (wanted_count == MAX_WANTED) wanted_count--;
+    memmove(&wanted[1], &wanted[0], wanted_count * sizeof(wanted[0]));
+    wanted[0] = index;
+    wanted_count++;
+}
+
+static bool is_decoding(void) {
+    for (int i = 0; i < IMAGE_CACHE_SLOTS; i++) {
+        if (slots[i].state == SLOT_DECODING) return true;
+    }
+    return false;
+}
+
+static cache_slot_t* find_slot(int index) {
+    for (int i = 0; i < IMAGE_CACHE_SLOTS; i++) {
+        if (slots[i].state != SLOT_EMPTY && slots[i].index == index) return &slots[i];
+    }
+    return NULL;
+}
+
+// Claim a slot to decode index into: an empty one, or one holding a frame
+// nobody wants anymore. The slot's frame is allocated on first use and kept
+// from then on. Must be called with the lock held.
+static cache_slot_t* claim_slot(int index) {
+    cache_slot_t* victim = NULL;
+    for (int s = 0; s < IMAGE_CACHE_SLOTS && victim == NULL; s++) {
+        if (slots[s].state == SLOT_EMPTY) victim = &slots[s];
+    }
+    for (int s = 0; s < IMAGE_CACHE_SLOTS && victim == NULL; s++) {
+        slot_state_t state = slots[s].state;
+        if (state != SLOT_DECODING && state != SLOT_SHOWN && state != SLOT_HELD && !is_wanted(slots[s].index)) {
+            victim = &slots[s];
+        }
+    }
+    if (victim == NULL) return NULL;
+
+    if (!victim->allocated) {
+        if (!pax_buf_init(&victim->image, NULL, frame_width, frame_height, IMAGE_BUF_TYPE)) {
+            ESP_LOGE(TAG, "Failed to allocate a %dx%d frame", frame_width, frame_height);
+            // Reported to a waiting image_cache_take like a failed decode,
+            // which frees the slot again
+            victim->state = SLOT_FAILED;
+            victim->index = index;
+            return NULL;
+        }
+        victim->allocated = true;
+    }
+    victim->state = SLOT_DECODING;
+    victim->index = index;
+    return victim;
+}
+
+// Pick the most important wanted index that is neither cached nor in progress
+// and claim a slot for it. Must be called with the lock held.
+static cache_slot_t* claim_job(void) {
+    for (size_t i = 0; i < wanted_count; i++) {
+        if (find_slot(wanted[i]) == NULL) return claim_slot(wanted[i]);
+    }
+    return NULL;
+}
+
+// The wanted index that claim_job would pick next, else ahead_index if it is
+// not cached, else -1. Must be called with the lock held.
+static int next_job(void) {
+    for (size_t i = 0; i < wanted_count; i++) {
+        if (find_slot(wanted[i]) == NULL) return wanted[i];
+    }
+    return ahead_index >= 0 && find_slot(ahead_index) == NULL ? ahead_index : -1;
+}
+
+// Decode into a claimed slot. Must be called without the lock held.
+static void decode_slot(cache_slot_t* slot, int index, uint32_t job_generation) {
+    bool decoded = decode_fn(index, &slot->image, decode_ctx);
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (job_generation != generation) {
+        slot->state = SLOT_EMPTY;
+    } else {
+        slot->state = decoded ? SLOT_READY : SLOT_FAILED;
+    }
+    xSemaphoreGive(lock);
+}
+
+static void decoder_task_fn(void* arg) {
+    (void)arg;
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Work through the wanted list until every wanted index has a slot
+        while (true) {
+            xSemaphoreTake(lock, portMAX_DELAY);
+            cache_slot_t* slot           = claim_job();
+            int           index          = slot ? slot->index : -1;
+            int           next           = slot ? next_job() : -1;
+            uint32_t      job_generation = generation;
+            xSemaphoreGive(lock);
+            if (slot == NULL) {
+                // Also wakes a waiter whose image could not get a frame
+                xSemaphoreGive(decode_done);
+                break;
+            }
+            if (next >= 0 && next_fn != NULL) next_fn(next, decode_ctx);
+
+            ESP_LOGD(TAG, "Prefetching image %d", index);
+            decode_slot(slot, index, job_generation);
+            xSemaphoreGive(decode_done);
+        }
+    }
+}
+
+bool image_cache_init(image_cache_decode_fn decode, image_cache_next_fn next, void* ctx, int width, int height) {
+    decode_fn    = decode;
+    next_fn      = next;
+    decode_ctx   = ctx;
+    frame_width  = width;
+    frame_height = height;
+    lock         = xSemaphoreCreateMutex();
+    decode_done  = xSemaphoreCreateBinary();
+    if (lock == NULL || decode_done == NULL) {
+        ESP_LOGE(TAG, "Failed to create decoder synchronisation primitives");
+        return false;
+    }
+    if (xTaskCreate(decoder_task_fn, "decoder", DECODER_TASK_STACK, NULL, DECODER_TASK_PRIORITY, &decoder_task) !=
+        pdPASS) {
+        ESP_LOGE(TAG, "Failed to start decoder task");
+        decoder_task = NULL;
+        return false;
+    }
+    return true;
+}
+
+void image_cache_prefetch(const int* indices, size_t count, int look_ahead) {
+    if (decoder_task == NULL) return;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    ahead_index  = look_ahead;
+    wanted_count = 0;
+    for (size_t i = 0; i < count && wanted_count < MAX_WANTED; i++) {
+        if (indices[i] >= 0 && !is_wanted(indices[i])) {
+            wanted[wanted_count++] = indices[i];
+        }
+    }
+    xSemaphoreGive(lock);
+    xTaskNotifyGive(decoder_task);
+}
+
+const pax_buf_t* image_cache_take(int index) {
+    if (lock == NULL || index < 0) return NULL;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (find_slot(index) == NULL && !is_wanted(index)) {
+        want_first(index);
+    }
+    while (true) {
+        cache_slot_t* slot = find_slot(index);
+        if (slot != NULL && (slot->state == SLOT_READY || slot->state == SLOT_SHOWN || slot->state == SLOT_HELD)) {
+            // The previous frame stays cached, so going back to it is free
+            for (int i = 0; i < IMAGE_CACHE_SLOTS; i++) {
+                if (slots[i].state == SLOT_SHOWN) slots[i].state = hold_shown ? SLOT_HELD : SLOT_READY;
+            }
+            slot->state = SLOT_SHOWN;
+            xSemaphoreGive(lock);
+            if (decoder_task != NULL) xTaskNotifyGive(decoder_task);
+            return &slot->image;
+        }
+        if (slot != NULL && slot->state == SLOT_FAILED) {
+            // Out of memory rather than a bad file: try again next time
+            if (!slot->allocated) slot->state = SLOT_EMPTY;
+            break;
+        }
+
+        if (decoder_task == NULL) {
+            // No background task: decode on the calling task
+            uint32_t job_generation = generation;
+            slot                    = claim_slot(index);
+            if (slot == NULL) break;
+            xSemaphoreGive(lock);
+            decode_slot(slot, index, job_generation);
+            xSemaphoreTake(lock, portMAX_DELAY);
+            continue;
+        }
+        // Dropped from the wanted list by a newer request before it was started
+        if (slot == NULL && !is_wanted(index)) break;
+
+        xSemaphoreGive(lock);
+        xTaskNotifyGive(decoder_task);
+        xSemaphoreTake(decode_done, portMAX_DELAY);
+        xSemaphoreTake(lock, portMAX_DELAY);
+    }
+    xSemaphoreGive(lock);
+    return NULL;
+}
+
+pax_buf_t* image_cache_modify_shown(void) {
+    if (lock == NULL) return NULL;
+
+    pax_buf_t* image = NULL;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < IMAGE_CACHE_SLOTS; i++) {
+        if (slots[i].state == SLOT_SHOWN) {
+            slots[i].index = -1;
+            image          = &slots[i].image;
+        }
+    }
+    xSemaphoreGive(lock);
+    return image;
+}
+
+void image_cache_hold_shown(void) {
+    if (lock == NULL) return;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    hold_shown = true;
+    xSemaphoreGive(lock);
+}
+
+void image_cache_release_held(void) {
+    if (lock == NULL) return;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    hold_shown = false;
+    for (int i = 0; i < IMAGE_CACHE_SLOTS; i++) {
+        if (slots[i].state == SLOT_HELD) slots[i].state = SLOT_READY;
+    }
+    xSemaphoreGive(lock);
+    if (decoder_task != NULL) xTaskNotifyGive(decoder_task);
+}
+
+void image_cache_invalidate(void) {
+    if (lock == NULL) return;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    generation++;
+    wanted_count = 0;
+    ahead_index  = -1;
+    for (int i = 0; i < IMAGE_CACHE_SLOTS; i++) {
+        if (slots[i].state == SLOT_SHOWN || slots[i].state == SLOT_HELD) {
+            // Still on screen, but no longer the image at its old index
+            slots[i].index = -1;
+        } else if (slots[i].state != SLOT_DECODING) {
+            slots[i].state = SLOT_EMPTY;
+        }
+    }
+    // Let decodes of the old list finish, the caller may free what they read
+    while (is_decoding()) {
+        xSemaphoreGive(lock);
+        xSemaphoreTake(decode_done, portMAX_DELAY);
+        xSemaphoreTake(lock, portMAX_DELAY);
+    }
+    xSemaphoreGive(lock);
+}
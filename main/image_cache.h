@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "pax_gfx.h"
+#include "sdkconfig.h"
+
+// Number of decoded frames kept in memory: the image being shown plus its
+// neighbours (next, previous and the pending random pick). Frames are
+// allocated once and reused, so decoding never allocates a full frame.
+#if CONFIG_IDF_TARGET_ESP32
+#define IMAGE_CACHE_SLOTS 2  // 4 MB of PSRAM: the shown image and one neighbour
+#else
+#define IMAGE_CACHE_SLOTS 4
+#endif
+
+// Decodes the image at index into dst, an existing IMAGE_BUF_TYPE buffer
+// of the dimensions given to image_cache_init. Called from the decoder task.
+typedef bool (*image_cache_decode_fn)(int index, pax_buf_t* dst, void* ctx);
+
+// Told the index the decoder task expects to need after the one it is
+// starting on, e.g. to read its file meanwhile. Called from the decoder task.
+typedef void (*image_cache_next_fn)(int index, void* ctx);
+
+// Start the background decoder task. Frames are width x height pixels; next
+// may be NULL. If the task cannot be started, image_cache_take decodes on the
+// calling task.
+bool image_cache_init(image_cache_decode_fn decode, image_cache_next_fn next, void* ctx, int width, int height);
+
+// Replace the set of indices the decoder should keep ready, most important
+// first. Queued work for indices no longer wanted is dropped, and a decode
+// that is already running for one of them is kept as a spare. The next
+// function is told about look_ahead, if not -1, when it starts on the last of
+// them, e.g. the image after the next one so its file is read by the time it
+// is wanted.
+void image_cache_prefetch(const int* indices, size_t count, int look_ahead);
+
+// Get the decoded frame for index, decoding it first if it is not cached and
+// waiting for it if the decoder is working on it. The frame stays valid until
+// the next successful call. Returns NULL if the image cannot be decoded, in
+// which case the previously returned frame stays valid. A bad file is
+// remembered, while a frame that could not be allocated is tried again.
+const pax_buf_t* image_cache_take(int index);
+
+// The frame returned by the last image_cache_take, to draw on, e.g. the
+// frames of an animation. It stops being the cached image of its index, so
+// taking that index again decodes it anew. Returns NULL if there is none.
+pax_buf_t* image_cache_modify_shown(void);
+
+// Keep the frame being shown valid through the next image_cache_take, e.g. to
+// transition from it to the next image, until image_cache_release_held. The
+// decoder cannot reuse it meanwhile, so release it as soon as possible.
+void image_cache_hold_shown(void);
+
+void image_cache_release_held(void);
+
+// Drop every cached frame except the one being shown, e.g. after the image
+// list has changed. Waits for a decode that is running, so once this returns
+// the decode function is not called for an index of the old list.
+void image_cache_invalidate(void);
@@ -0,0 +1,303 @@
+#include "image_file.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "power.h"
+#include "sdkconfig.h"
+
+static char const TAG[] = "image_file";
+
+#define BUFFER_ALIGN        128          // cache lines of the targets, so the card can DMA straight into buffers
+#define MAX_BUFFERED        4            // files with a buffer of their own at once, others get stdio's
+#define AHEAD_SLOTS         2            // one for the file being decoded from memory, one for the file after it
+#define AHEAD_CHUNK         (64 * 1024)  // read between checks that the file is still wanted
+#define AHEAD_PATH_LENGTH   528          // an image path and its .wag suffix
+#define AHEAD_TASK_STACK    4096
+#define AHEAD_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+
+typedef enum {
+    AHEAD_IDLE,
+    AHEAD_QUEUED,   // path is to be read
+    AHEAD_READING,  // by the task, which stops early once the state changes
+    AHEAD_READY,
+    AHEAD_OPEN,  // read through stream, data is left alone until it is closed
+} ahead_state_t;
+
+typedef struct {
+    ahead_state_t state;
+    uint32_t      request;  // order of the requests, the oldest is replaced first
+    size_t        size;
+    uint8_t*      data;
+    FILE*         stream;
+    char          path[AHEAD_PATH_LENGTH];
+} ahead_slot_t;
+
+typedef struct {
+    FILE* fd;
+    void* buffer;
+} buffered_file_t;
+
+static SemaphoreHandle_t  lock        = NULL;
+static size_t             buffer_size = CONFIG_IMAGEWAG_SD_READ_BUFFER_KB * 1024;
+static buffered_file_t    buffered[MAX_BUFFERED];
+static image_file_stats_t stats;
+
+static SemaphoreHandle_t ahead_wake     = NULL;
+static SemaphoreHandle_t ahead_done     = NULL;
+static ahead_slot_t      ahead[AHEAD_SLOTS];
+static size_t            ahead_capacity = 0;  // 0 if files are not read ahead
+static uint32_t          ahead_requests = 0;
+static bool              ahead_waiting  = false;  // an open waits for a read to finish
+
+// The slot that has or is getting path, NULL if none. Must be called with the lock held.
+static ahead_slot_t* find_ahead(const char* path) {
+    for (int i = 0; i < AHEAD_SLOTS; i++) {
+        if (ahead[i].state != AHEAD_IDLE && strcmp(ahead[i].path, path) == 0) return &ahead[i];
+    }
+    return NULL;
+}
+
+// Whether the task should go on reading into slot: nobody has asked for another file in it
+static bool still_wanted(ahead_slot_t* slot) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool wanted = slot->state == AHEAD_READING;
+    xSemaphoreGive(lock);
+    return wanted;
+}
+
+// Read path into the slot in large chunks, straight into its buffer rather
+// than through stdio. Returns its size, 0 if it does not fit, cannot be read
+// or is no longer wanted.
+static size_t read_whole(ahead_slot_t* slot, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    bool        fits = fstat(fd, &st) == 0 && st.st_size > 0 && (uint64_t)st.st_size <= ahead_capacity;
+    size_t      size = fits ? st.st_size : 0;
+    size_t      done = 0;
+    while (done < size && still_wanted(slot)) {
+        ssize_t n = read(fd, slot->data + done, size - done < AHEAD_CHUNK ? size - done : AHEAD_CHUNK);
+        if (n <= 0) break;
+        done += n;
+    }
+    close(fd);
+    return done == size ? size : 0;
+}
+
+// Claim the queued slot asked for first, NULL if there is none. Must be
+// called with the lock held.
+static ahead_slot_t* claim_queued(void) {
+    ahead_slot_t* slot = NULL;
+    for (int i = 0; i < AHEAD_SLOTS; i++) {
+        if (ahead[i].state == AHEAD_QUEUED && (slot == NULL || ahead[i].request < slot->request)) slot = &ahead[i];
+    }
+    if (slot != NULL) slot->state = AHEAD_READING;
+    return slot;
+}
+
+static void read_ahead_task(void* arg) {
+    (void)arg;
+    char path[AHEAD_PATH_LENGTH];
+    while (true) {
+        xSemaphoreTake(ahead_wake, portMAX_DELAY);
+        while (true) {
+            xSemaphoreTake(lock, portMAX_DELAY);
+            ahead_slot_t* slot = claim_queued();
+            if (slot != NULL) memcpy(path, slot->path, sizeof(path));
+            xSemaphoreGive(lock);
+            if (slot == NULL) break;
+
+            power_hold();
+            int64_t began = esp_timer_get_time();
+            size_t  size  = read_whole(slot, path);
+            int64_t took  = esp_timer_get_time() - began;
+            power_release();
+
+            xSemaphoreTake(lock, portMAX_DELAY);
+            if (slot->state == AHEAD_READING) {
+                slot->state = size > 0 ? AHEAD_READY : AHEAD_IDLE;
+                slot->size  = size;
+                if (size > 0) {
+                    stats.files++;
+                    stats.bytes   += size;
+                    stats.read_us += took;
+                }
+            }
+            xSemaphoreGive(lock);
+            xSemaphoreGive(ahead_done);
+            ESP_LOGD(TAG, "Read ahead %s: %zu bytes in %" PRId64 " us", path, size, took);
+        }
+    }
+}
+
+void image_file_init(void) {
+    lock = xSemaphoreCreateMutex();
+    if (lock == NULL) {
+        ESP_LOGW(TAG, "Failed to create the file lock, reading files with stdio's buffering");
+        return;
+    }
+    size_t capacity = (size_t)CONFIG_IMAGEWAG_SD_READ_AHEAD_KB * 1024;
+    if (capacity == 0) return;
+
+    // The card DMAs straight into PSRAM where the target can, else through the driver's bounce buffer
+    bool allocated = true;
+    for (int i = 0; i < AHEAD_SLOTS; i++) {
+        ahead[i].data = heap_caps_aligned_alloc(BUFFER_ALIGN, capacity, MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA);
+        if (ahead[i].data == NULL) ahead[i].data = heap_caps_aligned_alloc(BUFFER_ALIGN, capacity, MALLOC_CAP_SPIRAM);
+        allocated = allocated && ahead[i].data != NULL;
+    }
+    ahead_wake = xSemaphoreCreateBinary();
+    ahead_done = xSemaphoreCreateBinary();
+    if (!allocated || ahead_wake == NULL || ahead_done == NULL ||
+        xTaskCreate(read_ahead_task, "read_ahead", AHEAD_TASK_STACK, NULL, AHEAD_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGW(TAG, "Failed to set up reading ahead, reading files when they are opened");
+        for (int i = 0; i < AHEAD_SLOTS; i++) {
+            heap_caps_free(ahead[i].data);
+            ahead[i].data = NULL;
+        }
+        return;
+    }
+    ahead_capacity = capacity;
+    ESP_LOGI(TAG, "Reading files through %zu KB buffers, up to %zu KB ahead", buffer_size / 1024, capacity / 1024);
+}
+
+// The read-ahead copy of path as a memory stream, waiting for it if the read
+// is under way: part of the file is in memory already. NULL if there is none.
+static FILE* open_read_ahead(const char* path) {
+    FILE* fd = NULL;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    ahead_slot_t* slot = find_ahead(path);
+    // Not started yet: reading it here is as fast
+    if (slot != NULL && slot->state == AHEAD_QUEUED) slot->state = AHEAD_IDLE;
+    if (slot != NULL && slot->state == AHEAD_READING && !ahead_waiting) {
+        ahead_waiting = true;
+        while (slot->state == AHEAD_READING && strcmp(slot->path, path) == 0) {
+            xSemaphoreGive(lock);
+            xSemaphoreTake(ahead_done, portMAX_DELAY);
+            xSemaphoreTake(lock, portMAX_DELAY);
+        }
+        ahead_waiting = false;
+    }
+    if (slot != NULL && slot->state == AHEAD_READY && strcmp(slot->path, path) == 0) {
+        fd = fmemopen(slot->data, slot->size, "rb");
+    }
+    if (fd != NULL) {
+        slot->state  = AHEAD_OPEN;
+        slot->stream = fd;
+        stats.hits++;
+    }
+    xSemaphoreGive(lock);
+    return fd;
+}
+
+// Give fd a buffer of its own if there is room for one, before it is read
+static void give_buffer(FILE* fd) {
+    if (buffer_size == 0) return;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < MAX_BUFFERED; i++) {
+        if (buffered[i].fd != NULL) continue;
+        void* buffer = heap_caps_aligned_alloc(BUFFER_ALIGN, buffer_size, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+        if (buffer != NULL && setvbuf(fd, buffer, _IOFBF, buffer_size) == 0) {
+            buffered[i].fd     = fd;
+            buffered[i].buffer = buffer;
+        } else {
+            heap_caps_free(buffer);
+        }
+        break;
+    }
+    xSemaphoreGive(lock);
+}
+
+FILE* image_file_open(const char* path) {
+    if (lock == NULL) return fopen(path, "rb");
+    FILE* fd = ahead_capacity > 0 ? open_read_ahead(path) : NULL;
+    if (fd == NULL) {
+        fd = fopen(path, "rb");
+        if (fd != NULL) give_buffer(fd);
+    }
+    if (fd != NULL) {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        stats.opened++;
+        xSemaphoreGive(lock);
+    }
+    return fd;
+}
+
+void image_file_close(FILE* fd) {
+    if (fd == NULL) return;
+    if (lock == NULL) {
+        fclose(fd);
+        return;
+    }
+    // Forget fd before closing it: another task may get the same FILE next
+    ahead_slot_t* slot   = NULL;
+    void*         buffer = NULL;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < AHEAD_SLOTS && slot == NULL; i++) {
+        if (ahead[i].state == AHEAD_OPEN && ahead[i].stream == fd) slot = &ahead[i];
+    }
+    if (slot != NULL) slot->stream = NULL;
+    for (int i = 0; i < MAX_BUFFERED && slot == NULL; i++) {
+        if (buffered[i].fd == fd) {
+            buffer             = buffered[i].buffer;
+            buffered[i].fd     = NULL;
+            buffered[i].buffer = NULL;
+            break;
+        }
+    }
+    xSemaphoreGive(lock);
+    fclose(fd);
+    heap_caps_free(buffer);
+    if (slot != NULL) {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        slot->state = AHEAD_IDLE;
+        xSemaphoreGive(lock);
+    }
+}
+
+// Whether a is a better slot than b to read a new file into: a free one, else
+// the one asked for longest ago. Must be called with the lock held.
+static bool better_victim(const ahead_slot_t* a, const ahead_slot_t* b) {
+    if (a->state == AHEAD_OPEN) return false;
+    if (b == NULL) return true;
+    if ((a->state == AHEAD_IDLE) != (b->state == AHEAD_IDLE)) return a->state == AHEAD_IDLE;
+    return a->request < b->request;
+}
+
+void image_file_read_ahead(const char* path) {
+    if (ahead_capacity == 0 || strlen(path) >= AHEAD_PATH_LENGTH) return;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    ahead_slot_t* slot = NULL;
+    if (find_ahead(path) == NULL) {
+        for (int i = 0; i < AHEAD_SLOTS; i++) {
+            if (better_victim(&ahead[i], slot)) slot = &ahead[i];
+        }
+    }
+    if (slot != NULL) {
+        strcpy(slot->path, path);
+        slot->state   = AHEAD_QUEUED;
+        slot->request = ++ahead_requests;
+    }
+    xSemaphoreGive(lock);
+    if (slot != NULL) xSemaphoreGive(ahead_wake);
+}
+
+void image_file_set_buffer_size(size_t bytes) {
+    buffer_size = bytes;
+}
+
+void image_file_get_stats(image_file_stats_t* out) {
+    memset(out, 0, sizeof(*out));
+    if (lock == NULL) return;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(lock);
+}
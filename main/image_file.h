@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Image files on the SD card. Stdio's default buffer on ESP-IDF is 128 bytes,
+// so every refill is a single-sector transfer or less; files opened here get
+// a DMA-capable buffer of CONFIG_IMAGEWAG_SD_READ_BUFFER_KB instead, which
+// the card fills in multi-sector transfers. On top of that a background task
+// reads files ahead into PSRAM, the next one while the one before it is
+// decoded from memory; opening a file read ahead reads from memory.
+
+typedef struct {
+    uint32_t opened;   // files opened with image_file_open
+    uint32_t hits;     // of which read ahead
+    uint32_t files;    // files read ahead
+    uint64_t bytes;    // and their size
+    int64_t  read_us;  // time reading them took
+} image_file_stats_t;
+
+// Allocate the read-ahead buffer and start the task filling it. Without it,
+// or if it fails, files are read from the card when they are opened.
+void image_file_init(void);
+
+// Open path for reading, from memory if it has been read ahead, else from the
+// card with a large buffer. Returns NULL on failure, like fopen.
+FILE* image_file_open(const char* path);
+
+// Close a file opened with image_file_open
+void image_file_close(FILE* fd);
+
+// Read path into memory in the background, replacing the oldest file read
+// ahead that is not open. Files that do not fit a read-ahead buffer are left
+// to be read when they are opened.
+void image_file_read_ahead(const char* path);
+
+// Buffer given to files opened from the card, 0 for stdio's default. For
+// benchmarks: the default is CONFIG_IMAGEWAG_SD_READ_BUFFER_KB.
+void image_file_set_buffer_size(size_t bytes);
+
+void image_file_get_stats(image_file_stats_t* stats);
@@ -0,0 +1,187 @@
+#include "image_ops.h"
+#include <string.h>
+
+// x / 255 for x in [0, 255 * 255], rounded
+static inline uint32_t div255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+void image_blend_argb_over_rgb888(uint8_t* dst, const uint8_t* base, const uint32_t* sprite, size_t count) {
+    for (size_t i = 0; i < count; i++, dst += 3, base += 3) {
+        uint32_t col = sprite[i];
+        uint32_t a   = col >> 24;
+        if (a == 0) {
+            if (dst != base) {
+                dst[0] = base[0];
+                dst[1] = base[1];
+                dst[2] = base[2];
+            }
+            continue;
+        }
+        uint32_t inv = 255 - a;
+        dst[0]       = div255((col & 0xFF) * a + base[0] * inv);
+        dst[1]       = div255(((col >> 8) & 0xFF) * a + base[1] * inv);
+        dst[2]       = div255(((col >> 16) & 0xFF) * a + base[2] * inv);
+    }
+}
+
+static inline void swap_pixel(uint8_t* a, uint8_t* b) {
+    uint8_t t0 = a[0], t1 = a[1], t2 = a[2];
+    a[0]       = b[0];
+    a[1]       = b[1];
+    a[2]       = b[2];
+    b[0]       = t0;
+    b[1]       = t1;
+    b[2]       = t2;
+}
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+// Reverse the order of the four 3-byte pixels held in three little-endian
+// words: [A B C D] becomes [D C B A]
+static inline void reverse_quad(const uint32_t in[3], uint32_t out[3]) {
+    out[0] = (in[2] >> 8) | ((in[1] << 8) & 0xFF000000u);
+    out[1] = (in[1] >> 24) | ((in[2] & 0xFFu) << 8) | ((in[0] >> 24) << 16) | ((in[1] & 0xFFu) << 24);
+    out[2] = ((in[1] >> 8) & 0xFFu) | (in[0] << 8);
+}
+
+// Pixels taken from each end of the buffer per step: 48 bytes, 12 words
+#define FLIP_BLOCK_QUADS 4
+#define FLIP_BLOCK_WORDS (FLIP_BLOCK_QUADS * 3)
+#endif
+
+void image_flip_rgb888_180(uint8_t* pixels, size_t count) {
+    size_t lo = 0;
+    size_t hi = count;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // Swap a block from the front with a block from the back, reversing both
+    // with word shifts. The fixed-size word loops are what lets host compilers
+    // vectorise this.
+    while (hi - lo >= 2 * 4 * FLIP_BLOCK_QUADS) {
+        uint8_t* front = pixels + lo * 3;
+        uint8_t* back  = pixels + (hi - 4 * FLIP_BLOCK_QUADS) * 3;
+        uint32_t f[FLIP_BLOCK_WORDS], b[FLIP_BLOCK_WORDS], rf[FLIP_BLOCK_WORDS], rb[FLIP_BLOCK_WORDS];
+        memcpy(f, front, sizeof(f));
+        memcpy(b, back, sizeof(b));
+        for (int q = 0; q < FLIP_BLOCK_QUADS; q++) {
+            reverse_quad(b + 3 * (FLIP_BLOCK_QUADS - 1 - q), rf + 3 * q);
+            reverse_quad(f + 3 * (FLIP_BLOCK_QUADS - 1 - q), rb + 3 * q);
+        }
+        memcpy(front, rf, sizeof(rf));
+        memcpy(back, rb, sizeof(rb));
+        lo += 4 * FLIP_BLOCK_QUADS;
+        hi -= 4 * FLIP_BLOCK_QUADS;
+    }
+#endif
+
+    while (hi - lo >= 2) {
+        hi--;
+        swap_pixel(pixels + lo * 3, pixels + hi * 3);
+        lo++;
+    }
+}
+
+void image_reverse_copy_rgb888(uint8_t* dst, const uint8_t* src, size_t count) {
+    size_t i = 0;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    const uint8_t* back = src + count * 3;
+    for (; count - i >= 4; i += 4) {
+        back -= 12;
+        uint32_t in[3], out[3];
+        memcpy(in, back, sizeof(in));
+        reverse_quad(in, out);
+        memcpy(dst + i * 3, out, sizeof(out));
+    }
+#endif
+
+    for (; i < count; i++) {
+        const uint8_t* p = src + (count - 1 - i) * 3;
+        dst[i * 3]       = p[0];
+        dst[i * 3 + 1]   = p[1];
+        dst[i * 3 + 2]   = p[2];
+    }
+}
+
+// Mix the four bytes of two words, two at a time in 16-bit lanes: a lane
+// holds at most 255 * 256, so the products never carry into the next one
+static inline uint32_t mix_bytes(uint32_t a, uint32_t b, uint32_t alpha) {
+    uint32_t inv  = 256 - alpha;
+    uint32_t even = (((a & 0x00FF00FFu) * inv + (b & 0x00FF00FFu) * alpha) >> 8) & 0x00FF00FFu;
+    uint32_t odd  = ((a >> 8) & 0x00FF00FFu) * inv + ((b >> 8) & 0x00FF00FFu) * alpha;
+    return even | (odd & 0xFF00FF00u);
+}
+
+void image_crossfade_rgb888(uint8_t* dst, const uint8_t* a, const uint8_t* b, size_t count, uint32_t alpha) {
+    // Channels are mixed alike, so the pixels are just a run of bytes
+    size_t bytes = count * 3;
+    size_t i     = 0;
+    for (; bytes - i >= 8; i += 8) {
+        uint32_t wa[2], wb[2];
+        memcpy(wa, a + i, sizeof(wa));
+        memcpy(wb, b + i, sizeof(wb));
+        wa[0] = mix_bytes(wa[0], wb[0], alpha);
+        wa[1] = mix_bytes(wa[1], wb[1], alpha);
+        memcpy(dst + i, wa, sizeof(wa));
+    }
+    for (; i < bytes; i++) {
+        dst[i] = (uint8_t)((a[i] * (256 - alpha) + b[i] * alpha) >> 8);
+    }
+}
+
+void image_blend_argb_over_rgb565(uint8_t* dst, const uint8_t* base, const uint32_t* sprite, size_t count) {
+    for (size_t i = 0; i < count; i++, dst += 2, base += 2) {
+        uint32_t col = sprite[i];
+        uint32_t a   = col >> 24;
+        uint16_t pixel;
+        memcpy(&pixel, base, sizeof(pixel));
+        if (a != 0) {
+            // Widen to 8 bits per channel, repeating the top bits
+            uint32_t r   = pixel >> 11, g = (pixel >> 5) & 0x3F, b = pixel & 0x1F;
+            uint32_t inv = 255 - a;
+            r            = div255(((col >> 16) & 0xFF) * a + ((r << 3) | (r >> 2)) * inv);
+            g            = div255(((col >> 8) & 0xFF) * a + ((g << 2) | (g >> 4)) * inv);
+            b            = div255((col & 0xFF) * a + ((b << 3) | (b >> 2)) * inv);
+            pixel        = (uint16_t)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+        } else if (dst == base) {
+            continue;
+        }
+        memcpy(dst, &pixel, sizeof(pixel));
+    }
+}
+
+void image_flip_rgb565_180(uint8_t* pixels, size_t count) {
+    uint16_t* lo = (uint16_t*)pixels;
+    uint16_t* hi = lo + count;
+    while (hi - lo >= 2) {
+        uint16_t t = *--hi;
+        *hi        = *lo;
+        *lo++      = t;
+    }
+}
+
+void image_reverse_copy_rgb565(uint8_t* dst, const uint8_t* src, size_t count) {
+    uint16_t*       out = (uint16_t*)dst;
+    const uint16_t* in  = (const uint16_t*)src + count;
+    for (size_t i = 0; i < count; i++) {
+        out[i] = *--in;
+    }
+}
+
+// Spread a 565 pixel over a word as 00000GGGGGG00000RRRRR000000BBBBB, leaving
+// five spare bits above each channel for a 5-bit weight
+static inline uint32_t spread_565(uint16_t pixel) {
+    return (pixel | ((uint32_t)pixel << 16)) & 0x07E0F81Fu;
+}
+
+void image_crossfade_rgb565(uint8_t* dst, const uint8_t* a, const uint8_t* b, size_t count, uint32_t alpha) {
+    const uint16_t* in_a   = (const uint16_t*)a;
+    const uint16_t* in_b   = (const uint16_t*)b;
+    uint16_t*       out    = (uint16_t*)dst;
+    uint32_t        weight = alpha >> 3;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t mixed = ((spread_565(in_a[i]) * (32 - weight) + spread_565(in_b[i]) * weight) >> 5) & 0x07E0F81Fu;
+        out[i]         = (uint16_t)(mixed | (mixed >> 16));
+    }
+}
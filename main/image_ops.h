@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Pixel kernels working on raw buffer memory. PAX_BUF_24_888RGB pixels are
+// stored as B, G, R bytes; PAX_BUF_16_565RGB pixels are native uint16_t;
+// PAX_BUF_32_8888ARGB pixels are native pax_col_t.
+
+// Composite count ARGB sprite pixels over 24-bit base pixels into dst.
+// dst may be the same buffer as base.
+void image_blend_argb_over_rgb888(uint8_t* dst, const uint8_t* base, const uint32_t* sprite, size_t count);
+
+// Rotate count 24-bit pixels by 180 degrees in place, i.e. reverse their order.
+// Single pass, no allocation.
+void image_flip_rgb888_180(uint8_t* pixels, size_t count);
+
+// Copy count 24-bit pixels from src to dst in reverse order, so that dst holds
+// src rotated by 180 degrees. The buffers must not overlap.
+void image_reverse_copy_rgb888(uint8_t* dst, const uint8_t* src, size_t count);
+
+// Mix count 24-bit pixels of a and b into dst, b weighted alpha / 256 for
+// alpha 0-256. dst may be a or b.
+void image_crossfade_rgb888(uint8_t* dst, const uint8_t* a, const uint8_t* b, size_t count, uint32_t alpha);
+
+// The same for 16-bit RGB565 pixels. Crossfades go in 32 steps, one per
+// level of the 5-bit channels.
+void image_blend_argb_over_rgb565(uint8_t* dst, const uint8_t* base, const uint32_t* sprite, size_t count);
+void image_flip_rgb565_180(uint8_t* pixels, size_t count);
+void image_reverse_copy_rgb565(uint8_t* dst, const uint8_t* src, size_t count);
+void image_crossfade_rgb565(uint8_t* dst, const uint8_t* a, const uint8_t* b, size_t count, uint32_t alpha);
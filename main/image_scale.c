@@ -0,0 +1,334 @@
+#include "image_scale.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "pixel_format.h"
+
+static char const TAG[] = "image_scale";
+
+// Source rows are RGB888, frames are IMAGE_BUF_TYPE
+#define SOURCE_BYTES_PER_PIXEL 3
+
+// Box filter averages use 8.24 fixed-point reciprocals, exact to the nearest
+// integer while fewer than this many source pixels fall in one output pixel
+#define BOX_MAX_PIXELS 32768
+
+typedef enum {
+    SCALE_COPY,
+    SCALE_BOX,
+    SCALE_BILINEAR,
+} scale_mode_t;
+
+struct image_scaler {
+    scale_mode_t mode;
+    uint8_t*     dst;         // first pixel of the scaled image in the frame
+    size_t       dst_stride;  // bytes per frame row
+    uint32_t     src_width;
+    uint32_t     src_height;
+    uint32_t     width;       // scaled size
+    uint32_t     height;
+    uint32_t     top;         // frame row of the scaled image's first row
+    uint32_t     next_row;    // output row written next
+
+    // Box filter
+    uint16_t* columns;     // source columns in each output column
+    uint32_t* sums;        // channel sums of the output row being collected
+    uint32_t  rows_added;  // source rows in those sums
+    uint32_t* reciprocal;  // 2^24 / n, rounded up, for n source pixels
+
+    // Bilinear
+    uint32_t* x_offset;  // byte offset of the left source pixel of each output column
+    uint8_t*  x_step;    // bytes to the right source pixel, 0 at the right edge
+    uint8_t*  x_weight;  // weight of the right source pixel, 0-255
+    uint8_t*  rows[2];   // source rows y & 1
+};
+
+void image_fit(uint32_t src_width, uint32_t src_height, uint32_t dst_width, uint32_t dst_height, uint32_t* width,
+               uint32_t* height) {
+    if ((uint64_t)src_width * dst_height >= (uint64_t)dst_width * src_height) {
+        // Limited by the width: bars above and below
+        *width  = dst_width;
+        *height = (uint32_t)(((uint64_t)src_height * dst_width * 2 + src_width) / (src_width * 2ULL));
+    } else {
+        *height = dst_height;
+        *width  = (uint32_t)(((uint64_t)src_width * dst_height * 2 + src_height) / (src_height * 2ULL));
+    }
+    if (*width == 0) *width = 1;
+    if (*height == 0) *height = 1;
+}
+
+// Fixed-point position in the source, 16.16, of the centre of output pixel i,
+// clamped to the first pixel
+static uint32_t source_position(uint32_t i, uint32_t src_size, uint32_t size) {
+    int64_t position = (((int64_t)i * 2 + 1) * src_size * 65536) / ((int64_t)size * 2) - 32768;
+    return position > 0 ? (uint32_t)position : 0;
+}
+
+// Black bars around the scaled image
+static void clear_bars(image_scaler_t* s, pax_buf_t* dst) {
+    uint8_t* frame      = pax_buf_get_pixels_rw(dst);
+    uint32_t dst_height = pax_buf_get_height(dst);
+    size_t   top        = (size_t)(s->dst - frame) / s->dst_stride;
+    size_t   left       = (size_t)(s->dst - frame) % s->dst_stride;
+    size_t   right      = s->dst_stride - left - (size_t)s->width * IMAGE_BYTES_PER_PIXEL;
+
+    memset(frame, 0, top * s->dst_stride);
+    memset(frame + (top + s->height) * s->dst_stride, 0, (dst_height - top - s->height) * s->dst_stride);
+    if (left == 0 && right == 0) return;
+    for (uint32_t y = 0; y < s->height; y++) {
+        uint8_t* row = s->dst + y * s->dst_stride;
+        memset(row - left, 0, left);
+        memset(row + (size_t)s->width * IMAGE_BYTES_PER_PIXEL, 0, right);
+    }
+}
+
+static bool init_box(image_scaler_t* s) {
+    s->columns = calloc(s->width, sizeof(*s->columns));
+    s->sums    = calloc((size_t)s->width * SOURCE_BYTES_PER_PIXEL, sizeof(*s->sums));
+    if (s->columns == NULL || s->sums == NULL) return false;
+
+    // Source column x goes to output column x * width / src_width
+    uint32_t widest = 0;
+    for (uint32_t x = 0, column = 0; column < s->width; column++) {
+        uint32_t end = (uint32_t)(((uint64_t)(column + 1) * s->src_width + s->width - 1) / s->width);
+        s->columns[column] = (uint16_t)(end - x);
+        if (end - x > widest) widest = end - x;
+        x = end;
+    }
+    uint32_t tallest = (s->src_height + s->height - 1) / s->height + 1;
+    if ((uint64_t)widest * tallest >= BOX_MAX_PIXELS) {
+        ESP_LOGW(TAG, "Cannot reduce %" PRIu32 "x%" PRIu32 " to %" PRIu32 "x%" PRIu32, s->src_width, s->src_height,
+                 s->width, s->height);
+        return false;
+    }
+    s->reciprocal = malloc((widest * tallest + 1) * sizeof(*s->reciprocal));
+    if (s->reciprocal == NULL) return false;
+    for (uint32_t n = 1; n <= widest * tallest; n++) {
+        s->reciprocal[n] = ((1u << 24) + n - 1) / n;
+    }
+    return true;
+}
+
+static bool init_bilinear(image_scaler_t* s) {
+    s->x_offset = malloc(s->width * sizeof(*s->x_offset));
+    s->x_step   = malloc(s->width);
+    s->x_weight = malloc(s->width);
+    s->rows[0]  = malloc((size_t)s->src_width * SOURCE_BYTES_PER_PIXEL * 2);
+    if (s->x_offset == NULL || s->x_step == NULL || s->x_weight == NULL || s->rows[0] == NULL) return false;
+    s->rows[1] = s->rows[0] + (size_t)s->src_width * SOURCE_BYTES_PER_PIXEL;
+
+    for (uint32_t x = 0; x < s->width; x++) {
+        uint32_t position = source_position(x, s->src_width, s->width);
+        uint32_t left     = position >> 16;
+        if (left >= s->src_width - 1) {
+            left         = s->src_width - 1;
+            s->x_step[x] = 0;
+        } else {
+            s->x_step[x] = SOURCE_BYTES_PER_PIXEL;
+        }
+        s->x_offset[x] = left * SOURCE_BYTES_PER_PIXEL;
+        s->x_weight[x] = (uint8_t)(position >> 8);
+    }
+    return true;
+}
+
+image_scaler_t* image_scaler_create(uint32_t src_width, uint32_t src_height, pax_buf_t* dst) {
+    uint32_t dst_width  = pax_buf_get_width(dst);
+    uint32_t dst_height = pax_buf_get_height(dst);
+    if (pax_buf_get_type(dst) != IMAGE_BUF_TYPE || src_width == 0 || src_height == 0) return NULL;
+
+    image_scaler_t* s = calloc(1, sizeof(*s));
+    if (s == NULL) return NULL;
+    s->src_width  = src_width;
+    s->src_height = src_height;
+    image_fit(src_width, src_height, dst_width, dst_height, &s->width, &s->height);
+    s->dst_stride = (size_t)dst_width * IMAGE_BYTES_PER_PIXEL;
+    s->top        = (dst_height - s->height) / 2;
+    s->dst        = (uint8_t*)pax_buf_get_pixels_rw(dst) + s->top * s->dst_stride +
+             (dst_width - s->width) / 2 * IMAGE_BYTES_PER_PIXEL;
+
+    bool ok = true;
+    if (s->width == src_width && s->height == src_height) {
+        s->mode = SCALE_COPY;
+    } else if (s->width <= src_width && s->height <= src_height) {
+        s->mode = SCALE_BOX;
+        ok      = init_box(s);
+    } else {
+        s->mode = SCALE_BILINEAR;
+        ok      = init_bilinear(s);
+    }
+    if (!ok) {
+        image_scaler_destroy(s);
+        return NULL;
+    }
+    clear_bars(s, dst);
+    return s;
+}
+
+// Write the averages of the collected rows as the next output row
+static void box_flush(image_scaler_t* s) {
+    uint32_t        y   = s->next_row++;
+    uint8_t*        out = s->dst + y * s->dst_stride;
+    const uint32_t* sum = s->sums;
+    for (uint32_t x = 0; x < s->width; x++) {
+        uint32_t n     = s->columns[x] * s->rows_added;
+        uint64_t scale = s->reciprocal[n];
+        image_store_pixel(out, x, y, (uint32_t)(((sum[2] + n / 2) * scale) >> 24),
+                          (uint32_t)(((sum[1] + n / 2) * scale) >> 24), (uint32_t)(((sum[0] + n / 2) * scale) >> 24));
+        out += IMAGE_BYTES_PER_PIXEL;
+        sum += SOURCE_BYTES_PER_PIXEL;
+    }
+    memset(s->sums, 0, (size_t)s->width * SOURCE_BYTES_PER_PIXEL * sizeof(*s->sums));
+    s->rows_added = 0;
+}
+
+static void box_row(image_scaler_t* s, uint32_t y, const uint8_t* row) {
+    uint32_t* sum = s->sums;
+    for (uint32_t x = 0; x < s->width; x++) {
+        uint32_t r = 0, g = 0, b = 0;
+        for (uint32_t i = s->columns[x]; i > 0; i--) {
+            r += row[0];
+            g += row[1];
+            b += row[2];
+            row += SOURCE_BYTES_PER_PIXEL;
+        }
+        sum[0] += r;
+        sum[1] += g;
+        sum[2] += b;
+        sum += SOURCE_BYTES_PER_PIXEL;
+    }
+    s->rows_added++;
+
+    // Source row y goes to output row y * height / src_height
+    uint64_t next = (uint64_t)(y + 1) * s->height / s->src_height;
+    if (y + 1 == s->src_height || next != s->next_row) box_flush(s);
+}
+
+static void bilinear_emit(image_scaler_t* s, const uint8_t* top, const uint8_t* bottom, uint32_t y_weight) {
+    uint32_t y   = s->next_row++;
+    uint8_t* out = s->dst + y * s->dst_stride;
+    for (uint32_t x = 0; x < s->width; x++) {
+        const uint8_t* a  = top + s->x_offset[x];
+        const uint8_t* c  = bottom + s->x_offset[x];
+        uint32_t       fx = s->x_weight[x];
+        uint32_t       dx = s->x_step[x];
+        uint32_t       value[SOURCE_BYTES_PER_PIXEL];
+        for (int ch = 0; ch < SOURCE_BYTES_PER_PIXEL; ch++) {
+            uint32_t upper = a[ch] * (256 - fx) + a[ch + dx] * fx;
+            uint32_t lower = c[ch] * (256 - fx) + c[ch + dx] * fx;
+            value[ch]      = (upper * (256 - y_weight) + lower * y_weight + 32768) >> 16;
+        }
+        image_store_pixel(out, x, y, value[2], value[1], value[0]);
+        out += IMAGE_BYTES_PER_PIXEL;
+    }
+}
+
+// Source rows of output row y: the upper one is where rows must restart from
+static void bilinear_sources(image_scaler_t* s, uint32_t y, uint32_t* upper, uint32_t* lower, uint32_t* weight) {
+    uint32_t position = source_position(y, s->src_height, s->height);
+    *upper            = position >> 16;
+    *lower            = *upper + 1;
+    *weight           = (position >> 8) & 0xFF;
+    if (*upper >= s->src_height - 1) {
+        *upper = *lower = s->src_height - 1;
+        *weight         = 0;
+    }
+}
+
+static void bilinear_row(image_scaler_t* s, uint32_t y, const uint8_t* row) {
+    memcpy(s->rows[y & 1], row, (size_t)s->src_width * SOURCE_BYTES_PER_PIXEL);
+
+    // Emit every output row whose lower source row has arrived
+    while (s->next_row < s->height) {
+        uint32_t upper, lower, weight;
+        bilinear_sources(s, s->next_row, &upper, &lower, &weight);
+        if (lower > y) break;
+        bilinear_emit(s, s->rows[upper & 1], s->rows[lower & 1], weight);
+    }
+}
+
+static void copy_row(image_scaler_t* s, uint32_t y, const uint8_t* row) {
+    uint8_t* out = s->dst + y * s->dst_stride;
+#if CONFIG_IMAGEWAG_PIXEL_FORMAT_RGB565
+    for (uint32_t x = 0; x < s->width; x++, row += SOURCE_BYTES_PER_PIXEL, out += IMAGE_BYTES_PER_PIXEL) {
+        image_store_pixel(out, x, y, row[2], row[1], row[0]);
+    }
+#else
+    memcpy(out, row, (size_t)s->width * IMAGE_BYTES_PER_PIXEL);
+#endif
+}
+
+bool image_scaler_row(void* scaler, uint32_t y, const uint8_t* row) {
+    image_scaler_t* s = scaler;
+    // The header may come from an index that no longer matches the file
+    if (y >= s->src_height) return false;
+    switch (s->mode) {
+        case SCALE_COPY:     copy_row(s, y, row); break;
+        case SCALE_BOX:      box_row(s, y, row); break;
+        case SCALE_BILINEAR: bilinear_row(s, y, row); break;
+    }
+    return true;
+}
+
+void image_scaler_update(image_scaler_t* s, const uint8_t* image, size_t stride, uint32_t top, uint32_t bottom,
+                         uint32_t* dst_top, uint32_t* dst_bottom) {
+    if (bottom > s->src_height) bottom = s->src_height;
+    *dst_top = *dst_bottom = s->top;
+    if (top >= bottom) return;
+
+    // Rewind to the first output row the changed rows reach, and find the
+    // source rows that output row and the last one reached are made from
+    uint32_t first = top;
+    uint32_t end   = bottom;
+    switch (s->mode) {
+        case SCALE_COPY:
+            s->next_row = top;
+            break;
+        case SCALE_BOX: {
+            uint32_t first_row = (uint32_t)((uint64_t)top * s->height / s->src_height);
+            uint32_t end_row   = (uint32_t)((uint64_t)(bottom - 1) * s->height / s->src_height) + 1;
+            first = (uint32_t)(((uint64_t)first_row * s->src_height + s->height - 1) / s->height);
+            end   = (uint32_t)(((uint64_t)end_row * s->src_height + s->height - 1) / s->height);
+            if (end > s->src_height) end = s->src_height;
+            s->next_row   = first_row;
+            s->rows_added = 0;
+            memset(s->sums, 0, (size_t)s->width * SOURCE_BYTES_PER_PIXEL * sizeof(*s->sums));
+            break;
+        }
+        case SCALE_BILINEAR: {
+            uint32_t row = 0, upper = 0, lower = 0, weight;
+            for (; row < s->height; row++) {
+                bilinear_sources(s, row, &upper, &lower, &weight);
+                if (lower >= top) break;
+            }
+            if (row == s->height) return;
+            s->next_row = row;
+            first       = upper;
+            // Up to the last output row made partly from a changed row
+            for (; row < s->height; row++) {
+                bilinear_sources(s, row, &upper, &lower, &weight);
+                if (upper >= bottom) break;
+                end = lower + 1;
+            }
+            break;
+        }
+    }
+
+    uint32_t start_row = s->next_row;
+    for (uint32_t y = first; y < end; y++) image_scaler_row(s, y, image + y * stride);
+    *dst_top    = s->top + start_row;
+    *dst_bottom = s->top + (s->mode == SCALE_COPY ? bottom : s->next_row);
+}
+
+void image_scaler_destroy(image_scaler_t* s) {
+    if (s == NULL) return;
+    free(s->columns);
+    free(s->sums);
+    free(s->reciprocal);
+    free(s->x_offset);
+    free(s->x_step);
+    free(s->x_weight);
+    free(s->rows[0]);
+    free(s);
+}
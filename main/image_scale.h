@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "pax_gfx.h"
+
+// Streaming scaler from an image of any size into an IMAGE_BUF_TYPE frame.
+// The image is scaled to fit, keeping its aspect ratio, and centred, with
+// black bars on the sides it does not reach. Source rows are added top to
+// bottom as a streaming decoder produces them, so the source is never held in
+// full:
+//   - larger images are reduced with a box filter: each source pixel is added
+//     to the output pixel it falls in, keeping one row of sums
+//   - smaller images are enlarged bilinearly from the last two source rows
+//   - images of the frame's size are copied
+// Pixels are converted to the frame's format as they are written. All
+// arithmetic is integer.
+
+typedef struct image_scaler image_scaler_t;
+
+// The size of a src_width x src_height image scaled to fit dst_width x
+// dst_height, at least 1x1.
+void image_fit(uint32_t src_width, uint32_t src_height, uint32_t dst_width, uint32_t dst_height, uint32_t* width,
+               uint32_t* height);
+
+// Start scaling a src_width x src_height image into dst, clearing the bars.
+// Returns NULL if out of memory or the reduction is too large.
+image_scaler_t* image_scaler_create(uint32_t src_width, uint32_t src_height, pax_buf_t* dst);
+
+// Add source row y, src_width pixels in PAX_BUF_24_888RGB layout. Rows must
+// arrive in order. Has the signature of a png_row_fn, with the scaler as ctx.
+bool image_scaler_row(void* scaler, uint32_t y, const uint8_t* row);
+
+// Scale source rows [top, bottom) again after they changed, reading the whole
+// source from image, PAX_BUF_24_888RGB rows stride bytes apart, which every
+// row was added from before. Neighbouring rows the filter shares with them are
+// read too. *dst_top and *dst_bottom receive the frame rows rewritten.
+void image_scaler_update(image_scaler_t* scaler, const uint8_t* image, size_t stride, uint32_t top, uint32_t bottom,
+                         uint32_t* dst_top, uint32_t* dst_bottom);
+
+void image_scaler_destroy(image_scaler_t* scaler);
@@ -0,0 +1,289 @@
+#include "inflate.h"
+#include <string.h>
+
+#define WINDOW_MASK (INFLATE_WINDOW_SIZE - 1)
+
+// Output is handed to write once this much is pending. A single symbol adds
+// at most 258 bytes, so pending data never wraps onto itself in the window.
+#define FLUSH_THRESHOLD (INFLATE_WINDOW_SIZE / 4)
+
+static const uint16_t length_base[31] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27, 31,
+                                         35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 0,  0};
+static const uint8_t  length_extra[31] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                          3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0, 0, 0};
+static const uint16_t dist_base[32]    = {1,    2,    3,    4,    5,    7,     9,     13,    17,  25,   33,
+                                          49,   65,   97,   129,  193,  257,   385,   513,   769, 1025, 1537,
+                                          2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 0,   0};
+static const uint8_t  dist_extra[32]   = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6, 6,
+                                          7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 0, 0};
+static const uint8_t  code_length_order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static inline uint32_t bit_reverse(uint32_t v, int bits) {
+    v = ((v & 0xAAAA) >> 1) | ((v & 0x5555) << 1);
+    v = ((v & 0xCCCC) >> 2) | ((v & 0x3333) << 2);
+    v = ((v & 0xF0F0) >> 4) | ((v & 0x0F0F) << 4);
+    v = ((v & 0xFF00) >> 8) | ((v & 0x00FF) << 8);
+    return v >> (16 - bits);
+}
+
+// Build canonical Huffman tables. Codes up to INFLATE_FAST_BITS long are
+// resolved with a single lookup, longer ones by comparing against max_code.
+static bool build_huffman(inflate_huffman_t* h, const uint8_t* lengths, int count) {
+    int      sizes[17] = {0};
+    uint32_t next_code[16];
+
+    memset(h->fast, 0, sizeof(h->fast));
+    for (int i = 0; i < count; i++) {
+        sizes[lengths[i]]++;
+    }
+    sizes[0] = 0;
+    for (int i = 1; i < 16; i++) {
+        if (sizes[i] > (1 << i)) return false;
+    }
+
+    uint32_t code   = 0;
+    int      symbol = 0;
+    for (int i = 1; i < 16; i++) {
+        next_code[i]       = code;
+        h->first_code[i]   = code;
+        h->first_symbol[i] = symbol;
+        code += sizes[i];
+        if (sizes[i] && code - 1 >= (1u << i)) return false;
+        h->max_code[i] = code << (16 - i);
+        code <<= 1;
+        symbol += sizes[i];
+    }
+    h->max_code[16] = 0x10000;
+
+    for (int i = 0; i < count; i++) {
+        int len = lengths[i];
+        if (len == 0) continue;
+        int slot       = next_code[len] - h->first_code[len] + h->first_symbol[len];
+        h->size[slot]  = len;
+        h->value[slot] = i;
+        if (len <= INFLATE_FAST_BITS) {
+            for (uint32_t j = bit_reverse(next_code[len], len); j < (1 << INFLATE_FAST_BITS); j += 1u << len) {
+                h->fast[j] = (len << 9) | i;
+            }
+        }
+        next_code[len]++;
+    }
+    return true;
+}
+
+// Past the end of the input this returns zeros, so the bit buffer can always
+// be filled ahead; overran() tells whether any of those were actually used
+static inline uint8_t next_byte(inflate_t* z) {
+    if (z->input_pos == z->input_len) {
+        if (!z->input_end) {
+            z->input_len = z->read(z->ctx, z->input, sizeof(z->input));
+            z->input_pos = 0;
+            z->input_end = z->input_len == 0;
+        }
+        if (z->input_end) {
+            z->overrun++;
+            return 0;
+        }
+    }
+    return z->input[z->input_pos++];
+}
+
+static inline bool overran(const inflate_t* z) {
+    return z->overrun * 8 > (uint32_t)z->bit_count;
+}
+
+static inline void fill_bits(inflate_t* z) {
+    while (z->bit_count <= 24) {
+        z->bits |= (uint32_t)next_byte(z) << z->bit_count;
+        z->bit_count += 8;
+    }
+}
+
+static inline uint32_t take_bits(inflate_t* z, int count) {
+    if (z->bit_count < count) fill_bits(z);
+    uint32_t v = z->bits & ((1u << count) - 1);
+    z->bits >>= count;
+    z->bit_count -= count;
+    return v;
+}
+
+// Returns the decoded symbol, or -1 for an invalid code
+static inline int decode_symbol(inflate_t* z, const inflate_huffman_t* h) {
+    if (z->bit_count < 16) fill_bits(z);
+
+    uint16_t entry = h->fast[z->bits & ((1 << INFLATE_FAST_BITS) - 1)];
+    if (entry) {
+        int len = entry >> 9;
+        z->bits >>= len;
+        z->bit_count -= len;
+        return entry & 511;
+    }
+
+    uint32_t k = bit_reverse(z->bits, 16);
+    int      len;
+    for (len = INFLATE_FAST_BITS + 1; k >= h->max_code[len]; len++) {
+    }
+    if (len >= 16) return -1;
+    int slot = (k >> (16 - len)) - h->first_code[len] + h->first_symbol[len];
+    if (slot >= 288 || h->size[slot] != len) return -1;
+    z->bits >>= len;
+    z->bit_count -= len;
+    return h->value[slot];
+}
+
+static bool flush(inflate_t* z) {
+    while (z->flushed != z->window_pos) {
+        uint32_t start = z->flushed & WINDOW_MASK;
+        uint32_t len   = z->window_pos - z->flushed;
+        if (start + len > INFLATE_WINDOW_SIZE) len = INFLATE_WINDOW_SIZE - start;
+        if (!z->write(z->ctx, z->window + start, len)) return false;
+        z->flushed += len;
+    }
+    return true;
+}
+
+static inline bool maybe_flush(inflate_t* z) {
+    return z->window_pos - z->flushed < FLUSH_THRESHOLD || flush(z);
+}
+
+static bool inflate_stored(inflate_t* z) {
+    // Stored blocks start on a byte boundary
+    take_bits(z, z->bit_count & 7);
+    uint32_t len  = take_bits(z, 16);
+    uint32_t nlen = take_bits(z, 16);
+    if ((len ^ 0xFFFF) != nlen) return false;
+
+    while (len--) {
+        // Drain whole bytes still held in the bit buffer before reading input
+        uint8_t b = z->bit_count ? take_bits(z, 8) : next_byte(z);
+        if (overran(z)) return false;
+        z->window[z->window_pos++ & WINDOW_MASK] = b;
+        if (!maybe_flush(z)) return false;
+    }
+    return true;
+}
+
+static bool inflate_codes(inflate_t* z) {
+    while (true) {
+        int symbol = decode_symbol(z, &z->lengths);
+        if (symbol < 0) return false;
+
+        if (symbol < 256) {
+            z->window[z->window_pos++ & WINDOW_MASK] = symbol;
+        } else if (symbol == 256) {
+            return true;
+        } else {
+            symbol -= 257;
+            if (symbol >= 29) return false;
+            uint32_t len = length_base[symbol];
+            if (length_extra[symbol]) len += take_bits(z, length_extra[symbol]);
+
+            int dist_symbol = decode_symbol(z, &z->distances);
+            if (dist_symbol < 0 || dist_symbol >= 30) return false;
+            uint32_t dist = dist_base[dist_symbol];
+            if (dist_extra[dist_symbol]) dist += take_bits(z, dist_extra[dist_symbol]);
+            if (dist > z->window_pos) return false;
+
+            uint32_t from = z->window_pos - dist;
+            while (len--) {
+                z->window[z->window_pos++ & WINDOW_MASK] = z->window[from++ & WINDOW_MASK];
+            }
+        }
+
+        if (overran(z)) return false;
+        if (!maybe_flush(z)) return false;
+    }
+}
+
+static bool build_fixed(inflate_t* z) {
+    uint8_t lengths[288];
+    memset(lengths, 8, 144);
+    memset(lengths + 144, 9, 112);
+    memset(lengths + 256, 7, 24);
+    memset(lengths + 280, 8, 8);
+    uint8_t distances[32];
+    memset(distances, 5, sizeof(distances));
+    return build_huffman(&z->lengths, lengths, 288) && build_huffman(&z->distances, distances, 32);
+}
+
+static bool build_dynamic(inflate_t* z) {
+    int hlit  = take_bits(z, 5) + 257;
+    int hdist = take_bits(z, 5) + 1;
+    int hclen = take_bits(z, 4) + 4;
+    // The header can declare up to 288 and 32 codes, but deflate has only 286 and 30
+    if (hlit > 286 || hdist > 30) return false;
+
+    uint8_t code_lengths[19] = {0};
+    for (int i = 0; i < hclen; i++) {
+        code_lengths[code_length_order[i]] = take_bits(z, 3);
+    }
+    // The code length code is decoded with the distance table's storage
+    if (!build_huffman(&z->distances, code_lengths, 19)) return false;
+
+    uint8_t lengths[286 + 32];
+    int     n = 0;
+    while (n < hlit + hdist) {
+        int symbol = decode_symbol(z, &z->distances);
+        if (symbol < 0) return false;
+        if (symbol < 16) {
+            lengths[n++] = symbol;
+            continue;
+        }
+
+        int     repeat;
+        uint8_t fill = 0;
+        if (symbol == 16) {
+            if (n == 0) return false;
+            repeat = take_bits(z, 2) + 3;
+            fill   = lengths[n - 1];
+        } else if (symbol == 17) {
+            repeat = take_bits(z, 3) + 3;
+        } else {
+            repeat = take_bits(z, 7) + 11;
+        }
+        if (n + repeat > hlit + hdist) return false;
+        memset(lengths + n, fill, repeat);
+        n += repeat;
+    }
+    if (overran(z) || lengths[256] == 0) return false;
+
+    return build_huffman(&z->lengths, lengths, hlit) && build_huffman(&z->distances, lengths + hlit, hdist);
+}
+
+bool inflate_zlib(inflate_t* z, inflate_read_fn read, inflate_write_fn write, void* ctx) {
+    z->read       = read;
+    z->write      = write;
+    z->ctx        = ctx;
+    z->input_pos  = 0;
+    z->input_len  = 0;
+    z->input_end  = false;
+    z->overrun    = 0;
+    z->bits       = 0;
+    z->bit_count  = 0;
+    z->window_pos = 0;
+    z->flushed    = 0;
+
+    // zlib header: deflate, no preset dictionary, valid check bits
+    uint32_t cmf = next_byte(z);
+    uint32_t flg = next_byte(z);
+    if (overran(z) || (cmf & 0x0F) != 8 || (cmf >> 4) > 7 || (flg & 0x20) || (cmf * 256 + flg) % 31 != 0) {
+        return false;
+    }
+
+    bool last = false;
+    while (!last) {
+        last      = take_bits(z, 1);
+        int type  = take_bits(z, 2);
+        bool ok   = false;
+        if (type == 0) {
+            ok = inflate_stored(z);
+        } else if (type == 1) {
+            ok = build_fixed(z) && inflate_codes(z);
+        } else if (type == 2) {
+            ok = build_dynamic(z) && inflate_codes(z);
+        }
+        if (!ok) return false;
+    }
+    // The Adler-32 trailer is not verified; PNG chunks carry their own CRCs
+    return flush(z);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming zlib (RFC 1950/1951) decompressor with a fixed working set: the
+// 32 KB history window, Huffman tables and a small input buffer all live in
+// inflate_t, and nothing is allocated while decoding. Input is pulled through
+// a read callback and output is pushed to a write callback in chunks.
+
+#define INFLATE_WINDOW_SIZE 32768
+#define INFLATE_INPUT_SIZE  4096
+#define INFLATE_FAST_BITS   9
+
+// Fill buf with up to size bytes of compressed data. Returns the number of
+// bytes read, 0 at the end of the input.
+typedef size_t (*inflate_read_fn)(void* ctx, uint8_t* buf, size_t size);
+
+// Consume len decompressed bytes. Returning false aborts decompression.
+typedef bool (*inflate_write_fn)(void* ctx, const uint8_t* data, size_t len);
+
+typedef struct {
+    uint16_t fast[1 << INFLATE_FAST_BITS];
+    uint16_t first_code[16];
+    uint32_t max_code[17];
+    uint16_t first_symbol[16];
+    uint8_t  size[288];
+    uint16_t value[288];
+} inflate_huffman_t;
+
+typedef struct {
+    inflate_read_fn  read;
+    inflate_write_fn write;
+    void*            ctx;
+
+    uint8_t  input[INFLATE_INPUT_SIZE];
+    size_t   input_pos;
+    size_t   input_len;
+    bool     input_end;
+    uint32_t overrun;  // zero bytes supplied past the end of the input
+    uint32_t bits;
+    int      bit_count;
+
+    uint8_t  window[INFLATE_WINDOW_SIZE];
+    uint32_t window_pos;  // total bytes produced, the window index is this modulo its size
+    uint32_t flushed;     // bytes already handed to write
+
+    inflate_huffman_t lengths;
+    inflate_huffman_t distances;
+} inflate_t;
+
+// Decompress one complete zlib stream. Returns false on corrupt data, a
+// truncated stream, or when write aborts.
+bool inflate_zlib(inflate_t* z, inflate_read_fn read, inflate_write_fn write, void* ctx);
@@ -0,0 +1,681 @@
+#include "jpeg.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#if CONFIG_IMAGEWAG_JPEG_HARDWARE
+#include "driver/jpeg_decode.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#endif
+
+static char const TAG[] = "jpeg";
+
+#define MAX_COMPONENTS   3
+#define FAST_BITS        9  // Huffman codes up to this long are decoded with one table lookup
+#define READ_BUFFER_SIZE 4096
+
+// Markers
+#define M_SOF0 0xC0  // baseline
+#define M_SOF1 0xC1  // extended sequential, Huffman
+#define M_SOF2 0xC2  // progressive, Huffman
+#define M_DHT  0xC4
+#define M_DAC  0xCC
+#define M_RST0 0xD0
+#define M_SOI  0xD8
+#define M_EOI  0xD9
+#define M_SOS  0xDA
+#define M_DQT  0xDB
+#define M_DRI  0xDD
+#define M_APP0 0xE0
+#define M_APPE 0xEE
+
+// Natural order of the coefficients in zigzag order
+static const uint8_t zigzag[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,  12, 19, 26, 33, 40, 48,
+    41, 34, 27, 20, 13, 6,  7,  14, 21, 28, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23,
+    30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+typedef struct {
+    uint16_t fast[1 << FAST_BITS];  // length << 8 | symbol, 0 for longer codes
+    uint8_t  symbols[256];
+    int32_t  max_code[17];  // largest code of each length, -1 if there is none
+    int32_t  offset[17];    // index in symbols of a code of each length, minus the code
+    bool     defined;
+} huffman_t;
+
+typedef struct {
+    uint8_t  id;
+    uint8_t  h;  // sampling factors
+    uint8_t  v;
+    uint8_t  quant;
+    uint8_t  dc_table;
+    uint8_t  ac_table;
+    uint8_t  shift_x;  // log2 of the upsampling to full resolution
+    uint8_t  shift_y;
+    int32_t  dc_pred;
+    size_t   stride;  // bytes per plane row
+    uint8_t* plane;   // one row of MCUs of this component, v * 8 rows
+} component_t;
+
+typedef struct {
+    FILE*   fd;
+    size_t  pos;
+    size_t  length;
+    bool    eof;
+    uint8_t data[READ_BUFFER_SIZE];
+
+    uint32_t bits;    // entropy-coded bits, first bit in the MSB
+    int      count;   // valid bits in bits
+    uint8_t  marker;  // marker that ended the entropy-coded data, 0 if none yet
+
+    uint16_t    quant[4][64];  // zigzag order
+    huffman_t   dc[4];
+    huffman_t   ac[4];
+    component_t comp[MAX_COMPONENTS];
+    int         components;
+    uint32_t    width;
+    uint32_t    height;
+    int         h_max;
+    int         v_max;
+    uint32_t    restart_interval;
+    bool        jfif;
+    int         adobe_transform;  // -1 without an Adobe marker
+    uint8_t*    out;              // converted row
+} jpeg_t;
+
+static inline uint32_t read_be16(const uint8_t* p) {
+    return ((uint32_t)p[0] << 8) | p[1];
+}
+
+// Next byte of the file, 0 past its end
+static inline uint8_t next_byte(jpeg_t* j) {
+    if (j->pos == j->length) {
+        j->length = fread(j->data, 1, sizeof(j->data), j->fd);
+        j->pos    = 0;
+        if (j->length == 0) {
+            j->eof = true;
+            return 0;
+        }
+    }
+    return j->data[j->pos++];
+}
+
+static bool read_bytes(jpeg_t* j, uint8_t* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = next_byte(j);
+    }
+    return !j->eof;
+}
+
+static bool skip_bytes(jpeg_t* j, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        next_byte(j);
+    }
+    return !j->eof;
+}
+
+// The next marker, skipping fill bytes and anything that is not a marker
+static uint8_t next_marker(jpeg_t* j) {
+    uint8_t byte = next_byte(j);
+    while (!j->eof) {
+        if (byte == 0xFF) {
+            byte = next_byte(j);
+            if (byte != 0 && byte != 0xFF) return byte;
+        } else {
+            byte = next_byte(j);
+        }
+    }
+    return 0;
+}
+
+// Segment payload length from the length field, which counts itself
+static bool segment_length(jpeg_t* j, size_t* length) {
+    uint8_t data[2];
+    if (!read_bytes(j, data, 2) || read_be16(data) < 2) return false;
+    *length = read_be16(data) - 2;
+    return true;
+}
+
+static bool read_quant_tables(jpeg_t* j, size_t length) {
+    while (length > 0) {
+        uint8_t pq_tq = next_byte(j);
+        int     wide  = pq_tq >> 4;
+        size_t  size  = 1 + 64 * (wide ? 2 : 1);
+        if (wide > 1 || (pq_tq & 0x0F) > 3 || length < size) return false;
+        uint16_t* table = j->quant[pq_tq & 3];
+        for (int k = 0; k < 64; k++) {
+            table[k] = next_byte(j);
+            if (wide) table[k] = (uint16_t)(table[k] << 8 | next_byte(j));
+        }
+        length -= size;
+    }
+    return !j->eof;
+}
+
+static bool build_huffman(huffman_t* h, const uint8_t counts[16], int total) {
+    memset(h->fast, 0, sizeof(h->fast));
+    int32_t code = 0;
+    int     k    = 0;
+    for (int length = 1; length <= 16; length++) {
+        // Codes of one length must not run past the longest possible code,
+        // checked before any of them go into the fast table
+        if (code + counts[length - 1] > (1 << length)) return false;
+        h->offset[length] = k - code;
+        for (int i = 0; i < counts[length - 1]; i++, k++, code++) {
+            if (length <= FAST_BITS) {
+                int shift = FAST_BITS - length;
+                for (int fill = 0; fill < (1 << shift); fill++) {
+                    h->fast[(code << shift) | fill] = (uint16_t)(length << 8 | h->symbols[k]);
+                }
+            }
+        }
+        h->max_code[length] = counts[length - 1] ? code - 1 : -1;
+        code <<= 1;
+    }
+    h->defined = k == total;
+    return h->defined;
+}
+
+static bool read_huffman_tables(jpeg_t* j, size_t length) {
+    while (length > 17) {
+        uint8_t tc_th = next_byte(j);
+        uint8_t counts[16];
+        int     total = 0;
+        if (!read_bytes(j, counts, sizeof(counts))) return false;
+        for (int i = 0; i < 16; i++) total += counts[i];
+        if ((tc_th >> 4) > 1 || (tc_th & 0x0F) > 3 || total > 256 || length < 17 + (size_t)total) return false;
+
+        huffman_t* h = (tc_th >> 4) ? &j->ac[tc_th & 3] : &j->dc[tc_th & 3];
+        if (!read_bytes(j, h->symbols, total) || !build_huffman(h, counts, total)) return false;
+        length -= 17 + total;
+    }
+    return length == 0;
+}
+
+static bool read_frame_header(jpeg_t* j, size_t length) {
+    uint8_t data[6 + 3 * MAX_COMPONENTS];
+    if (length < 6 || !read_bytes(j, data, 6)) return false;
+    j->width      = read_be16(data + 3);
+    j->height     = read_be16(data + 1);
+    j->components = data[5];
+    if (data[0] != 8 || j->width == 0 || j->height == 0 || (j->components != 1 && j->components != 3) ||
+        length != 6 + 3 * (size_t)j->components || !read_bytes(j, data + 6, 3 * j->components)) {
+        return false;
+    }
+
+    j->h_max = j->v_max = 1;
+    for (int i = 0; i < j->components; i++) {
+        component_t* c = &j->comp[i];
+        c->id          = data[6 + 3 * i];
+        c->h           = data[7 + 3 * i] >> 4;
+        c->v           = data[7 + 3 * i] & 0x0F;
+        c->quant       = data[8 + 3 * i];
+        if (c->h < 1 || c->h > 4 || c->v < 1 || c->v > 4 || c->quant > 3) return false;
+        if (c->h > j->h_max) j->h_max = c->h;
+        if (c->v > j->v_max) j->v_max = c->v;
+    }
+    // Upsampling by a power of two is a shift
+    for (int i = 0; i < j->components; i++) {
+        component_t* c = &j->comp[i];
+        if (j->h_max % c->h != 0 || j->v_max % c->v != 0) return false;
+        int ratio_x = j->h_max / c->h, ratio_y = j->v_max / c->v;
+        if ((ratio_x & (ratio_x - 1)) != 0 || (ratio_y & (ratio_y - 1)) != 0) return false;
+        c->shift_x = (uint8_t)__builtin_ctz(ratio_x);
+        c->shift_y = (uint8_t)__builtin_ctz(ratio_y);
+    }
+    return true;
+}
+
+static bool read_scan_header(jpeg_t* j, size_t length) {
+    uint8_t data[1 + 2 * MAX_COMPONENTS + 3];
+    if (length < 1 || !read_bytes(j, data, 1)) return false;
+    int count = data[0];
+    // Every component in one scan: files with several scans are progressive in all but name
+    if (count != j->components || length != 1 + 2 * (size_t)count + 3 || !read_bytes(j, data + 1, length - 1)) {
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        component_t* c = &j->comp[i];
+        if (c->id != data[1 + 2 * i]) return false;
+        c->dc_table = data[2 + 2 * i] >> 4;
+        c->ac_table = data[2 + 2 * i] & 0x0F;
+        if (c->dc_table > 3 || c->ac_table > 3 || !j->dc[c->dc_table].defined || !j->ac[c->ac_table].defined) {
+            return false;
+        }
+    }
+    // A scan of one component codes its blocks one by one, whatever its sampling factors
+    if (count == 1) {
+        j->comp[0].h = j->comp[0].v = 1;
+        j->h_max = j->v_max = 1;
+    }
+    return true;
+}
+
+// Read the markers up to the start of the image data
+static bool read_headers(jpeg_t* j) {
+    uint8_t soi[2];
+    if (!read_bytes(j, soi, 2) || soi[0] != 0xFF || soi[1] != M_SOI) return false;
+
+    bool have_frame = false;
+    while (true) {
+        uint8_t marker = next_marker(j);
+        size_t  length = 0;
+        if (marker == 0 || marker == M_EOI || !segment_length(j, &length)) return false;
+
+        bool ok = true;
+        if (marker == M_SOF0 || marker == M_SOF1) {
+            ok         = !have_frame && read_frame_header(j, length);
+            have_frame = true;
+        } else if ((marker & 0xF0) == 0xC0 && marker != M_DHT && marker != M_DAC) {
+            return false;  // progressive, lossless or arithmetic coded
+        } else if (marker == M_DHT) {
+            ok = read_huffman_tables(j, length);
+        } else if (marker == M_DQT) {
+            ok = read_quant_tables(j, length);
+        } else if (marker == M_DRI) {
+            uint8_t data[2];
+            ok                  = length == 2 && read_bytes(j, data, 2);
+            j->restart_interval = read_be16(data);
+        } else if (marker == M_SOS) {
+            return have_frame && read_scan_header(j, length);
+        } else if ((marker == M_APP0 || marker == M_APPE) && length >= 12) {
+            uint8_t data[12];
+            ok = read_bytes(j, data, sizeof(data)) && skip_bytes(j, length - sizeof(data));
+            if (marker == M_APP0 && memcmp(data, "JFIF", 5) == 0) j->jfif = true;
+            if (marker == M_APPE && memcmp(data, "Adobe", 5) == 0) j->adobe_transform = data[11];
+        } else {
+            ok = skip_bytes(j, length);
+        }
+        if (!ok) return false;
+    }
+}
+
+// Top up the bit buffer to more than 24 bits. Stuffed zero bytes are
+// dropped; at a marker the data has ended and zeros are fed instead.
+static void fill_bits(jpeg_t* j) {
+    while (j->count <= 24) {
+        uint32_t byte = 0;
+        if (j->marker == 0) {
+            byte = next_byte(j);
+            if (byte == 0xFF) {
+                uint8_t next = next_byte(j);
+                while (next == 0xFF) next = next_byte(j);
+                if (next != 0) {
+                    j->marker = next;
+                    byte      = 0;
+                }
+            }
+        }
+        j->bits |= byte << (24 - j->count);
+        j->count += 8;
+    }
+}
+
+static inline int decode_huffman(jpeg_t* j, const huffman_t* h) {
+    if (j->count < 16) fill_bits(j);
+    uint32_t fast = h->fast[j->bits >> (32 - FAST_BITS)];
+    if (fast != 0) {
+        int length = fast >> 8;
+        j->bits <<= length;
+        j->count -= length;
+        return fast & 0xFF;
+    }
+    for (int length = FAST_BITS + 1; length <= 16; length++) {
+        int32_t code = (int32_t)(j->bits >> (32 - length));
+        if (code <= h->max_code[length]) {
+            j->bits <<= length;
+            j->count -= length;
+            return h->symbols[code + h->offset[length]];
+        }
+    }
+    return -1;
+}
+
+// Read an n-bit value and extend its sign as JPEG codes it
+static inline int32_t receive_extend(jpeg_t* j, int n) {
+    if (n == 0) return 0;
+    if (j->count < n) fill_bits(j);
+    int32_t value = (int32_t)(j->bits >> (32 - n));
+    j->bits <<= n;
+    j->count -= n;
+    return value < (1 << (n - 1)) ? value - (1 << n) + 1 : value;
+}
+
+static inline int32_t clamp16(int32_t value) {
+    return value < -32768 ? -32768 : value > 32767 ? 32767 : value;
+}
+
+static bool decode_block(jpeg_t* j, component_t* c, int32_t coef[64]) {
+    memset(coef, 0, 64 * sizeof(*coef));
+    const uint16_t* q = j->quant[c->quant];
+
+    int t = decode_huffman(j, &j->dc[c->dc_table]);
+    if (t < 0 || t > 11) return false;
+    c->dc_pred += receive_extend(j, t);
+    coef[0] = clamp16(c->dc_pred * q[0]);
+
+    for (int k = 1; k < 64;) {
+        int rs = decode_huffman(j, &j->ac[c->ac_table]);
+        if (rs < 0) return false;
+        int run = rs >> 4, size = rs & 0x0F;
+        if (size == 0) {
+            if (run != 15) break;  // end of block
+            k += 16;
+            continue;
+        }
+        k += run;
+        if (k > 63) return false;
+        coef[zigzag[k]] = clamp16(receive_extend(j, size) * q[k]);
+        k++;
+    }
+    return true;
+}
+
+// 12-bit fixed-point constants of the Loeffler-Ligtenberg-Moschytz IDCT, the
+// accurate integer IDCT of the IJG library
+#define FIX(x) ((int32_t)((x) * 4096 + 0.5))
+
+// One 8-point IDCT of in[0], in[stride], ... into out, scaled by 4096
+static inline void idct_1d(const int32_t* in, int stride, int32_t out[8]) {
+    // Even part
+    int32_t p2 = in[2 * stride], p3 = in[6 * stride];
+    int32_t p1 = (p2 + p3) * FIX(0.541196100);
+    int32_t t2 = p1 + p3 * FIX(-1.847759065);
+    int32_t t3 = p1 + p2 * FIX(0.765366865);
+    int32_t t0 = (in[0] + in[4 * stride]) * 4096;
+    int32_t t1 = (in[0] - in[4 * stride]) * 4096;
+    int32_t x0 = t0 + t3, x3 = t0 - t3, x1 = t1 + t2, x2 = t1 - t2;
+
+    // Odd part
+    t0         = in[7 * stride];
+    t1         = in[5 * stride];
+    t2         = in[3 * stride];
+    t3         = in[1 * stride];
+    p3         = t0 + t2;
+    int32_t p4 = t1 + t3;
+    p1         = t0 + t3;
+    p2         = t1 + t2;
+    int32_t p5 = (p3 + p4) * FIX(1.175875602);
+    t0 *= FIX(0.298631336);
+    t1 *= FIX(2.053119869);
+    t2 *= FIX(3.072711026);
+    t3 *= FIX(1.501321110);
+    p1 = p5 + p1 * FIX(-0.899976223);
+    p2 = p5 + p2 * FIX(-2.562915447);
+    p3 *= FIX(-1.961570560);
+    p4 *= FIX(-0.390180644);
+    t3 += p1 + p4;
+    t2 += p2 + p3;
+    t1 += p2 + p4;
+    t0 += p1 + p3;
+
+    out[0] = x0 + t3;
+    out[7] = x0 - t3;
+    out[1] = x1 + t2;
+    out[6] = x1 - t2;
+    out[2] = x2 + t1;
+    out[5] = x2 - t1;
+    out[3] = x3 + t0;
+    out[4] = x3 - t0;
+}
+
+static inline uint8_t clamp8(int32_t value) {
+    return value < 0 ? 0 : value > 255 ? 255 : (uint8_t)value;
+}
+
+// Inverse DCT of a dequantised block into 8x8 samples at out
+static void idct_block(const int32_t coef[64], uint8_t* out, size_t stride) {
+    int32_t columns[64], t[8];
+
+    // Columns, keeping 2 extra bits. Most columns have no AC coefficients.
+    for (int i = 0; i < 8; i++) {
+        const int32_t* c = coef + i;
+        if ((c[8] | c[16] | c[24] | c[32] | c[40] | c[48] | c[56]) == 0) {
+            for (int k = 0; k < 8; k++) columns[8 * k + i] = c[0] * 4;
+            continue;
+        }
+        idct_1d(c, 8, t);
+        for (int k = 0; k < 8; k++) columns[8 * k + i] = (t[k] + 512) >> 10;
+    }
+
+    // Rows: remove the 12 bits of the constants, the 2 extra bits and the
+    // factor of 8 of the two passes, rounding and moving to 0-255
+    for (int k = 0; k < 8; k++, out += stride) {
+        idct_1d(columns + 8 * k, 1, t);
+        for (int i = 0; i < 8; i++) out[i] = clamp8((t[i] + 65536 + (128 << 17)) >> 17);
+    }
+}
+
+// Consume the RSTn marker that ends a restart interval and reset the decoder
+static bool restart(jpeg_t* j) {
+    j->bits  = 0;
+    j->count = 0;
+    if (j->marker == 0) j->marker = next_marker(j);
+    if (j->marker < M_RST0 || j->marker > M_RST0 + 7) return false;
+    j->marker = 0;
+    for (int i = 0; i < j->components; i++) j->comp[i].dc_pred = 0;
+    return true;
+}
+
+// Convert row r of the current MCU row to B, G, R bytes
+static void convert_row(jpeg_t* j, int r) {
+    const component_t* c = j->comp;
+    uint8_t*           o = j->out;
+    if (j->components == 1) {
+        const uint8_t* y = c[0].plane + (size_t)r * c[0].stride;
+        for (uint32_t x = 0; x < j->width; x++, o += 3) o[0] = o[1] = o[2] = y[x];
+        return;
+    }
+
+    const uint8_t* p0 = c[0].plane + (size_t)(r >> c[0].shift_y) * c[0].stride;
+    const uint8_t* p1 = c[1].plane + (size_t)(r >> c[1].shift_y) * c[1].stride;
+    const uint8_t* p2 = c[2].plane + (size_t)(r >> c[2].shift_y) * c[2].stride;
+    int            s0 = c[0].shift_x, s1 = c[1].shift_x, s2 = c[2].shift_x;
+
+    // Adobe transform 0, or component IDs R, G, B without JFIF, mean no colour transform
+    bool rgb = j->adobe_transform == 0 ||
+               (j->adobe_transform < 0 && !j->jfif && c[0].id == 'R' && c[1].id == 'G' && c[2].id == 'B');
+    if (rgb) {
+        for (uint32_t x = 0; x < j->width; x++, o += 3) {
+            o[0] = p2[x >> s2];
+            o[1] = p1[x >> s1];
+            o[2] = p0[x >> s0];
+        }
+        return;
+    }
+    // ITU-R BT.601 full range, 16-bit fixed point
+    for (uint32_t x = 0; x < j->width; x++, o += 3) {
+        int32_t y  = (p0[x >> s0] << 16) + 32768;
+        int32_t cb = p1[x >> s1] - 128;
+        int32_t cr = p2[x >> s2] - 128;
+        o[0]       = clamp8((y + 116130 * cb) >> 16);
+        o[1]       = clamp8((y - 22554 * cb - 46802 * cr) >> 16);
+        o[2]       = clamp8((y + 91881 * cr) >> 16);
+    }
+}
+
+static bool decode_scan(jpeg_t* j, png_row_fn row, void* ctx) {
+    uint32_t mcu_width  = 8 * j->h_max;
+    uint32_t mcu_height = 8 * j->v_max;
+    uint32_t mcus_x     = (j->width + mcu_width - 1) / mcu_width;
+    uint32_t mcus_y     = (j->height + mcu_height - 1) / mcu_height;
+    uint32_t mcu_count  = 0;
+    int32_t  coef[64];
+
+    for (uint32_t my = 0; my < mcus_y; my++) {
+        if (j->eof) return false;
+        for (uint32_t mx = 0; mx < mcus_x; mx++, mcu_count++) {
+            if (j->restart_interval != 0 && mcu_count > 0 && mcu_count % j->restart_interval == 0 && !restart(j)) {
+                ESP_LOGW(TAG, "Missing restart marker at MCU %" PRIu32, mcu_count);
+                return false;
+            }
+            for (int i = 0; i < j->components; i++) {
+                component_t* c = &j->comp[i];
+                for (int by = 0; by < c->v; by++) {
+                    for (int bx = 0; bx < c->h; bx++) {
+                        if (!decode_block(j, c, coef)) return false;
+                        idct_block(coef, c->plane + by * 8 * c->stride + (mx * c->h + bx) * 8, c->stride);
+                    }
+                }
+            }
+        }
+        for (uint32_t r = 0; r < mcu_height && my * mcu_height + r < j->height; r++) {
+            convert_row(j, r);
+            if (!row(ctx, my * mcu_height + r, j->out)) return false;
+        }
+    }
+    return true;
+}
+
+#if CONFIG_IMAGEWAG_JPEG_HARDWARE
+static jpeg_decoder_handle_t hardware      = NULL;
+static SemaphoreHandle_t     hardware_lock = NULL;  // the engine decodes one image at a time
+
+typedef enum {
+    HARDWARE_SKIPPED,  // not attempted or not possible, decode in software
+    HARDWARE_DONE,
+    HARDWARE_FAILED,   // the row callback aborted decoding
+} hardware_result_t;
+
+static inline uint32_t align_up(uint32_t value, uint32_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Decode the JPEG in memory with the codec peripheral into a buffer covering
+// the whole image, padded to whole MCUs, and hand out its rows
+static hardware_result_t decode_hardware_buffer(const uint8_t* in, size_t size, png_row_fn row, void* ctx) {
+    jpeg_decode_picture_info_t picture;
+    if (jpeg_decoder_get_info(in, size, &picture) != ESP_OK ||
+        (uint64_t)picture.width * picture.height > JPEG_HARDWARE_MAX_PIXELS) {
+        return HARDWARE_SKIPPED;
+    }
+
+    bool     wide   = picture.sample_method == JPEG_DOWN_SAMPLING_YUV422 ||
+                    picture.sample_method == JPEG_DOWN_SAMPLING_YUV420;
+    bool     tall   = picture.sample_method == JPEG_DOWN_SAMPLING_YUV420;
+    size_t   stride = (size_t)align_up(picture.width, wide ? 16 : 8) * 3;
+    uint32_t rows   = align_up(picture.height, tall ? 16 : 8);
+
+    jpeg_decode_memory_alloc_cfg_t alloc    = {.buffer_direction = JPEG_DEC_ALLOC_OUTPUT_BUFFER};
+    size_t                         out_size = 0;
+    uint8_t*                       out      = jpeg_alloc_decoder_mem(stride * rows, &alloc, &out_size);
+    if (out == NULL) return HARDWARE_SKIPPED;
+
+    jpeg_decode_cfg_t config = {
+        .output_format = JPEG_DECODE_OUT_FORMAT_RGB888,
+        .rgb_order     = JPEG_DEC_RGB_ELEMENT_ORDER_BGR,  // B, G, R bytes as PAX_BUF_24_888RGB
+        .conv_std      = JPEG_YUV_RGB_CONV_STD_BT601,
+    };
+    uint32_t written = 0;
+    xSemaphoreTake(hardware_lock, portMAX_DELAY);
+    esp_err_t res = jpeg_decoder_process(hardware, &config, in, size, out, out_size, &written);
+    xSemaphoreGive(hardware_lock);
+
+    hardware_result_t result = res == ESP_OK ? HARDWARE_DONE : HARDWARE_SKIPPED;
+    if (res != ESP_OK) ESP_LOGD(TAG, "Hardware decoder failed (%d), decoding in software", res);
+    for (uint32_t y = 0; y < picture.height && result == HARDWARE_DONE; y++) {
+        if (!row(ctx, y, out + y * stride)) result = HARDWARE_FAILED;
+    }
+    free(out);
+    return result;
+}
+
+// Read the rest of fd into DMA-capable memory and decode it with the codec
+// peripheral. fd is left where it was if the software decoder has to take over.
+static hardware_result_t decode_hardware(FILE* fd, png_row_fn row, void* ctx) {
+    long start = ftell(fd);
+    if (hardware == NULL || start < 0 || fseek(fd, 0, SEEK_END) != 0) return HARDWARE_SKIPPED;
+    long size = ftell(fd) - start;
+    if (fseek(fd, start, SEEK_SET) != 0 || size <= 0) return HARDWARE_SKIPPED;
+
+    jpeg_decode_memory_alloc_cfg_t alloc   = {.buffer_direction = JPEG_DEC_ALLOC_INPUT_BUFFER};
+    size_t                         in_size = 0;
+    uint8_t*                       in      = jpeg_alloc_decoder_mem(size, &alloc, &in_size);
+    hardware_result_t              result  = HARDWARE_SKIPPED;
+    if (in != NULL && fread(in, 1, size, fd) == (size_t)size) result = decode_hardware_buffer(in, size, row, ctx);
+    free(in);
+    if (result == HARDWARE_SKIPPED) fseek(fd, start, SEEK_SET);
+    return result;
+}
+#endif
+
+void jpeg_init(void) {
+#if CONFIG_IMAGEWAG_JPEG_HARDWARE
+    jpeg_decode_engine_cfg_t config = {.timeout_ms = 1000};
+    hardware_lock                   = xSemaphoreCreateMutex();
+    if (hardware_lock == NULL || jpeg_new_decoder_engine(&config, &hardware) != ESP_OK) {
+        ESP_LOGW(TAG, "Hardware JPEG decoder unavailable, decoding in software");
+        hardware = NULL;
+    }
+#endif
+}
+
+bool jpeg_read_info(FILE* fd, jpeg_info_t* info) {
+    uint8_t data[8];
+    if (fread(data, 1, 2, fd) != 2 || data[0] != 0xFF || data[1] != M_SOI) return false;
+
+    // Skip segments up to the frame header
+    while (true) {
+        int marker = fgetc(fd);
+        if (marker != 0xFF) return false;
+        while (marker == 0xFF) marker = fgetc(fd);
+        if (marker == EOF || fread(data, 1, 2, fd) != 2 || read_be16(data) < 2) return false;
+        size_t length = read_be16(data) - 2;
+
+        bool frame = (marker & 0xF0) == 0xC0 && marker != M_DHT && marker != M_DAC;
+        if (!frame) {
+            if (marker == M_SOS || marker == M_EOI || fseek(fd, length, SEEK_CUR) != 0) return false;
+            continue;
+        }
+        if (length < 6 || fread(data, 1, 6, fd) != 6) return false;
+        info->precision  = data[0];
+        info->height     = read_be16(data + 1);
+        info->width      = read_be16(data + 3);
+        info->components = data[5];
+        info->sequential = marker == M_SOF0 || marker == M_SOF1;
+        return info->width > 0 && info->height > 0 && info->components > 0;
+    }
+}
+
+bool jpeg_supported(const jpeg_info_t* info) {
+    return info->sequential && info->precision == 8 && (info->components == 1 || info->components == 3);
+}
+
+bool jpeg_decode(FILE* fd, png_row_fn row, void* ctx) {
+#if CONFIG_IMAGEWAG_JPEG_HARDWARE
+    hardware_result_t result = decode_hardware(fd, row, ctx);
+    if (result != HARDWARE_SKIPPED) return result == HARDWARE_DONE;
+#endif
+
+    jpeg_t* j = calloc(1, sizeof(jpeg_t));
+    if (j == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate decoder state");
+        return false;
+    }
+    j->fd              = fd;
+    j->adobe_transform = -1;
+
+    bool ok = read_headers(j);
+    if (ok) {
+        uint32_t mcus_x = (j->width + 8 * j->h_max - 1) / (8 * j->h_max);
+        j->out          = malloc((size_t)j->width * 3);
+        ok              = j->out != NULL;
+        for (int i = 0; i < j->components && ok; i++) {
+            component_t* c = &j->comp[i];
+            c->stride      = (size_t)mcus_x * c->h * 8;
+            c->plane       = malloc(c->stride * c->v * 8);
+            ok             = c->plane != NULL;
+        }
+        if (!ok) ESP_LOGE(TAG, "Failed to allocate row buffers for width %" PRIu32, j->width);
+        ok = ok && decode_scan(j, row, ctx);
+    }
+
+    for (int i = 0; i < j->components; i++) free(j->comp[i].plane);
+    free(j->out);
+    free(j);
+    return ok;
+}
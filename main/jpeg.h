@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "png_stream.h"
+
+// JPEG decoder for baseline and extended sequential Huffman-coded files: the
+// kind cameras, phones and image editors write by default. Greyscale and
+// three-component (YCbCr, or RGB when marked so) images with power-of-two
+// chroma subsampling and restart intervals are supported; progressive,
+// arithmetic-coded, lossless, 12-bit and CMYK files are not.
+//
+// Decoding is streamed one row of MCUs at a time, so the working set is
+// 8 or 16 rows no matter how large the image is. Chroma is upsampled by
+// replication. On targets with a JPEG codec peripheral (ESP32-P4) images up
+// to JPEG_HARDWARE_MAX_PIXELS are decoded by it instead, whole, which is
+// several times faster.
+#define JPEG_HARDWARE_MAX_PIXELS (1920 * 1088)
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint8_t  components;
+    uint8_t  precision;   // bits per sample
+    bool     sequential;  // baseline or extended sequential Huffman coding
+} jpeg_info_t;
+
+// Start the hardware decoder, where there is one. Call once before decoding.
+void jpeg_init(void);
+
+// Read the markers at the current position up to the frame header.
+bool jpeg_read_info(FILE* fd, jpeg_info_t* info);
+
+// Whether jpeg_decode can handle an image with this header.
+bool jpeg_supported(const jpeg_info_t* info);
+
+// Decode the JPEG at the current position of fd, calling row with every row
+// from top to bottom in PAX_BUF_24_888RGB layout.
+bool jpeg_decode(FILE* fd, png_row_fn row, void* ctx);
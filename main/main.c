@@ -4,7 +4,11 @@
 #include <dirent.h>
 #include <time.h>
 #include <inttypes.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
 #include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "bsp/device.h"
 #include "bsp/display.h"
@@ -12,22 +16,53 @@
 #include "pax_codecs.h"
 #include "pax_fonts.h"
 #include "pax_gfx.h"
+#include "album.h"
+#include "animation.h"
+#include "catalog.h"
+#include "codec.h"
 #include "driver/gpio.h"
 #include "driver/sdmmc_host.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_vfs_fat.h"
+#include "image_cache.h"
+#include "image_file.h"
+#include "image_ops.h"
+#include "image_scale.h"
+#include "nvs.h"
 #include "nvs_flash.h"
+#include "perf.h"
+#include "pixel_format.h"
+#include "playlist.h"
+#include "power.h"
 #include "sdmmc_cmd.h"
+#include "transition.h"
+#include "wag.h"
 
 // Constants
 static char const TAG[] = "main";
+#ifndef SD_MOUNT_POINT
 #define SD_MOUNT_POINT "/sd"
+#endif
 #define IMAGES_DIR SD_MOUNT_POINT "/images"
-#define MAX_PNG_FILES 100
+#define INDEX_NAME "imagewag.idx"  // catalogue index kept in each album directory
 #define MAX_PATH_LENGTH 512
-#define IMAGE_WIDTH 800
-#define IMAGE_HEIGHT 480
-#define IMAGE_BYTES_PER_PIXEL 3  // PAX_BUF_24_888RGB
+// An index saved for another frame size or pixel format, whose sidecars are
+// made for them, or by a version that judged files differently is ignored.
+// Revision 1: images of any size are usable.
+// Entries of indexes older than the codec field read as CODEC_PNG, which they are.
+// Revision 2: animated images are flagged.
+#define INDEX_REVISION 2
+#define INDEX_CONFIG                                                                \
+    (((uint32_t)INDEX_REVISION << 28) | ((uint32_t)IMAGE_BYTES_PER_PIXEL << 26) | \
+     ((uint32_t)image_width << 13) | (uint32_t)image_height)
+
+#if CONFIG_IMAGEWAG_PIXEL_FORMAT_RGB565
+#define DISPLAY_COLOR_FORMAT BSP_DISPLAY_COLOR_FORMAT_16_565RGB
+#else
+#define DISPLAY_COLOR_FORMAT BSP_DISPLAY_COLOR_FORMAT_24_888RGB
+#endif
 
 #define COLOR_BLACK 0xFF000000
 #define COLOR_WHITE 0xFFFFFFFF
@@ -36,92 +71,281 @@ static char const TAG[] = "main";
 static size_t         display_h_res = 0;
 static size_t         display_v_res = 0;
 static pax_buf_t      fb            = {0};
+static pax_orientation_t fb_orientation = PAX_O_UPRIGHT;
+static size_t         fb_bytes_per_pixel = 3;
+// Decoded images are scaled to the panel as the app sees it, i.e. after rotation
+static int            image_width   = 0;
+static int            image_height  = 0;
 static QueueHandle_t  input_event_queue = NULL;
 
-// Image navigation variables
-static char png_files[MAX_PNG_FILES][MAX_PATH_LENGTH];
-static int  png_count            = 0;
-static int  current_image_index  = 0;
-static bool sd_card_available    = false;
-static pax_buf_t current_image   = {0};
-static bool has_current_image    = false;
-static bool image_flipped        = false;
+// Zero-copy display path: when the image has the panel's size and layout its
+// pixels are blitted as-is, and only the menu bar strip goes through a buffer
+static bool      direct_blit_supported = false;
+static pax_buf_t menu_strip            = {0};
+static size_t    frame_bytes_touched   = 0;  // bytes written or read by the last render_frame()
+
+// Damage covering more rows than this is pushed as a single full-frame blit
+#define FULL_BLIT_MIN_ROWS (display_v_res * 3 / 4)
+
+// Image navigation variables. The files of the current album are in its
+// listing, which the decoder task reads too.
+static catalog_t* listing = NULL;
+
+static int  image_count         = 0;
+static int  current_image_index = 0;
+static bool sd_card_available   = false;
+static bool image_flipped       = false;
+
+// Set by the decoder task when a sidecar the index calls fresh turned out
+// stale, the main loop saves the index again
+static atomic_bool index_dirty = false;
+
+// Held while an index is written. The builder task saves the album it rebuilt
+// while the main task may save the same one, both through the same temporary
+// file. The builder only runs if this exists.
+static SemaphoreHandle_t index_lock = NULL;
+
+// Shuffled order of the album's images. R moves on to its next image, and
+// S switches the arrows and the slideshow to it and back. Its position
+// follows the image shown in either order, so both go on from there.
+static playlist_t* playlist    = NULL;
+static bool        shuffle     = false;
+static bool        on_playlist = false;  // R led to the image shown, so left goes back along the playlist
+
+// Where the image keys handled so far lead. A burst of them, drained from the
+// queue in one go, is applied as a single move to where it ends up.
+static int pending_move_index     = -1;  // -1 if none
+static int pending_move_direction = 1;
+static int pending_move_keys      = 0;
+
+// Frame being shown, owned by the image cache and valid until the next load
+static const pax_buf_t* current_image = NULL;
+
+// Staged startup: a placeholder is drawn before the SD card is touched, then
+// the image viewed last is decoded into a frame of its own while a background
+// task lists its album. The listing is adopted by the main task once complete.
+#define NVS_NAMESPACE      "imagewag"
+#define NVS_KEY_LAST_IMAGE "last_image"
+#define NVS_KEY_SHUFFLE    "shuffle"
+#define NVS_KEY_SEED       "shuffle_seed"
+#define NVS_KEY_ROUND      "shuffle_round"
+#define LAST_IMAGE_SAVE_MS 10000  // images shown for less time are not remembered, sparing the flash
+#define STARTUP_POLL_MS    10   // only without main_events, when nothing else wakes the main loop
+#define IDLE_POLL_MS       100
+static char              last_image_path[MAX_PATH_LENGTH] = "";  // as stored in NVS
+static TickType_t        image_shown_tick   = 0;
+static bool              last_image_due     = false;  // the image shown since image_shown_tick is to be remembered
+static pax_buf_t         startup_frame      = {0};
+static bool              startup_frame_used = false;
+static bool              images_loading     = true;   // nothing to show yet, the SD card is still being read
+static bool              startup_scanning   = false;  // the startup task owns the album list
+static int               startup_album      = -1;     // album of last_image_path, found by the startup task
+static SemaphoreHandle_t startup_scan_done  = NULL;
+
+// The shuffle as stored in NVS: whether it is on and the round of the
+// playlist the last image was shown in, which that image's album resumes
+static bool     saved_shuffle       = false;
+static uint32_t saved_shuffle_seed  = 0;
+static uint32_t saved_shuffle_round = 0;
 
 // Menu bar: shown at startup and on any key press, auto-hides after a timeout
 #define MENU_TIMEOUT_MS 3000
 static bool       menu_visible    = false;
 static TickType_t menu_shown_tick = 0;
 
+// Performance HUD: P toggles timing statistics in the top left corner
+#define PERF_HUD_REFRESH_MS 1000
+static bool       hud_visible    = false;
+static TickType_t hud_drawn_tick = 0;
+
 // Slideshow timer: T cycles through static (off) and preset advance intervals
 static const uint32_t slideshow_intervals_ms[] = {0, 15000, 30000, 60000, 300000, 600000};
 static const char*    slideshow_labels[]       = {"Static", "15s", "30s", "1m", "5m", "10m"};
 #define SLIDESHOW_MODE_COUNT (sizeof(slideshow_intervals_ms) / sizeof(slideshow_intervals_ms[0]))
 static int        slideshow_mode      = 0;
 static TickType_t slideshow_last_tick = 0;
+// With nobody at the badge only the next image is decoded, this long before
+// it is due, so the decoder does not wake the CPU for neighbours nobody asks for
+#define SLIDESHOW_PREFETCH_LEAD_MS 3000
+static bool slideshow_prefetch_due = false;
+
+// Transitions between images: E cycles through them. They are played by
+// load_image on a frame of their own, allocated on first use, as fast as the
+// panel takes them; the time they take is fixed, their frame rate is not.
+#define TRANSITION_MS       400
+#define TRANSITION_FRAME_US 16667  // frames faster than the panel refreshes, 60 Hz, are a waste
+static transition_t transition_mode            = TRANSITION_CUT;
+static pax_buf_t    transition_frame           = {0};
+static bool         transition_frame_allocated = false;
+
+// Animated images play on the frame showing them, taken over from the image
+// cache: animation.c composes each frame at the image's size and the rows it
+// changed are scaled into the frame and redrawn. A one-shot esp_timer wakes
+// the main loop, through a queue set shared with the input queue, when the
+// next frame is due.
+#define ANIMATION_MAX_LAG_US  1000000  // further behind than this, restart the schedule instead of catching up
+#define ANIMATION_MIN_WAIT_US 5000     // even when behind, so input and prefetching get a turn between frames
+static animation_t*       animation          = NULL;
+static FILE*              animation_file     = NULL;
+static image_scaler_t*    animation_scaler   = NULL;
+static int64_t            animation_deadline = 0;  // esp_timer time the next frame is due
+static esp_timer_handle_t frame_timer        = NULL;
+static SemaphoreHandle_t  frame_due          = NULL;  // given by frame_timer
+static SemaphoreHandle_t  main_wake          = NULL;  // given by other tasks with work for the main loop
+static QueueSetHandle_t   main_events        = NULL;  // input_event_queue, frame_due and main_wake
+
+// Fill in the catalogue entry for an image from its header, and check whether
+// it has an up-to-date .wag sidecar
+static void read_image_info(const char* image_path, int codec, catalog_entry_t* info) {
+    info->bad = true;
+
+    struct stat  source;
+    codec_info_t header;
+    FILE*        fd = stat(image_path, &source) == 0 ? fopen(image_path, "rb") : NULL;
+    if (fd == NULL) {
+        ESP_LOGW(TAG, "Failed to open %s", image_path);
+        return;
+    }
+    bool valid = codec_read_info(fd, &codec, &header);
+    fclose(fd);
+    if (!valid) {
+        ESP_LOGW(TAG, "Skipping %s: not a valid image", image_path);
+        return;
+    }
 
-// Function to check if a filename ends with .png
-static bool is_png_file(const char* filename) {
-    size_t len = strlen(filename);
-    if (len < 4) return false;
-    return (strcasecmp(filename + len - 4, ".png") == 0);
+    info->codec      = (uint8_t)codec;
+    info->size       = (uint32_t)source.st_size;
+    info->width      = header.width > UINT16_MAX ? UINT16_MAX : header.width;
+    info->height     = header.height > UINT16_MAX ? UINT16_MAX : header.height;
+    info->color_type = header.color_type;
+    info->bit_depth  = header.bit_depth;
+    info->interlaced = header.interlaced;
+    info->animated   = header.animated;
+    if (!header.supported) {
+        const char* layout = !header.interlaced ? "" : codec == CODEC_JPEG ? ", progressive" : ", interlaced";
+        ESP_LOGW(TAG, "Skipping %s: unsupported %s (colour type %u, bit depth %u%s)", image_path, codec_name(codec),
+                 header.color_type, header.bit_depth, layout);
+        return;
+    }
+    info->bad = false;
+
+    char wag_path[MAX_PATH_LENGTH + sizeof(WAG_SUFFIX)];
+    info->cache_stale = !wag_path_for(image_path, wag_path, sizeof(wag_path)) ||
+                        !wag_is_fresh(wag_path, &source, IMAGE_BUF_TYPE);
 }
 
-// Function to scan the images directory for PNG files and populate the global list
-static int scan_png_files(void) {
-    DIR* dir = opendir(IMAGES_DIR);
+static bool index_path_for(const catalog_t* album, char* out, size_t out_size) {
+    int len = snprintf(out, out_size, "%s/%s", album->dir, INDEX_NAME);
+    return len > 0 && (size_t)len < out_size;
+}
+
+static void save_index(const catalog_t* album) {
+    char index_path[MAX_PATH_LENGTH];
+    if (!index_path_for(album, index_path, sizeof(index_path))) return;
+    if (index_lock != NULL) xSemaphoreTake(index_lock, portMAX_DELAY);
+    catalog_save(album, index_path, INDEX_CONFIG);
+    if (index_lock != NULL) xSemaphoreGive(index_lock);
+}
+
+// Scan an album directory for image files and subdirectories, populating its
+// listing. Metadata of files in the index saved by the previous scan is reused,
+// so only new files are opened. The directory listing itself is always read:
+// FAT does not update a directory's timestamp when its contents change.
+static void scan_image_files(catalog_t* album, void* ctx) {
+    (void)ctx;
+    const char* dir_path = album->dir;
+    int64_t     start    = perf_begin();
+
+    DIR* dir = opendir(dir_path);
     if (dir == NULL) {
-        ESP_LOGW(TAG, "Failed to open directory %s (does it exist?)", IMAGES_DIR);
-        return 0;
+        ESP_LOGW(TAG, "Failed to open directory %s (does it exist?)", dir_path);
+        return;
     }
 
-    png_count = 0;
-    int total_files = 0;
+    char index_path[MAX_PATH_LENGTH];
+    bool have_index  = index_path_for(album, index_path, sizeof(index_path)) &&
+                      catalog_load_previous(index_path, INDEX_CONFIG);
+    int  total_files = 0;
+    int  image_files = 0;
+    int  read_files  = 0;  // not in the index, opened to read their header
     struct dirent* entry;
 
-    ESP_LOGI(TAG, "Scanning directory %s for files:", IMAGES_DIR);
+    ESP_LOGI(TAG, "Scanning directory %s for files:", dir_path);
 
-    while ((entry = readdir(dir)) != NULL && png_count < MAX_PNG_FILES) {
-        if (entry->d_type == DT_REG) {
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_type == DT_DIR && entry->d_name[0] != '.') {
+            ESP_LOGD(TAG, "Found album: %s", entry->d_name);
+            album_found_subdir(entry->d_name);
+        } else if (entry->d_type == DT_REG && strcmp(entry->d_name, INDEX_NAME) != 0) {
             total_files++;
-            ESP_LOGI(TAG, "Found file: %s", entry->d_name);
+            ESP_LOGD(TAG, "Found file: %s", entry->d_name);
 
-            if (is_png_file(entry->d_name)) {
-                size_t path_len = strlen(IMAGES_DIR) + strlen(entry->d_name) + 2;  // +2 for '/' and '\0'
+            int codec = codec_for_name(entry->d_name);
+            if (codec >= 0) {
+                size_t path_len = strlen(dir_path) + strlen(entry->d_name) + 2;  // +2 for '/' and '\0'
                 if (path_len < MAX_PATH_LENGTH) {
-                    snprintf(png_files[png_count], sizeof(png_files[png_count]),
-                             "%s/%s", IMAGES_DIR, entry->d_name);
-                    png_count++;
-                    ESP_LOGI(TAG, "  -> This is a PNG file!");
+                    catalog_entry_t* info = catalog_add(album, entry->d_name);
+                    if (info == NULL) {
+                        ESP_LOGW(TAG, "Out of memory after %d images, ignoring the rest", image_files);
+                        break;
+                    }
+                    const catalog_entry_t* known = catalog_find_previous(entry->d_name);
+                    if (known != NULL) {
+                        uint32_t name = info->name;
+                        *info         = *known;
+                        info->name    = name;
+                    } else {
+                        char image_path[MAX_PATH_LENGTH];
+                        catalog_path(album, image_files, image_path, sizeof(image_path));
+                        read_image_info(image_path, codec, info);
+                        read_files++;
+                    }
+                    image_files++;
                 } else {
-                    ESP_LOGW(TAG, "Path too long for PNG file: %s", entry->d_name);
+                    ESP_LOGW(TAG, "Path too long for image file: %s", entry->d_name);
                 }
             }
         }
     }
     closedir(dir);
 
-    ESP_LOGI(TAG, "Scan complete. Found %d total files, %d PNG files", total_files, png_count);
-    for (int i = 0; i < png_count; i++) {
-        ESP_LOGI(TAG, "PNG file %d: %s", i, png_files[i]);
+    ESP_LOGI(TAG, "Scan complete. Found %d total files, %d images, %d of them not in the index", total_files,
+             image_files, read_files);
+    if (have_index ? read_files > 0 || !catalog_matches_previous(album) : image_files > 0) {
+        ESP_LOGI(TAG, "Directory changed, saving index");
+        save_index(album);
+    }
+    catalog_free_previous();
+    for (int i = 0; i < image_files; i++) {
+        ESP_LOGD(TAG, "Image file %d: %s", i, catalog_name(album, i));
     }
 
-    if (png_count == 0) {
+    if (image_files == 0) {
         if (total_files == 0) {
-            ESP_LOGW(TAG, "No files found in %s", IMAGES_DIR);
+            ESP_LOGW(TAG, "No files found in %s", dir_path);
         } else {
-            ESP_LOGW(TAG, "No PNG files found in %s (found %d other files)", IMAGES_DIR, total_files);
+            ESP_LOGW(TAG, "No images found in %s (found %d other files)", dir_path, total_files);
         }
     }
 
-    return png_count;
+    perf_end(PERF_SCAN, start);
+    ESP_LOGI(TAG, "Listed %s in %" PRId64 " ms, album uses %zu bytes, %zu bytes internal RAM free", dir_path,
+             (esp_timer_get_time() - start) / 1000, catalog_memory(album),
+             heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
 }
 
-// Blit the framebuffer to the physical display
-static void blit(void) {
-    esp_err_t res = bsp_display_blit(0, 0, display_h_res, display_v_res, pax_buf_get_pixels(&fb));
+// Push full-width rows [y_start, y_end) to the physical display. pixels points
+// at the first of those rows, packed in the panel's native format.
+static void blit_rows(size_t y_start, size_t y_end, const void* pixels) {
+    int64_t   start = perf_begin();
+    esp_err_t res   = bsp_display_blit(0, y_start, display_h_res, y_end, pixels);
+    perf_end(PERF_BLIT, start);
+    perf_milestone(PERF_FIRST_PIXEL);
+    if (current_image != NULL) perf_milestone(PERF_FIRST_IMAGE);
     if (res != ESP_OK) {
         ESP_LOGE(TAG, "Failed to blit to display: %d", res);
     }
+    frame_bytes_touched += (y_end - y_start) * display_h_res * fb_bytes_per_pixel;
 }
 
 // Reverse a decoded image's pixels in place, 180 degrees.
@@ -129,39 +353,8 @@ static void blit(void) {
 // matrix/shader, so there is no interpolation/transform edge case that can
 // leave stray pixels at the buffer boundary.
 static void flip_image_pixels_180(pax_buf_t* buf) {
-    int      w          = pax_buf_get_width(buf);
-    int      h          = pax_buf_get_height(buf);
-    int      row_bytes  = w * IMAGE_BYTES_PER_PIXEL;
-    uint8_t* pixels     = (uint8_t*)pax_buf_get_pixels_rw(buf);
-
-    uint8_t* tmp_row = malloc(row_bytes);
-    if (tmp_row == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate row buffer for flip");
-        return;
-    }
-
-    // Swap row i with row (h-1-i)
-    for (int y = 0; y < h / 2; y++) {
-        uint8_t* top_row    = pixels + (size_t)y * row_bytes;
-        uint8_t* bottom_row = pixels + (size_t)(h - 1 - y) * row_bytes;
-        memcpy(tmp_row, top_row, row_bytes);
-        memcpy(top_row, bottom_row, row_bytes);
-        memcpy(bottom_row, tmp_row, row_bytes);
-    }
-    free(tmp_row);
-
-    // Reverse pixel order within every row
-    for (int y = 0; y < h; y++) {
-        uint8_t* row = pixels + (size_t)y * row_bytes;
-        for (int x = 0; x < w / 2; x++) {
-            uint8_t* left  = row + (size_t)x * IMAGE_BYTES_PER_PIXEL;
-            uint8_t* right = row + (size_t)(w - 1 - x) * IMAGE_BYTES_PER_PIXEL;
-            uint8_t  tmp[IMAGE_BYTES_PER_PIXEL];
-            memcpy(tmp, left, IMAGE_BYTES_PER_PIXEL);
-            memcpy(left, right, IMAGE_BYTES_PER_PIXEL);
-            memcpy(right, tmp, IMAGE_BYTES_PER_PIXEL);
-        }
-    }
+    size_t count = (size_t)pax_buf_get_width(buf) * pax_buf_get_height(buf);
+    image_flip_180(pax_buf_get_pixels_rw(buf), count);
 }
 
 static void draw_message(const char* line1, const char* line2, const char* line3) {
@@ -189,10 +382,12 @@ static void draw_message(const char* line1, const char* line2, const char* line3
 #define FOOTER_SIDE_MARGIN     20
 // Native glyph size of pax_font_saira_regular; bitmap fonts blur at other sizes
 #define FOOTER_TEXT_HEIGHT     18
+#define FOOTER_BOX_HEIGHT      (FOOTER_HEIGHT + (FOOTER_VERTICAL_MARGIN * 2))
 
 // Draw a launcher-icon-style keycap (dark rounded square with the key label)
 // followed by a description. Returns the total width drawn.
-static float draw_menu_hint(float x, float bar_top, int box_height, const char* key, const char* description) {
+static float draw_menu_hint(pax_buf_t* target, float x, float bar_top, int box_height, const char* key,
+                            const char* description) {
     const pax_font_t* font = pax_font_saira_regular;
 
     pax_vec2f key_size  = pax_text_size(font, FOOTER_TEXT_HEIGHT, key);
@@ -200,165 +395,1138 @@ static float draw_menu_hint(float x, float bar_top, int box_height, const char*
     float     cap_w     = key_size.x + 12;
     float     cap_y     = bar_top + (box_height - cap_h) / 2;
 
-    pax_draw_round_rect(&fb, FOOTER_COLOR_FG, x, cap_y, cap_w, cap_h, 4);
-    pax_draw_text(&fb, 0xFF101010, font, FOOTER_TEXT_HEIGHT, x + 6,
+    pax_draw_round_rect(target, FOOTER_COLOR_FG, x, cap_y, cap_w, cap_h, 4);
+    pax_draw_text(target, 0xFF101010, font, FOOTER_TEXT_HEIGHT, x + 6,
                   cap_y + (cap_h - FOOTER_TEXT_HEIGHT) / 2 - 1, key);
 
     float text_x = x + cap_w + 6;
     pax_vec2f desc_size = pax_text_size(font, FOOTER_TEXT_HEIGHT, description);
-    pax_draw_text(&fb, FOOTER_COLOR_FG, font, FOOTER_TEXT_HEIGHT, text_x,
+    pax_draw_text(target, FOOTER_COLOR_FG, font, FOOTER_TEXT_HEIGHT, text_x,
                   bar_top + (box_height - FOOTER_TEXT_HEIGHT) / 2.0f, description);
 
     return cap_w + 6 + desc_size.x;
 }
 
-static void draw_menu_bar(void) {
-    int width      = pax_buf_get_width(&fb);
-    int height     = pax_buf_get_height(&fb);
-    int box_height = FOOTER_HEIGHT + (FOOTER_VERTICAL_MARGIN * 2);
+// Draw the menu bar along the bottom edge of target
+static void draw_menu_bar(pax_buf_t* target) {
+    int width      = pax_buf_get_width(target);
+    int height     = pax_buf_get_height(target);
+    int box_height = FOOTER_BOX_HEIGHT;
     int bar_top    = height - box_height;
 
     // Bar background and separator line, same geometry as the launcher's gui_footer_draw
-    pax_draw_rect(&fb, FOOTER_COLOR_BG, FOOTER_SIDE_MARGIN, bar_top,
+    pax_draw_rect(target, FOOTER_COLOR_BG, FOOTER_SIDE_MARGIN, bar_top,
                   width - (FOOTER_SIDE_MARGIN * 2), box_height - FOOTER_VERTICAL_MARGIN);
-    pax_draw_line(&fb, FOOTER_COLOR_FG, FOOTER_SIDE_MARGIN, bar_top,
+    pax_draw_line(target, FOOTER_COLOR_FG, FOOTER_SIDE_MARGIN, bar_top,
                   width - FOOTER_SIDE_MARGIN, bar_top);
 
     char timer_text[32];
     snprintf(timer_text, sizeof(timer_text), "Timer: %s", slideshow_labels[slideshow_mode]);
 
     float x = FOOTER_SIDE_MARGIN + 10;
-    x += draw_menu_hint(x, bar_top, box_height - FOOTER_VERTICAL_MARGIN, "ESC", "Exit") + 20;
-    x += draw_menu_hint(x, bar_top, box_height - FOOTER_VERTICAL_MARGIN, "< >", "Navigate") + 20;
-    x += draw_menu_hint(x, bar_top, box_height - FOOTER_VERTICAL_MARGIN, "R", "Random") + 20;
-    x += draw_menu_hint(x, bar_top, box_height - FOOTER_VERTICAL_MARGIN, "F", "Flip") + 20;
-    x += draw_menu_hint(x, bar_top, box_height - FOOTER_VERTICAL_MARGIN, "T", timer_text);
+    x += draw_menu_hint(target, x, bar_top, box_height - FOOTER_VERTICAL_MARGIN, "ESC", "Exit") + 20;
+    x += draw_menu_hint(target, x, bar_top, box_height - FOOTER_VERTICAL_MARGIN, "< >", "Navigate") + 20;
+    x += draw_menu_hint(target, x, bar_top, box_height - FOOTER_VERTICAL_MARGIN, "R", "Random") + 20;
+    x += draw_menu_hint(target, x, bar_top, box_height - FOOTER_VERTICAL_MARGIN, "S",
+                        shuffle ? "Shuffle: On" : "Shuffle: Off") +
+         20;
+    x += draw_menu_hint(target, x, bar_top, box_height - FOOTER_VERTICAL_MARGIN, "F", "Flip") + 20;
+    x += draw_menu_hint(target, x, bar_top, box_height - FOOTER_VERTICAL_MARGIN, "T", timer_text) + 20;
+    x += draw_menu_hint(target, x, bar_top, box_height - FOOTER_VERTICAL_MARGIN, "E", transition_name(transition_mode));
 }
 
-// Redraw the current frame: the loaded image (or a fallback message),
-// plus the menu bar when visible, then push it to the display.
-static void render_frame(void) {
-    if (has_current_image) {
-        pax_background(&fb, COLOR_BLACK);
-        pax_draw_image_op(&fb, &current_image, 0, 0);
+// The menu bar is rasterised once into an ARGB sprite and only re-rendered
+// when its content (the shuffle, timer and transition labels) changes
+static pax_buf_t menu_sprite      = {0};
+static int       menu_sprite_mode = -1;  // menu_mode() the sprite shows, -1 if not allocated
+
+static int menu_mode(void) {
+    return (slideshow_mode * TRANSITION_COUNT + transition_mode) * 2 + shuffle;
+}
+
+static pax_buf_t* get_menu_sprite(void) {
+    if (menu_sprite_mode == menu_mode()) return &menu_sprite;
+    if (menu_sprite_mode < 0 &&
+        !pax_buf_init(&menu_sprite, NULL, pax_buf_get_width(&fb), FOOTER_BOX_HEIGHT, PAX_BUF_32_8888ARGB)) {
+        ESP_LOGW(TAG, "Failed to allocate menu sprite, drawing the menu directly");
+        return NULL;
+    }
+    pax_background(&menu_sprite, 0x00000000);
+    draw_menu_bar(&menu_sprite);
+    menu_sprite_mode = menu_mode();
+    return &menu_sprite;
+}
+
+// Rows [damage_top, damage_bottom) no longer match what is on the panel
+static size_t damage_top    = 0;
+static size_t damage_bottom = 0;
+
+static void mark_damage(size_t top, size_t bottom) {
+    if (damage_top == damage_bottom) {
+        damage_top    = top;
+        damage_bottom = bottom;
+        return;
+    }
+    if (top < damage_top) damage_top = top;
+    if (bottom > damage_bottom) damage_bottom = bottom;
+}
+
+static void mark_all_damaged(void) {
+    mark_damage(0, display_v_res);
+}
+
+static void mark_menu_damaged(void) {
+    mark_damage(display_v_res - FOOTER_BOX_HEIGHT, display_v_res);
+}
+
+static void set_menu_visible(bool visible) {
+    if (visible != menu_visible) {
+        menu_visible = visible;
+        mark_menu_damaged();
+    }
+    if (visible) {
+        menu_shown_tick = xTaskGetTickCount();
+    }
+}
+
+// Timing statistics overlay, one line per probe that has samples plus heap
+// high-water marks, animation and transition frame counts, the time spent
+// busy and idle and the startup milestones
+#define PERF_HUD_TEXT_HEIGHT 18  // twice the native size of pax_font_sky_mono
+#define PERF_HUD_LINE_HEIGHT 20
+#define PERF_HUD_WIDTH       460
+#define PERF_HUD_HEIGHT      ((PERF_PROBE_COUNT + 7) * PERF_HUD_LINE_HEIGHT + 16)
+
+static void draw_perf_hud(pax_buf_t* target) {
+    char line[64];
+    int  y = 8;
+    pax_draw_rect(target, FOOTER_COLOR_BG, 0, 0, PERF_HUD_WIDTH, PERF_HUD_HEIGHT);
+    for (int p = 0; p < PERF_PROBE_COUNT; p++) {
+        perf_stats_t stats;
+        perf_get_stats(p, &stats);
+        if (stats.count == 0) continue;
+        snprintf(line, sizeof(line), "%-8s %3" PRIu32 "x avg %7.1f p99 %7.1f ms", perf_probe_name(p), stats.count,
+                 stats.avg_us / 1000.0f, stats.p99_us / 1000.0f);
+        pax_draw_text(target, FOOTER_COLOR_FG, pax_font_sky_mono, PERF_HUD_TEXT_HEIGHT, 8, y, line);
+        y += PERF_HUD_LINE_HEIGHT;
+    }
+
+    perf_memory_t memory;
+    perf_get_memory(&memory);
+    snprintf(line, sizeof(line), "RAM   peak %5zu of %5zu KB", memory.internal_peak / 1024,
+             memory.internal_total / 1024);
+    pax_draw_text(target, FOOTER_COLOR_FG, pax_font_sky_mono, PERF_HUD_TEXT_HEIGHT, 8, y, line);
+    y += PERF_HUD_LINE_HEIGHT;
+    snprintf(line, sizeof(line), "PSRAM peak %5zu of %5zu KB", memory.psram_peak / 1024, memory.psram_total / 1024);
+    pax_draw_text(target, FOOTER_COLOR_FG, pax_font_sky_mono, PERF_HUD_TEXT_HEIGHT, 8, y, line);
+    y += PERF_HUD_LINE_HEIGHT;
+    snprintf(line, sizeof(line), "Anim  shown %5" PRIu32 " dropped %5" PRIu32, perf_counter(PERF_FRAMES_SHOWN),
+             perf_counter(PERF_FRAMES_DROPPED));
+    pax_draw_text(target, FOOTER_COLOR_FG, pax_font_sky_mono, PERF_HUD_TEXT_HEIGHT, 8, y, line);
+    y += PERF_HUD_LINE_HEIGHT;
+    perf_stats_t transition;
+    perf_get_stats(PERF_TRANSITION, &transition);
+    snprintf(line, sizeof(line), "Trans frames %5" PRIu32 " max %5.1f fps", perf_counter(PERF_TRANSITION_FRAMES),
+             transition.avg_us > 0 ? 1e6f / transition.avg_us : 0.0f);
+    pax_draw_text(target, FOOTER_COLOR_FG, pax_font_sky_mono, PERF_HUD_TEXT_HEIGHT, 8, y, line);
+    y += PERF_HUD_LINE_HEIGHT;
+    int64_t busy_us, idle_us;
+    power_get_times(&busy_us, &idle_us);
+    snprintf(line, sizeof(line), "Power busy %6.1f s idle %7.1f s", busy_us / 1e6, idle_us / 1e6);
+    pax_draw_text(target, FOOTER_COLOR_FG, pax_font_sky_mono, PERF_HUD_TEXT_HEIGHT, 8, y, line);
+    y += PERF_HUD_LINE_HEIGHT;
+    image_file_stats_t sd;
+    image_file_get_stats(&sd);
+    snprintf(line, sizeof(line), "SD    ahead %5.1f MB/s hits %4" PRIu32 " of %4" PRIu32,
+             sd.read_us > 0 ? sd.bytes / (double)sd.read_us : 0.0, sd.hits, sd.opened);
+    pax_draw_text(target, FOOTER_COLOR_FG, pax_font_sky_mono, PERF_HUD_TEXT_HEIGHT, 8, y, line);
+    y += PERF_HUD_LINE_HEIGHT;
+    snprintf(line, sizeof(line), "Boot  pixel %5d image %5d list %5d ms",
+             (int)(perf_milestone_us(PERF_FIRST_PIXEL) / 1000), (int)(perf_milestone_us(PERF_FIRST_IMAGE) / 1000),
+             (int)(perf_milestone_us(PERF_LISTING_READY) / 1000));
+    pax_draw_text(target, FOOTER_COLOR_FG, pax_font_sky_mono, PERF_HUD_TEXT_HEIGHT, 8, y, line);
+    hud_drawn_tick = xTaskGetTickCount();
+}
+
+static void toggle_perf_hud(void) {
+    hud_visible = !hud_visible;
+    // Switches between the direct and framebuffer paths
+    mark_all_damaged();
+    if (hud_visible) {
+        perf_dump_csv();
+    }
+    ESP_LOGI(TAG, "Performance HUD is now %s", hud_visible ? "on" : "off");
+}
+
+// The decoded image can be handed to the display untouched when the panel is
+// upright, takes IMAGE_BUF_TYPE pixels little-endian and the image has exactly
+// its dimensions.
+// The performance HUD is only drawn in the framebuffer.
+static bool can_blit_image_directly(void) {
+    return direct_blit_supported && !hud_visible && current_image != NULL && pax_buf_get_width(current_image) == (int)display_h_res &&
+           pax_buf_get_height(current_image) == (int)display_v_res;
+}
+
+// Write display rows [top, bottom) of the current image, rotated by 180
+// degrees, to dst. A band of flipped rows is one contiguous run of source
+// pixels in reverse order.
+static void copy_flipped_rows(size_t top, size_t bottom, uint8_t* dst) {
+    const uint8_t* pixels = pax_buf_get_pixels(current_image);
+    size_t         total  = display_h_res * display_v_res;
+    size_t         count  = (bottom - top) * display_h_res;
+    image_reverse_copy(dst, pixels + (total - bottom * display_h_res) * IMAGE_BYTES_PER_PIXEL, count);
+    frame_bytes_touched += 2 * count * IMAGE_BYTES_PER_PIXEL;
+}
+
+// Zero-copy update of rows [top, bottom): image rows are blitted straight
+// from current_image, and the menu bar is composited into a copy of the
+// bottom strip only. Without the menu this restores the image under it.
+// A flipped image is streamed through the strip buffer one band at a time,
+// so flipping never touches the decoded pixels.
+static void render_image_direct(size_t top, size_t bottom) {
+    const uint8_t* pixels     = pax_buf_get_pixels(current_image);
+    size_t         row_bytes  = display_h_res * IMAGE_BYTES_PER_PIXEL;
+    size_t         strip_rows = pax_buf_get_height(&menu_strip);
+    size_t         strip_top  = display_v_res - strip_rows;
+    size_t         image_end  = (menu_visible && bottom > strip_top) ? strip_top : bottom;
+    uint8_t*       strip      = pax_buf_get_pixels_rw(&menu_strip);
+
+    if (!image_flipped) {
+        if (top < image_end) {
+            blit_rows(top, image_end, pixels + top * row_bytes);
+        }
+    } else {
+        for (size_t y = top; y < image_end; y += strip_rows) {
+            size_t end = y + strip_rows < image_end ? y + strip_rows : image_end;
+            copy_flipped_rows(y, end, strip);
+            blit_rows(y, end, strip);
+        }
+    }
+
+    if (menu_visible && bottom > strip_top) {
+        int64_t        start       = perf_begin();
+        size_t         strip_bytes = strip_rows * row_bytes;
+        const uint8_t* base        = pixels + strip_top * row_bytes;
+        pax_buf_t*     sprite      = get_menu_sprite();
+        if (image_flipped) {
+            copy_flipped_rows(strip_top, display_v_res, strip);
+            base = strip;
+        }
+        if (sprite != NULL) {
+            // Image rows and sprite are combined in one pass straight into the strip
+            image_blend_argb_over(strip, base, pax_buf_get_pixels(sprite), strip_rows * display_h_res);
+            // Read image and ARGB sprite, write strip
+            frame_bytes_touched += strip_bytes * (2 * IMAGE_BYTES_PER_PIXEL + 4) / IMAGE_BYTES_PER_PIXEL;
+        } else {
+            if (base != strip) {
+                memcpy(strip, base, strip_bytes);
+                frame_bytes_touched += 2 * strip_bytes;
+            }
+            draw_menu_bar(&menu_strip);
+            frame_bytes_touched += strip_bytes;
+        }
+        perf_end(PERF_DRAW_MENU, start);
+        blit_rows(strip_top, display_v_res, strip);
+    }
+}
+
+// The framebuffer orientation with an extra 180 degree turn, for drawing
+// flipped images
+static pax_orientation_t rotated_half(pax_orientation_t orientation) {
+    switch (orientation) {
+        case PAX_O_UPRIGHT:  return PAX_O_ROT_HALF;
+        case PAX_O_ROT_CCW:  return PAX_O_ROT_CW;
+        case PAX_O_ROT_HALF: return PAX_O_UPRIGHT;
+        case PAX_O_ROT_CW:   return PAX_O_ROT_CCW;
+        default:             return orientation;
+    }
+}
+
+// Redraw rows [top, bottom) of fb and push them. Partial redraws clip to the
+// damaged rows and repaint the image underneath, which needs fb rows to be
+// memory rows, so rotated panels and flipped images always redraw the whole
+// frame. Flipping is done by drawing the image with the framebuffer turned
+// by 180 degrees.
+static void render_framebuffer(size_t top, size_t bottom) {
+    size_t row_bytes = display_h_res * fb_bytes_per_pixel;
+    if (current_image == NULL || image_flipped || fb_orientation != PAX_O_UPRIGHT) {
+        top    = 0;
+        bottom = display_v_res;
+    }
+    size_t band_bytes = (bottom - top) * row_bytes;
+    bool   partial    = top > 0 || bottom < display_v_res;
+
+    int64_t start = perf_begin();
+    if (current_image != NULL) {
+        if (partial) {
+            pax_clip(&fb, 0, top, display_h_res, bottom - top);
+            pax_simple_rect(&fb, COLOR_BLACK, 0, top, display_h_res, bottom - top);
+        } else {
+            pax_background(&fb, COLOR_BLACK);
+        }
+        if (image_flipped) {
+            pax_buf_set_orientation(&fb, rotated_half(fb_orientation));
+        }
+        pax_draw_image_op(&fb, current_image, 0, 0);
+        pax_buf_set_orientation(&fb, fb_orientation);
+        frame_bytes_touched += 3 * band_bytes;  // clear, then read image and write fb
+    } else if (images_loading) {
+        draw_message("Loading images...", NULL, NULL);
+        frame_bytes_touched += band_bytes;
     } else if (!sd_card_available) {
         draw_message("SD Card Error", "Check that an SD card is", "inserted and reboot the device");
+        frame_bytes_touched += band_bytes;
     } else {
-        draw_message("No images found", "Copy 800x480 PNGs to the images/", "folder on the SD card and restart");
+        draw_message("No images found", "Copy PNG, JPEG or QOI files to", "images/ on the SD card and restart");
+        frame_bytes_touched += band_bytes;
     }
+    perf_end(PERF_DRAW_IMAGE, start);
 
-    if (menu_visible) {
-        draw_menu_bar();
+    if (menu_visible && bottom > display_v_res - FOOTER_BOX_HEIGHT) {
+        start             = perf_begin();
+        pax_buf_t* sprite = get_menu_sprite();
+        if (sprite != NULL) {
+            pax_draw_image(&fb, sprite, 0, pax_buf_get_height(&fb) - FOOTER_BOX_HEIGHT);
+        } else {
+            draw_menu_bar(&fb);
+        }
+        frame_bytes_touched += FOOTER_BOX_HEIGHT * row_bytes;
+        perf_end(PERF_DRAW_MENU, start);
     }
+    if (hud_visible && top < PERF_HUD_HEIGHT) {
+        draw_perf_hud(&fb);
+    }
+    pax_noclip(&fb);
 
-    blit();
+    blit_rows(top, bottom, (const uint8_t*)pax_buf_get_pixels(&fb) + top * row_bytes);
 }
 
-static void free_current_image(void) {
-    if (has_current_image) {
-        pax_buf_destroy(&current_image);
-        has_current_image = false;
+// Bring the panel up to date: redraw the damaged rows (the loaded image or a
+// fallback message, plus the menu bar when visible) and push only those.
+// Large damage is sent as one full-frame blit.
+static void render_frame(void) {
+    if (damage_top == damage_bottom) return;
+
+    size_t top    = damage_top;
+    size_t bottom = damage_bottom;
+    if (bottom - top > FULL_BLIT_MIN_ROWS) {
+        top    = 0;
+        bottom = display_v_res;
     }
+    damage_top = damage_bottom = 0;
+    frame_bytes_touched        = 0;
+
+    int64_t start = perf_begin();
+    if (can_blit_image_directly()) {
+        render_image_direct(top, bottom);
+        ESP_LOGD(TAG, "Rows %zu-%zu rendered directly, %zu bytes touched", top, bottom, frame_bytes_touched);
+    } else {
+        render_framebuffer(top, bottom);
+        ESP_LOGD(TAG, "Rows %zu-%zu rendered via framebuffer, %zu bytes touched", top, bottom, frame_bytes_touched);
+    }
+    perf_end(PERF_RENDER, start);
 }
 
-// Decode and display the PNG at the given index. Returns false (and leaves
-// the previously displayed image, if any, untouched) on any failure.
-static bool load_image(int index) {
-    if (!sd_card_available) {
-        ESP_LOGE(TAG, "SD card not available");
+// Decode the image file at the given index of an album listing into dst,
+// upright and scaled to fit. The header was checked while scanning, so the
+// file is opened once and read front to back, with rows streamed straight
+// into dst.
+static bool decode_image_file(catalog_t* album, int index, pax_buf_t* dst) {
+    catalog_entry_t* info = catalog_entry(album, index);
+    if (info->bad) return false;
+
+    char image_path[MAX_PATH_LENGTH];
+    catalog_path(album, index, image_path, sizeof(image_path));
+    int64_t start = perf_begin();
+    FILE*   fd    = image_file_open(image_path);
+    perf_end(PERF_OPEN, start);
+    if (fd == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s", image_path);
         return false;
     }
-    if (png_count == 0) {
-        ESP_LOGE(TAG, "No PNG files available");
+    // The header as scanned, unless its size did not fit the catalogue
+    codec_info_t header = {
+        .width      = info->width,
+        .height     = info->height,
+        .color_type = info->color_type,
+        .bit_depth  = info->bit_depth,
+        .interlaced = info->interlaced,
+        .supported  = true,
+        .animated   = info->animated,
+    };
+    bool clamped = info->width == UINT16_MAX || info->height == UINT16_MAX;
+    start        = perf_begin();
+    bool decoded = codec_decode_into(fd, info->codec, clamped ? NULL : &header, dst);
+    image_file_close(fd);
+    perf_end(PERF_DECODE, start);
+
+    if (!decoded) {
+        ESP_LOGE(TAG, "Failed to decode %s, skipping it from now on", image_path);
+        info->bad = true;
         return false;
     }
-    if (index < 0 || index >= png_count) {
-        ESP_LOGE(TAG, "Invalid image index: %d (total: %d)", index, png_count);
-        return false;
+    return true;
+}
+
+// Load an image's up-to-date .wag sidecar into dst, upright. Returns false if
+// there is none.
+static bool read_sidecar(const char* image_path, pax_buf_t* dst) {
+    struct stat source;
+    char        wag_path[MAX_PATH_LENGTH + sizeof(WAG_SUFFIX)];
+    bool        flipped = false;
+    int64_t     start   = perf_begin();
+    bool        cached  = stat(image_path, &source) == 0 && wag_path_for(image_path, wag_path, sizeof(wag_path)) &&
+                  wag_read(wag_path, &source, dst, &flipped);
+    perf_end(PERF_WAG_READ, start);
+    if (cached && flipped) {
+        start = perf_begin();
+        flip_image_pixels_180(dst);
+        perf_end(PERF_FLIP, start);
     }
+    return cached;
+}
 
-    ESP_LOGI(TAG, "Loading image %d: %s", index, png_files[index]);
+// Have the main loop look at its jobs now rather than at its next deadline.
+// For other tasks: the main loop itself never waits on work it has set up.
+static void wake_main_loop(void) {
+    if (main_wake != NULL) xSemaphoreGive(main_wake);
+}
 
-    FILE* fd = fopen(png_files[index], "rb");
-    if (fd == NULL) {
-        ESP_LOGE(TAG, "Failed to open %s", png_files[index]);
-        return false;
+// Load the image at the given index into dst, upright, preferring its .wag
+// sidecar over decoding the image. Runs on the decoder task, or on the main
+// task if the decoder task could not be started.
+static bool decode_image(int index, pax_buf_t* dst, void* ctx) {
+    (void)ctx;
+    catalog_entry_t* info = catalog_entry(listing, index);
+    if (info->bad) return false;
+
+    char image_path[MAX_PATH_LENGTH];
+    catalog_path(listing, index, image_path, sizeof(image_path));
+    perf_count(PERF_IMAGES_LOADED);
+    power_hold();
+    bool ok = read_sidecar(image_path, dst);
+    if (!ok) {
+        // Replaced after the index was saved: have the next visit rebuild it
+        if (!info->cache_stale) {
+            info->cache_stale = true;
+            atomic_store(&index_dirty, true);
+            wake_main_loop();
+        }
+        ok = decode_image_file(listing, index, dst);
+    }
+    power_release();
+    return ok;
+}
+
+// Read the file the decoder is going to need for index while it decodes the
+// image before: the sidecar if it is up to date, else the image itself
+static void read_ahead_image(int index, void* ctx) {
+    (void)ctx;
+    catalog_entry_t* info = catalog_entry(listing, index);
+    if (info->bad) return;
+
+    char image_path[MAX_PATH_LENGTH];
+    char wag_path[MAX_PATH_LENGTH + sizeof(WAG_SUFFIX)];
+    catalog_path(listing, index, image_path, sizeof(image_path));
+    if (!info->cache_stale && wag_path_for(image_path, wag_path, sizeof(wag_path))) {
+        image_file_read_ahead(wag_path);
+    } else {
+        image_file_read_ahead(image_path);
+    }
+}
+
+// Albums whose missing or stale .wag sidecars should be rebuilt. Listings
+// are pinned while queued. With the current album, the one being rebuilt and
+// the queued ones pinned, at least one cached listing must stay free.
+#define WAG_BUILD_QUEUE_LENGTH (ALBUM_CACHE_SIZE - 3)
+static QueueHandle_t wag_build_queue = NULL;
+
+static void build_album_sidecars(catalog_t* album) {
+    int       built = 0;
+    pax_buf_t image;
+    if (!pax_buf_init(&image, NULL, image_width, image_height, IMAGE_BUF_TYPE)) {
+        ESP_LOGE(TAG, "Failed to allocate a frame for rebuilding the image cache");
+        return;
+    }
+    for (int i = 0; i < catalog_count(album); i++) {
+        catalog_entry_t* info = catalog_entry(album, i);
+        if (!info->cache_stale || info->bad) continue;
+
+        struct stat source;
+        char        image_path[MAX_PATH_LENGTH];
+        char        wag_path[MAX_PATH_LENGTH + sizeof(WAG_SUFFIX)];
+        catalog_path(album, i, image_path, sizeof(image_path));
+        if (stat(image_path, &source) == 0 && wag_path_for(image_path, wag_path, sizeof(wag_path)) &&
+            decode_image_file(album, i, &image) && wag_write(wag_path, &source, &image, false)) {
+            ESP_LOGI(TAG, "Built cache %s", wag_path);
+            built++;
+        }
+        info->cache_stale = false;
+    }
+    pax_buf_destroy(&image);
+    ESP_LOGI(TAG, "Image cache rebuild of %s finished, %d files written", album->dir, built);
+    // Remember which sidecars are fresh now, so the next visit does not look again
+    save_index(album);
+}
+
+// Rebuild sidecars one file at a time. Runs at idle priority so it never
+// competes with prefetching or the UI.
+static void wag_builder_task(void* arg) {
+    (void)arg;
+    catalog_t* album;
+    while (true) {
+        xQueueReceive(wag_build_queue, &album, portMAX_DELAY);
+        power_hold();
+        build_album_sidecars(album);
+        power_release();
+        album_unpin(album);
+    }
+}
+
+static void start_wag_builder(void) {
+    wag_build_queue = xQueueCreate(WAG_BUILD_QUEUE_LENGTH, sizeof(catalog_t*));
+    index_lock      = xSemaphoreCreateMutex();
+    if (wag_build_queue == NULL || index_lock == NULL ||
+        xTaskCreate(wag_builder_task, "wag_builder", 8192, NULL, tskIDLE_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGW(TAG, "Failed to start the image cache builder, caches will not be rebuilt");
+        wag_build_queue = NULL;
+    }
+}
+
+// Have the builder rebuild the stale sidecars of an album, if it has any
+static void queue_wag_build(catalog_t* album) {
+    int stale = 0;
+    for (int i = 0; i < catalog_count(album); i++) {
+        stale += catalog_entry(album, i)->cache_stale && !catalog_entry(album, i)->bad;
+    }
+    if (stale == 0 || wag_build_queue == NULL) return;
+
+    album_pin(album);
+    if (xQueueSend(wag_build_queue, &album, 0) != pdTRUE) {
+        album_unpin(album);
+        ESP_LOGI(TAG, "Image cache builder busy, %s is rebuilt on a later visit", album->dir);
+        return;
+    }
+    ESP_LOGI(TAG, "%d images in %s have no up-to-date cache, rebuilding in the background", stale, album->dir);
+}
+
+// The first usable image after index in the given direction (1 or -1), or -1
+// if every file is known to be bad
+static int step_image(int index, int direction) {
+    for (int i = 0; i < image_count; i++) {
+        index = (index + direction + image_count) % image_count;
+        if (!catalog_entry(listing, index)->bad) return index;
+    }
+    return -1;
+}
+
+static bool shuffling(void) {
+    return shuffle && playlist != NULL;
+}
+
+// Step the playlist to the next usable image in the given direction, or -1
+// if there is none
+static int shuffle_step(int direction) {
+    for (int i = 0; i < image_count; i++) {
+        int index = playlist_step(playlist, direction);
+        if (index < 0 || !catalog_entry(listing, index)->bad) return index;
+    }
+    return -1;
+}
+
+// New shuffled order for the album just entered, starting at round of seed
+static void start_playlist(uint32_t seed, uint32_t round) {
+    on_playlist = false;
+    playlist_destroy(playlist);
+    playlist = playlist_create(image_count, seed, round);
+    if (playlist == NULL && image_count > 0) ESP_LOGW(TAG, "Failed to allocate the shuffle playlist");
+}
+
+static uint32_t new_shuffle_seed(void) {
+    return (uint32_t)rand() ^ (uint32_t)esp_timer_get_time();
+}
+
+// Ask the decoder to have the images reachable with one key press ready
+static void prefetch_neighbours(void) {
+    if (image_count == 0) return;
+    int neighbours[3];
+    if (shuffling()) {
+        neighbours[0] = playlist_at(playlist, 1);
+        neighbours[1] = playlist_at(playlist, -1);
+        neighbours[2] = playlist_at(playlist, 2);
+    } else {
+        neighbours[0] = step_image(current_image_index, 1);
+        neighbours[1] = on_playlist ? playlist_at(playlist, -1) : step_image(current_image_index, -1);
+        neighbours[2] = playlist != NULL ? playlist_at(playlist, 1) : -1;  // where R leads
+    }
+    // Paging on, the file of the image after the next one is read while the next one decodes
+    int look_ahead = -1;
+    if (shuffling()) {
+        look_ahead = playlist_at(playlist, 3);
+    } else if (neighbours[0] >= 0) {
+        look_ahead = step_image(neighbours[0], 1);
+    }
+    image_cache_prefetch(neighbours, sizeof(neighbours) / sizeof(neighbours[0]), look_ahead);
+}
+
+// A slideshow with its menu hidden, running with nobody pressing keys
+static bool slideshow_unattended(void) {
+    return slideshow_mode > 0 && !menu_visible;
+}
+
+// Ask the decoder for the image an unattended slideshow shows next, once it
+// is due soon
+static void prefetch_slideshow_next(void) {
+    slideshow_prefetch_due = false;
+    int next               = shuffling() ? playlist_at(playlist, 1) : step_image(current_image_index, 1);
+    image_cache_prefetch(&next, 1, -1);
+}
+
+static void frame_timer_callback(void* arg) {
+    (void)arg;
+    xSemaphoreGive(frame_due);
+}
+
+static void stop_animation(void) {
+    if (animation_file == NULL) return;
+    esp_timer_stop(frame_timer);
+    xSemaphoreTake(frame_due, 0);  // in case it came due meanwhile
+    animation_close(animation);
+    image_scaler_destroy(animation_scaler);
+    image_file_close(animation_file);
+    animation        = NULL;
+    animation_scaler = NULL;
+    animation_file   = NULL;
+}
+
+// Mark image rows [top, bottom) for redrawing wherever they are on the panel
+static void mark_image_damage(size_t top, size_t bottom) {
+    if (fb_orientation != PAX_O_UPRIGHT) {
+        // Image rows are panel columns, or mirrored: redrawn whole anyway
+        mark_all_damaged();
+    } else if (image_flipped) {
+        mark_damage(display_v_res - bottom, display_v_res - top);
+    } else {
+        mark_damage(top, bottom);
+    }
+}
+
+// Scale the canvas rows the last steps changed into the frame
+static void present_animation(void) {
+    uint32_t top, bottom, width, height, frame_top, frame_bottom;
+    if (!animation_take_damage(animation, &top, &bottom)) return;
+    animation_size(animation, &width, &height);
+    image_scaler_update(animation_scaler, animation_canvas(animation), (size_t)width * 3, top, bottom, &frame_top,
+                        &frame_bottom);
+    mark_image_damage(frame_top, frame_bottom);
+}
+
+static void schedule_animation_frame(void) {
+    int64_t wait_us = animation_deadline - esp_timer_get_time();
+    esp_timer_start_once(frame_timer, wait_us > ANIMATION_MIN_WAIT_US ? wait_us : ANIMATION_MIN_WAIT_US);
+}
+
+// Start playing the image at index, just loaded into current_image, if it is
+// animated. The first frame is composed and drawn right away: the frame may
+// hold another frame of it from before, or the default image of an APNG.
+static void start_animation(int index) {
+    stop_animation();
+    catalog_entry_t* entry = catalog_entry(listing, index);
+    char             path[MAX_PATH_LENGTH];
+    if (!entry->animated || frame_timer == NULL || !catalog_path(listing, index, path, sizeof(path))) return;
+
+    pax_buf_t* frame = current_image == &startup_frame ? &startup_frame : image_cache_modify_shown();
+    uint32_t   width, height, delay_ms;
+    animation_file = frame != NULL ? image_file_open(path) : NULL;
+    animation      = animation_file != NULL ? animation_open(animation_file, entry->codec) : NULL;
+    if (animation != NULL) {
+        animation_size(animation, &width, &height);
+        animation_scaler = image_scaler_create(width, height, frame);
+    }
+    if (animation_scaler == NULL || !animation_step(animation, &delay_ms)) {
+        ESP_LOGW(TAG, "Cannot play %s, showing its first frame", path);
+        stop_animation();
+        return;
+    }
+    present_animation();
+    animation_deadline = esp_timer_get_time() + (int64_t)delay_ms * 1000;
+    schedule_animation_frame();
+}
+
+// Show the frame that is due. Frames whose successor is due as well are
+// composed but not drawn, so a slow panel or a busy task drops frames rather
+// than slowing the animation down.
+static void play_animation_frame(void) {
+    int64_t now = esp_timer_get_time();
+    if (now - animation_deadline > ANIMATION_MAX_LAG_US) animation_deadline = now;
+
+    int64_t  due = animation_deadline;
+    uint32_t delay_ms;
+    while (true) {
+        if (!animation_step(animation, &delay_ms)) {
+            // Ended, or broken: the last frame stays
+            present_animation();
+            render_frame();
+            stop_animation();
+            return;
+        }
+        due = animation_deadline;
+        animation_deadline += (int64_t)delay_ms * 1000;
+        if (animation_deadline > now) break;
+        perf_count(PERF_FRAMES_DROPPED);
+    }
+    present_animation();
+    render_frame();
+    perf_end(PERF_FRAME_LATE, due);
+    perf_count(PERF_FRAMES_SHOWN);
+    schedule_animation_frame();
+}
+
+// Wait up to timeout for an input event, playing animation frames that come
+// due meanwhile. The power is released while waiting. Returns false on
+// timeout, after playing a frame or when woken by wake_main_loop.
+static bool wait_for_input(bsp_input_event_t* event, TickType_t timeout) {
+    power_release();
+    if (main_events == NULL) {
+        // Nothing but input wakes the main loop: poll for the rest
+        TickType_t poll = pdMS_TO_TICKS(startup_scanning ? STARTUP_POLL_MS : IDLE_POLL_MS);
+        bool       got  = xQueueReceive(input_event_queue, event, timeout < poll ? timeout : poll) == pdTRUE;
+        power_hold();
+        return got;
     }
 
-    pax_png_info_t info;
-    if (!pax_info_png_fd(&info, fd)) {
-        ESP_LOGE(TAG, "Failed to read PNG info for %s", png_files[index]);
-        fclose(fd);
+    // Events drained along with an earlier one leave their entries in the set
+    QueueSetMemberHandle_t ready;
+    do {
+        ready = xQueueSelectFromSet(main_events, timeout);
+    } while (ready == input_event_queue && xQueueReceive(input_event_queue, event, 0) != pdTRUE);
+    power_hold();
+    if (ready == frame_due) {
+        if (xSemaphoreTake(frame_due, 0) == pdTRUE && animation != NULL) play_animation_frame();
         return false;
     }
-    if (info.width != IMAGE_WIDTH || info.height != IMAGE_HEIGHT) {
-        ESP_LOGW(TAG, "Skipping %s: expected %dx%d, got %" PRIu32 "x%" PRIu32,
-                 png_files[index], IMAGE_WIDTH, IMAGE_HEIGHT, info.width, info.height);
-        fclose(fd);
+    if (ready == main_wake) xSemaphoreTake(main_wake, 0);
+    return ready == input_event_queue;
+}
+
+// Set up the frame timer and the queue set the main loop waits on. Without
+// them images are shown still and the main loop polls.
+static void init_main_events(void) {
+    const esp_timer_create_args_t timer_args = {
+        .callback        = frame_timer_callback,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name            = "frame",
+    };
+    UBaseType_t input_length = uxQueueSpacesAvailable(input_event_queue) + uxQueueMessagesWaiting(input_event_queue);
+    frame_due                = xSemaphoreCreateBinary();
+    main_wake                = xSemaphoreCreateBinary();
+    main_events              = frame_due != NULL && main_wake != NULL ? xQueueCreateSet(input_length + 2) : NULL;
+    if (main_events == NULL || xQueueAddToSet(frame_due, main_events) != pdPASS ||
+        xQueueAddToSet(main_wake, main_events) != pdPASS || esp_timer_create(&timer_args, &frame_timer) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to set up the frame timer, animations will not play");
+        frame_timer = NULL;
+        main_wake   = NULL;
+        main_events = NULL;
+        return;
+    }
+    // Only an empty queue can join a set: keys pressed while booting are dropped
+    bsp_input_event_t event;
+    while (xQueueAddToSet(input_event_queue, main_events) != pdPASS) {
+        xQueueReceive(input_event_queue, &event, 0);
+    }
+}
+
+// The startup frame is only needed until the first image from the cache is shown
+static void release_startup_frame(void) {
+    if (!startup_frame_used || current_image == &startup_frame) return;
+    pax_buf_destroy(&startup_frame);
+    startup_frame_used = false;
+}
+
+// Whether to play a transition away from the image shown. Not when keys are
+// waiting: someone holding an arrow key wants to get somewhere, not watch.
+static bool want_transition(void) {
+    if (transition_mode == TRANSITION_CUT || current_image == NULL || uxQueueMessagesWaiting(input_event_queue) > 0) {
         return false;
     }
+    if (!transition_frame_allocated) {
+        if (!pax_buf_init(&transition_frame, NULL, image_width, image_height, IMAGE_BUF_TYPE)) {
+            ESP_LOGW(TAG, "Failed to allocate a frame for transitions, cutting instead");
+            return false;
+        }
+        transition_frame_allocated = true;
+    }
+    return true;
+}
 
-    rewind(fd);
-    pax_buf_t new_image;
-    bool      decoded = pax_decode_png_fd(&new_image, fd, PAX_BUF_24_888RGB, CODEC_FLAG_STRICT);
-    fclose(fd);
+// Transition from the image on the panel to `to`, which becomes current_image.
+// Each step is rendered into the transition frame and only the rows it
+// changed are redrawn. A key press ends it early, on the new image.
+static void play_transition(const pax_buf_t* to, int direction) {
+    const uint8_t* from     = pax_buf_get_pixels(current_image);
+    uint8_t*       dst      = pax_buf_get_pixels_rw(&transition_frame);
+    int64_t        start    = esp_timer_get_time();
+    uint32_t       previous = 0;
+    current_image           = &transition_frame;
+    while (uxQueueMessagesWaiting(input_event_queue) == 0) {
+        int64_t  frame_start = perf_begin();
+        int64_t  elapsed     = frame_start - start;
+        uint32_t progress    = TRANSITION_END;
+        if (elapsed < TRANSITION_MS * 1000) progress = (uint32_t)(elapsed * TRANSITION_END / (TRANSITION_MS * 1000));
+        uint32_t top, bottom;
+        if (transition_render(transition_mode, direction, dst, from, pax_buf_get_pixels(to), image_width, image_height,
+                              previous, progress, &top, &bottom)) {
+            previous = progress;
+            mark_image_damage(top, bottom);
+            render_frame();
+            perf_end(PERF_TRANSITION, frame_start);
+            perf_count(PERF_TRANSITION_FRAMES);
+        }
+        if (progress == TRANSITION_END) break;
+        // Give the rest of the frame to the decoder instead of spinning
+        int64_t rest_us = TRANSITION_FRAME_US - (esp_timer_get_time() - frame_start);
+        if (rest_us > 0) vTaskDelay(pdMS_TO_TICKS(rest_us / 1000) > 0 ? pdMS_TO_TICKS(rest_us / 1000) : 1);
+    }
+    // The panel shows `to` unless the transition was cut short
+    if (previous != TRANSITION_END) mark_all_damaged();
+    current_image = to;
+}
 
-    if (!decoded) {
-        ESP_LOGE(TAG, "Failed to decode %s", png_files[index]);
+// Display the image at the given index, with a transition that moves in
+// direction, 1 for onwards or -1 for back. The image cache hands out a
+// prefetched frame when it has one and decodes into a recycled frame
+// otherwise. Returns false (and leaves the previously displayed image, if
+// any, untouched) on any failure.
+static bool load_image(int index, int direction) {
+    if (!sd_card_available) {
+        ESP_LOGE(TAG, "SD card not available");
         return false;
     }
-    if (pax_buf_get_type(&new_image) != PAX_BUF_24_888RGB) {
-        ESP_LOGE(TAG, "Decoded %s in unexpected pixel format, skipping", png_files[index]);
-        pax_buf_destroy(&new_image);
+    if (image_count == 0) {
+        ESP_LOGE(TAG, "No images available");
         return false;
     }
+    if (index < 0 || index >= image_count) {
+        ESP_LOGE(TAG, "Invalid image index: %d (total: %d)", index, image_count);
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Loading image %d: %s", index, catalog_name(listing, index));
 
-    if (image_flipped) {
-        flip_image_pixels_180(&new_image);
+    int64_t start      = perf_begin();
+    bool    transition = want_transition();
+    // The frame on the panel is what the transition starts from
+    if (transition) image_cache_hold_shown();
+    const pax_buf_t* image = image_cache_take(index);
+    if (image == NULL) {
+        if (transition) image_cache_release_held();
+        return false;
     }
 
-    free_current_image();
-    current_image      = new_image;
-    has_current_image  = true;
+    perf_end(PERF_LOAD, start);
+    stop_animation();
+    if (transition && image != current_image) {
+        play_transition(image, direction);
+    } else {
+        current_image = image;
+        mark_all_damaged();
+    }
+    if (transition) image_cache_release_held();
     current_image_index = index;
+    if (playlist != NULL && playlist_at(playlist, 0) != index) playlist_seek(playlist, index);
+    release_startup_frame();
+    start_animation(index);
 
     // Any image change (manual or automatic) restarts the slideshow countdown
     slideshow_last_tick = xTaskGetTickCount();
+    image_shown_tick    = slideshow_last_tick;
+    last_image_due      = true;
+    perf_count(PERF_IMAGES_SHOWN);
+    if (slideshow_unattended()) {
+        slideshow_prefetch_due = true;
+    } else {
+        prefetch_neighbours();
+    }
 
-    ESP_LOGI(TAG, "Image loaded successfully: %s", png_files[index]);
+    ESP_LOGI(TAG, "Image loaded successfully: %s (%" PRId64 " ms)", catalog_name(listing, index),
+             (esp_timer_get_time() - start) / 1000);
     return true;
 }
 
 static void next_image(void) {
-    if (png_count == 0) return;
-    int next_index = (current_image_index + 1) % png_count;
-    load_image(next_index);
-    ESP_LOGI(TAG, "Switched to next image: %d/%d", next_index + 1, png_count);
+    if (image_count == 0) return;
+    int next_index = shuffling() ? shuffle_step(1) : step_image(current_image_index, 1);
+    if (next_index < 0) return;
+    if (!shuffling()) on_playlist = false;
+    load_image(next_index, 1);
+    ESP_LOGI(TAG, "Switched to next image: %d/%d", next_index + 1, image_count);
+}
+
+static void queue_move(int index, int direction) {
+    if (index < 0) return;
+    pending_move_index     = index;
+    pending_move_direction = direction;
+    pending_move_keys++;
+}
+
+// Step in direction from where the keys so far lead: along the playlist while
+// shuffling or going back from where R led, in the album's order otherwise.
+// The playlist is stepped right away, so it already is where they lead.
+static void move_image(int direction) {
+    if (image_count == 0) return;
+    if (shuffling() || (on_playlist && direction < 0)) {
+        queue_move(shuffle_step(direction), direction);
+    } else {
+        on_playlist = false;
+        queue_move(step_image(pending_move_index >= 0 ? pending_move_index : current_image_index, direction),
+                   direction);
+    }
+}
+
+// Move on to the playlist's next image from where the keys so far lead,
+// which was prefetched for R. Left then goes back the way R came.
+static void move_random(void) {
+    if (image_count == 0 || playlist == NULL) return;
+    int from = pending_move_index >= 0 ? pending_move_index : current_image_index;
+    if (from >= 0 && playlist_at(playlist, 0) != from) playlist_seek(playlist, from);
+    on_playlist = true;
+    queue_move(shuffle_step(1), 1);
+}
+
+// Switch between the album's order and the shuffled one. Switching the
+// shuffle on moves on to its next image right away.
+static void toggle_shuffle(void) {
+    shuffle        = !shuffle;
+    last_image_due = true;
+    mark_menu_damaged();
+    ESP_LOGI(TAG, "Shuffle %s", shuffle ? "on" : "off");
+    if (!shuffling()) {
+        prefetch_neighbours();
+        return;
+    }
+    if (pending_move_index >= 0) playlist_seek(playlist, pending_move_index);
+    queue_move(shuffle_step(1), 1);
+}
+
+// Show the image the queued moves lead to, skipping every one on the way
+static void apply_moves(void) {
+    int index = pending_move_index;
+    int keys  = pending_move_keys;
+    pending_move_index = -1;
+    pending_move_keys  = 0;
+    if (index < 0 || index == current_image_index || !load_image(index, pending_move_direction)) return;
+    ESP_LOGI(TAG, "Switched to image %d/%d after %d key%s", index + 1, image_count, keys, keys == 1 ? "" : "s");
+}
+
+// The first usable image of an album listing, or -1 if it has none
+static int first_usable_index(const catalog_t* album) {
+    for (int i = 0; i < catalog_count(album); i++) {
+        if (!catalog_entry(album, i)->bad) return i;
+    }
+    return -1;
+}
+
+// Enter the first album from album on, in the given direction, that has a
+// usable image and show that image. Albums are listed as they are reached, so
+// the album list can grow while searching. Returns false, staying in the
+// current album, if no other album has an image.
+static bool open_album(int album, int direction) {
+    for (int tries = 0; tries < album_count(); tries++) {
+        if (album == album_current()) break;
+        catalog_t* candidate = album_list(album);
+        int        first     = candidate ? first_usable_index(candidate) : -1;
+        if (first >= 0) {
+            // The decoder must be done with the old listing before it can be evicted
+            image_cache_invalidate();
+            listing            = album_enter(album);
+            image_count        = catalog_count(listing);
+            pending_move_index = -1;  // moves within the old album lead nowhere now
+            pending_move_keys  = 0;
+            start_playlist(new_shuffle_seed(), 0);
+            load_image(first, direction);
+            queue_wag_build(listing);
+            ESP_LOGI(TAG, "Switched to album %d/%d: %s", album + 1, album_count(), album_dir(album));
+            return true;
+        }
+        album = (album + direction + album_count()) % album_count();
+    }
+    return false;
+}
+
+static void next_album(void) {
+    if (startup_scanning || album_count() <= 1) return;
+    open_album((album_current() + 1) % album_count(), 1);
+}
+
+static void previous_album(void) {
+    if (startup_scanning || album_count() <= 1) return;
+    open_album((album_current() - 1 + album_count()) % album_count(), -1);
+}
+
+// Remember the image being shown and the shuffle, so the next start can show
+// it right away and go on in the same order. Only what changed is written.
+static void save_last_image(void) {
+    char path[MAX_PATH_LENGTH];
+    if (image_count == 0 || !catalog_path(listing, current_image_index, path, sizeof(path))) return;
+    uint32_t seed            = playlist != NULL ? playlist_seed(playlist) : saved_shuffle_seed;
+    uint32_t round           = playlist != NULL ? playlist_round(playlist) : saved_shuffle_round;
+    bool     path_changed    = strcmp(path, last_image_path) != 0;
+    bool     shuffle_changed = shuffle != saved_shuffle || seed != saved_shuffle_seed || round != saved_shuffle_round;
+    if (!path_changed && !shuffle_changed) return;
+
+    nvs_handle_t handle;
+    esp_err_t    res = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (res == ESP_OK) {
+        if (path_changed) res = nvs_set_str(handle, NVS_KEY_LAST_IMAGE, path);
+        if (res == ESP_OK && shuffle_changed) res = nvs_set_u8(handle, NVS_KEY_SHUFFLE, shuffle);
+        if (res == ESP_OK && shuffle_changed) res = nvs_set_u32(handle, NVS_KEY_SEED, seed);
+        if (res == ESP_OK && shuffle_changed) res = nvs_set_u32(handle, NVS_KEY_ROUND, round);
+        if (res == ESP_OK) res = nvs_commit(handle);
+        nvs_close(handle);
+    }
+    if (res != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to remember the last image (%s)", esp_err_to_name(res));
+        return;
+    }
+    strcpy(last_image_path, path);
+    saved_shuffle       = shuffle;
+    saved_shuffle_seed  = seed;
+    saved_shuffle_round = round;
+    ESP_LOGI(TAG, "Remembered %s as the last image, shuffle %s in round %" PRIu32, path, shuffle ? "on" : "off",
+             round);
+}
+
+static void load_last_image_path(void) {
+    nvs_handle_t handle;
+    size_t       length = sizeof(last_image_path);
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return;
+    if (nvs_get_str(handle, NVS_KEY_LAST_IMAGE, last_image_path, &length) != ESP_OK) last_image_path[0] = '\0';
+    uint8_t on = 0;
+    if (nvs_get_u8(handle, NVS_KEY_SHUFFLE, &on) == ESP_OK) saved_shuffle = on != 0;
+    // Without a stored order the last image's album gets a new one
+    if (nvs_get_u32(handle, NVS_KEY_SEED, &saved_shuffle_seed) != ESP_OK) saved_shuffle_seed = new_shuffle_seed();
+    if (nvs_get_u32(handle, NVS_KEY_ROUND, &saved_shuffle_round) != ESP_OK) saved_shuffle_round = 0;
+    nvs_close(handle);
+    shuffle = saved_shuffle;
+    mark_menu_damaged();  // the placeholder's menu bar shows the default
+}
+
+// Decode the image viewed last into the startup frame and show it, before
+// its album has been listed
+static void show_last_image(void) {
+    if (last_image_path[0] == '\0') return;
+    if (!pax_buf_init(&startup_frame, NULL, image_width, image_height, IMAGE_BUF_TYPE)) {
+        ESP_LOGW(TAG, "Failed to allocate the startup frame");
+        return;
+    }
+
+    int64_t start = perf_begin();
+    bool    shown = read_sidecar(last_image_path, &startup_frame);
+    if (!shown) {
+        FILE* fd = image_file_open(last_image_path);
+        if (fd != NULL) {
+            shown = codec_decode_into(fd, codec_for_name(last_image_path), NULL, &startup_frame);
+            image_file_close(fd);
+        }
+    }
+    if (!shown) {
+        ESP_LOGW(TAG, "Last image %s is gone or unreadable", last_image_path);
+        pax_buf_destroy(&startup_frame);
+        return;
+    }
+    startup_frame_used = true;
+    current_image      = &startup_frame;
+    image_shown_tick   = xTaskGetTickCount();
+    mark_all_damaged();
+    ESP_LOGI(TAG, "Showing last image %s (%" PRId64 " ms)", last_image_path, (esp_timer_get_time() - start) / 1000);
+}
+
+// List the album of the last image, or else the top album, off the main task
+static void startup_scan(void) {
+    if (!album_init(IMAGES_DIR, scan_image_files, NULL)) {
+        ESP_LOGE(TAG, "Out of memory for the album list");
+        return;
+    }
+    if (last_image_path[0] != '\0') {
+        char  dir[MAX_PATH_LENGTH];
+        char* slash = strrchr(strcpy(dir, last_image_path), '/');
+        if (slash != NULL) {
+            *slash        = '\0';
+            startup_album = album_discover(dir);
+        }
+    }
+    album_list(startup_album >= 0 ? startup_album : 0);
 }
 
-static void previous_image(void) {
-    if (png_count == 0) return;
-    int prev_index = (current_image_index - 1 + png_count) % png_count;
-    load_image(prev_index);
-    ESP_LOGI(TAG, "Switched to previous image: %d/%d", prev_index + 1, png_count);
+static void startup_scan_task(void* arg) {
+    (void)arg;
+    power_hold();
+    startup_scan();
+    power_release();
+    xSemaphoreGive(startup_scan_done);
+    wake_main_loop();
+    vTaskDelete(NULL);
 }
 
-static void random_image(void) {
-    if (png_count == 0) return;
-    int random_index = rand() % png_count;
-    load_image(random_index);
-    ESP_LOGI(TAG, "Switched to random image: %d/%d", random_index + 1, png_count);
+static void start_startup_scan(void) {
+    startup_scan_done = xSemaphoreCreateBinary();
+    startup_scanning  = true;
+    if (startup_scan_done != NULL &&
+        xTaskCreate(startup_scan_task, "startup_scan", 8192, NULL, tskIDLE_PRIORITY + 1, NULL) == pdPASS) {
+        return;
+    }
+    ESP_LOGW(TAG, "Failed to start the background scan, scanning first");
+    startup_scan();
+    if (startup_scan_done == NULL) startup_scan_done = xSemaphoreCreateBinary();
+    if (startup_scan_done != NULL) xSemaphoreGive(startup_scan_done);
+}
+
+// Take over the album list from the startup task: stay on the last image if
+// it is still there, otherwise open the first album from its album on with a
+// usable image
+static void finish_startup(void) {
+    startup_scanning = false;
+    images_loading   = false;
+
+    catalog_t*  album = startup_album >= 0 ? album_list(startup_album) : NULL;
+    const char* name  = strrchr(last_image_path, '/');
+    int         last  = album != NULL && name != NULL ? catalog_find(album, name + 1) : -1;
+    if (last >= 0 && current_image == &startup_frame && !catalog_entry(album, last)->bad) {
+        listing             = album_enter(startup_album);
+        image_count         = catalog_count(listing);
+        current_image_index = last;
+        start_playlist(saved_shuffle_seed, saved_shuffle_round);
+        if (playlist != NULL) playlist_seek(playlist, last);
+        prefetch_neighbours();
+        queue_wag_build(listing);
+        start_animation(last);
+    } else if (!open_album(startup_album >= 0 ? startup_album : 0, 1)) {
+        // Nothing to show anywhere: stay in the top album
+        listing       = album_enter(0);
+        image_count   = listing ? catalog_count(listing) : 0;
+        current_image = NULL;
+        stop_animation();
+        release_startup_frame();
+        mark_all_damaged();
+        if (image_count > 0) ESP_LOGW(TAG, "None of the images can be shown");
+    }
+    perf_milestone(PERF_LISTING_READY);
+    ESP_LOGI(TAG, "Found %d images, %d albums so far", image_count, album_count());
 }
 
+static void return_to_launcher(void) {
+    save_last_image();
+    bsp_device_restart_to_launcher();
+}
+
+// Flipping is applied while rendering, so toggling it only needs a redraw
 static void flip_image(void) {
     image_flipped = !image_flipped;
-    if (has_current_image) {
-        flip_image_pixels_180(&current_image);
-    }
+    mark_all_damaged();
     ESP_LOGI(TAG, "Image flip is now %s", image_flipped ? "on" : "off");
 }
 
-// Function to handle input events
+// Handle one input event. Image keys only queue a move, see apply_moves.
 static void handle_input_event(bsp_input_event_t* event) {
     ESP_LOGI(TAG, "Input event received: type=%d", event->type);
 
@@ -370,16 +1538,24 @@ static void handle_input_event(bsp_input_event_t* event) {
                 switch (event->args_navigation.key) {
                     case BSP_INPUT_NAVIGATION_KEY_LEFT:
                         ESP_LOGI(TAG, "Left arrow pressed");
-                        previous_image();
+                        move_image(-1);
                         break;
                     case BSP_INPUT_NAVIGATION_KEY_RIGHT:
                         ESP_LOGI(TAG, "Right arrow pressed");
-                        next_image();
+                        move_image(1);
+                        break;
+                    case BSP_INPUT_NAVIGATION_KEY_UP:
+                        ESP_LOGI(TAG, "Up arrow pressed");
+                        previous_album();
+                        break;
+                    case BSP_INPUT_NAVIGATION_KEY_DOWN:
+                        ESP_LOGI(TAG, "Down arrow pressed");
+                        next_album();
                         break;
                     case BSP_INPUT_NAVIGATION_KEY_ESC:
                     case BSP_INPUT_NAVIGATION_KEY_F1:
                         ESP_LOGI(TAG, "Exit key pressed - returning to launcher");
-                        bsp_device_restart_to_launcher();
+                        return_to_launcher();
                         break;
                     default:
                         ESP_LOGI(TAG, "Other navigation key: %d", event->args_navigation.key);
@@ -393,17 +1569,28 @@ static void handle_input_event(bsp_input_event_t* event) {
                      event->args_keyboard.ascii);
             if (event->args_keyboard.ascii == 'r' || event->args_keyboard.ascii == 'R') {
                 ESP_LOGI(TAG, "R key pressed - random image");
-                random_image();
+                move_random();
+            } else if (event->args_keyboard.ascii == 's' || event->args_keyboard.ascii == 'S') {
+                ESP_LOGI(TAG, "S key pressed - toggle shuffle");
+                toggle_shuffle();
             } else if (event->args_keyboard.ascii == 'f' || event->args_keyboard.ascii == 'F') {
                 ESP_LOGI(TAG, "F key pressed - flip image");
                 flip_image();
             } else if (event->args_keyboard.ascii == 't' || event->args_keyboard.ascii == 'T') {
                 slideshow_mode      = (slideshow_mode + 1) % SLIDESHOW_MODE_COUNT;
+                mark_menu_damaged();
                 slideshow_last_tick = xTaskGetTickCount();
                 ESP_LOGI(TAG, "T key pressed - slideshow timer: %s", slideshow_labels[slideshow_mode]);
+            } else if (event->args_keyboard.ascii == 'e' || event->args_keyboard.ascii == 'E') {
+                transition_mode = (transition_mode + 1) % TRANSITION_COUNT;
+                mark_menu_damaged();
+                ESP_LOGI(TAG, "E key pressed - transition: %s", transition_name(transition_mode));
+            } else if (event->args_keyboard.ascii == 'p' || event->args_keyboard.ascii == 'P') {
+                ESP_LOGI(TAG, "P key pressed - toggle performance HUD");
+                toggle_perf_hud();
             } else if (event->args_keyboard.ascii == 'x' || event->args_keyboard.ascii == 'X') {
                 ESP_LOGI(TAG, "X key pressed - returning to launcher");
-                bsp_device_restart_to_launcher();
+                return_to_launcher();
             }
             break;
 
@@ -419,37 +1606,57 @@ static void handle_input_event(bsp_input_event_t* event) {
     }
 }
 
-void app_main(void) {
-    // Start the GPIO interrupt service
-    gpio_install_isr_service(0);
-
-    // Initialize the Non Volatile Storage service
-    esp_err_t res = nvs_flash_init();
-    if (res == ESP_ERR_NVS_NO_FREE_PAGES || res == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        res = nvs_flash_init();
-    }
-    ESP_ERROR_CHECK(res);
+// Handle event and every other event already queued, then show the result of
+// them all: a burst of image keys moves once, to where it ends up
+static void handle_input_events(bsp_input_event_t* event) {
+    int handled = 0;
+    do {
+        handle_input_event(event);
+        handled++;
+    } while (xQueueReceive(input_event_queue, event, 0) == pdTRUE);
+    if (handled > 1) ESP_LOGI(TAG, "Handled %d queued input events at once", handled);
+    apply_moves();
+}
 
-    // Initialize the Board Support Package
-    const bsp_configuration_t bsp_configuration = {
-        .display =
-            {
-                .requested_color_format = BSP_DISPLAY_COLOR_FORMAT_24_888RGB,
-                .num_fbs                = 1,
-            },
-    };
-    ESP_ERROR_CHECK(bsp_device_initialize(&bsp_configuration));
+// Time into the slideshow interval the next image is decoded at
+static uint32_t slideshow_prefetch_ms(void) {
+    return slideshow_intervals_ms[slideshow_mode] - SLIDESHOW_PREFETCH_LEAD_MS;
+}
 
-    // Set log level to maximum verbosity to see all debug messages
-    esp_log_level_set("*", ESP_LOG_VERBOSE);
+// Ticks from now until period_ms after since, 0 if that has passed
+static TickType_t ticks_left(TickType_t now, TickType_t since, uint32_t period_ms) {
+    TickType_t elapsed = now - since;
+    TickType_t period  = pdMS_TO_TICKS(period_ms);
+    return elapsed >= period ? 0 : period - elapsed;
+}
 
-    srand(time(NULL));
+// Ticks until the next timed job of the main loop is due, 0 if one is due
+// now, or portMAX_DELAY if none is pending and only an event can bring work
+static TickType_t ticks_until_due(void) {
+    if (atomic_load(&index_dirty)) return 0;
+    TickType_t now  = xTaskGetTickCount();
+    TickType_t wait = portMAX_DELAY;
+    TickType_t left;
+    if (menu_visible && (left = ticks_left(now, menu_shown_tick, MENU_TIMEOUT_MS)) < wait) wait = left;
+    if (last_image_due && (left = ticks_left(now, image_shown_tick, LAST_IMAGE_SAVE_MS)) < wait) wait = left;
+    if (slideshow_mode > 0 && current_image != NULL &&
+        (left = ticks_left(now, slideshow_last_tick, slideshow_intervals_ms[slideshow_mode])) < wait) {
+        wait = left;
+    }
+    if (slideshow_prefetch_due && slideshow_unattended() &&
+        (left = ticks_left(now, slideshow_last_tick, slideshow_prefetch_ms())) < wait) {
+        wait = left;
+    }
+    if (hud_visible && (left = ticks_left(now, hud_drawn_tick, PERF_HUD_REFRESH_MS)) < wait) wait = left;
+    return wait;
+}
 
+// Mount the SD card, over SDMMC or else SPI. Returns false if neither works.
+static bool mount_sd_card(void) {
     // Mount SD card with proper GPIO configuration for Tanmatsu
     esp_vfs_fat_sdmmc_mount_config_t mount_config = {
         .format_if_mount_failed = false,
-        .max_files              = 5,
+        .max_files              = 6,  // one more for the read-ahead task
         .allocation_unit_size   = 16 * 1024
     };
 
@@ -458,6 +1665,9 @@ void app_main(void) {
     ESP_LOGI(TAG, "Initializing SD card");
 
     sdmmc_host_t host = SDMMC_HOST_DEFAULT();
+#if CONFIG_IMAGEWAG_SD_HIGH_SPEED
+    host.max_freq_khz = SDMMC_FREQ_HIGHSPEED;
+#endif
 
     // Use the same GPIO configuration as Tanmatsu launcher
     sdmmc_slot_config_t slot_config = {
@@ -478,13 +1688,12 @@ void app_main(void) {
     };
 
     esp_err_t sd_ret = esp_vfs_fat_sdmmc_mount(mount_point, &host, &slot_config, &mount_config, &card);
-    sd_card_available = false;
 
     if (sd_ret != ESP_OK) {
         ESP_LOGW(TAG, "SDMMC mount failed (%s), trying SPI mode...", esp_err_to_name(sd_ret));
 
         // Try SPI mode as fallback (like Tanmatsu launcher)
-        sdmmc_host_t spi_host = SDSPI_HOST_DEFAULT();
+        sdmmc_host_t spi_host = SDSPI_HOST_DEFAULT();  // 20 MHz, high speed or not
 
         spi_bus_config_t bus_cfg = {
             .mosi_io_num     = GPIO_NUM_44,
@@ -516,12 +1725,42 @@ void app_main(void) {
                      esp_err_to_name(sd_ret));
         }
         ESP_LOGW(TAG, "Continuing without SD card - will show fallback message");
-        sd_card_available = false;
-    } else {
-        ESP_LOGI(TAG, "SD card mounted successfully");
-        sdmmc_card_print_info(stdout, card);
-        sd_card_available = true;
+        return false;
+    }
+    ESP_LOGI(TAG, "SD card mounted successfully");
+    sdmmc_card_print_info(stdout, card);
+    return true;
+}
+
+void app_main(void) {
+    // Run at full speed only while there is work
+    power_init();
+
+    // Start the GPIO interrupt service
+    gpio_install_isr_service(0);
+
+    // Initialize the Non Volatile Storage service
+    esp_err_t res = nvs_flash_init();
+    if (res == ESP_ERR_NVS_NO_FREE_PAGES || res == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        res = nvs_flash_init();
     }
+    ESP_ERROR_CHECK(res);
+
+    // Initialize the Board Support Package
+    const bsp_configuration_t bsp_configuration = {
+        .display =
+            {
+                .requested_color_format = DISPLAY_COLOR_FORMAT,
+                .num_fbs                = 2,
+            },
+    };
+    ESP_ERROR_CHECK(bsp_device_initialize(&bsp_configuration));
+
+    // Set log level to maximum verbosity to see all debug messages
+    esp_log_level_set("*", ESP_LOG_VERBOSE);
+
+    srand(time(NULL));
 
     // Get display parameters and rotation
     size_t                       h_res  = 0;
@@ -558,10 +1797,14 @@ void app_main(void) {
             break;
     }
 
-    if (format != PAX_BUF_24_888RGB) {
-        ESP_LOGE(TAG, "Display did not provide the requested 24_888RGB format (got %d) - image drawing assumes "
-                       "24-bit RGB and will not work correctly", format);
+    if (format != PAX_BUF_24_888RGB && format != PAX_BUF_16_565RGB) {
+        ESP_LOGE(TAG, "Display provides neither 24_888RGB nor 16_565RGB (got %d) - image drawing assumes "
+                       "one of them and will not work correctly", format);
+    } else if (format != IMAGE_BUF_TYPE) {
+        ESP_LOGW(TAG, "Display format %d differs from the image format, images will be converted while drawing",
+                 format);
     }
+    fb_bytes_per_pixel = format == PAX_BUF_16_565RGB ? 2 : 3;
 
     bsp_display_rotation_t display_rotation = bsp_display_get_default_rotation();
     pax_orientation_t      orientation      = PAX_O_UPRIGHT;
@@ -577,55 +1820,99 @@ void app_main(void) {
     pax_buf_init(&fb, NULL, display_h_res, display_v_res, format);
     pax_buf_reversed(&fb, data_endian == BSP_DISPLAY_ENDIAN_BIG);
     pax_buf_set_orientation(&fb, orientation);
+    fb_orientation = orientation;
+
+    // Images are scaled to the rotated panel, so they fill it whichever way up it is
+    bool sideways = orientation == PAX_O_ROT_CCW || orientation == PAX_O_ROT_CW;
+    image_width   = sideways ? display_v_res : display_h_res;
+    image_height  = sideways ? display_h_res : display_v_res;
+
+    direct_blit_supported = format == IMAGE_BUF_TYPE && orientation == PAX_O_UPRIGHT &&
+                            data_endian != BSP_DISPLAY_ENDIAN_BIG;
+    if (direct_blit_supported && !pax_buf_init(&menu_strip, NULL, display_h_res, FOOTER_BOX_HEIGHT, format)) {
+        ESP_LOGW(TAG, "Failed to allocate menu strip, images will be drawn through the framebuffer");
+        direct_blit_supported = false;
+    }
 
     ESP_ERROR_CHECK(bsp_input_get_queue(&input_event_queue));
+    init_main_events();
 
     ESP_LOGW(TAG, "Hello world!");
 
-    // Scan for PNG files on SD card if available
+    // Show a placeholder and the menu bar before touching the SD card
+    mark_all_damaged();
+    set_menu_visible(true);
+    render_frame();
+
+    // List the images in the background and show the last one viewed meanwhile
+    sd_card_available = mount_sd_card();
     if (sd_card_available) {
-        ESP_LOGI(TAG, "SD card is available, scanning for PNG files...");
-        int found_files = scan_png_files();
-        ESP_LOGI(TAG, "Found %d PNG files", found_files);
+        ESP_LOGI(TAG, "SD card is available, scanning for images in the background...");
+        codec_init();
+        image_file_init();
+        start_wag_builder();
+        if (!image_cache_init(decode_image, read_ahead_image, NULL, image_width, image_height)) {
+            ESP_LOGW(TAG, "Continuing without background prefetch");
+        }
+        load_last_image_path();
+        start_startup_scan();
+        show_last_image();
     } else {
-        ESP_LOGW(TAG, "SD card not available, skipping PNG file scanning");
-    }
-
-    if (png_count > 0) {
-        ESP_LOGI(TAG, "PNG files found, attempting to load first image...");
-        current_image_index = 0;
-        load_image(current_image_index);
-        ESP_LOGI(TAG, "Attempted to load first image: %d/%d", current_image_index + 1, png_count);
+        ESP_LOGW(TAG, "SD card not available, skipping image scanning");
+        images_loading = false;
+        mark_all_damaged();
+        perf_milestone(PERF_LISTING_READY);
     }
-
-    // Show the menu bar on first start
-    menu_visible    = true;
-    menu_shown_tick = xTaskGetTickCount();
     render_frame();
 
     ESP_LOGI(TAG, "Starting main event loop");
-    ESP_LOGI(TAG, "Controls: Left/Right arrows = navigate, R = random image, F = flip image");
+    ESP_LOGI(TAG, "Controls: Left/Right arrows = navigate, Up/Down arrows = album, R = random image, S = shuffle, "
+                  "F = flip image, T = slideshow timer, E = transition, P = performance HUD");
 
-    // Main event loop
+    // Main event loop: sleeps until an event or the next timed job is due
     bsp_input_event_t input_event;
     while (true) {
-        if (xQueueReceive(input_event_queue, &input_event, pdMS_TO_TICKS(100)) == pdTRUE) {
-            menu_visible    = true;
-            menu_shown_tick = xTaskGetTickCount();
-            handle_input_event(&input_event);
+        if (startup_scanning && xSemaphoreTake(startup_scan_done, 0) == pdTRUE) {
+            finish_startup();
+            render_frame();
+        }
+
+        bool got_input = wait_for_input(&input_event, ticks_until_due());
+        perf_count(PERF_WAKEUPS);
+        if (got_input) {
+            // Someone is back at an unattended slideshow: have every neighbour ready
+            if (slideshow_unattended()) prefetch_neighbours();
+            set_menu_visible(true);
+            handle_input_events(&input_event);
             render_frame();
-        } else if (menu_visible &&
-                   (xTaskGetTickCount() - menu_shown_tick) >= pdMS_TO_TICKS(MENU_TIMEOUT_MS)) {
-            menu_visible = false;
+        } else if (menu_visible && ticks_left(xTaskGetTickCount(), menu_shown_tick, MENU_TIMEOUT_MS) == 0) {
+            set_menu_visible(false);
             render_frame();
+        } else if (atomic_exchange(&index_dirty, false)) {
+            save_index(listing);
+        } else if (last_image_due && ticks_left(xTaskGetTickCount(), image_shown_tick, LAST_IMAGE_SAVE_MS) == 0) {
+            last_image_due = false;
+            save_last_image();
+        }
+
+        if (slideshow_prefetch_due && slideshow_unattended() &&
+            ticks_left(xTaskGetTickCount(), slideshow_last_tick, slideshow_prefetch_ms()) == 0) {
+            prefetch_slideshow_next();
         }
 
         // Slideshow timer: advance to the next image when the interval elapses
-        if (slideshow_mode > 0 && has_current_image &&
-            (xTaskGetTickCount() - slideshow_last_tick) >=
-                pdMS_TO_TICKS(slideshow_intervals_ms[slideshow_mode])) {
+        if (slideshow_mode > 0 && current_image != NULL &&
+            ticks_left(xTaskGetTickCount(), slideshow_last_tick, slideshow_intervals_ms[slideshow_mode]) == 0) {
+            // Counted from now even if there is no other image to go to
+            slideshow_last_tick = xTaskGetTickCount();
             next_image();
             render_frame();
         }
+
+        // Keep the performance HUD current
+        if (hud_visible && ticks_left(xTaskGetTickCount(), hud_drawn_tick, PERF_HUD_REFRESH_MS) == 0) {
+            mark_damage(0, PERF_HUD_HEIGHT);
+            render_frame();
+        }
     }
 }
@@ -0,0 +1,191 @@
+#include "perf.h"
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static char const TAG[] = "perf";
+
+#define PERF_RING_SIZE 256
+
+typedef struct {
+    atomic_uint_least32_t sequence;  // 0 while being written, otherwise the write count
+    uint8_t               probe;
+    uint32_t              duration_us;
+    int64_t               start_us;
+} perf_sample_t;
+
+static perf_sample_t         ring[PERF_RING_SIZE];
+static atomic_uint_least32_t ring_next = 0;
+
+// Durations of one probe, sorted for percentiles. Only used from the main task.
+static uint32_t scratch[PERF_RING_SIZE];
+
+static atomic_int_least64_t milestones[PERF_MILESTONE_COUNT];  // 0 if not reached
+
+static atomic_uint_least32_t counters[PERF_COUNTER_COUNT];
+
+static const char* const milestone_names[PERF_MILESTONE_COUNT] = {
+    [PERF_FIRST_PIXEL]   = "first_pixel",
+    [PERF_FIRST_IMAGE]   = "first_image",
+    [PERF_LISTING_READY] = "listing_ready",
+};
+
+static const char* const probe_names[PERF_PROBE_COUNT] = {
+    [PERF_SCAN]       = "scan",
+    [PERF_LOAD]       = "load",
+    [PERF_OPEN]       = "open",
+    [PERF_WAG_READ]   = "wag_read",
+    [PERF_DECODE]     = "decode",
+    [PERF_FLIP]       = "flip",
+    [PERF_RENDER]     = "render",
+    [PERF_DRAW_IMAGE] = "draw",
+    [PERF_DRAW_MENU]  = "menu",
+    [PERF_BLIT]       = "blit",
+    [PERF_FRAME_LATE] = "late",
+    [PERF_TRANSITION] = "transition",
+};
+
+static const char* const counter_names[PERF_COUNTER_COUNT] = {
+    [PERF_FRAMES_SHOWN]      = "frames_shown",
+    [PERF_FRAMES_DROPPED]    = "frames_dropped",
+    [PERF_TRANSITION_FRAMES] = "transition_frames",
+    [PERF_IMAGES_SHOWN]      = "images_shown",
+    [PERF_WAKEUPS]           = "wakeups",
+    [PERF_IMAGES_LOADED]     = "images_loaded",
+};
+
+int64_t perf_begin(void) {
+    return esp_timer_get_time();
+}
+
+void perf_end(perf_probe_t probe, int64_t start) {
+    int64_t        now    = esp_timer_get_time();
+    uint32_t       n      = atomic_fetch_add_explicit(&ring_next, 1, memory_order_relaxed);
+    perf_sample_t* sample = &ring[n % PERF_RING_SIZE];
+
+    atomic_store_explicit(&sample->sequence, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    sample->probe       = probe;
+    sample->duration_us = (uint32_t)(now - start);
+    sample->start_us    = start;
+    atomic_store_explicit(&sample->sequence, n + 1, memory_order_release);
+}
+
+const char* perf_probe_name(perf_probe_t probe) {
+    return probe < PERF_PROBE_COUNT ? probe_names[probe] : "?";
+}
+
+void perf_count(perf_counter_t counter) {
+    atomic_fetch_add_explicit(&counters[counter], 1, memory_order_relaxed);
+}
+
+uint32_t perf_counter(perf_counter_t counter) {
+    return atomic_load_explicit(&counters[counter], memory_order_relaxed);
+}
+
+const char* perf_counter_name(perf_counter_t counter) {
+    return counter < PERF_COUNTER_COUNT ? counter_names[counter] : "?";
+}
+
+void perf_milestone(perf_milestone_t milestone) {
+    int_least64_t unset = 0;
+    int_least64_t now   = esp_timer_get_time();
+    atomic_compare_exchange_strong(&milestones[milestone], &unset, now > 0 ? now : 1);
+}
+
+int64_t perf_milestone_us(perf_milestone_t milestone) {
+    int64_t at = atomic_load(&milestones[milestone]);
+    return at > 0 ? at : -1;
+}
+
+const char* perf_milestone_name(perf_milestone_t milestone) {
+    return milestone < PERF_MILESTONE_COUNT ? milestone_names[milestone] : "?";
+}
+
+// Copy a sample out of the ring. Returns false if it is empty or was being
+// overwritten while it was read.
+static bool read_sample(size_t slot, perf_sample_t* out) {
+    perf_sample_t* sample   = &ring[slot];
+    uint32_t       sequence = atomic_load_explicit(&sample->sequence, memory_order_acquire);
+    if (sequence == 0) return false;
+    out->probe       = sample->probe;
+    out->duration_us = sample->duration_us;
+    out->start_us    = sample->start_us;
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&sample->sequence, memory_order_relaxed) == sequence;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+void perf_get_stats(perf_probe_t probe, perf_stats_t* stats) {
+    size_t   count = 0;
+    uint64_t total = 0;
+    for (size_t i = 0; i < PERF_RING_SIZE; i++) {
+        perf_sample_t sample;
+        if (read_sample(i, &sample) && sample.probe == probe) {
+            scratch[count++] = sample.duration_us;
+            total += sample.duration_us;
+        }
+    }
+
+    *stats = (perf_stats_t){.count = count};
+    if (count == 0) return;
+    qsort(scratch, count, sizeof(scratch[0]), compare_u32);
+    stats->min_us = scratch[0];
+    stats->max_us = scratch[count - 1];
+    stats->avg_us = total / count;
+    stats->p99_us = scratch[(count * 99 + 99) / 100 - 1];
+}
+
+void perf_get_memory(perf_memory_t* memory) {
+    memory->internal_total = heap_caps_get_total_size(MALLOC_CAP_INTERNAL);
+    memory->internal_peak  = memory->internal_total - heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+    memory->psram_total    = heap_caps_get_total_size(MALLOC_CAP_SPIRAM);
+    memory->psram_peak     = memory->psram_total - heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM);
+}
+
+void perf_dump_csv(void) {
+    ESP_LOGI(TAG, "probe,count,min_us,avg_us,p99_us,max_us");
+    for (int p = 0; p < PERF_PROBE_COUNT; p++) {
+        perf_stats_t stats;
+        perf_get_stats(p, &stats);
+        if (stats.count == 0) continue;
+        ESP_LOGI(TAG, "%s,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32, probe_names[p], stats.count,
+                 stats.min_us, stats.avg_us, stats.p99_us, stats.max_us);
+    }
+
+    ESP_LOGI(TAG, "counter,count");
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+        ESP_LOGI(TAG, "%s,%" PRIu32, counter_names[c], perf_counter(c));
+    }
+
+    ESP_LOGI(TAG, "milestone,since_boot_us");
+    for (int m = 0; m < PERF_MILESTONE_COUNT; m++) {
+        ESP_LOGI(TAG, "%s,%" PRId64, milestone_names[m], perf_milestone_us(m));
+    }
+
+    perf_memory_t memory;
+    perf_get_memory(&memory);
+    ESP_LOGI(TAG, "heap,total_bytes,peak_bytes");
+    ESP_LOGI(TAG, "internal,%zu,%zu", memory.internal_total, memory.internal_peak);
+    ESP_LOGI(TAG, "psram,%zu,%zu", memory.psram_total, memory.psram_peak);
+
+    // Oldest sample first
+    ESP_LOGI(TAG, "probe,start_us,duration_us");
+    uint32_t next = atomic_load_explicit(&ring_next, memory_order_relaxed);
+    for (size_t i = 0; i < PERF_RING_SIZE; i++) {
+        perf_sample_t sample;
+        if (read_sample((next + i) % PERF_RING_SIZE, &sample)) {
+            ESP_LOGI(TAG, "%s,%" PRId64 ",%" PRIu32, perf_probe_name(sample.probe), sample.start_us,
+                     sample.duration_us);
+        }
+    }
+}
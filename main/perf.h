@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Lightweight timing probes. Each measurement is one entry in a fixed ring
+// of recent samples, written without locks so the main and decoder tasks can
+// both record. Statistics are computed over whatever the ring holds.
+
+typedef enum {
+    PERF_SCAN,        // scanning the images directory
+    PERF_LOAD,        // load_image, including any wait for the decoder
+    PERF_OPEN,        // opening an image for decoding
+    PERF_WAG_READ,    // reading a .wag sidecar
+    PERF_DECODE,      // decoding an image into a frame
+    PERF_FLIP,        // flipping stored pixels of a flipped sidecar
+    PERF_RENDER,      // render_frame as a whole
+    PERF_DRAW_IMAGE,  // background and image drawn into the framebuffer
+    PERF_DRAW_MENU,   // menu bar composited
+    PERF_BLIT,        // pushing rows to the panel
+    PERF_FRAME_LATE,  // how long after it was due an animation frame reached the panel
+    PERF_TRANSITION,  // one transition frame rendered and pushed to the panel
+    PERF_PROBE_COUNT,
+} perf_probe_t;
+
+// Points in startup, recorded once as the time since boot
+typedef enum {
+    PERF_FIRST_PIXEL,     // first blit to the panel
+    PERF_FIRST_IMAGE,     // first blit with an image on it
+    PERF_LISTING_READY,   // the startup album is listed and navigation works
+    PERF_MILESTONE_COUNT,
+} perf_milestone_t;
+
+// Events counted since boot
+typedef enum {
+    PERF_FRAMES_SHOWN,       // animation frames that reached the panel
+    PERF_FRAMES_DROPPED,     // animation frames skipped because the next one was already due
+    PERF_TRANSITION_FRAMES,  // frames of transitions between images that reached the panel
+    PERF_IMAGES_SHOWN,       // images load_image put on the panel
+    PERF_WAKEUPS,            // times the main loop woke up, for whatever reason
+    PERF_IMAGES_LOADED,      // images loaded into the image cache's frames, from a sidecar or decoded
+    PERF_COUNTER_COUNT,
+} perf_counter_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t avg_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} perf_stats_t;
+
+typedef struct {
+    size_t internal_total;
+    size_t internal_peak;  // most internal RAM ever in use
+    size_t psram_total;
+    size_t psram_peak;
+} perf_memory_t;
+
+// Timestamp to pass to perf_end.
+int64_t perf_begin(void);
+
+// Record the time since start for probe.
+void perf_end(perf_probe_t probe, int64_t start);
+
+const char* perf_probe_name(perf_probe_t probe);
+
+// Count one occurrence of counter.
+void perf_count(perf_counter_t counter);
+
+uint32_t perf_counter(perf_counter_t counter);
+
+const char* perf_counter_name(perf_counter_t counter);
+
+// Record that a milestone was reached now. Later calls for it are ignored.
+void perf_milestone(perf_milestone_t milestone);
+
+// Microseconds since boot at which a milestone was reached, or -1 if not yet.
+int64_t perf_milestone_us(perf_milestone_t milestone);
+
+const char* perf_milestone_name(perf_milestone_t milestone);
+
+// Statistics for probe over the samples currently in the ring.
+void perf_get_stats(perf_probe_t probe, perf_stats_t* stats);
+
+// Heap high-water marks since boot.
+void perf_get_memory(perf_memory_t* memory);
+
+// Log a summary and every sample in the ring as CSV.
+void perf_dump_csv(void);
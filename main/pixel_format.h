@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "image_ops.h"
+#include "pax_gfx.h"
+#include "sdkconfig.h"
+
+// Pixel format of decoded images, cached frames and sidecars, chosen per
+// target with CONFIG_IMAGEWAG_PIXEL_FORMAT_*. The app is built for one format,
+// so the per-pixel loops never branch on it. Decoders produce RGB888 rows,
+// which the scaler converts with image_store_pixel as it writes the frame.
+#if CONFIG_IMAGEWAG_PIXEL_FORMAT_RGB565
+#define IMAGE_BUF_TYPE        PAX_BUF_16_565RGB
+#define IMAGE_BYTES_PER_PIXEL 2
+#define image_blend_argb_over image_blend_argb_over_rgb565
+#define image_flip_180        image_flip_rgb565_180
+#define image_reverse_copy    image_reverse_copy_rgb565
+#define image_crossfade       image_crossfade_rgb565
+#else
+#define IMAGE_BUF_TYPE        PAX_BUF_24_888RGB
+#define IMAGE_BYTES_PER_PIXEL 3
+#define image_blend_argb_over image_blend_argb_over_rgb888
+#define image_flip_180        image_flip_rgb888_180
+#define image_reverse_copy    image_reverse_copy_rgb888
+#define image_crossfade       image_crossfade_rgb888
+#endif
+
+#if CONFIG_IMAGEWAG_PIXEL_FORMAT_RGB565 && CONFIG_IMAGEWAG_RGB565_DITHER
+// 4x4 Bayer matrix, 0-15
+static const uint8_t image_dither[4][4] = {
+    {0, 8, 2, 10},
+    {12, 4, 14, 6},
+    {3, 11, 1, 9},
+    {15, 7, 13, 5},
+};
+#endif
+
+// Store the pixel r, g, b at dst. x and y place it in the image, for the
+// dither pattern.
+static inline void image_store_pixel(uint8_t* dst, uint32_t x, uint32_t y, uint32_t r, uint32_t g, uint32_t b) {
+#if CONFIG_IMAGEWAG_PIXEL_FORMAT_RGB565
+#if CONFIG_IMAGEWAG_RGB565_DITHER
+    // Scale to 31 and 63 levels in 16ths of a level and add the threshold as
+    // the fraction at which to round up, so an area keeps its average colour.
+    // The threshold stays below a whole level, so white and black are exact.
+    uint32_t threshold = image_dither[y & 3][x & 3] * 255u;
+    r                  = (r * 31 * 16 + threshold) / 4080;
+    g                  = (g * 63 * 16 + threshold) / 4080;
+    b                  = (b * 31 * 16 + threshold) / 4080;
+    uint16_t pixel     = (uint16_t)((r << 11) | (g << 5) | b);
+#else
+    (void)x;
+    (void)y;
+    uint16_t pixel = (uint16_t)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+#endif
+    memcpy(dst, &pixel, sizeof(pixel));
+#else
+    (void)x;
+    (void)y;
+    dst[0] = (uint8_t)b;
+    dst[1] = (uint8_t)g;
+    dst[2] = (uint8_t)r;
+#endif
+}
@@ -0,0 +1,156 @@
+#include "playlist.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+struct playlist {
+    uint32_t  count;
+    uint32_t  seed;
+    uint32_t  round;
+    uint32_t  position;  // in the round
+    uint16_t* narrow;    // the round's images, when count fits 16 bits
+    uint32_t* wide;      // otherwise
+};
+
+static uint32_t get(const playlist_t* p, uint32_t i) {
+    return p->narrow != NULL ? p->narrow[i] : p->wide[i];
+}
+
+static void set(playlist_t* p, uint32_t i, uint32_t index) {
+    if (p->narrow != NULL) {
+        p->narrow[i] = (uint16_t)index;
+    } else {
+        p->wide[i] = index;
+    }
+}
+
+// splitmix64, one generator per round
+static uint32_t next_random(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15u);
+    z          = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9u;
+    z          = (z ^ (z >> 27)) * 0x94D049BB133111EBu;
+    return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+// Uniform in [0, bound), without the bias of a plain modulo
+static uint32_t random_below(uint64_t* state, uint32_t bound) {
+    uint64_t product = (uint64_t)next_random(state) * bound;
+    if ((uint32_t)product < bound) {
+        uint32_t threshold = -bound % bound;
+        while ((uint32_t)product < threshold) product = (uint64_t)next_random(state) * bound;
+    }
+    return (uint32_t)(product >> 32);
+}
+
+static uint64_t round_state(const playlist_t* p, uint32_t round) {
+    // Two images can only alternate: every round is the first one again
+    if (p->count <= 2) round = 0;
+    return (uint64_t)p->seed << 32 | round;
+}
+
+// Shuffle 0..count-1 into the array, front to back, so the first draws of a
+// round decide its first images
+static void shuffle(playlist_t* p, uint32_t round) {
+    for (uint32_t i = 0; i < p->count; i++) set(p, i, i);
+    uint64_t state = round_state(p, round);
+    for (uint32_t i = 0; i + 1 < p->count; i++) {
+        uint32_t j     = i + random_below(&state, p->count - i);
+        uint32_t image = get(p, j);
+        set(p, j, get(p, i));
+        set(p, i, image);
+    }
+}
+
+// First image of round as shuffle would place it, from the first two draws,
+// before the fix-up against repeating previous_last
+static uint32_t round_first(const playlist_t* p, uint32_t round, uint32_t previous_last) {
+    uint64_t state = round_state(p, round);
+    uint32_t first = random_below(&state, p->count);
+    if (first != previous_last || p->count < 3) return first;
+    uint32_t second = 1 + random_below(&state, p->count - 1);
+    return second == first ? 0 : second;
+}
+
+// Load round into the array. A round that would start with the image the
+// previous one ends on swaps its first two: the others stay where they are,
+// so the last image of a round does not depend on the round before it.
+static void load_round(playlist_t* p, uint32_t round) {
+    uint32_t previous_last = 0;
+    bool     fix           = round > 0 && p->count >= 3;
+    if (fix) {
+        shuffle(p, round - 1);
+        previous_last = get(p, p->count - 1);
+    }
+    shuffle(p, round);
+    if (fix && get(p, 0) == previous_last) {
+        set(p, 0, get(p, 1));
+        set(p, 1, previous_last);
+    }
+    p->round = round;
+}
+
+playlist_t* playlist_create(uint32_t count, uint32_t seed, uint32_t round) {
+    if (count == 0) return NULL;
+    playlist_t* p = calloc(1, sizeof(*p));
+    if (p == NULL) return NULL;
+    p->count = count;
+    p->seed  = seed;
+    if (count <= UINT16_MAX + 1u) {
+        p->narrow = malloc(count * sizeof(uint16_t));
+    } else {
+        p->wide = malloc(count * sizeof(uint32_t));
+    }
+    if (p->narrow == NULL && p->wide == NULL) {
+        free(p);
+        return NULL;
+    }
+    load_round(p, round);
+    return p;
+}
+
+void playlist_destroy(playlist_t* p) {
+    if (p == NULL) return;
+    free(p->narrow);
+    free(p->wide);
+    free(p);
+}
+
+uint32_t playlist_seed(const playlist_t* p) {
+    return p->seed;
+}
+
+uint32_t playlist_round(const playlist_t* p) {
+    return p->round;
+}
+
+int playlist_at(const playlist_t* p, int offset) {
+    int64_t position = (int64_t)p->position + offset;
+    if (position < 0) return -1;
+    if (position < p->count) return (int)get(p, (uint32_t)position);
+    if (position > p->count) return -1;
+    return (int)round_first(p, p->round + 1, get(p, p->count - 1));
+}
+
+int playlist_step(playlist_t* p, int direction) {
+    if (direction > 0) {
+        if (++p->position == p->count) {
+            load_round(p, p->round + 1);
+            p->position = 0;
+        }
+    } else if (p->position > 0) {
+        p->position--;
+    } else {
+        if (p->round == 0) return -1;
+        load_round(p, p->round - 1);
+        p->position = p->count - 1;
+    }
+    return (int)get(p, p->position);
+}
+
+void playlist_seek(playlist_t* p, uint32_t index) {
+    for (uint32_t i = 0; i < p->count; i++) {
+        if (get(p, i) == index) {
+            p->position = i;
+            return;
+        }
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+// Shuffled order to show count images in, without repeats: every image comes
+// once per round, and no round starts with the image the one before ended
+// on. Each round is a Fisher-Yates shuffle seeded with the playlist's seed
+// and the round's number, so seed, round and image are all it takes to pick
+// the order up again after a restart. Only the round being played is kept,
+// as 16-bit indices when count allows and 32-bit ones otherwise. Stepping is
+// O(1) except when it crosses into another round, which is shuffled anew.
+
+typedef struct playlist playlist_t;
+
+// Start at the beginning of round. Returns NULL if count is 0 or out of memory.
+playlist_t* playlist_create(uint32_t count, uint32_t seed, uint32_t round);
+
+void playlist_destroy(playlist_t* playlist);
+
+uint32_t playlist_seed(const playlist_t* playlist);
+
+uint32_t playlist_round(const playlist_t* playlist);
+
+// The image offset steps from the current one, 0 for the current one. Looks
+// ahead into the next round by one image at most and not back into the
+// previous one: -1 if the image is further away than that.
+int playlist_at(const playlist_t* playlist, int offset);
+
+// Move one image on (direction 1) or back (-1) and return the image there.
+// Returns -1, staying put, when going back from the start of the first round.
+int playlist_step(playlist_t* playlist, int direction);
+
+// Move to image index within the current round. O(count).
+void playlist_seek(playlist_t* playlist, uint32_t index);
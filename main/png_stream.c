@@ -0,0 +1,784 @@
+#include "png_stream.h"
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "inflate.h"
+#include "sdkconfig.h"
+
+static char const TAG[] = "png_stream";
+
+static const uint8_t png_signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+typedef struct {
+    inflate_t  z;  // first: by far the largest member
+    FILE*      fd;
+    png_ihdr_t ihdr;        // the size is the frame's when decoding an APNG frame
+    uint32_t   chunk_left;  // image data bytes left in the current IDAT or fdAT chunk
+    bool       data_done;
+    bool       frame_data;  // data is in fdAT chunks, each starting with a sequence number
+    bool       alpha;       // convert to B, G, R, A instead of B, G, R
+    bool       has_key;     // tRNS colour key of a grey or RGB image
+    uint16_t   key[3];      // grey, or R, G, B, at the image's bit depth
+    uint8_t    palette[256 * 3];
+    uint8_t    palette_alpha[256];
+
+    uint8_t* rows;    // allocation holding prev, cur and out
+    size_t   stride;  // filtered bytes per row, without the filter type byte
+    size_t   bpp;     // bytes per complete pixel for filtering, at least 1
+    uint8_t* prev;    // previous unfiltered row, [0] is the filter type byte
+    uint8_t* cur;
+    size_t   filled;  // bytes of cur received so far, including the filter type
+    uint8_t* out;     // converted row
+    uint32_t y;
+
+    png_row_fn row;
+    void*      row_ctx;
+} png_stream_t;
+
+static inline uint32_t read_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static bool read_chunk_header(FILE* fd, uint32_t* length, char type[4]) {
+    uint8_t header[8];
+    if (fread(header, 1, sizeof(header), fd) != sizeof(header)) return false;
+    *length = read_be32(header);
+    memcpy(type, header + 4, 4);
+    return *length <= 0x7FFFFFFF;
+}
+
+static bool skip_bytes(FILE* fd, uint32_t count) {
+    return fseek(fd, count, SEEK_CUR) == 0;
+}
+
+bool png_read_ihdr(FILE* fd, png_ihdr_t* ihdr) {
+    uint8_t  data[8 + 8 + 13 + 4];
+    uint32_t length;
+    char     type[4];
+    if (fread(data, 1, sizeof(png_signature), fd) != sizeof(png_signature) ||
+        memcmp(data, png_signature, sizeof(png_signature)) != 0) {
+        return false;
+    }
+    if (!read_chunk_header(fd, &length, type) || length != 13 || memcmp(type, "IHDR", 4) != 0) return false;
+    if (fread(data, 1, 13 + 4, fd) != 13 + 4) return false;
+
+    ihdr->width      = read_be32(data);
+    ihdr->height     = read_be32(data + 4);
+    ihdr->bit_depth  = data[8];
+    ihdr->color_type = data[9];
+    ihdr->interlace  = data[12];
+    return ihdr->width > 0 && ihdr->height > 0 && data[10] == 0 && data[11] == 0;
+}
+
+bool png_stream_supported(const png_ihdr_t* ihdr) {
+    if (ihdr->interlace != 0) return false;
+    switch (ihdr->color_type) {
+        case PNG_COLOR_GREY:
+            return ihdr->bit_depth == 1 || ihdr->bit_depth == 2 || ihdr->bit_depth == 4 || ihdr->bit_depth == 8 ||
+                   ihdr->bit_depth == 16;
+        case PNG_COLOR_PALETTE:
+            return ihdr->bit_depth == 1 || ihdr->bit_depth == 2 || ihdr->bit_depth == 4 || ihdr->bit_depth == 8;
+        case PNG_COLOR_RGB:
+        case PNG_COLOR_GREY_ALPHA:
+        case PNG_COLOR_RGBA:
+            return ihdr->bit_depth == 8 || ihdr->bit_depth == 16;
+        default:
+            return false;
+    }
+}
+
+static int channel_count(uint8_t color_type) {
+    switch (color_type) {
+        case PNG_COLOR_RGB:        return 3;
+        case PNG_COLOR_GREY_ALPHA: return 2;
+        case PNG_COLOR_RGBA:       return 4;
+        default:                   return 1;
+    }
+}
+
+// Skip the sequence number at the start of an fdAT chunk of length bytes
+static bool skip_sequence(png_stream_t* s, uint32_t* length) {
+    if (*length < 4 || !skip_bytes(s->fd, 4)) return false;
+    *length -= 4;
+    return true;
+}
+
+// Feeds the inflater with the contents of consecutive IDAT or fdAT chunks
+static size_t read_image_data(void* ctx, uint8_t* buf, size_t size) {
+    png_stream_t* s = ctx;
+    while (s->chunk_left == 0) {
+        if (s->data_done) return 0;
+        uint32_t length;
+        char     type[4];
+        // Skip the CRC of the previous chunk
+        if (!skip_bytes(s->fd, 4) || !read_chunk_header(s->fd, &length, type) ||
+            memcmp(type, s->frame_data ? "fdAT" : "IDAT", 4) != 0 || (s->frame_data && !skip_sequence(s, &length))) {
+            s->data_done = true;
+            return 0;
+        }
+        s->chunk_left = length;
+    }
+
+    size_t n = fread(buf, 1, size < s->chunk_left ? size : s->chunk_left, s->fd);
+    if (n == 0) s->data_done = true;
+    s->chunk_left -= n;
+    return n;
+}
+
+static inline uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+    int p  = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+static bool unfilter(png_stream_t* s) {
+    uint8_t*       r   = s->cur + 1;
+    const uint8_t* p   = s->prev + 1;
+    size_t         bpp = s->bpp;
+    size_t         n   = s->stride;
+
+    switch (s->cur[0]) {
+        case 0:
+            break;
+        case 1:
+            for (size_t i = bpp; i < n; i++) r[i] += r[i - bpp];
+            break;
+        case 2:
+            for (size_t i = 0; i < n; i++) r[i] += p[i];
+            break;
+        case 3:
+            for (size_t i = 0; i < bpp; i++) r[i] += p[i] >> 1;
+            for (size_t i = bpp; i < n; i++) r[i] += (r[i - bpp] + p[i]) >> 1;
+            break;
+        case 4:
+            for (size_t i = 0; i < bpp; i++) r[i] += p[i];
+            for (size_t i = bpp; i < n; i++) r[i] += paeth(r[i - bpp], p[i], p[i - bpp]);
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+// Sample x of a row of 1, 2 or 4 bit samples
+static inline uint8_t packed_sample(const uint8_t* row, uint32_t x, int depth) {
+    int per_byte = 8 / depth;
+    int shift    = 8 - depth * (1 + x % per_byte);
+    return (row[x / per_byte] >> shift) & ((1 << depth) - 1);
+}
+
+// Convert the unfiltered row into B, G, R bytes. Alpha is dropped, the same
+// as when pax-codecs decodes into a 24-bit buffer.
+static void convert_row(png_stream_t* s) {
+    const uint8_t* in    = s->cur + 1;
+    uint8_t*       out   = s->out;
+    uint32_t       width = s->ihdr.width;
+    int            depth = s->ihdr.bit_depth;
+
+    switch (s->ihdr.color_type) {
+        case PNG_COLOR_RGB:
+        case PNG_COLOR_RGBA: {
+            // 16-bit samples are reduced to their high byte
+            size_t step = (s->ihdr.color_type == PNG_COLOR_RGBA ? 4 : 3) * (depth / 8);
+            size_t g    = depth / 8;
+            for (uint32_t x = 0; x < width; x++, in += step, out += 3) {
+                out[0] = in[2 * g];
+                out[1] = in[g];
+                out[2] = in[0];
+            }
+            break;
+        }
+        case PNG_COLOR_GREY:
+        case PNG_COLOR_GREY_ALPHA:
+            if (depth >= 8) {
+                size_t step = channel_count(s->ihdr.color_type) * (depth / 8);
+                for (uint32_t x = 0; x < width; x++, in += step, out += 3) {
+                    out[0] = out[1] = out[2] = in[0];
+                }
+            } else {
+                int scale = 255 / ((1 << depth) - 1);
+                for (uint32_t x = 0; x < width; x++, out += 3) {
+                    out[0] = out[1] = out[2] = packed_sample(in, x, depth) * scale;
+                }
+            }
+            break;
+        case PNG_COLOR_PALETTE:
+            for (uint32_t x = 0; x < width; x++, out += 3) {
+                const uint8_t* entry = s->palette + 3 * (depth == 8 ? in[x] : packed_sample(in, x, depth));
+                out[0]               = entry[2];
+                out[1]               = entry[1];
+                out[2]               = entry[0];
+            }
+            break;
+    }
+}
+
+// Sample x of a row at the image's bit depth, 16-bit samples whole
+static inline uint16_t sample_at(const uint8_t* row, uint32_t x, int depth) {
+    if (depth == 16) return (uint16_t)(row[2 * x] << 8 | row[2 * x + 1]);
+    if (depth == 8) return row[x];
+    return packed_sample(row, x, depth);
+}
+
+// Convert the unfiltered row into B, G, R, A bytes, with transparency from
+// the alpha channel or the tRNS chunk
+static void convert_row_alpha(png_stream_t* s) {
+    const uint8_t* in    = s->cur + 1;
+    uint8_t*       out   = s->out;
+    uint32_t       width = s->ihdr.width;
+    int            depth = s->ihdr.bit_depth;
+    size_t         g     = depth == 16 ? 2 : 1;
+
+    switch (s->ihdr.color_type) {
+        case PNG_COLOR_RGB:
+            for (uint32_t x = 0; x < width; x++, in += 3 * g, out += 4) {
+                out[0] = in[2 * g];
+                out[1] = in[g];
+                out[2] = in[0];
+                out[3] = s->has_key && sample_at(in, 0, depth) == s->key[0] && sample_at(in, 1, depth) == s->key[1] &&
+                                 sample_at(in, 2, depth) == s->key[2]
+                             ? 0
+                             : 255;
+            }
+            break;
+        case PNG_COLOR_RGBA:
+            for (uint32_t x = 0; x < width; x++, in += 4 * g, out += 4) {
+                out[0] = in[2 * g];
+                out[1] = in[g];
+                out[2] = in[0];
+                out[3] = in[3 * g];
+            }
+            break;
+        case PNG_COLOR_GREY_ALPHA:
+            for (uint32_t x = 0; x < width; x++, in += 2 * g, out += 4) {
+                out[0] = out[1] = out[2] = in[0];
+                out[3]                   = in[g];
+            }
+            break;
+        case PNG_COLOR_GREY: {
+            int scale = depth >= 8 ? 1 : 255 / ((1 << depth) - 1);
+            for (uint32_t x = 0; x < width; x++, out += 4) {
+                uint16_t value = sample_at(in, x, depth);
+                out[0] = out[1] = out[2] = depth == 16 ? value >> 8 : value * scale;
+                out[3]                   = s->has_key && value == s->key[0] ? 0 : 255;
+            }
+            break;
+        }
+        case PNG_COLOR_PALETTE:
+            for (uint32_t x = 0; x < width; x++, out += 4) {
+                uint8_t        index = depth == 8 ? in[x] : packed_sample(in, x, depth);
+                const uint8_t* entry = s->palette + 3 * index;
+                out[0]               = entry[2];
+                out[1]               = entry[1];
+                out[2]               = entry[0];
+                out[3]               = s->palette_alpha[index];
+            }
+            break;
+    }
+}
+
+// Unfilter the row in cur against the one in prev, convert it and hand it out
+static bool emit_row(png_stream_t* s) {
+    if (!unfilter(s)) {
+        ESP_LOGE(TAG, "Invalid filter type %u in row %" PRIu32, s->cur[0], s->y);
+        return false;
+    }
+    if (s->alpha) {
+        convert_row_alpha(s);
+    } else {
+        convert_row(s);
+    }
+    if (!s->row(s->row_ctx, s->y, s->out)) return false;
+    s->y++;
+    return true;
+}
+
+// Collects inflated bytes into scanlines and emits each completed row
+static bool write_image_data(void* ctx, const uint8_t* data, size_t len) {
+    png_stream_t* s         = ctx;
+    size_t        row_bytes = s->stride + 1;
+
+    while (len > 0 && s->y < s->ihdr.height) {
+        size_t n = row_bytes - s->filled;
+        if (n > len) n = len;
+        memcpy(s->cur + s->filled, data, n);
+        s->filled += n;
+        data += n;
+        len -= n;
+        if (s->filled < row_bytes) break;
+        if (!emit_row(s)) return false;
+
+        uint8_t* tmp = s->prev;
+        s->prev      = s->cur;
+        s->cur       = tmp;
+        s->filled    = 0;
+    }
+    return true;
+}
+
+// Pipelined decoding: the decoding task inflates filtered rows into a ring of
+// slots, and a worker task on the other core unfilters, converts and hands
+// out the rows of each slot meanwhile. The ring has one producer and one
+// consumer, so publishing a slot is a store to head and consuming one a
+// store to tail; the semaphores only wake a side that found the ring full or
+// empty. There is one worker: a decode that finds it busy, or an image too
+// small to gain from it, decodes serially.
+#define PIPELINE_SLOTS         4
+#define PIPELINE_SLOT_BYTES    16384        // rounded down to whole rows, at least one
+#define PIPELINE_MIN_BYTES     (64 * 1024)  // of filtered image data
+#define PIPELINE_TASK_STACK    4096
+#define PIPELINE_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+
+typedef struct {
+    png_stream_t* s;
+    uint8_t*      data;  // PIPELINE_SLOTS slots of slot_size bytes
+    size_t        slot_size;
+    uint32_t      slot_rows;
+    uint32_t      rows[PIPELINE_SLOTS];  // rows in each published slot, the last one of an image may be short
+    atomic_uint   head;                  // slots published
+    atomic_uint   tail;                  // slots consumed
+    atomic_bool   end;                   // no more slots are published
+    atomic_bool   failed;                // the worker stopped handing out rows
+
+    // Producer side
+    uint8_t* slot;  // being filled, NULL if none
+    uint32_t slot_filled;
+    uint32_t rows_in;
+} pipeline_t;
+
+static pipeline_t        pipeline;
+static SemaphoreHandle_t pipeline_lock  = NULL;  // held for the image the worker is on
+static SemaphoreHandle_t pipeline_start = NULL;  // given to start the worker on an image
+static SemaphoreHandle_t pipeline_ready = NULL;  // given when a slot is published or end is set
+static SemaphoreHandle_t pipeline_space = NULL;  // given when a slot is consumed
+static SemaphoreHandle_t pipeline_done  = NULL;  // given when the worker has finished an image
+static bool              pipelined      = true;
+
+// Wait for a slot to be published. Returns false once the last one has been consumed.
+static bool wait_for_slot(pipeline_t* p) {
+    unsigned tail = atomic_load_explicit(&p->tail, memory_order_relaxed);
+    while (atomic_load_explicit(&p->head, memory_order_acquire) == tail) {
+        // head is final once end is set
+        if (atomic_load_explicit(&p->end, memory_order_acquire)) {
+            return atomic_load_explicit(&p->head, memory_order_acquire) != tail;
+        }
+        xSemaphoreTake(pipeline_ready, portMAX_DELAY);
+    }
+    return true;
+}
+
+// Hand out the rows of the slot at tail. The producer refills the slot once it
+// is consumed, so its last row is kept to unfilter the next slot's first one.
+static bool emit_slot(pipeline_t* p) {
+    png_stream_t* s         = p->s;
+    size_t        row_bytes = s->stride + 1;
+    unsigned      slot      = atomic_load_explicit(&p->tail, memory_order_relaxed) % PIPELINE_SLOTS;
+    uint8_t*      row       = p->data + slot * p->slot_size;
+    for (uint32_t i = 0; i < p->rows[slot]; i++, row += row_bytes) {
+        s->cur = row;
+        if (!emit_row(s)) return false;
+        s->prev = row;
+    }
+    memcpy(s->rows, s->prev, row_bytes);
+    s->prev = s->rows;
+    return true;
+}
+
+static void pipeline_task(void* arg) {
+    (void)arg;
+    pipeline_t* p = &pipeline;
+    while (true) {
+        xSemaphoreTake(pipeline_start, portMAX_DELAY);
+        while (wait_for_slot(p)) {
+            // After a failure slots are still consumed, so the producer never waits for space in vain
+            if (!atomic_load_explicit(&p->failed, memory_order_relaxed) && !emit_slot(p)) {
+                atomic_store_explicit(&p->failed, true, memory_order_release);
+            }
+            atomic_store_explicit(&p->tail, atomic_load_explicit(&p->tail, memory_order_relaxed) + 1,
+                                  memory_order_release);
+            xSemaphoreGive(pipeline_space);
+        }
+        xSemaphoreGive(pipeline_done);
+    }
+}
+
+// Wait for a free slot to fill. Returns false if the worker has failed.
+static bool claim_slot(pipeline_t* p) {
+    unsigned head = atomic_load_explicit(&p->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&p->tail, memory_order_acquire) == PIPELINE_SLOTS) {
+        if (atomic_load_explicit(&p->failed, memory_order_acquire)) return false;
+        xSemaphoreTake(pipeline_space, portMAX_DELAY);
+    }
+    if (atomic_load_explicit(&p->failed, memory_order_acquire)) return false;
+    p->slot        = p->data + (head % PIPELINE_SLOTS) * p->slot_size;
+    p->slot_filled = 0;
+    return true;
+}
+
+static void publish_slot(pipeline_t* p) {
+    unsigned head                  = atomic_load_explicit(&p->head, memory_order_relaxed);
+    p->rows[head % PIPELINE_SLOTS] = p->slot_filled;
+    atomic_store_explicit(&p->head, head + 1, memory_order_release);
+    xSemaphoreGive(pipeline_ready);
+    p->slot = NULL;
+}
+
+// Collects inflated bytes into the slots of the ring and publishes each full one
+static bool write_image_data_pipelined(void* ctx, const uint8_t* data, size_t len) {
+    png_stream_t* s         = ctx;
+    pipeline_t*   p         = &pipeline;
+    size_t        row_bytes = s->stride + 1;
+
+    while (len > 0 && p->rows_in < s->ihdr.height) {
+        if (p->slot == NULL && !claim_slot(p)) return false;
+        size_t n = row_bytes - s->filled;
+        if (n > len) n = len;
+        memcpy(p->slot + p->slot_filled * row_bytes + s->filled, data, n);
+        s->filled += n;
+        data += n;
+        len -= n;
+        if (s->filled < row_bytes) break;
+
+        s->filled = 0;
+        p->rows_in++;
+        if (++p->slot_filled == p->slot_rows || p->rows_in == s->ihdr.height) publish_slot(p);
+    }
+    return true;
+}
+
+// Hand the rows of the image s is about to inflate to the worker. Returns
+// false, leaving them to the caller, if it is busy or not worth it.
+static bool pipeline_begin(png_stream_t* s) {
+    size_t row_bytes = s->stride + 1;
+    if (!pipelined || pipeline_lock == NULL || row_bytes * s->ihdr.height < PIPELINE_MIN_BYTES ||
+        xSemaphoreTake(pipeline_lock, 0) != pdTRUE) {
+        return false;
+    }
+    pipeline_t* p   = &pipeline;
+    size_t      fit = PIPELINE_SLOT_BYTES / row_bytes;
+    p->slot_rows    = fit > 0 ? fit : 1;
+    p->slot_size    = p->slot_rows * row_bytes;
+    p->data         = malloc(p->slot_size * PIPELINE_SLOTS);
+    if (p->data == NULL) {
+        xSemaphoreGive(pipeline_lock);
+        return false;
+    }
+    p->s       = s;
+    p->slot    = NULL;
+    p->rows_in = 0;
+    atomic_store(&p->head, 0);
+    atomic_store(&p->tail, 0);
+    atomic_store(&p->end, false);
+    atomic_store(&p->failed, false);
+    // Left over from the previous image
+    xSemaphoreTake(pipeline_ready, 0);
+    xSemaphoreTake(pipeline_space, 0);
+    xSemaphoreGive(pipeline_start);
+    return true;
+}
+
+// Publish what the producer has left and wait for the worker to finish.
+// Returns false if it failed.
+static bool pipeline_end(void) {
+    pipeline_t* p = &pipeline;
+    if (p->slot != NULL && p->slot_filled > 0) publish_slot(p);
+    atomic_store_explicit(&p->end, true, memory_order_release);
+    xSemaphoreGive(pipeline_ready);
+    xSemaphoreTake(pipeline_done, portMAX_DELAY);
+    bool ok = !atomic_load(&p->failed);
+    free(p->data);
+    p->data = NULL;
+    xSemaphoreGive(pipeline_lock);
+    return ok;
+}
+
+void png_stream_init(void) {
+#if CONFIG_IMAGEWAG_PNG_PIPELINE
+    pipeline_lock  = xSemaphoreCreateMutex();
+    pipeline_start = xSemaphoreCreateBinary();
+    pipeline_ready = xSemaphoreCreateBinary();
+    pipeline_space = xSemaphoreCreateBinary();
+    pipeline_done  = xSemaphoreCreateBinary();
+    if (pipeline_lock == NULL || pipeline_start == NULL || pipeline_ready == NULL || pipeline_space == NULL ||
+        pipeline_done == NULL ||
+        xTaskCreatePinnedToCore(pipeline_task, "png_rows", PIPELINE_TASK_STACK, NULL, PIPELINE_TASK_PRIORITY, NULL,
+                                portNUM_PROCESSORS - 1) != pdPASS) {
+        ESP_LOGW(TAG, "Failed to start the row worker, decoding PNGs on one core");
+        if (pipeline_lock != NULL) vSemaphoreDelete(pipeline_lock);
+        pipeline_lock = NULL;
+    }
+#endif
+}
+
+void png_stream_set_pipelined(bool enable) {
+    pipelined = enable;
+}
+
+static inline uint16_t read_be16(const uint8_t* p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+// Allocate the decoder state and row buffers for rows up to ihdr's width
+static png_stream_t* stream_create(FILE* fd, const png_ihdr_t* ihdr, bool alpha) {
+    png_stream_t* s = malloc(sizeof(png_stream_t));
+    if (s == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate decoder state");
+        return NULL;
+    }
+    // The inflater initialises itself, clearing its 40 KB is wasted time
+    memset(&s->fd, 0, sizeof(*s) - offsetof(png_stream_t, fd));
+    memset(s->palette_alpha, 255, sizeof(s->palette_alpha));
+    s->fd    = fd;
+    s->ihdr  = *ihdr;
+    s->alpha = alpha;
+
+    int    bits   = channel_count(ihdr->color_type) * ihdr->bit_depth;
+    size_t stride = ((size_t)ihdr->width * bits + 7) / 8;
+    s->rows       = calloc(2 * (stride + 1) + (size_t)ihdr->width * (alpha ? 4 : 3), 1);
+    if (s->rows == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate row buffers for width %" PRIu32, ihdr->width);
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static void stream_destroy(png_stream_t* s) {
+    free(s->rows);
+    free(s);
+}
+
+// Read a PLTE or tRNS chunk whose header has been read, or skip any other
+// chunk, including its CRC. Returns false on a read error.
+static bool read_chunk_body(png_stream_t* s, const char type[4], uint32_t length) {
+    if (memcmp(type, "PLTE", 4) == 0 && length <= sizeof(s->palette) && length % 3 == 0) {
+        return fread(s->palette, 1, length, s->fd) == length && skip_bytes(s->fd, 4);
+    }
+    if (memcmp(type, "tRNS", 4) == 0 && length <= sizeof(s->palette_alpha)) {
+        uint8_t data[sizeof(s->palette_alpha)];
+        if (fread(data, 1, length, s->fd) != length || !skip_bytes(s->fd, 4)) return false;
+        if (s->ihdr.color_type == PNG_COLOR_PALETTE) {
+            memcpy(s->palette_alpha, data, length);
+        } else if (s->ihdr.color_type == PNG_COLOR_GREY && length >= 2) {
+            s->key[0]  = read_be16(data);
+            s->has_key = true;
+        } else if (s->ihdr.color_type == PNG_COLOR_RGB && length >= 6) {
+            s->key[0]  = read_be16(data);
+            s->key[1]  = read_be16(data + 2);
+            s->key[2]  = read_be16(data + 4);
+            s->has_key = true;
+        }
+        return true;
+    }
+    return skip_bytes(s->fd, length + 4);
+}
+
+// Inflate a width x height image from the data chunk whose header has just
+// been read, and the ones of the same type following it
+static bool stream_inflate(png_stream_t* s, uint32_t width, uint32_t height, uint32_t length, png_row_fn row,
+                           void* ctx) {
+    int bits = channel_count(s->ihdr.color_type) * s->ihdr.bit_depth;
+
+    s->ihdr.width  = width;
+    s->ihdr.height = height;
+    s->stride      = ((size_t)width * bits + 7) / 8;
+    s->bpp         = bits >= 8 ? bits / 8 : 1;
+    s->prev        = s->rows;
+    s->cur         = s->rows + s->stride + 1;
+    s->out         = s->rows + 2 * (s->stride + 1);
+    s->filled      = 0;
+    s->y           = 0;
+    s->chunk_left  = length;
+    s->data_done   = false;
+    s->row         = row;
+    s->row_ctx     = ctx;
+    memset(s->prev, 0, s->stride + 1);
+    if (!pipeline_begin(s)) return inflate_zlib(&s->z, read_image_data, write_image_data, s) && s->y == height;
+    bool ok = inflate_zlib(&s->z, read_image_data, write_image_data_pipelined, s);
+    return pipeline_end() && ok && s->y == height;
+}
+
+// Decode the image data following an IHDR chunk that has already been read
+static bool decode_after_ihdr(FILE* fd, const png_ihdr_t* ihdr, png_row_fn row, void* ctx) {
+    if (!png_stream_supported(ihdr)) return false;
+    png_stream_t* s = stream_create(fd, ihdr, false);
+    if (s == NULL) return false;
+
+    // Walk the chunks up to the first IDAT, keeping the palette
+    bool ok = false;
+    while (true) {
+        uint32_t length;
+        char     type[4];
+        if (!read_chunk_header(fd, &length, type)) break;
+        if (memcmp(type, "IDAT", 4) == 0) {
+            ok = stream_inflate(s, ihdr->width, ihdr->height, length, row, ctx);
+            break;
+        }
+        if (memcmp(type, "IEND", 4) == 0 || !read_chunk_body(s, type, length)) break;
+    }
+    stream_destroy(s);
+    return ok;
+}
+
+bool png_stream_decode(FILE* fd, png_ihdr_t* ihdr, png_row_fn row, void* ctx) {
+    png_ihdr_t header;
+    if (!png_read_ihdr(fd, &header)) return false;
+    if (ihdr != NULL) *ihdr = header;
+    return decode_after_ihdr(fd, &header, row, ctx);
+}
+
+uint32_t png_frame_count(FILE* fd) {
+    uint32_t length;
+    char     type[4];
+    while (read_chunk_header(fd, &length, type) && memcmp(type, "IDAT", 4) != 0 && memcmp(type, "IEND", 4) != 0) {
+        uint8_t data[8];
+        if (memcmp(type, "acTL", 4) == 0 && length == sizeof(data)) {
+            if (fread(data, 1, sizeof(data), fd) != sizeof(data)) break;
+            uint32_t frames = read_be32(data);
+            return frames > 0 ? frames : 1;
+        }
+        if (!skip_bytes(fd, length + 4)) break;
+    }
+    return 1;
+}
+
+struct png_animation {
+    png_stream_t* s;
+    uint32_t      width;  // canvas size
+    uint32_t      height;
+    uint32_t      frames;
+    uint32_t      plays;
+    long          first_frame;  // offset of the first fcTL chunk
+    long          next_chunk;   // offset of the chunk after the current frame
+    long          frame_data;   // offset of the current frame's first data chunk
+    png_frame_t   frame;
+};
+
+png_animation_t* png_animation_open(FILE* fd, png_ihdr_t* ihdr, uint32_t* frames, uint32_t* plays) {
+    png_ihdr_t header;
+    if (!png_read_ihdr(fd, &header) || !png_stream_supported(&header)) return NULL;
+
+    png_animation_t* a = calloc(1, sizeof(*a));
+    if (a == NULL) return NULL;
+    a->s      = stream_create(fd, &header, true);
+    a->width  = header.width;
+    a->height = header.height;
+    if (a->s == NULL) {
+        free(a);
+        return NULL;
+    }
+
+    // The palette and transparency come before the first frame, which may or
+    // may not be the default image in IDAT
+    a->first_frame = -1;
+    while (a->first_frame < 0) {
+        long     offset = ftell(fd);
+        uint32_t length;
+        char     type[4];
+        uint8_t  data[8];
+        if (!read_chunk_header(fd, &length, type) || memcmp(type, "IEND", 4) == 0) break;
+        if (memcmp(type, "fcTL", 4) == 0) {
+            a->first_frame = offset;
+        } else if (memcmp(type, "acTL", 4) == 0 && length == sizeof(data)) {
+            if (fread(data, 1, sizeof(data), fd) != sizeof(data) || !skip_bytes(fd, 4)) break;
+            a->frames = read_be32(data);
+            a->plays  = read_be32(data + 4);
+        } else if (!read_chunk_body(a->s, type, length)) {
+            break;
+        }
+    }
+    if (a->frames == 0 || a->first_frame < 0) {
+        png_animation_close(a);
+        return NULL;
+    }
+    a->next_chunk = a->first_frame;
+    *ihdr         = header;
+    *frames       = a->frames;
+    *plays        = a->plays;
+    return a;
+}
+
+// Parse an fcTL chunk whose header has been read
+static bool read_frame_control(png_animation_t* a, uint32_t length) {
+    uint8_t data[26];
+    if (length != sizeof(data) || fread(data, 1, sizeof(data), a->s->fd) != sizeof(data) ||
+        !skip_bytes(a->s->fd, 4)) {
+        return false;
+    }
+    png_frame_t* frame = &a->frame;
+    uint16_t     num   = read_be16(data + 20);
+    uint16_t     den   = read_be16(data + 22);
+    frame->width       = read_be32(data + 4);
+    frame->height      = read_be32(data + 8);
+    frame->x           = read_be32(data + 12);
+    frame->y           = read_be32(data + 16);
+    frame->delay_ms    = (uint32_t)num * 1000 / (den != 0 ? den : 100);
+    frame->dispose     = data[24];
+    frame->blend       = data[25];
+    return frame->width > 0 && frame->height > 0 && (uint64_t)frame->x + frame->width <= a->width &&
+           (uint64_t)frame->y + frame->height <= a->height && frame->dispose <= PNG_DISPOSE_PREVIOUS &&
+           frame->blend <= PNG_BLEND_OVER;
+}
+
+bool png_animation_next(png_animation_t* a, png_frame_t* frame) {
+    FILE* fd = a->s->fd;
+    if (fseek(fd, a->next_chunk, SEEK_SET) != 0) return false;
+
+    // A frame is its fcTL and the data chunks after it, up to the next other chunk
+    bool control  = false;
+    a->frame_data = -1;
+    while (true) {
+        long     offset = ftell(fd);
+        uint32_t length;
+        char     type[4];
+        if (!read_chunk_header(fd, &length, type)) return false;
+        bool data = memcmp(type, "IDAT", 4) == 0 || memcmp(type, "fdAT", 4) == 0;
+        if (a->frame_data >= 0 && !data) {
+            a->next_chunk = offset;
+            *frame        = a->frame;
+            return true;
+        }
+        if (memcmp(type, "IEND", 4) == 0) return false;
+        if (memcmp(type, "fcTL", 4) == 0) {
+            if (!read_frame_control(a, length)) {
+                ESP_LOGW(TAG, "Invalid frame control chunk");
+                return false;
+            }
+            control = true;
+            continue;
+        }
+        if (data && control && a->frame_data < 0) a->frame_data = offset;
+        if (!skip_bytes(fd, length + 4)) return false;
+    }
+}
+
+bool png_animation_decode(png_animation_t* a, png_row_fn row, void* ctx) {
+    png_stream_t* s = a->s;
+    uint32_t      length;
+    char          type[4];
+    if (a->frame_data < 0 || fseek(s->fd, a->frame_data, SEEK_SET) != 0 || !read_chunk_header(s->fd, &length, type)) {
+        return false;
+    }
+    s->frame_data = memcmp(type, "fdAT", 4) == 0;
+    if (s->frame_data && !skip_sequence(s, &length)) return false;
+    return stream_inflate(s, a->frame.width, a->frame.height, length, row, ctx);
+}
+
+void png_animation_rewind(png_animation_t* a) {
+    a->next_chunk = a->first_frame;
+}
+
+void png_animation_close(png_animation_t* a) {
+    if (a == NULL) return;
+    if (a->s != NULL) stream_destroy(a->s);
+    free(a);
+}
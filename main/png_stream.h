@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Streaming PNG decoder. Scanlines are inflated, unfiltered and converted one
+// at a time and handed to a callback, so the working set is the inflate
+// window plus two rows no matter how large the image is. Interlaced images
+// are not supported; callers fall back to pax-codecs for those. Large images
+// are decoded on two cores, see png_stream_init.
+//
+// The frames of animated PNGs (APNG) are decoded the same way, one at a time,
+// with their transparency.
+
+#define PNG_COLOR_GREY       0
+#define PNG_COLOR_RGB        2
+#define PNG_COLOR_PALETTE    3
+#define PNG_COLOR_GREY_ALPHA 4
+#define PNG_COLOR_RGBA       6
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint8_t  bit_depth;
+    uint8_t  color_type;
+    uint8_t  interlace;
+} png_ihdr_t;
+
+#define PNG_DISPOSE_NONE       0  // leave the frame on the canvas
+#define PNG_DISPOSE_BACKGROUND 1  // clear its area to transparent black
+#define PNG_DISPOSE_PREVIOUS   2  // restore its area to what was there before it
+
+#define PNG_BLEND_SOURCE 0  // replace the area, transparency included
+#define PNG_BLEND_OVER   1  // alpha-composite over the canvas
+
+// One frame of an animation, placed on a canvas of the image's size. GIF
+// frames are described the same way.
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t x;
+    uint32_t y;
+    uint32_t delay_ms;  // as stored in the file, how long to show the canvas with this frame on it
+    uint8_t  dispose;   // PNG_DISPOSE_*, applied before the next frame
+    uint8_t  blend;     // PNG_BLEND_*
+} png_frame_t;
+
+typedef struct png_animation png_animation_t;
+
+// Receives row y as width pixels in PAX_BUF_24_888RGB memory layout. The row
+// is only valid during the call. Returning false aborts decoding.
+typedef bool (*png_row_fn)(void* ctx, uint32_t y, const uint8_t* row);
+
+// Start the worker that unfilters and converts the rows of large images on
+// the other CPU core while the decoding task inflates the next ones. Without
+// it, or while another decode is using it, images are decoded on one core.
+void png_stream_init(void);
+
+// Whether to use the worker (the default) or decode serially, to compare.
+void png_stream_set_pipelined(bool enable);
+
+// Read and validate the signature and IHDR chunk at the current position.
+bool png_read_ihdr(FILE* fd, png_ihdr_t* ihdr);
+
+// Whether png_stream_decode can handle an image with this header.
+bool png_stream_supported(const png_ihdr_t* ihdr);
+
+// Decode the PNG at the current position of fd, calling row for every
+// scanline from top to bottom. ihdr, if not NULL, receives the header.
+bool png_stream_decode(FILE* fd, png_ihdr_t* ihdr, png_row_fn row, void* ctx);
+
+
+// After png_read_ihdr, look for an acTL chunk ahead of the image data. Returns
+// the number of frames it declares, or 1 if the PNG is not animated.
+uint32_t png_frame_count(FILE* fd);
+
+// Start reading the frames of the animated PNG at the current position of fd.
+// Returns NULL if it is not animated, not supported or out of memory.
+// *plays receives how many times to play it, 0 for forever.
+png_animation_t* png_animation_open(FILE* fd, png_ihdr_t* ihdr, uint32_t* frames, uint32_t* plays);
+
+// Read the control chunk of the next frame. Returns false after the last one.
+bool png_animation_next(png_animation_t* animation, png_frame_t* frame);
+
+// Decode the frame png_animation_next read, calling row for every row of it
+// from top to bottom as frame width pixels of B, G, R, A bytes.
+bool png_animation_decode(png_animation_t* animation, png_row_fn row, void* ctx);
+
+// Go back to before the first frame.
+void png_animation_rewind(png_animation_t* animation);
+
+void png_animation_close(png_animation_t* animation);
@@ -0,0 +1,105 @@
+#include "power.h"
+#include <stdbool.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+#if CONFIG_IMAGEWAG_POWER_SAVE
+#include "driver/gpio.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#endif
+
+#if CONFIG_IMAGEWAG_POWER_SAVE_LIGHT_SLEEP
+#define LIGHT_SLEEP true
+#else
+#define LIGHT_SLEEP false
+#endif
+
+static char const TAG[] = "power";
+
+static SemaphoreHandle_t lock     = NULL;
+static int               holders  = 0;
+static int64_t           since_us = 0;  // start of the current busy or idle stretch
+static int64_t           busy_us  = 0;
+static int64_t           idle_us  = 0;
+#if CONFIG_IMAGEWAG_POWER_SAVE
+static esp_pm_lock_handle_t cpu_lock = NULL;
+#endif
+
+static void configure(void) {
+#if CONFIG_IMAGEWAG_POWER_SAVE
+    const esp_pm_config_t config = {
+        .max_freq_mhz       = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz       = CONFIG_IMAGEWAG_POWER_SAVE_MIN_FREQ_MHZ,
+        .light_sleep_enable = LIGHT_SLEEP,
+    };
+    esp_err_t res = esp_pm_configure(&config);
+    if (res == ESP_OK) res = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "imagewag", &cpu_lock);
+    if (res == ESP_OK) res = esp_pm_lock_acquire(cpu_lock);
+    if (res != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to set up power management (%s), running at full speed", esp_err_to_name(res));
+        if (cpu_lock != NULL) esp_pm_lock_delete(cpu_lock);
+        cpu_lock = NULL;
+        return;
+    }
+#if CONFIG_IMAGEWAG_POWER_SAVE_LIGHT_SLEEP && CONFIG_IMAGEWAG_POWER_SAVE_WAKE_GPIO >= 0
+    // Keys must end a light sleep, not just the next timer
+    gpio_wakeup_enable(CONFIG_IMAGEWAG_POWER_SAVE_WAKE_GPIO, GPIO_INTR_LOW_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+#endif
+    ESP_LOGI(TAG, "Clocking down to %d MHz%s while idle", CONFIG_IMAGEWAG_POWER_SAVE_MIN_FREQ_MHZ,
+             LIGHT_SLEEP ? " and light sleeping" : "");
+#endif
+}
+
+void power_init(void) {
+    lock = xSemaphoreCreateMutex();
+    if (lock == NULL) {
+        ESP_LOGW(TAG, "Failed to create the power lock, the CPU stays at full speed");
+        return;
+    }
+    since_us = esp_timer_get_time();
+    holders  = 1;
+    configure();
+}
+
+void power_hold(void) {
+    if (lock == NULL) return;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (holders++ == 0) {
+        int64_t now = esp_timer_get_time();
+        idle_us  += now - since_us;
+        since_us  = now;
+#if CONFIG_IMAGEWAG_POWER_SAVE
+        if (cpu_lock != NULL) esp_pm_lock_acquire(cpu_lock);
+#endif
+    }
+    xSemaphoreGive(lock);
+}
+
+void power_release(void) {
+    if (lock == NULL) return;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (--holders == 0) {
+        int64_t now = esp_timer_get_time();
+        busy_us  += now - since_us;
+        since_us  = now;
+#if CONFIG_IMAGEWAG_POWER_SAVE
+        if (cpu_lock != NULL) esp_pm_lock_release(cpu_lock);
+#endif
+    }
+    xSemaphoreGive(lock);
+}
+
+void power_get_times(int64_t* busy, int64_t* idle) {
+    *busy = 0;
+    *idle = 0;
+    if (lock == NULL) return;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int64_t current = esp_timer_get_time() - since_us;
+    *busy           = busy_us + (holders > 0 ? current : 0);
+    *idle           = idle_us + (holders > 0 ? 0 : current);
+    xSemaphoreGive(lock);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+// Keeps the CPU at full speed only while the app has work. Tasks hold the
+// power while they compute and release it when they wait; once nobody holds
+// it, the power management of a CONFIG_IMAGEWAG_POWER_SAVE build lowers the
+// clock and, with tickless idle, lets the chip light sleep until the next
+// timer or interrupt. The time with and without holders is accounted either
+// way, as busy and idle time, so builds without power management, like the
+// simulator, show how long the app could sleep. Idle is not time actually
+// spent asleep, which depends on the chip and its other users.
+
+// Configure power management. Until then, and if it fails, the CPU runs at
+// full speed throughout. The calling task holds the power on return.
+void power_init(void);
+
+// Keep the CPU at full speed until the matching power_release. Holds nest.
+void power_hold(void);
+
+void power_release(void);
+
+// Time since power_init with at least one holder (busy) and with none (idle),
+// the current stretch included
+void power_get_times(int64_t* busy_us, int64_t* idle_us);
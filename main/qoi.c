@@ -0,0 +1,126 @@
+#include "qoi.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+
+static char const TAG[] = "qoi";
+
+#define QOI_HEADER_SIZE 14
+#define QOI_MAX_PIXELS  (400u * 1000 * 1000)  // the limit of the reference decoder
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xC0
+#define QOI_OP_RGB   0xFE
+#define QOI_OP_RGBA  0xFF
+#define QOI_MASK_2   0xC0
+
+#define READ_BUFFER_SIZE 4096
+
+typedef struct {
+    FILE*   fd;
+    size_t  pos;
+    size_t  length;
+    bool    eof;
+    uint8_t data[READ_BUFFER_SIZE];
+} qoi_reader_t;
+
+static inline uint32_t read_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Next byte of the file, 0 past its end. A valid file ends with an 8-byte
+// marker, so reaching the end while decoding means it is truncated.
+static inline uint8_t next_byte(qoi_reader_t* r) {
+    if (r->pos == r->length) {
+        r->length = fread(r->data, 1, sizeof(r->data), r->fd);
+        r->pos    = 0;
+        if (r->length == 0) {
+            r->eof = true;
+            return 0;
+        }
+    }
+    return r->data[r->pos++];
+}
+
+// Pixels are kept as 0xAARRGGBB
+static inline uint32_t pack(uint32_t red, uint32_t green, uint32_t blue, uint32_t alpha) {
+    return ((alpha & 0xFF) << 24) | ((red & 0xFF) << 16) | ((green & 0xFF) << 8) | (blue & 0xFF);
+}
+
+static inline uint32_t hash(uint32_t px) {
+    return (((px >> 16) & 0xFF) * 3 + ((px >> 8) & 0xFF) * 5 + (px & 0xFF) * 7 + (px >> 24) * 11) % 64;
+}
+
+bool qoi_read_header(FILE* fd, qoi_header_t* header) {
+    uint8_t data[QOI_HEADER_SIZE];
+    if (fread(data, 1, sizeof(data), fd) != sizeof(data) || memcmp(data, "qoif", 4) != 0) return false;
+    header->width      = read_be32(data + 4);
+    header->height     = read_be32(data + 8);
+    header->channels   = data[12];
+    header->colorspace = data[13];
+    return header->width > 0 && header->height > 0 && header->height < QOI_MAX_PIXELS / header->width &&
+           (header->channels == 3 || header->channels == 4) && header->colorspace <= 1;
+}
+
+bool qoi_decode(FILE* fd, png_row_fn row, void* ctx) {
+    qoi_header_t header;
+    if (!qoi_read_header(fd, &header)) return false;
+
+    qoi_reader_t* r   = malloc(sizeof(qoi_reader_t));
+    uint8_t*      out = malloc((size_t)header.width * 3);
+    if (r == NULL || out == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate buffers for width %" PRIu32, header.width);
+        free(r);
+        free(out);
+        return false;
+    }
+    r->fd     = fd;
+    r->pos    = 0;
+    r->length = 0;
+    r->eof    = false;
+
+    uint32_t index[64] = {0};
+    uint32_t px        = pack(0, 0, 0, 255);
+    uint32_t run       = 0;
+    bool     ok        = true;
+    for (uint32_t y = 0; y < header.height && ok; y++) {
+        uint8_t* o = out;
+        for (uint32_t x = 0; x < header.width; x++, o += 3) {
+            if (run > 0) {
+                run--;
+            } else {
+                uint32_t op    = next_byte(r);
+                uint32_t red   = (px >> 16) & 0xFF;
+                uint32_t green = (px >> 8) & 0xFF;
+                uint32_t blue  = px & 0xFF;
+                if (op == QOI_OP_RGB || op == QOI_OP_RGBA) {
+                    red   = next_byte(r);
+                    green = next_byte(r);
+                    blue  = next_byte(r);
+                    px    = pack(red, green, blue, op == QOI_OP_RGBA ? next_byte(r) : px >> 24);
+                } else if ((op & QOI_MASK_2) == QOI_OP_INDEX) {
+                    px = index[op];
+                } else if ((op & QOI_MASK_2) == QOI_OP_DIFF) {
+                    px = pack(red + ((op >> 4) & 3) - 2, green + ((op >> 2) & 3) - 2, blue + (op & 3) - 2, px >> 24);
+                } else if ((op & QOI_MASK_2) == QOI_OP_LUMA) {
+                    uint32_t next = next_byte(r);
+                    uint32_t dg   = (op & 0x3F) - 32;
+                    px = pack(red + dg - 8 + (next >> 4), green + dg, blue + dg - 8 + (next & 0x0F), px >> 24);
+                } else {
+                    run = op & 0x3F;
+                }
+                index[hash(px)] = px;
+            }
+            o[0] = (uint8_t)px;
+            o[1] = (uint8_t)(px >> 8);
+            o[2] = (uint8_t)(px >> 16);
+        }
+        ok = !r->eof && row(ctx, y, out);
+    }
+    free(out);
+    free(r);
+    return ok;
+}
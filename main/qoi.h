@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "png_stream.h"
+
+// Streaming decoder for QOI, the "Quite OK Image" format: a byte-oriented
+// run/index/delta coding of RGB(A) pixels that decodes several times faster
+// than PNG's inflate at similar sizes. Rows are produced one at a time like
+// png_stream does, so only one row is held. Alpha is dropped.
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint8_t  channels;    // 3 or 4
+    uint8_t  colorspace;  // 0 sRGB with linear alpha, 1 all linear
+} qoi_header_t;
+
+// Read and validate the header at the current position.
+bool qoi_read_header(FILE* fd, qoi_header_t* header);
+
+// Decode the QOI image at the current position of fd, calling row for every
+// row from top to bottom.
+bool qoi_decode(FILE* fd, png_row_fn row, void* ctx);
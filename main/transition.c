@@ -0,0 +1,73 @@
+#include "transition.h"
+#include <string.h>
+#include "pixel_format.h"
+
+static const char* const transition_names[TRANSITION_COUNT] = {
+    [TRANSITION_CUT]   = "Cut",
+    [TRANSITION_FADE]  = "Fade",
+    [TRANSITION_SLIDE] = "Slide",
+    [TRANSITION_WIPE]  = "Wipe",
+};
+
+const char* transition_name(transition_t type) {
+    return type < TRANSITION_COUNT ? transition_names[type] : "?";
+}
+
+// progress scaled to 0-range
+static uint32_t scale_progress(uint32_t progress, uint32_t range) {
+    return (uint32_t)(((uint64_t)progress * range) / TRANSITION_END);
+}
+
+// The new image pushes the old one out sideways
+static void render_slide(int direction, uint8_t* dst, const uint8_t* from, const uint8_t* to, uint32_t width,
+                         uint32_t height, uint32_t offset) {
+    size_t row_bytes = (size_t)width * IMAGE_BYTES_PER_PIXEL;
+    size_t in_bytes  = (size_t)offset * IMAGE_BYTES_PER_PIXEL;  // of the new image
+    size_t out_bytes = row_bytes - in_bytes;
+    for (uint32_t y = 0; y < height; y++, dst += row_bytes, from += row_bytes, to += row_bytes) {
+        if (direction > 0) {
+            // In from the right
+            memcpy(dst, from + in_bytes, out_bytes);
+            memcpy(dst + out_bytes, to, in_bytes);
+        } else {
+            memcpy(dst, to + out_bytes, in_bytes);
+            memcpy(dst + in_bytes, from, out_bytes);
+        }
+    }
+}
+
+bool transition_render(transition_t type, int direction, uint8_t* dst, const uint8_t* from, const uint8_t* to,
+                       uint32_t width, uint32_t height, uint32_t previous, uint32_t progress, uint32_t* top,
+                       uint32_t* bottom) {
+    size_t row_bytes = (size_t)width * IMAGE_BYTES_PER_PIXEL;
+    switch (type) {
+        case TRANSITION_FADE: {
+            uint32_t alpha = scale_progress(progress, 256);
+            if (previous > 0 && alpha == scale_progress(previous, 256)) return false;
+            image_crossfade(dst, from, to, (size_t)width * height, alpha);
+            *top    = 0;
+            *bottom = height;
+            return true;
+        }
+        case TRANSITION_SLIDE: {
+            uint32_t offset = scale_progress(progress, width);
+            if (previous > 0 && offset == scale_progress(previous, width)) return false;
+            render_slide(direction, dst, from, to, width, height, offset);
+            *top    = 0;
+            *bottom = height;
+            return true;
+        }
+        case TRANSITION_WIPE: {
+            // Down over the old image, or up when going back
+            uint32_t edge  = scale_progress(progress, height);
+            uint32_t start = scale_progress(previous, height);
+            if (edge == start) return false;
+            *top    = direction > 0 ? start : height - edge;
+            *bottom = direction > 0 ? edge : height - start;
+            if (previous == 0) memcpy(dst, from, row_bytes * height);
+            memcpy(dst + *top * row_bytes, to + *top * row_bytes, (*bottom - *top) * row_bytes);
+            return true;
+        }
+        default: return false;
+    }
+}
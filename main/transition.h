@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Transitions between two images, rendered into a third frame one step at a
+// time. All three are frames of the app's pixel format and the same size.
+// Every step reports the rows it changed, so the caller pushes only those to
+// the panel: a wipe touches a band of rows per step, while a crossfade or a
+// slide changes them all.
+
+typedef enum {
+    TRANSITION_CUT,  // none, the new image replaces the old one at once
+    TRANSITION_FADE,
+    TRANSITION_SLIDE,
+    TRANSITION_WIPE,
+    TRANSITION_COUNT,
+} transition_t;
+
+// Progress runs from 0, the old image, to TRANSITION_END, the new one
+#define TRANSITION_END 65536
+
+const char* transition_name(transition_t type);
+
+// Render the frame of a transition from `from` to `to` at progress into dst,
+// width x height pixels. direction is 1 when moving on to a next image and
+// -1 when going back, which slides and wipes the other way. dst must hold the
+// frame at `previous`, anything if that is 0, and only what differs from that
+// is written. Returns false if nothing changed, otherwise the changed rows
+// are [*top, *bottom).
+bool transition_render(transition_t type, int direction, uint8_t* dst, const uint8_t* from, const uint8_t* to,
+                       uint32_t width, uint32_t height, uint32_t previous, uint32_t progress, uint32_t* top,
+                       uint32_t* bottom);
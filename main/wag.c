@@ -0,0 +1,128 @@
+#include "wag.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "image_file.h"
+
+static char const TAG[] = "wag";
+
+_Static_assert(sizeof(wag_header_t) == 32, "wag_header_t must stay 32 bytes");
+
+bool wag_path_for(const char* png_path, char* out, size_t out_size) {
+    int len = snprintf(out, out_size, "%s%s", png_path, WAG_SUFFIX);
+    return len > 0 && (size_t)len < out_size;
+}
+
+// Bytes per pixel of a .wag format, 0 if unknown
+static size_t format_bytes(uint8_t format) {
+    switch (format) {
+        case WAG_FORMAT_24_888RGB: return 3;
+        case WAG_FORMAT_16_565RGB: return 2;
+        default:                   return 0;
+    }
+}
+
+static uint8_t format_of(pax_buf_type_t type) {
+    switch (type) {
+        case PAX_BUF_24_888RGB: return WAG_FORMAT_24_888RGB;
+        case PAX_BUF_16_565RGB: return WAG_FORMAT_16_565RGB;
+        default:                return 0;
+    }
+}
+
+// A source_mtime of 0 matches on size alone: FAT timestamps are local time
+// with two second resolution, so files converted on a PC cannot know theirs.
+static bool header_matches(const wag_header_t* header, const struct stat* source) {
+    return memcmp(header->magic, WAG_MAGIC, sizeof(header->magic)) == 0 && header->version == WAG_VERSION &&
+           header->header_size >= sizeof(wag_header_t) && format_bytes(header->format) != 0 &&
+           header->width > 0 && header->height > 0 && header->source_size == (uint32_t)source->st_size &&
+           (header->source_mtime == 0 || header->source_mtime == (int64_t)source->st_mtime);
+}
+
+static bool read_header(FILE* fd, const struct stat* source, wag_header_t* header) {
+    if (fread(header, sizeof(*header), 1, fd) != 1) return false;
+    return header_matches(header, source);
+}
+
+bool wag_is_fresh(const char* wag_path, const struct stat* source, pax_buf_type_t type) {
+    FILE* fd = fopen(wag_path, "rb");
+    if (fd == NULL) return false;
+    wag_header_t header;
+    bool         fresh = read_header(fd, source, &header) && header.format == format_of(type);
+    fclose(fd);
+    return fresh;
+}
+
+bool wag_read(const char* wag_path, const struct stat* source, pax_buf_t* dst, bool* flipped) {
+    FILE* fd = image_file_open(wag_path);
+    if (fd == NULL) return false;
+
+    wag_header_t header;
+    if (!read_header(fd, source, &header)) {
+        image_file_close(fd);
+        return false;
+    }
+    if (header.format != format_of(pax_buf_get_type(dst)) || header.width != pax_buf_get_width(dst) ||
+        header.height != pax_buf_get_height(dst)) {
+        ESP_LOGW(TAG, "Ignoring %s: %ux%u format %u does not match the target buffer", wag_path, header.width,
+                 header.height, header.format);
+        image_file_close(fd);
+        return false;
+    }
+    if (header.header_size != sizeof(header) && fseek(fd, header.header_size, SEEK_SET) != 0) {
+        image_file_close(fd);
+        return false;
+    }
+
+    size_t size = (size_t)header.width * header.height * format_bytes(header.format);
+    bool   ok   = fread(pax_buf_get_pixels_rw(dst), 1, size, fd) == size;
+    image_file_close(fd);
+
+    if (!ok) {
+        ESP_LOGW(TAG, "Truncated cache file %s", wag_path);
+        return false;
+    }
+    *flipped = (header.flags & WAG_FLAG_FLIPPED) != 0;
+    return true;
+}
+
+bool wag_write(const char* wag_path, const struct stat* source, const pax_buf_t* image, bool flipped) {
+    uint8_t format = format_of(pax_buf_get_type(image));
+    if (format == 0) return false;
+
+    char tmp_path[strlen(wag_path) + 2];
+    snprintf(tmp_path, sizeof(tmp_path), "%s~", wag_path);
+
+    wag_header_t header = {
+        .version      = WAG_VERSION,
+        .header_size  = sizeof(wag_header_t),
+        .width        = pax_buf_get_width(image),
+        .height       = pax_buf_get_height(image),
+        .format       = format,
+        .flags        = flipped ? WAG_FLAG_FLIPPED : 0,
+        .source_size  = (uint32_t)source->st_size,
+        .source_mtime = (int64_t)source->st_mtime,
+    };
+    memcpy(header.magic, WAG_MAGIC, sizeof(header.magic));
+
+    FILE* fd = fopen(tmp_path, "wb");
+    if (fd == NULL) {
+        ESP_LOGW(TAG, "Failed to create %s", tmp_path);
+        return false;
+    }
+    size_t size = (size_t)header.width * header.height * format_bytes(format);
+    bool   ok   = fwrite(&header, sizeof(header), 1, fd) == 1 && fwrite(pax_buf_get_pixels(image), 1, size, fd) == size;
+    ok          = (fclose(fd) == 0) && ok;
+
+    // FAT cannot rename over an existing file
+    if (ok) {
+        unlink(wag_path);
+        ok = rename(tmp_path, wag_path) == 0;
+    }
+    if (!ok) {
+        ESP_LOGW(TAG, "Failed to write %s", wag_path);
+        unlink(tmp_path);
+    }
+    return ok;
+}
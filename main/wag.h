@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "pax_gfx.h"
+
+// ".wag" sidecar: a pre-decoded copy of a PNG stored next to it as
+// "<name>.png.wag". A fixed header is followed by the raw rows of a
+// PAX_BUF_24_888RGB or PAX_BUF_16_565RGB buffer exactly as they sit in
+// memory, so loading is a single fread into the pixel buffer instead of an
+// inflate. A sidecar in another format than the target buffer is stale.
+#define WAG_SUFFIX  ".wag"
+#define WAG_MAGIC   "IWAG"
+#define WAG_VERSION 1
+
+// Pixel formats a .wag file can carry
+#define WAG_FORMAT_24_888RGB 1
+#define WAG_FORMAT_16_565RGB 2  // native-endian uint16_t
+
+// Set when the stored pixels are already rotated by 180 degrees
+#define WAG_FLAG_FLIPPED 0x01
+
+typedef struct __attribute__((packed)) {
+    char     magic[4];
+    uint16_t version;
+    uint16_t header_size;  // offset of the first pixel row
+    uint16_t width;
+    uint16_t height;
+    uint8_t  format;
+    uint8_t  flags;
+    uint16_t reserved;
+    uint32_t source_size;   // size of the PNG this was made from
+    int64_t  source_mtime;  // modification time of that PNG, 0 to match on size only
+    uint32_t reserved2;
+} wag_header_t;
+
+// Build the sidecar path for a PNG path. Returns false if it does not fit.
+bool wag_path_for(const char* png_path, char* out, size_t out_size);
+
+// Check whether the sidecar exists, matches the given source PNG and holds
+// pixels for a buffer of the given type.
+bool wag_is_fresh(const char* wag_path, const struct stat* source, pax_buf_type_t type);
+
+// Load a fresh sidecar into an existing buffer of the same format and size.
+// flipped reports whether the stored pixels are rotated by 180 degrees.
+bool wag_read(const char* wag_path, const struct stat* source, pax_buf_t* dst, bool* flipped);
+
+// Write image as the sidecar for source. The file is written under a
+// temporary name first so readers never see a half-written cache.
+bool wag_write(const char* wag_path, const struct stat* source, const pax_buf_t* image, bool flipped);
@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+# Convert PNG files into ImageWag ".wag" sidecars (see main/wag.h) on a PC, so
+# the badge can skip inflating them on first view. Copy the resulting
+# "<name>.png.wag" files next to the PNGs in the images/ folder. FAT keeps
+# local timestamps, so these files are matched to their PNG by size only.
+# Only images of the panel's size are converted; the badge scales other sizes
+# itself and builds their caches in the background. The sidecars are 24-bit;
+# builds using RGB565 frames ignore them and build their own.
+#
+# Usage: tools/png2wag.py image.png [image.png ...]
+
+import os
+import struct
+import sys
+import zlib
+
+WAG_MAGIC = b"IWAG"
+WAG_VERSION = 1
+WAG_FORMAT_24_888RGB = 1
+WAG_HEADER = struct.Struct("<4sHHHHBBHIqI")
+
+PANEL_WIDTH, PANEL_HEIGHT = 800, 480
+
+PNG_SIGNATURE = b"\x89PNG\r\n\x1a\n"
+CHANNELS = {0: 1, 2: 3, 3: 1, 4: 2, 6: 4}
+
+
+def read_chunks(data):
+    pos = len(PNG_SIGNATURE)
+    while pos + 8 <= len(data):
+        length, kind = struct.unpack(">I4s", data[pos:pos + 8])
+        yield kind, data[pos + 8:pos + 8 + length]
+        pos += 12 + length
+
+
+def paeth(a, b, c):
+    p = a + b - c
+    pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+    if pa <= pb and pa <= pc:
+        return a
+    return b if pb <= pc else c
+
+
+def unfilter(raw, height, stride, bpp):
+    rows = []
+    prev = bytearray(stride)
+    pos = 0
+    for _ in range(height):
+        kind = raw[pos]
+        row = bytearray(raw[pos + 1:pos + 1 + stride])
+        pos += 1 + stride
+        for i in range(stride):
+            left = row[i - bpp] if i >= bpp else 0
+            if kind == 1:
+                row[i] = (row[i] + left) & 0xFF
+            elif kind == 2:
+                row[i] = (row[i] + prev[i]) & 0xFF
+            elif kind == 3:
+                row[i] = (row[i] + ((left + prev[i]) >> 1)) & 0xFF
+            elif kind == 4:
+                up_left = prev[i - bpp] if i >= bpp else 0
+                row[i] = (row[i] + paeth(left, prev[i], up_left)) & 0xFF
+            elif kind != 0:
+                raise ValueError("bad filter type %d" % kind)
+        rows.append(row)
+        prev = row
+    return rows
+
+
+def samples(row, width, channels, depth):
+    # Yield 8-bit samples for one unfiltered row
+    if depth == 8:
+        return row
+    if depth == 16:
+        return row[0::2]
+    out = bytearray()
+    mask = (1 << depth) - 1
+    for byte in row:
+        for shift in range(8 - depth, -1, -depth):
+            out.append((byte >> shift) & mask)
+    return out[:width * channels]
+
+
+def decode_png(data):
+    if not data.startswith(PNG_SIGNATURE):
+        raise ValueError("not a PNG file")
+    idat = bytearray()
+    palette = None
+    for kind, body in read_chunks(data):
+        if kind == b"IHDR":
+            width, height, depth, color, _, _, interlace = struct.unpack(">IIBBBBB", body)
+        elif kind == b"PLTE":
+            palette = body
+        elif kind == b"IDAT":
+            idat += body
+        elif kind == b"IEND":
+            break
+    if interlace:
+        raise ValueError("interlaced PNGs are not supported")
+
+    channels = CHANNELS[color]
+    bits = channels * depth
+    stride = (width * bits + 7) // 8
+    rows = unfilter(zlib.decompress(bytes(idat)), height, stride, max(1, bits // 8))
+
+    # Output matches the in-memory layout of PAX_BUF_24_888RGB: B, G, R
+    scale = 255 // ((1 << min(depth, 8)) - 1)
+    out = bytearray()
+    for row in rows:
+        s = samples(row, width, channels, depth)
+        for x in range(width):
+            if color == 3:
+                r, g, b = palette[s[x] * 3:s[x] * 3 + 3]
+            elif color in (0, 4):
+                r = g = b = s[x * channels] * scale
+            else:
+                r, g, b = s[x * channels:x * channels + 3]
+            out += bytes((b, g, r))
+    return width, height, out
+
+
+def convert(png_path):
+    with open(png_path, "rb") as f:
+        data = f.read()
+    width, height, pixels = decode_png(data)
+    if (width, height) != (PANEL_WIDTH, PANEL_HEIGHT):
+        print("%s: %dx%d, skipped (scaled on the badge)" % (png_path, width, height))
+        return
+    st = os.stat(png_path)
+    header = WAG_HEADER.pack(WAG_MAGIC, WAG_VERSION, WAG_HEADER.size, width, height,
+                             WAG_FORMAT_24_888RGB, 0, 0, st.st_size, 0, 0)
+    with open(png_path + ".wag", "wb") as f:
+        f.write(header)
+        f.write(pixels)
+    print("%s: %dx%d -> %s.wag" % (png_path, width, height, png_path))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.exit("usage: %s image.png [image.png ...]" % sys.argv[0])
+    for path in sys.argv[1:]:
+        convert(path)